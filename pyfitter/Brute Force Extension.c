@@ -4,10 +4,24 @@ Built by Brandon Carroll 7/31/19 All Rights Reserved
 C Brute force search extension to the Code
 
 Build Command:
-gcc -Wall -o Brute Brute\ Force\ Extension.c -lm -lgsl -lgslcblas -O3 -funroll-loops
+gcc -Wall -o Brute Brute\ Force\ Extension.c -lm -lgsl -lgslcblas -pthread -O3 -funroll-loops
 
 Ctypes Shared Lib:
-gcc -Wall -o Brute.so -shared -fPIC -O3 -funroll-loops Brute\ Force\ Extension.c -lm -lgsl -lgslcblas
+gcc -Wall -o Brute.so -shared -fPIC -O3 -funroll-loops Brute\ Force\ Extension.c -lm -lgsl -lgslcblas -pthread
+
+Merging sharded searches:
+./Brute merge SaveCount OutputFile Partial_0.bin Partial_1.bin ...
+Combines the partials written by Brute_Force_Fit_Four_Shard into the global top SaveCount, written as text by Save_MultiSave
+./Brute mergecluster Radius SaveCount OutputFile Partial_0.bin Partial_1.bin ...
+Same, but the saves are the best fits of unique solutions within Radius MHz across every shard's Hits_<ShardIndex>.bin, which have to be in the working directory. The clusters go to Clusters.txt
+
+Exporting hit files:
+./Brute export Hits_0.bin Hits.txt [base_cat_dict.txt]
+Writes a binary hit file out as text, with the dictionary the fitted transitions get quantum numbers instead of level indices
+
+Clustering hit files:
+./Brute cluster Radius Clusters.txt Hits_0.bin Hits_1.bin ...
+Merges the fits in one or more hit files into unique solutions within Radius MHz, centred on their best fits, written as text by Save_Solution_Clusters (most fits first)
 */
 
 #include <math.h>
@@ -27,7 +41,39 @@ gcc -Wall -o Brute.so -shared -fPIC -O3 -funroll-loops Brute\ Force\ Extension.c
 //=============Functions========================
 int main (int argc, char *argv[])
 {
-
+int i,SaveCount;
+struct MultiSave *Saves;
+struct Level *Dictionary;
+struct Solution_Clusters Clusters;
+	if ((argc > 4) && (strcmp(argv[1],"merge") == 0)) {
+		SaveCount = atoi(argv[2]);
+		if ((SaveCount < 1) || !Allocate_MultiSave (SaveCount, &Saves)) return 1;
+		if (!Merge_Shard_Partials (argv+4, argc-4, SaveCount, Saves, 0.0, 1)) return 1;
+		if (!Save_MultiSave (argv[3], SaveCount, Saves)) return 1;
+		return 0;
+	}
+	if ((argc > 5) && (strcmp(argv[1],"mergecluster") == 0)) {
+		SaveCount = atoi(argv[3]);
+		if ((SaveCount < 1) || !Allocate_MultiSave (SaveCount, &Saves)) return 1;
+		if (!Merge_Shard_Partials (argv+5, argc-5, SaveCount, Saves, atof(argv[2]), 1)) return 1;
+		if (!Save_MultiSave (argv[4], SaveCount, Saves)) return 1;
+		return 0;
+	}
+	if ((argc > 3) && (strcmp(argv[1],"export") == 0)) {
+		Dictionary = NULL;
+		if ((argc > 4) && !Load_Base_Catalog_Dictionary (argv[4], &Dictionary, 0)) return 1;
+		if (!Export_Hits_Text (argv[2], argv[3], Dictionary)) return 1;
+		return 0;
+	}
+	if ((argc > 4) && (strcmp(argv[1],"cluster") == 0)) {
+		if (!Initialize_Solution_Clusters (&Clusters, atof(argv[2]), 1024)) return 1;
+		for (i=4;i<argc;i++) if (!Cluster_Hit_File (argv[i], &Clusters)) return 1;
+		if (!Recenter_Solution_Clusters (&Clusters)) return 1;
+		Print_Cluster_Stats (&Clusters);
+		if (!Save_Solution_Clusters (argv[3], &Clusters, NULL)) return 1;
+		Free_Solution_Clusters (&Clusters);
+		return 0;
+	}
 	return 1;
 }
 
@@ -4,10 +4,13 @@ Built by Brandon Carroll 7/31/19 All Rights Reserved
 C Brute force search extension to the Code
 
 Build Command:
-gcc -Wall -o Brute Brute\ Force\ Extension.c -lm -lgsl -lgslcblas -O3 -funroll-loops
+gcc -Wall -o Brute Brute\ Force\ Extension.c -lm -lgsl -lgslcblas -pthread -O3 -funroll-loops
 
 Ctypes Shared Lib:
-gcc -Wall -o Brute.so -shared -fPIC -O3 -funroll-loops Brute\ Force\ Extension.c -lm -lgsl -lgslcblas
+gcc -Wall -o Brute.so -shared -fPIC -O3 -funroll-loops Brute\ Force\ Extension.c -lm -lgsl -lgslcblas -pthread
+
+The AVX2/AVX-512 fixed point scoring kernels are always built on x86 with gcc/clang and picked at run time from what the CPU supports, no -march flag needed
+Test_Fixed_Point_Kernels checks each one the CPU can run against the scalar loop
 */
 
 #ifndef __BRUTE_FORCE_H__
@@ -18,6 +21,12 @@ gcc -Wall -o Brute.so -shared -fPIC -O3 -funroll-loops Brute\ Force\ Extension.c
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define FIXED_POINT_X86
+#include <immintrin.h>
+#endif
 #include <gsl/gsl_vector.h>
 #include <gsl/gsl_blas.h>
 #include <gsl/gsl_matrix.h>
@@ -27,13 +36,7 @@ gcc -Wall -o Brute.so -shared -fPIC -O3 -funroll-loops Brute\ Force\ Extension.c
 
 
 //=============Structures==============
-struct MultiSave 
-{
-	double Score;
-	double A;
-	double B;
-	double C;
-};
+//struct MultiSave lives in Fitter.h alongside the top K save functions
 
 struct Axis
 {
@@ -48,7 +51,58 @@ struct Cube
 	struct Axis CAxis;
 };
 
+struct Search_Box
+{
+	//Box of grid points for the branch and bound search, Low/High are inclusive grid indices in A/B/C
+	int Low[3];
+	int High[3];
+	double Bound;
+};
+
+struct Incremental_Score
+{
+	//Per catalog line cursors into the sorted experimental lines, carried from one C step to the next
+	double *Lines;			//Ascending experimental lines, not owned
+	int LineCount;
+	int CatalogTransitions;
+	double Tolerance;
+	int Weighted;			//Also keep the CountWins_Exp score
+	int *Cursor;			//Lowest line that isn't Tolerance or more below each catalog line
+	double *Weight;			//Each catalog line's current contribution, -1 if it has no match
+	double Wins;
+	double WinsExp;
+	double Moves;			//Total cursor steps taken, for gauging how much work the updates do
+};
+
+#define FIXED_POINT_STEPS 8			//Fixed point units per Tolerance in the packed scoring kernels
+#define FIXED_POINT_LANES 16		//Catalog lines compared per step, one AVX-512 register or two AVX2 ones
+#define FIXED_POINT_FAR (1<<29)		//Code given to catalog lines nowhere near the band and to padding
+#define FIXED_KERNEL_SCALAR 0		//Fixed_Lines.Kernel values, see Fixed_Best_Kernel
+#define FIXED_KERNEL_AVX2 1
+#define FIXED_KERNEL_AVX512 2
+
+struct Fixed_Lines
+{
+	//Experimental lines and the current catalog as integer codes counted from the band start, see Initialize_Fixed_Lines
+	int *Codes;				//Ascending experimental line codes
+	int LineCount;
+	double Low;				//Frequency of code 0
+	double Scale;			//Codes per MHz, FIXED_POINT_STEPS/Tolerance
+	int Reach;				//Largest code difference a match within Tolerance can have
+	int *Catalog;			//Catalog codes sorted into coarse buckets, padded out to whole groups of FIXED_POINT_LANES
+	int *Scratch;			//Catalog codes in catalog order
+	int *Buckets;			//Counting sort offsets
+	int BucketCount;
+	int Shift;				//Codes per bucket as a power of 2
+	int *GroupFirst;		//Range of experimental lines each group of catalog lines can reach
+	int *GroupLast;
+	int CatalogTransitions;
+	int Groups;
+	int Kernel;				//FIXED_KERNEL_* used by Count_Fixed_Wins, Initialize_Fixed_Lines picks the best the CPU has
+};
+
 typedef double (*WinCounter)(double * /*ExperimentalFrequencies*/, int /*ExperimentalLines*/, struct Transition * /*SourceCatalog*/, int /*CatalogTransitions*/, double /*Tolerance*/);	//Generic function pointer for the scoring function used in the triples fitter
+typedef double (*BoundedWinCounter)(double * /*ExperimentalFrequencies*/, int /*ExperimentalLines*/, struct Transition * /*SourceCatalog*/, int /*CatalogTransitions*/, double /*Tolerance*/, double /*Threshold*/);	//WinCounter that can stop early once it can't beat Threshold, see CountWins_Bounded
 
 
 //=============Function Prototypes==============
@@ -57,19 +111,72 @@ typedef double (*WinCounter)(double * /*ExperimentalFrequencies*/, int /*Experim
 double Brute_Force (double /*CostantsStart*/, double /*CosntantsStop*/, double /*ConstantsStep*/, double * /*ExperimentalLines*/, int ExperimentalLineCount, struct Transition * /*SearchingCatalog*/, int /*CatalogTransitions*/, double /*Tolerance*/, struct ETauStruct /*ETStruct*/, struct Level * /*SearchingDictionary*/, int /*ScoreMethod*/);
 double Brute_Force_ConstantsArray (double * /*ConstantsArray*/, int /*ConstantsSize*/, double * /*ExperimentalLines*/, int ExperimentalLineCount, struct Transition * /*SearchingCatalog*/, int /*CatalogTransitions*/, double /*Tolerance*/, struct ETauStruct /*ETStruct*/, struct Level * /*SearchingDictionary*/, int /*ScoreMethod*/);
 double Brute_Force_Top_Results (double /*ConstantsStart*/, double /*ConstantsStop*/, double /*ConstantsStep*/, double * /*ExperimentalLines*/, int /*ExperimentalLineCount*/, struct Transition * /*SearchingCatalog*/, int /*CatalogTransitions*/, double /*Tolerance*/, struct ETauStruct /*ETStruct*/, struct Level * /*SearchingDictionary*/, int /*ScoreMethod*/, int /*SaveCount*/, struct MultiSave * /*Saves*/, int /*Verbose*/);
+double Brute_Force_Fused (double /*ConstantsStart*/, double /*ConstantsStop*/, double /*ConstantsStep*/, double * /*ExperimentalLines*/, int /*ExperimentalLineCount*/, struct Transition * /*SearchingCatalog*/, int /*CatalogTransitions*/, double /*Tolerance*/, struct ETauStruct /*ETStruct*/, struct Level * /*SearchingDictionary*/, int /*Weighted*/, int /*SaveCount*/, struct MultiSave * /*Saves*/, int /*Verbose*/);
+double Brute_Force_Multi_Tolerance (double /*ConstantsStart*/, double /*ConstantsStop*/, double /*ConstantsStep*/, double * /*ExperimentalLines*/, int /*ExperimentalLineCount*/, struct Transition * /*SearchingCatalog*/, int /*CatalogTransitions*/, double * /*Tolerances*/, int /*ToleranceCount*/, int /*RankBy*/, int /*Weighted*/, struct ETauStruct /*ETStruct*/, struct Level * /*SearchingDictionary*/, int /*SaveCount*/, struct Profile_Save * /*Saves*/, int /*Verbose*/);
+double Brute_Force_Incremental (double /*ConstantsStart*/, double /*ConstantsStop*/, double /*ConstantsStep*/, double * /*ExperimentalLines*/, int /*ExperimentalLineCount*/, struct Transition * /*SearchingCatalog*/, int /*CatalogTransitions*/, double /*Tolerance*/, struct ETauStruct /*ETStruct*/, struct Level * /*SearchingDictionary*/, int /*Weighted*/, int /*SaveCount*/, struct MultiSave * /*Saves*/, int /*Verbose*/);
+double Brute_Force_Fixed_Point (double /*ConstantsStart*/, double /*ConstantsStop*/, double /*ConstantsStep*/, double * /*ExperimentalLines*/, int /*ExperimentalLineCount*/, struct Transition * /*SearchingCatalog*/, int /*CatalogTransitions*/, double /*Tolerance*/, struct ETauStruct /*ETStruct*/, struct Level * /*SearchingDictionary*/, int /*Weighted*/, int /*SaveCount*/, struct MultiSave * /*Saves*/, int /*Verbose*/);
 double Brute_Force_Pointer_Scoring (double /*ConstantsStart*/, double /*ConstantsStop*/, double /*ConstantsStep*/, double * /*ExperimentalLines*/, int /*ExperimentalLineCount*/, struct Transition * /*SearchingCatalog*/, int /*CatalogTransitions*/, double /*Tolerance*/, struct ETauStruct /*ETStruct*/, struct Level * /*SearchingDictionary*/, WinCounter /*WinFunction*/, int /*SaveCount*/, struct MultiSave * /*Saves*/, int /*Verbose*/);
 double Brute_Force_Cube (struct Cube /*SearchCube*/, double * /*ExperimentalLines*/, int /*ExperimentalLineCount*/, struct Transition * /*SearchingCatalog*/, int /*CatalogTransitions*/, double /*Tolerance*/, struct ETauStruct /*ETStruct*/, struct Level * /*SearchingDictionary*/, WinCounter /*WinFunction*/, int /*SaveCount*/, struct MultiSave * /*Saves*/, char * /*FileName*/, int /*Verbose*/);
 double Brute_Force_Fit_Four (double /*AStart*/, double /*AStop*/, double /*ConstantsStart*/, double /*ConstantsStop*/, double /*ConstantsStep*/, double * /*ExperimentalLines*/, int /*ExperimentalLineCount*/, struct Transition * /*SearchingCatalog*/, int /*CatalogTransitions*/, double /*Tolerance*/, struct ETauStruct /*ETStruct*/, struct Level * /*SearchingDictionary*/, int /*ScoreMethod*/, int /*SaveCount*/, struct MultiSave * /*Saves*/, int /*Verbose*/);
-
+double Brute_Force_Fit_Four_Profile (double /*AStart*/, double /*AStop*/, double /*ConstantsStart*/, double /*ConstantsStop*/, double /*ConstantsStep*/, double * /*ExperimentalLines*/, int /*ExperimentalLineCount*/, struct Transition * /*SearchingCatalog*/, int /*CatalogTransitions*/, double /*Tolerance*/, struct ETauStruct /*ETStruct*/, struct Level * /*SearchingDictionary*/, int /*ScoreMethod*/, int /*SaveCount*/, struct MultiSave * /*Saves*/, int /*Verbose*/);
+double Brute_Force_Fit_Four_Small (double /*AStart*/, double /*AStop*/, double /*ConstantsStart*/, double /*ConstantsStop*/, double /*ConstantsStep*/, double * /*ExperimentalLines*/, int /*ExperimentalLineCount*/, struct Transition * /*SearchingCatalog*/, int /*CatalogTransitions*/, double /*Tolerance*/, struct ETauStruct /*ETStruct*/, struct Level * /*SearchingDictionary*/, int /*ScoreMethod*/, int /*SaveCount*/, struct MultiSave * /*Saves*/, int /*Verbose*/);
+double Brute_Force_Fit_Four_Checkpoint (double /*AStart*/, double /*AStop*/, double /*ConstantsStart*/, double /*ConstantsStop*/, double /*ConstantsStep*/, double * /*ExperimentalLines*/, int /*ExperimentalLineCount*/, struct Transition * /*SearchingCatalog*/, int /*CatalogTransitions*/, double /*Tolerance*/, struct ETauStruct /*ETStruct*/, struct Level * /*SearchingDictionary*/, int /*ScoreMethod*/, int /*SaveCount*/, struct MultiSave * /*Saves*/, int /*Verbose*/, char * /*CheckpointFile*/, double /*CheckpointInterval*/);
+double Brute_Force_Fit_Four_Shard (double /*AStart*/, double /*AStop*/, double /*ConstantsStart*/, double /*ConstantsStop*/, double /*ConstantsStep*/, double * /*ExperimentalLines*/, int /*ExperimentalLineCount*/, struct Transition * /*SearchingCatalog*/, int /*CatalogTransitions*/, double /*Tolerance*/, struct ETauStruct /*ETStruct*/, struct Level * /*SearchingDictionary*/, int /*ScoreMethod*/, int /*SaveCount*/, struct MultiSave * /*Saves*/, int /*Verbose*/, int /*ShardIndex*/, int /*ShardCount*/, char * /*PartialFile*/, char * /*CheckpointFile*/, double /*CheckpointInterval*/, int /*FitMethod*/, double /*ClusterRadius*/);
+double Brute_Force_Fit_Four_Local_Shards (double /*AStart*/, double /*AStop*/, double /*ConstantsStart*/, double /*ConstantsStop*/, double /*ConstantsStep*/, double * /*ExperimentalLines*/, int /*ExperimentalLineCount*/, struct Transition * /*SearchingCatalog*/, int /*CatalogTransitions*/, double /*Tolerance*/, struct ETauStruct /*ETStruct*/, struct Level * /*SearchingDictionary*/, int /*ScoreMethod*/, int /*SaveCount*/, struct MultiSave * /*Saves*/, int /*Verbose*/, int /*ShardCount*/, char * /*PartialPrefix*/, double /*ClusterRadius*/);
+double Fit_Line_Subsets (struct Transition * /*Lines*/, int /*LineCount*/, int /*SubsetSize*/, double /*First*/, double /*Last*/, double * /*Guess*/, struct GSL_Bundle * /*FitBundle*/, int /*FitMethod*/, struct Opt_Bundle /*FitOptBundle*/, struct Fit_Cache * /*Cache*/, double * /*FittingFrequencies*/, double /*MaxChiSqr*/, double /*MaxKappa*/, double /*MinDelta*/, double /*MaxDelta*/, double /*Score*/, int * /*GridIndex*/, int /*SaveCount*/, struct MultiSave * /*Saves*/, struct Hit_Buffer * /*Hits*/, struct Solution_Clusters * /*Clusters*/, double * /*BadFits*/, int /*Verbose*/);
+int Merge_Shard_Partials (char ** /*PartialFiles*/, int /*PartialCount*/, int /*SaveCount*/, struct MultiSave * /*Saves*/, double /*ClusterRadius*/, int /*Verbose*/);
+double Brute_Force_Hierarchical (double /*ConstantsStart*/, double /*ConstantsStop*/, double /*CoarseStep*/, double /*FineStep*/, int /*RefineFactor*/, int /*CellsKept*/, double * /*ExperimentalLines*/, int /*ExperimentalLineCount*/, struct Transition * /*SearchingCatalog*/, int /*CatalogTransitions*/, double /*Tolerance*/, struct ETauStruct /*ETStruct*/, struct Level * /*SearchingDictionary*/, WinCounter /*WinFunction*/, int /*SaveCount*/, struct MultiSave * /*Saves*/, int /*Verbose*/);
+double Brute_Force_Branch_Bound (double /*ConstantsStart*/, double /*ConstantsStop*/, double /*ConstantsStep*/, double * /*ExperimentalLines*/, int /*ExperimentalLineCount*/, struct Transition * /*SearchingCatalog*/, int /*CatalogTransitions*/, double /*Tolerance*/, struct ETauStruct /*ETStruct*/, struct Level * /*SearchingDictionary*/, WinCounter /*WinFunction*/, int /*SaveCount*/, struct MultiSave * /*Saves*/, int /*Verbose*/);
+double Box_Win_Bound (double * /*Lower*/, double * /*Upper*/, double * /*SortedLines*/, int /*LineCount*/, struct Transition * /*SearchingCatalog*/, int /*CatalogTransitions*/, double /*Tolerance*/, struct ETauStruct /*ETStruct*/, struct Level * /*SearchingDictionary*/);
+int Frequency_Bounds (double * /*Lower*/, double * /*Upper*/, struct Transition /*BoundTransition*/, struct ETauStruct /*ETStruct*/, struct Level * /*SearchingDictionary*/, double * /*FrequencyLow*/, double * /*FrequencyHigh*/);
+int Box_Has_Asymmetric_Top (double * /*Lower*/, double * /*Upper*/);
+int Comparator_Double (const void * /*a*/, const void * /*b*/);
+double Search_Cell_Grid (double * /*Low*/, double /*Step*/, int /*Steps*/, int /*Strict*/, double * /*ExperimentalLines*/, int /*ExperimentalLineCount*/, struct Transition * /*SearchingCatalog*/, int /*CatalogTransitions*/, double /*Tolerance*/, struct ETauStruct /*ETStruct*/, struct Level * /*SearchingDictionary*/, WinCounter /*WinFunction*/, int /*SaveCount*/, struct MultiSave * /*Saves*/);
 
 
 //Scoring Functions
 int CountWins (double * /*ExperimentalFrequencies*/, int /*ExperimentalLines*/, struct Transition * /*SourceCatalog*/, int /*CatalogTransitions*/, double /*Tolerance*/);
+double CountWins_Score (double * /*ExperimentalFrequencies*/, int /*ExperimentalLines*/, struct Transition * /*SourceCatalog*/, int /*CatalogTransitions*/, double /*Tolerance*/);
 double CountWins_Exp (double * /*ExperimentalFrequencies*/, int /*ExperimentalLines*/, struct Transition * /*SourceCatalog*/, int /*CatalogTransitions*/, double /*Tolerance*/);
 double CountWins_No_Double (double * /*ExperimentalFrequencies*/, int /*ExperimentalLines*/, struct Transition * /*SourceCatalog*/, int /*CatalogTransitions*/, double /*Tolerance*/);
 double CountWins_No_Double_Exp (double * /*ExperimentalFrequencies*/, int /*ExperimentalLines*/, struct Transition * /*SourceCatalog*/, int /*CatalogTransitions*/, double /*Tolerance*/);
 double CountWins_No_Double_Nearest (double * /*ExperimentalFrequencies*/, int /*ExperimentalLines*/, struct Transition * /*SourceCatalog*/, int /*CatalogTransitions*/, double /*Tolerance*/);
 int Find_Wins (double * /*ExperimentalFrequencies*/, int /*ExperimentalLines*/, struct Transition * /*SourceCatalog*/, int /*CatalogTransitions*/, double /*Tolerance*/, struct Transition ** /*MatchedTransitions*/);
+double CountWins_Sorted (double * /*ExperimentalFrequencies*/, int /*ExperimentalLines*/, struct Transition * /*SourceCatalog*/, int /*CatalogTransitions*/, double /*Tolerance*/);
+double CountWins_Exp_Sorted (double * /*ExperimentalFrequencies*/, int /*ExperimentalLines*/, struct Transition * /*SourceCatalog*/, int /*CatalogTransitions*/, double /*Tolerance*/);
+double CountWins_No_Double_Sorted (double * /*ExperimentalFrequencies*/, int /*ExperimentalLines*/, struct Transition * /*SourceCatalog*/, int /*CatalogTransitions*/, double /*Tolerance*/);
+double CountWins_No_Double_Exp_Sorted (double * /*ExperimentalFrequencies*/, int /*ExperimentalLines*/, struct Transition * /*SourceCatalog*/, int /*CatalogTransitions*/, double /*Tolerance*/);
+int Find_Wins_Sorted (double * /*ExperimentalFrequencies*/, int /*ExperimentalLines*/, struct Transition * /*SourceCatalog*/, int /*CatalogTransitions*/, double /*Tolerance*/, struct Transition ** /*MatchedTransitions*/);
+int Sort_Exp_Lines (double * /*ExperimentalLines*/, int /*ExperimentalLineCount*/, double ** /*SortedLines*/);
+int Initialize_Incremental_Score (struct Incremental_Score * /*Score*/, double * /*SortedLines*/, int /*LineCount*/, int /*CatalogTransitions*/, double /*Tolerance*/, int /*Weighted*/);
+void Free_Incremental_Score (struct Incremental_Score * /*Score*/);
+void Start_Incremental_Score (struct Incremental_Score * /*Score*/, struct Transition * /*SourceCatalog*/);
+void Update_Incremental_Score (struct Incremental_Score * /*Score*/, struct Transition * /*SourceCatalog*/);
+double Incremental_Line_Weight (struct Incremental_Score * /*Score*/, int /*Cursor*/, double /*Frequency*/);
+int Initialize_Fixed_Lines (struct Fixed_Lines * /*Fixed*/, double * /*SortedLines*/, int /*LineCount*/, int /*CatalogTransitions*/, double /*Tolerance*/);
+void Free_Fixed_Lines (struct Fixed_Lines * /*Fixed*/);
+int Fixed_Code (struct Fixed_Lines * /*Fixed*/, double /*Frequency*/);
+int Fixed_Bucket (struct Fixed_Lines * /*Fixed*/, int /*Code*/);
+void Encode_Fixed_Catalog (struct Fixed_Lines * /*Fixed*/, struct Transition * /*SourceCatalog*/);
+unsigned int Fixed_Group_Hits (struct Fixed_Lines * /*Fixed*/, int /*Group*/);
+int Fixed_Best_Kernel (void);
+int Count_Fixed_Wins_Scalar (struct Fixed_Lines * /*Fixed*/);
+#ifdef FIXED_POINT_X86
+int Count_Fixed_Wins_AVX2 (struct Fixed_Lines * /*Fixed*/);
+int Count_Fixed_Wins_AVX512 (struct Fixed_Lines * /*Fixed*/);
+#endif
+int Count_Fixed_Wins (struct Fixed_Lines * /*Fixed*/);
+double CountWins_Bounded (double * /*ExperimentalFrequencies*/, int /*ExperimentalLines*/, struct Transition * /*SourceCatalog*/, int /*CatalogTransitions*/, double /*Tolerance*/, double /*Threshold*/);
+double CountWins_Exp_Bounded (double * /*ExperimentalFrequencies*/, int /*ExperimentalLines*/, struct Transition * /*SourceCatalog*/, int /*CatalogTransitions*/, double /*Tolerance*/, double /*Threshold*/);
+double CountWins_Indexed (double * /*ExperimentalFrequencies*/, int /*ExperimentalLines*/, struct Transition * /*SourceCatalog*/, int /*CatalogTransitions*/, double /*Tolerance*/);
+double CountWins_Exp_Indexed (double * /*ExperimentalFrequencies*/, int /*ExperimentalLines*/, struct Transition * /*SourceCatalog*/, int /*CatalogTransitions*/, double /*Tolerance*/);
+double CountWins_Indexed_Bounded (double * /*ExperimentalFrequencies*/, int /*ExperimentalLines*/, struct Transition * /*SourceCatalog*/, int /*CatalogTransitions*/, double /*Tolerance*/, double /*Threshold*/);
+double CountWins_Exp_Indexed_Bounded (double * /*ExperimentalFrequencies*/, int /*ExperimentalLines*/, struct Transition * /*SourceCatalog*/, int /*CatalogTransitions*/, double /*Tolerance*/, double /*Threshold*/);
+int CountWins_Multi (double * /*ExperimentalFrequencies*/, int /*ExperimentalLines*/, struct Transition * /*SourceCatalog*/, int /*CatalogTransitions*/, double * /*Tolerances*/, int /*ToleranceCount*/, double * /*Wins*/, double * /*WinsExp*/);
+struct Line_Index *Thread_Line_Index (double * /*ExperimentalFrequencies*/, int /*ExperimentalLines*/, double /*Tolerance*/);
+void Free_Thread_Line_Index (void);
+BoundedWinCounter Bounded_Win_Counter (WinCounter /*WinFunction*/);
+void Order_Catalog_Strongest_First (struct Transition * /*SearchingCatalog*/, int /*CatalogTransitions*/);
 int Find_Wins_No_Double_Nearest (double * /*ExperimentalFrequencies*/, int /*ExperimentalLines*/, struct Transition * /*SourceCatalog*/, int /*CatalogTransitions*/, double /*Tolerance*/, struct Transition ** /*FrequencyList*/, int /*Count*/, double **);
 
 void insertionSort_Saves (struct MultiSave * /*SavestoSort*/, int /*SaveCount*/);
@@ -77,9 +184,14 @@ void insertionSort_Saves_Descending (struct MultiSave * /*SavestoSort*/, int /*S
 int Load_Exp_Lines  (char * /*FileName*/, double ** /*X*/, int /*Verbose*/);
 int Allocate_MultiSave (int /*Size*/, struct MultiSave ** /*SavestoAllocate*/);
 int Save_MultiSave (char * /*FileName*/, int /*Size*/, struct MultiSave * /*SavestoSave*/);
+int Save_Profile_Saves (char * /*FileName*/, int /*Size*/, struct Profile_Save * /*SavestoSave*/, double * /*Tolerances*/);
 int Build_Axis_Linear (struct Axis * /*TargetAxis*/, double /*AxisStart*/, double /*AxisStepSize*/, unsigned int /*AxisSteps*/);
 int Build_Cube_Linear (struct Cube * /*TargetCube*/, double * /*AxisStart*/, double * /*AxisStepSize*/, unsigned int * /*AxisSteps*/);
 
+//Test Functions
+int Test_Indexed_Win_Counters (void);
+int Test_Fixed_Point_Kernels (void);
+
 
 
 double Factorial (int /*Input*/);
@@ -194,12 +306,15 @@ int i,j,k;
 double Brute_Force_Top_Results (double ConstantsStart, double ConstantsStop, double ConstantsStep, double *ExperimentalLines, int ExperimentalLineCount, struct Transition *SearchingCatalog, int CatalogTransitions, double Tolerance, struct ETauStruct ETStruct, struct Level *SearchingDictionary, int ScoreMethod, int SaveCount, struct MultiSave *Saves, int Verbose)
 {
 //Variant of the Brute Force search that takes an array of values for the constants so you can use nonlinear steps for more effective searches
+//Methods 1 and 2 stop counting once a point can't beat the worst save (see CountWins_Bounded), for those SearchingCatalog is put in Order_Catalog_Strongest_First order first
 double CurrentA,CurrentB,CurrentC,Wins,Count,Timing;
 double Constants[3];
 int i;
+	if ((ScoreMethod == 1) || (ScoreMethod == 2)) Order_Catalog_Strongest_First (SearchingCatalog, CatalogTransitions);
 	Count = 0.0;		//Tracking the number of counts we perform, using doubles to prevent int overflow
 	Wins = 0;
 	CurrentA = ConstantsStart;
+	Heapify_Saves (Saves, SaveCount, 1.0);	//Saves are set up by the caller, make sure they're a valid heap before pushing
 	clock_t begin = clock();
 	while (CurrentA < ConstantsStop) {
 		CurrentB = ConstantsStart;
@@ -220,10 +335,10 @@ int i;
 								);
 					switch (ScoreMethod) {
 						case 1:
-							Wins = CountWins (ExperimentalLines, ExperimentalLineCount, SearchingCatalog, CatalogTransitions, Tolerance);
+							Wins = CountWins_Bounded (ExperimentalLines, ExperimentalLineCount, SearchingCatalog, CatalogTransitions, Tolerance, Saves[0].Score);
 							break;
 						case 2:
-							Wins = CountWins_Exp (ExperimentalLines, ExperimentalLineCount, SearchingCatalog, CatalogTransitions, Tolerance);	
+							Wins = CountWins_Exp_Bounded (ExperimentalLines, ExperimentalLineCount, SearchingCatalog, CatalogTransitions, Tolerance, Saves[0].Score);
 							break;
 						case 3:
 							Wins = CountWins_No_Double (ExperimentalLines, ExperimentalLineCount, SearchingCatalog, CatalogTransitions, Tolerance);
@@ -233,12 +348,7 @@ int i;
 							break;
 
 					}
-					if (Wins > Saves[0].Score) {
-						Saves[0].Score = Wins;
-						Saves[0].A = CurrentA;
-						Saves[0].B = CurrentB;
-						Saves[0].C = CurrentC;
-						insertionSort_Saves(Saves, SaveCount); 
+					if (Push_Save (Saves, SaveCount, Wins, CurrentA, CurrentB, CurrentC)) {
 						if (Verbose > 1) printf ("New Good One -- %.2f %.2f %.2f %.2f Kappa:%f\n",Wins,CurrentA,CurrentB,CurrentC,Get_Kappa(CurrentA,CurrentB,CurrentC));
 					}
 					Count+=1.0;
@@ -252,20 +362,323 @@ int i;
 	}
 	clock_t end = clock();
 	Timing = (double)(end - begin) / CLOCKS_PER_SEC;
+	Sort_Saves (Saves, SaveCount);
 	if (Verbose) printf ("%.1f Fits in %.2f sec\n", Count,Timing);
 	if (Verbose > 1) for (i=0;i<SaveCount;i++) printf ("%d: Score:%f %f %f %f\n",i,Saves[i].Score,Saves[i].A,Saves[i].B,Saves[i].C);
 	return 1;
 }
 
+double Brute_Force_Fused (double ConstantsStart, double ConstantsStop, double ConstantsStep, double *ExperimentalLines, int ExperimentalLineCount, struct Transition *SearchingCatalog, int CatalogTransitions, double Tolerance, struct ETauStruct ETStruct, struct Level *SearchingDictionary, int Weighted, int SaveCount, struct MultiSave *Saves, int Verbose)
+{
+/*
+	-Brute_Force_Top_Results with the catalog generation and scoring fused (see Score_Catalog_Fused in Fitter.h)
+	-The catalog frequencies are never written, each is matched against a bucketed line index as soon as it's computed
+	-The lowest kept score is the threshold, a catalog stops being generated once it can't make the top SaveCount
+
+ConstantsStart (MHz) - Start for A, B and C
+ConstantsStop (MHz) - Stop for A, B and C
+ConstantsStep (MHz) - Step for all constants
+ExperimentalLines - List of experimental lines to match against, any order
+ExperimentalLineCount - # of lines in the experimental line list
+SearchingCatalog - Catalog of transitions to score, only Upper/Lower are used, the frequencies are left alone
+CatalogTransitions - # of transitions in the catalog
+Tolerance (MHz) - Max distance between a predicted and experimental line for a match
+ETStruct - ETStruct for computing the frequencies
+SearchingDictionary - Dictionary that goes with the catalog/ET
+Weighted - 0 scores like CountWins, 1 like CountWins_Exp
+SaveCount - # of best catalogs to keep, at least 1
+Saves - Best SaveCount catalogs, set up by the caller like Brute_Force_Top_Results, sorted so the best is last
+Verbose - The standard verbosity flag
+
+*/
+double CurrentA,CurrentB,CurrentC,Wins,Count,Missed,Timing;
+double Constants[3];
+int i;
+struct Line_Index Index;
+	if (SaveCount < 1) {
+		printf ("Error: Fused search needs at least one save for its threshold\n");
+		return 0;
+	}
+	if (!Build_Line_Index (ExperimentalLines, ExperimentalLineCount, Tolerance, &Index)) return 0;
+	Count = 0.0;		//Tracking the number of counts we perform, using doubles to prevent int overflow
+	Missed = 0.0;
+	CurrentA = ConstantsStart;
+	Heapify_Saves (Saves, SaveCount, 1.0);	//Saves are set up by the caller, make sure they're a valid heap before pushing
+	clock_t begin = clock();
+	while (CurrentA < ConstantsStop) {
+		CurrentB = ConstantsStart;
+		while (CurrentB < ConstantsStop) {
+			CurrentC = ConstantsStart;
+			while (CurrentC < ConstantsStop) {
+				if ((CurrentA > CurrentB) && (CurrentB > CurrentC)) {
+					Constants[0] = CurrentA;
+					Constants[1] = CurrentB;
+					Constants[2] = CurrentC;
+					Wins = Score_Catalog_Fused (SearchingCatalog, CatalogTransitions, Constants, ETStruct, SearchingDictionary, &Index, Weighted, Saves[0].Score);	//Saves[0] is the lowest score kept
+					if (Push_Save (Saves, SaveCount, Wins, CurrentA, CurrentB, CurrentC)) {
+						if (Verbose > 1) printf ("New Good One -- %.2f %.2f %.2f %.2f Kappa:%f\n",Wins,CurrentA,CurrentB,CurrentC,Get_Kappa(CurrentA,CurrentB,CurrentC));
+					} else {
+						Missed += 1.0;	//Every catalog that missed the top K, cut short or not
+					}
+					Count+=1.0;
+				}
+				CurrentC += ConstantsStep;
+			}
+			CurrentB += ConstantsStep;
+		}
+		CurrentA += ConstantsStep;
+		if (Verbose) printf ("A:%f\n",CurrentA);
+	}
+	clock_t end = clock();
+	Timing = (double)(end - begin) / CLOCKS_PER_SEC;
+	Sort_Saves (Saves, SaveCount);
+	Free_Line_Index (&Index);
+	if (Verbose) printf ("%.1f Catalogs in %.2f sec, %.1f missed the top %d\n", Count,Timing,Missed,SaveCount);
+	if (Verbose > 1) for (i=0;i<SaveCount;i++) printf ("%d: Score:%f %f %f %f\n",i,Saves[i].Score,Saves[i].A,Saves[i].B,Saves[i].C);
+	return 1;
+}
+
+double Brute_Force_Multi_Tolerance (double ConstantsStart, double ConstantsStop, double ConstantsStep, double *ExperimentalLines, int ExperimentalLineCount, struct Transition *SearchingCatalog, int CatalogTransitions, double *Tolerances, int ToleranceCount, int RankBy, int Weighted, struct ETauStruct ETStruct, struct Level *SearchingDictionary, int SaveCount, struct Profile_Save *Saves, int Verbose)
+{
+/*
+	-Brute_Force_Top_Results scored at several tolerances in the same sweep, instead of rerunning the whole search per tolerance
+	-Every catalog gets CountWins and CountWins_Exp at each tolerance (see Count_Index_Wins_Multi in Fitter.h), the saves keep the whole profile
+
+ConstantsStart (MHz) - Start for A, B and C
+ConstantsStop (MHz) - Stop for A, B and C
+ConstantsStep (MHz) - Step for all constants
+ExperimentalLines - List of experimental lines to match against, any order
+ExperimentalLineCount - # of lines in the experimental line list
+SearchingCatalog - Catalog used for matching against experimental lines
+CatalogTransitions - # of transitions in the catalog
+Tolerances (MHz) - Tolerances to score at, up to MAX_TOLERANCES of them
+ToleranceCount - # of tolerances
+RankBy - Which tolerance the top K is ranked by, 0 to ToleranceCount-1
+Weighted - 0 ranks by the CountWins score at Tolerances[RankBy], 1 by the CountWins_Exp score
+ETStruct - ETStruct for computing the frequencies
+SearchingDictionary - Dictionary that goes with the catalog/ET
+SaveCount - # of best catalogs to keep
+Saves - Best SaveCount catalogs with their profiles, sorted so the best is last
+Verbose - The standard verbosity flag
+
+*/
+double CurrentA,CurrentB,CurrentC,Count,Timing,MaxTolerance;
+double Constants[3];
+int i;
+struct Line_Index Index;
+struct Profile_Save Candidate;
+	if ((ToleranceCount < 1) || (ToleranceCount > MAX_TOLERANCES) || (RankBy < 0) || (RankBy >= ToleranceCount)) {
+		printf ("Error: Need 1 to %d tolerances and RankBy inside them, got %d and %d\n",MAX_TOLERANCES,ToleranceCount,RankBy);
+		return 0;
+	}
+	MaxTolerance = Tolerances[0];
+	for (i=1;i<ToleranceCount;i++) if (Tolerances[i] > MaxTolerance) MaxTolerance = Tolerances[i];
+	if (!Build_Line_Index (ExperimentalLines, ExperimentalLineCount, MaxTolerance, &Index)) return 0;	//One index at the widest tolerance serves all of them
+	Count = 0.0;		//Tracking the number of counts we perform, using doubles to prevent int overflow
+	Initialize_Profile_Saves (Saves, SaveCount);
+	memset (&Candidate,0,sizeof(struct Profile_Save));
+	Candidate.ToleranceCount = ToleranceCount;
+	CurrentA = ConstantsStart;
+	clock_t begin = clock();
+	while (CurrentA < ConstantsStop) {
+		CurrentB = ConstantsStart;
+		while (CurrentB < ConstantsStop) {
+			CurrentC = ConstantsStart;
+			while (CurrentC < ConstantsStop) {
+				if ((CurrentA > CurrentB) && (CurrentB > CurrentC)) {
+					Constants[0] = CurrentA;
+					Constants[1] = CurrentB;
+					Constants[2] = CurrentC;
+					Get_Catalog (	SearchingCatalog, 		//Catalog to compute frequencies for
+									Constants, 			//Rotational constants for the calculation
+									CatalogTransitions,	//# of transitions in the catalog
+									0,					//Verbose
+									ETStruct,
+									SearchingDictionary
+								);
+					Count_Index_Wins_Multi (&Index, SearchingCatalog, CatalogTransitions, Tolerances, ToleranceCount, Candidate.Wins, Candidate.WinsExp);
+					Candidate.Score = Weighted ? Candidate.WinsExp[RankBy] : Candidate.Wins[RankBy];
+					Candidate.A = CurrentA;
+					Candidate.B = CurrentB;
+					Candidate.C = CurrentC;
+					if (Push_Profile_Save (Saves, SaveCount, &Candidate)) {
+						if (Verbose > 1) printf ("New Good One -- %.2f %.2f %.2f %.2f Kappa:%f\n",Candidate.Score,CurrentA,CurrentB,CurrentC,Get_Kappa(CurrentA,CurrentB,CurrentC));
+					}
+					Count+=1.0;
+				}
+				CurrentC += ConstantsStep;
+			}
+			CurrentB += ConstantsStep;
+		}
+		CurrentA += ConstantsStep;
+		if (Verbose) printf ("A:%f\n",CurrentA);
+	}
+	clock_t end = clock();
+	Timing = (double)(end - begin) / CLOCKS_PER_SEC;
+	Sort_Profile_Saves (Saves, SaveCount);
+	Free_Line_Index (&Index);
+	if (Verbose) printf ("%.1f Catalogs scored at %d tolerances in %.2f sec\n", Count,ToleranceCount,Timing);
+	return 1;
+}
+
+double Brute_Force_Incremental (double ConstantsStart, double ConstantsStop, double ConstantsStep, double *ExperimentalLines, int ExperimentalLineCount, struct Transition *SearchingCatalog, int CatalogTransitions, double Tolerance, struct ETauStruct ETStruct, struct Level *SearchingDictionary, int Weighted, int SaveCount, struct MultiSave *Saves, int Verbose)
+{
+/*
+	-Brute_Force_Top_Results with the scores carried along C (see Start_Incremental_Score) instead of matched from scratch at every grid point
+	-Each B row starts the cursors with a binary search, every C step after that only moves them past the lines they crossed
+
+Arguments are the same as Brute_Force_Fused
+Weighted - 0 scores like CountWins, 1 like CountWins_Exp
+
+*/
+double CurrentA,CurrentB,CurrentC,Wins,Count,Timing;
+double Constants[3];
+double *SortedLines;
+int i,RowStart;
+struct Incremental_Score Score;
+	if (!Sort_Exp_Lines (ExperimentalLines, ExperimentalLineCount, &SortedLines)) return 0;
+	if (!Initialize_Incremental_Score (&Score, SortedLines, ExperimentalLineCount, CatalogTransitions, Tolerance, Weighted)) {
+		free (SortedLines);
+		return 0;
+	}
+	Count = 0.0;		//Tracking the number of counts we perform, using doubles to prevent int overflow
+	CurrentA = ConstantsStart;
+	Heapify_Saves (Saves, SaveCount, 1.0);	//Saves are set up by the caller, make sure they're a valid heap before pushing
+	clock_t begin = clock();
+	while (CurrentA < ConstantsStop) {
+		CurrentB = ConstantsStart;
+		while (CurrentB < ConstantsStop) {
+			CurrentC = ConstantsStart;
+			RowStart = 1;
+			while (CurrentC < ConstantsStop) {
+				if ((CurrentA > CurrentB) && (CurrentB > CurrentC)) {
+					Constants[0] = CurrentA;
+					Constants[1] = CurrentB;
+					Constants[2] = CurrentC;
+					Get_Catalog (	SearchingCatalog, 		//Catalog to compute frequencies for
+									Constants, 			//Rotational constants for the calculation
+									CatalogTransitions,	//# of transitions in the catalog
+									0,					//Verbose
+									ETStruct,
+									SearchingDictionary
+								);
+					if (RowStart) Start_Incremental_Score (&Score, SearchingCatalog);	//First valid C of the row, nothing to carry over
+					else Update_Incremental_Score (&Score, SearchingCatalog);
+					RowStart = 0;
+					Wins = Weighted ? Score.WinsExp : Score.Wins;
+					if (Push_Save (Saves, SaveCount, Wins, CurrentA, CurrentB, CurrentC)) {
+						if (Verbose > 1) printf ("New Good One -- %.2f %.2f %.2f %.2f Kappa:%f\n",Wins,CurrentA,CurrentB,CurrentC,Get_Kappa(CurrentA,CurrentB,CurrentC));
+					}
+					Count+=1.0;
+				}
+				CurrentC += ConstantsStep;
+			}
+			CurrentB += ConstantsStep;
+		}
+		CurrentA += ConstantsStep;
+		if (Verbose) printf ("A:%f\n",CurrentA);
+	}
+	clock_t end = clock();
+	Timing = (double)(end - begin) / CLOCKS_PER_SEC;
+	Sort_Saves (Saves, SaveCount);
+	if (Verbose) printf ("%.1f Catalogs in %.2f sec, %.2f cursor moves per catalog line per step\n", Count,Timing,(Count*CatalogTransitions > 0.0) ? Score.Moves/(Count*CatalogTransitions) : 0.0);	//Nothing scored if the box has no A>B>C points
+	if (Verbose > 1) for (i=0;i<SaveCount;i++) printf ("%d: Score:%f %f %f %f\n",i,Saves[i].Score,Saves[i].A,Saves[i].B,Saves[i].C);
+	Free_Incremental_Score (&Score);
+	free (SortedLines);
+	return 1;
+}
+
+double Brute_Force_Fixed_Point (double ConstantsStart, double ConstantsStop, double ConstantsStep, double *ExperimentalLines, int ExperimentalLineCount, struct Transition *SearchingCatalog, int CatalogTransitions, double Tolerance, struct ETauStruct ETStruct, struct Level *SearchingDictionary, int Weighted, int SaveCount, struct MultiSave *Saves, int Verbose)
+{
+/*
+	-Brute_Force_Top_Results screened with the packed fixed point kernel (see Count_Fixed_Wins), which gives an upper bound on the score
+	-Only grid points whose bound beats the worst save kept get scored in double precision, so every save is an exact score
+
+Arguments are the same as Brute_Force_Fused
+Weighted - 0 scores like CountWins, 1 like CountWins_Exp
+
+*/
+double CurrentA,CurrentB,CurrentC,Wins,Count,Verified,Timing;
+double Constants[3];
+double *SortedLines;
+int i,Bound;
+struct Fixed_Lines Fixed;
+struct Line_Index Index;
+	if (!Sort_Exp_Lines (ExperimentalLines, ExperimentalLineCount, &SortedLines)) return 0;
+	if (!Initialize_Fixed_Lines (&Fixed, SortedLines, ExperimentalLineCount, CatalogTransitions, Tolerance)) {
+		free (SortedLines);
+		return 0;
+	}
+	if (!Build_Line_Index (SortedLines, ExperimentalLineCount, Tolerance, &Index)) {		//For the exact scores
+		Free_Fixed_Lines (&Fixed);
+		free (SortedLines);
+		return 0;
+	}
+	Count = 0.0;		//Tracking the number of counts we perform, using doubles to prevent int overflow
+	Verified = 0.0;
+	CurrentA = ConstantsStart;
+	Heapify_Saves (Saves, SaveCount, 1.0);	//Saves are set up by the caller, make sure they're a valid heap before pushing
+	clock_t begin = clock();
+	while (CurrentA < ConstantsStop) {
+		CurrentB = ConstantsStart;
+		while (CurrentB < ConstantsStop) {
+			CurrentC = ConstantsStart;
+			while (CurrentC < ConstantsStop) {
+				if ((CurrentA > CurrentB) && (CurrentB > CurrentC)) {
+					Constants[0] = CurrentA;
+					Constants[1] = CurrentB;
+					Constants[2] = CurrentC;
+					Get_Catalog (	SearchingCatalog, 		//Catalog to compute frequencies for
+									Constants, 			//Rotational constants for the calculation
+									CatalogTransitions,	//# of transitions in the catalog
+									0,					//Verbose
+									ETStruct,
+									SearchingDictionary
+								);
+					Encode_Fixed_Catalog (&Fixed, SearchingCatalog);
+					Bound = Count_Fixed_Wins (&Fixed);
+					if (Bound > Saves[0].Score) {		//Could make the top K, get the exact score
+						if (Weighted) Wins = Count_Index_Wins_Exp (&Index, SearchingCatalog, CatalogTransitions);
+						else Wins = Count_Index_Wins (&Index, SearchingCatalog, CatalogTransitions);
+						Verified += 1.0;
+						if (Push_Save (Saves, SaveCount, Wins, CurrentA, CurrentB, CurrentC)) {
+							if (Verbose > 1) printf ("New Good One -- %.2f %.2f %.2f %.2f Kappa:%f\n",Wins,CurrentA,CurrentB,CurrentC,Get_Kappa(CurrentA,CurrentB,CurrentC));
+						}
+					}
+					Count+=1.0;
+				}
+				CurrentC += ConstantsStep;
+			}
+			CurrentB += ConstantsStep;
+		}
+		CurrentA += ConstantsStep;
+		if (Verbose) printf ("A:%f\n",CurrentA);
+	}
+	clock_t end = clock();
+	Timing = (double)(end - begin) / CLOCKS_PER_SEC;
+	Sort_Saves (Saves, SaveCount);
+	if (Verbose) printf ("%.1f Catalogs in %.2f sec, %.1f verified in double precision\n", Count,Timing,Verified);
+	if (Verbose > 1) for (i=0;i<SaveCount;i++) printf ("%d: Score:%f %f %f %f\n",i,Saves[i].Score,Saves[i].A,Saves[i].B,Saves[i].C);
+	Free_Fixed_Lines (&Fixed);
+	Free_Line_Index (&Index);
+	free (SortedLines);
+	return 1;
+}
+
 double Brute_Force_Pointer_Scoring (double ConstantsStart, double ConstantsStop, double ConstantsStep, double *ExperimentalLines, int ExperimentalLineCount, struct Transition *SearchingCatalog, int CatalogTransitions, double Tolerance, struct ETauStruct ETStruct, struct Level *SearchingDictionary, WinCounter WinFunction, int SaveCount, struct MultiSave *Saves, int Verbose)
 {
 //Variant of the Brute Force search that takes an array of values for the constants so you can use nonlinear steps for more effective searches
+//WinFunctions with a bounded version (see Bounded_Win_Counter) are swapped for it and stop early on points that can't make the saves, SearchingCatalog is then put in Order_Catalog_Strongest_First order
 double CurrentA,CurrentB,CurrentC,Wins,Count,Timing;
 double Constants[3];
 int i;
+BoundedWinCounter BoundedFunction;
+	BoundedFunction = Bounded_Win_Counter (WinFunction);
+	if (BoundedFunction != NULL) Order_Catalog_Strongest_First (SearchingCatalog, CatalogTransitions);
 	Count = 0.0;		//Tracking the number of counts we perform, using doubles to prevent int overflow
 	Wins = 0;
 	CurrentA = ConstantsStart;
+	Heapify_Saves (Saves, SaveCount, 1.0);	//Saves are set up by the caller, make sure they're a valid heap before pushing
 	clock_t begin = clock();
 	while (CurrentA < ConstantsStop) {
 		CurrentB = ConstantsStart;
@@ -283,13 +696,9 @@ int i;
 									ETStruct,
 									SearchingDictionary
 								);
-					Wins = WinFunction (ExperimentalLines, ExperimentalLineCount, SearchingCatalog, CatalogTransitions, Tolerance);
-					if (Wins > Saves[0].Score) {
-						Saves[0].Score = Wins;
-						Saves[0].A = CurrentA;
-						Saves[0].B = CurrentB;
-						Saves[0].C = CurrentC;
-						insertionSort_Saves(Saves, SaveCount); 
+					if (BoundedFunction != NULL) Wins = BoundedFunction (ExperimentalLines, ExperimentalLineCount, SearchingCatalog, CatalogTransitions, Tolerance, Saves[0].Score);
+					else Wins = WinFunction (ExperimentalLines, ExperimentalLineCount, SearchingCatalog, CatalogTransitions, Tolerance);
+					if (Push_Save (Saves, SaveCount, Wins, CurrentA, CurrentB, CurrentC)) {
 						if (Verbose > 1) printf ("New Good One -- %.2f %.2f %.2f %.2f Kappa:%f\n",Wins,CurrentA,CurrentB,CurrentC,Get_Kappa(CurrentA,CurrentB,CurrentC));
 					}
 					Count+=1.0;
@@ -303,6 +712,7 @@ int i;
 	}
 	clock_t end = clock();
 	Timing = (double)(end - begin) / CLOCKS_PER_SEC;
+	Sort_Saves (Saves, SaveCount);
 	if (Verbose) printf ("%.1f Fits in %.2f sec\n", Count,Timing);
 	if (Verbose > 1) for (i=0;i<SaveCount;i++) printf ("%d: Score:%f %f %f %f\n",i,Saves[i].Score,Saves[i].A,Saves[i].B,Saves[i].C);
 	return 1;
@@ -330,7 +740,7 @@ struct Opt_Bundle MyOptBundle;
 	MyOptBundle.MyDictionary = SearchingDictionary;
 	MyOptBundle.TransitionsGSL = NULL;
 	
-	for (i=0;i<SaveCount;i++) Saves[i].Score = 10000.0;
+	Initialize_Saves (Saves, SaveCount, 10000.0);
 	
 	while (CurrentA < ConstantsStop) {
 		CurrentB = ConstantsStart;
@@ -374,12 +784,7 @@ struct Opt_Bundle MyOptBundle;
 						Find_Wins_No_Double_Nearest (ExperimentalLines, ExperimentalLineCount, SearchingCatalog, CatalogTransitions, Tolerance, &(MyOptBundle.TransitionsGSL), Wins, &FittingFrequencies);
 						if (!SBFIT (Constants, &ChiSqr, &MyGSLBundle, MyOptBundle, FittingFrequencies, &FittedConstants)) BadFits++;
 						Wins = ChiSqr;
-						if (Wins < Saves[0].Score) {
-							Saves[0].Score = Wins;
-							Saves[0].A = CurrentA;
-							Saves[0].B = CurrentB;
-							Saves[0].C = CurrentC;
-							insertionSort_Saves_Descending(Saves, SaveCount); 
+						if (Push_Save_Descending (Saves, SaveCount, Wins, CurrentA, CurrentB, CurrentC)) {
 							if (Verbose > 1) printf ("New Good One -- %.2f %.2f %.2f %.2f Kappa:%f\n",Wins,CurrentA,CurrentB,CurrentC,Get_Kappa(CurrentA,CurrentB,CurrentC));
 						}
 					}
@@ -394,6 +799,7 @@ struct Opt_Bundle MyOptBundle;
 	}
 	clock_t end = clock();
 	Timing = (double)(end - begin) / CLOCKS_PER_SEC;
+	Sort_Saves_Descending (Saves, SaveCount);
 	if (Verbose > 1) for (i=0;i<SaveCount;i++) printf ("%d: Score:%f %f %f %f\n",i,Saves[i].Score,Saves[i].A,Saves[i].B,Saves[i].C);
 	if (Verbose) printf ("%.1f Fits in %.2f sec\n", Count,Timing);
 	if (Verbose) printf ("%d Bad Fits\n",BadFits);
@@ -413,6 +819,7 @@ double Constants[3];
 int i,j,k;
 	Count = 0.0;		//Tracking the number of counts we perform, using doubles to prevent int overflow
 	Wins = 0.0;
+	Heapify_Saves (Saves, SaveCount, 1.0);	//Saves are set up by the caller, make sure they're a valid heap before pushing
 	clock_t begin = clock();
 	for (i=0;i<SearchCube.AAxis.Length;i++) {
 		Constants[0] = SearchCube.AAxis.Array[i];
@@ -429,12 +836,7 @@ int i,j,k;
 									SearchingDictionary
 								);
 					Wins = WinFunction (ExperimentalLines, ExperimentalLineCount, SearchingCatalog, CatalogTransitions, Tolerance);
-					if (Wins > Saves[0].Score) {
-						Saves[0].Score = Wins;
-						Saves[0].A = Constants[0];
-						Saves[0].B = Constants[1];
-						Saves[0].C = Constants[2];
-						insertionSort_Saves(Saves, SaveCount); 
+					if (Push_Save (Saves, SaveCount, Wins, Constants[0], Constants[1], Constants[2])) {
 						if (Verbose > 1) printf ("New Good One -- %.2f %.2f %.2f %.2f Kappa:%f\n",Wins,Constants[0],Constants[1],Constants[2],Get_Kappa(Constants[0],Constants[1],Constants[2]));
 					}
 					Count+=1.0;
@@ -445,6 +847,7 @@ int i,j,k;
 	}
 	clock_t end = clock();
 	Timing = (double)(end - begin) / CLOCKS_PER_SEC;
+	Sort_Saves (Saves, SaveCount);
 	if (FileName != NULL) Save_MultiSave (FileName, SaveCount, Saves);
 	if (Verbose) printf ("%.1e Fits in %.2f sec\n", Count,Timing);
 	if (Verbose > 1) for (i=0;i<SaveCount;i++) printf ("%d: Score:%f %f %f %f\n",i,Saves[i].Score,Saves[i].A,Saves[i].B,Saves[i].C);
@@ -456,10 +859,34 @@ int i,j,k;
 
 double Brute_Force_Fit_Four (double AStart, double AStop, double ConstantsStart, double ConstantsStop, double ConstantsStep, double *ExperimentalLines, int ExperimentalLineCount, struct Transition *SearchingCatalog, int CatalogTransitions, double Tolerance, struct ETauStruct ETStruct, struct Level *SearchingDictionary, int ScoreMethod, int SaveCount, struct MultiSave *Saves, int Verbose)
 {
+//Original entry point, runs the whole search without checkpointing
+	return Brute_Force_Fit_Four_Checkpoint (AStart, AStop, ConstantsStart, ConstantsStop, ConstantsStep, ExperimentalLines, ExperimentalLineCount, SearchingCatalog, CatalogTransitions, Tolerance, ETStruct, SearchingDictionary, ScoreMethod, SaveCount, Saves, Verbose, NULL, 0.0);
+}
+
+double Brute_Force_Fit_Four_Profile (double AStart, double AStop, double ConstantsStart, double ConstantsStop, double ConstantsStep, double *ExperimentalLines, int ExperimentalLineCount, struct Transition *SearchingCatalog, int CatalogTransitions, double Tolerance, struct ETauStruct ETStruct, struct Level *SearchingDictionary, int ScoreMethod, int SaveCount, struct MultiSave *Saves, int Verbose)
+{
+//Same search as Brute_Force_Fit_Four with the four line subsets fit by the kappa profile solver rather than GSL
+	return Brute_Force_Fit_Four_Shard (AStart, AStop, ConstantsStart, ConstantsStop, ConstantsStep, ExperimentalLines, ExperimentalLineCount, SearchingCatalog, CatalogTransitions, Tolerance, ETStruct, SearchingDictionary, ScoreMethod, SaveCount, Saves, Verbose, 0, 1, NULL, NULL, 0.0, FIT_METHOD_PROFILE, 0.0);
+}
+
+double Brute_Force_Fit_Four_Small (double AStart, double AStop, double ConstantsStart, double ConstantsStop, double ConstantsStep, double *ExperimentalLines, int ExperimentalLineCount, struct Transition *SearchingCatalog, int CatalogTransitions, double Tolerance, struct ETauStruct ETStruct, struct Level *SearchingDictionary, int ScoreMethod, int SaveCount, struct MultiSave *Saves, int Verbose)
+{
+//Same search as Brute_Force_Fit_Four with the four line subsets fit by the stack allocated Levenberg-Marquardt
+	return Brute_Force_Fit_Four_Shard (AStart, AStop, ConstantsStart, ConstantsStop, ConstantsStep, ExperimentalLines, ExperimentalLineCount, SearchingCatalog, CatalogTransitions, Tolerance, ETStruct, SearchingDictionary, ScoreMethod, SaveCount, Saves, Verbose, 0, 1, NULL, NULL, 0.0, FIT_METHOD_SMALL_LM, 0.0);
+}
+
+double Brute_Force_Fit_Four_Checkpoint (double AStart, double AStop, double ConstantsStart, double ConstantsStop, double ConstantsStep, double *ExperimentalLines, int ExperimentalLineCount, struct Transition *SearchingCatalog, int CatalogTransitions, double Tolerance, struct ETauStruct ETStruct, struct Level *SearchingDictionary, int ScoreMethod, int SaveCount, struct MultiSave *Saves, int Verbose, char *CheckpointFile, double CheckpointInterval)
+{
+//Unsharded search with checkpointing, the whole grid as shard 0 of 1
+	return Brute_Force_Fit_Four_Shard (AStart, AStop, ConstantsStart, ConstantsStop, ConstantsStep, ExperimentalLines, ExperimentalLineCount, SearchingCatalog, CatalogTransitions, Tolerance, ETStruct, SearchingDictionary, ScoreMethod, SaveCount, Saves, Verbose, 0, 1, NULL, CheckpointFile, CheckpointInterval, FIT_METHOD_GSL, 0.0);
+}
+
+double Brute_Force_Fit_Four_Shard (double AStart, double AStop, double ConstantsStart, double ConstantsStop, double ConstantsStep, double *ExperimentalLines, int ExperimentalLineCount, struct Transition *SearchingCatalog, int CatalogTransitions, double Tolerance, struct ETauStruct ETStruct, struct Level *SearchingDictionary, int ScoreMethod, int SaveCount, struct MultiSave *Saves, int Verbose, int ShardIndex, int ShardCount, char *PartialFile, char *CheckpointFile, double CheckpointInterval, int FitMethod, double ClusterRadius)
+{
 /*
 	-Newest variant of the brute force approach to fitting spectra.
 	-The premise of this is that fitting three lines to three constants is essentially useless, but four lines will often have an unacceptable RMS, eliminating a lot of spurious fits
-	-For each catalog a list of matching lines within the tolerance is produced, then an array of all possible combinations is made and fit, anything that is non ridiculous is kept
+	-For each catalog a list of matching lines within the tolerance is produced, then every combination of four of them is fit (see Fit_Line_Subsets), anything that is non ridiculous is kept
 
 AStart (MHx) - Individual start for the A constant for subdividing this task into chunks for multithreading
 AStop (MHz) - Individual stop for the A constant for subdividing this task into chunks for multithreading
@@ -474,20 +901,37 @@ Tolerance (MHz) - Absolute value Max amount a predicted line can differ from an
 ETStruct - ETStruct used for fitting etc...
 SearchingDictionary - Dictionary that goes with the catalog/ET
 ScoreMethod - Method used for deciding how many matches we have, see the individual score methods for details, default is 1 which is a simple tolerance match, and generally the best to use since most filtering is done later
+	5-8 are the sorted merge versions of 1-4 (CountWins_Sorted etc.), same scores but O(N+M) per catalog instead of O(N*M). These score a sorted copy of SearchingCatalog, the caller's catalog isn't reordered
 SaveCount - Max number of good saves to keep, currently not in use
 Saves - Saves of good fits, currently not in use
 Verbose - The standard verbosity flag, higher numbers produce higher levels of detail
+CheckpointFile - Binary checkpoint file, NULL disables checkpointing. If the file exists the search resumes from it (grid cursor, saves, counters and the hit file are all restored), otherwise it's created. A checkpoint that can't be read or belongs to another search stops the search, delete it (and the hit file) to start over
+CheckpointInterval (s) - Minimum wall time between checkpoints, checked once per B row
+ShardIndex - Which shard of the grid to search, 0 to ShardCount-1
+ShardCount - # of shards the grid is split into, every shard must be run with the same arguments apart from ShardIndex/PartialFile/CheckpointFile. 1 searches the whole grid
+PartialFile - Binary partial result written when the shard finishes (saves plus counters), NULL to skip. Partials from all shards are combined with Merge_Shard_Partials
+FitMethod - FIT_METHOD_GSL fits each four line subset with SBFIT (GSL Levenberg-Marquardt from the grid point), FIT_METHOD_PROFILE uses the kappa profile solver (SBFIT_Profile), which finds the best fit of the subset wherever it is and counts a bracket failure as a bad fit, FIT_METHOD_SMALL_LM is the same Levenberg-Marquardt as SBFIT on stack arrays (SBFIT_Small)
+ClusterRadius (MHz) - Kept fits within this of each other are merged as they're found (see Add_Cluster_Fit) and Saves ends up holding the best fit of each of the SaveCount best clusters rather than the same solution many times over. The clusters are written to Clusters.txt (Clusters_<ShardIndex>.txt for shards). 0 disables clustering, which is what the older entry points (Brute_Force_Fit_Four etc.) use so their Saves and output files are unchanged. CLUSTER_RADIUS is a sensible radius to opt in with
+
+Every kept fit is written to the binary hit file Hits_<ShardIndex>.bin (see Add_Hit in Fitter.h, Export_Hits_Text or "./Brute export" turn it into text), Hits_0.bin for an unsharded search, so several shards can run in the same directory and Merge_Shard_Partials finds them all. A new search starts the file over, only a resumed one appends to it
 
 */
-double CurrentA,CurrentB,CurrentC,Count,Timing,ChiSqr,Kappa,Delta,MaxKappa,MaxDelta,MinDelta,MaxChiSqr,BadFits;
-double Constants[3];
-double *FittingFrequencies,*FitConstants;
-int i,FittableLines,BinomialSize,Wins;
-int **PickFourArray;
+double CurrentA,CurrentB,CurrentC,Count,Timing,Kappa,Delta,MaxKappa,MaxDelta,MinDelta,MaxChiSqr,BadFits,Hits,Kept;
+double Constants[3],Bounds[4];
+double *FittingFrequencies,*SortedLines;
+int i,FittableLines,Wins,IndexA,IndexB,IndexC,StartA,StartB,RowsPerA,Source,Resume;
+int GridIndex[3];
+char LogName[64];
 struct GSL_Bundle MyGSLBundle;
 struct Opt_Bundle MyOptBundle;
-struct Transition *FoundLines;
-FILE *FileHandle;
+struct Transition *FoundLines,*ScoringCatalog,*SortedCatalog;
+struct Search_Checkpoint MyCheckpoint;
+time_t LastCheckpoint;
+struct Result_Sink MySink;
+struct Hit_Buffer MyHits;
+struct Fit_Cache MyCache;
+struct Solution_Clusters MyClusters;
+char ClusterName[64];
 
 	Count = 0.0;		//Tracking the number of counts we perform, using doubles to prevent int overflow
 	Wins = 0;
@@ -497,27 +941,104 @@ FILE *FileHandle;
 	MinDelta = -250.0;
 	BadFits = 0.0;
 	MaxChiSqr = 0.2;
+	Hits = 0.0;
+	StartA = 0;
+	StartB = 0;
+	Bounds[0] = AStart;
+	Bounds[1] = AStop;
+	Bounds[2] = ConstantsStart;
+	Bounds[3] = ConstantsStop;
+	FittingFrequencies = NULL;	//Everything the error path frees starts out empty
+	SortedLines = NULL;
+	SortedCatalog = NULL;
+	FoundLines = NULL;
+	MySink.FileHandle = NULL;
+	MyHits.Records = NULL;
+	memset (&MyCache, 0, sizeof(struct Fit_Cache));
+	memset (&MyClusters, 0, sizeof(struct Solution_Clusters));
+	if ((ShardCount < 1) || (ShardIndex < 0) || (ShardIndex >= ShardCount)) {
+		printf ("Error: Shard %d of %d doesn't exist\n",ShardIndex,ShardCount);
+		return 0;
+	}
+	sprintf (LogName,"Hits_%d.bin",ShardIndex);
+	if (ShardCount > 1) sprintf (ClusterName,"Clusters_%d.txt",ShardIndex);
+	else sprintf (ClusterName,"Clusters.txt");
+	for (RowsPerA=0;ConstantsStart+RowsPerA*ConstantsStep < ConstantsStop;RowsPerA++);	//Same count as the B loop below, needed to number the rows for sharding
 	
 	clock_t begin = clock();
-	FoundLines = NULL;
-	PickFourArray = malloc (50000000*sizeof(int *));
-	for (i=0;i<50000000;i++) PickFourArray[i] = malloc(4*sizeof(int));
-	FitConstants = malloc(3*sizeof(double));
+	Initialize_Saves (Saves, SaveCount, 10000.0);
+	Resume = (CheckpointFile != NULL) ? Read_Checkpoint (CheckpointFile, &MyCheckpoint, Saves, SaveCount, sizeof(struct MultiSave)) : 0;
+	if (Resume < 0) {
+		printf ("Error: Checkpoint %s can't be resumed, delete it and %s to start the search over\n",CheckpointFile,LogName);
+		return 0;
+	}
+	if (Resume) {
+		if (!Checkpoint_Matches (&MyCheckpoint, CHECKPOINT_FIT_FOUR, Bounds, ConstantsStep, Tolerance, ShardIndex, ShardCount)) {
+			printf ("Error: Checkpoint %s was written by a different search, refusing to resume\n",CheckpointFile);
+			return 0;
+		}
+		if (MyCheckpoint.Complete) {
+			if (Verbose) printf ("Checkpoint %s is for a completed search, nothing to do\n",CheckpointFile);
+			if ((PartialFile != NULL) && !Write_Checkpoint (PartialFile, &MyCheckpoint, Saves)) return 0;
+			return 1;
+		}
+		if (!Trim_Log (LogName, MyCheckpoint.LogOffset)) return 0;	//Anything logged after the checkpoint will be found again, so drop it
+		StartA = MyCheckpoint.IndexA;
+		StartB = MyCheckpoint.IndexB;
+		Count = MyCheckpoint.Count;
+		BadFits = MyCheckpoint.BadFits;
+		Hits = MyCheckpoint.Hits;
+		if (Verbose) printf ("Resuming from checkpoint %s at A:%.2f B:%.2f, %.0f fits kept so far\n",CheckpointFile,AStart+StartA*ConstantsStep,ConstantsStart+StartB*ConstantsStep,Hits);
+	} else {
+		MyCheckpoint.SearchType = CHECKPOINT_FIT_FOUR;
+		for (i=0;i<4;i++) MyCheckpoint.Bounds[i] = Bounds[i];
+		MyCheckpoint.Step = ConstantsStep;
+		MyCheckpoint.Tolerance = Tolerance;
+		MyCheckpoint.ShardIndex = ShardIndex;
+		MyCheckpoint.ShardCount = ShardCount;
+		MyCheckpoint.SaveCount = SaveCount;
+		MyCheckpoint.SaveSize = sizeof(struct MultiSave);
+	}
+	Source = Set_Telemetry_Source (TELEMETRY_FOUR_LINE);
 	MyOptBundle.ETGSL = ETStruct;
 	MyOptBundle.MyDictionary = SearchingDictionary;
 	MyOptBundle.TransitionsGSL = NULL;
 	MyOptBundle.TransitionCount = 4;
 	Initialize_SBFIT (&MyGSLBundle, &MyOptBundle);	
 	FittingFrequencies = malloc (4*sizeof(double));
-	for (i=0;i<SaveCount;i++) Saves[i].Score = 10000.0;
+	if ((ScoreMethod >= 5) && (ScoreMethod <= 8) && !Sort_Exp_Lines (ExperimentalLines, ExperimentalLineCount, &SortedLines)) goto Error;	//The sorted merge scores need the lines in ascending order
+	if (SortedLines != NULL) {	//...and the catalog, which gets sorted in a private copy so the caller's order is left alone
+		SortedCatalog = malloc (CatalogTransitions*sizeof(struct Transition));
+		if (SortedCatalog == NULL) goto Error;
+		memcpy (SortedCatalog, SearchingCatalog, CatalogTransitions*sizeof(struct Transition));
+	}
+	ScoringCatalog = (SortedCatalog != NULL) ? SortedCatalog : SearchingCatalog;
 	FoundLines = malloc (CatalogTransitions*sizeof(struct Transition)); //Array for the lines found to possibly match a set of constants, max number of lines we could match is the number of catalog transitions, realistically far fewer
-	CurrentA = AStart;
-	CurrentB = ConstantsStart;
-	CurrentC = ConstantsStart;
-	while (CurrentA < AStop) {
-		CurrentB = ConstantsStart;
-		while (CurrentB < ConstantsStop) {
+	if (!Open_Result_Sink (LogName, Resume, &MySink) || !Allocate_Hit_Buffer (&MySink, 4096, &MyHits)) goto Error;
+	if (!Initialize_Fit_Cache (&MyCache, FIT_CACHE_SIZE)) goto Error;
+	if (ClusterRadius > 0.0) {
+		if (!Initialize_Solution_Clusters (&MyClusters, ClusterRadius, 1024)) goto Error;
+		if ((Hits > 0.0) && !Cluster_Hit_File (LogName, &MyClusters)) goto Error;	//Fits kept before the checkpoint are only in the hit file now
+	}
+	LastCheckpoint = time(NULL);
+	//A and B are walked by integer index rather than accumulated so the grid cursor can be saved and restored exactly
+	for (IndexA=StartA;(CurrentA = AStart+IndexA*ConstantsStep) < AStop;IndexA++) {
+		for (IndexB=((IndexA == StartA) ? StartB : 0);(CurrentB = ConstantsStart+IndexB*ConstantsStep) < ConstantsStop;IndexB++) {
+			if ((CheckpointFile != NULL) && (difftime(time(NULL),LastCheckpoint) >= CheckpointInterval)) {
+				MyCheckpoint.IndexA = IndexA;
+				MyCheckpoint.IndexB = IndexB;
+				MyCheckpoint.Complete = 0;
+				MyCheckpoint.Count = Count;
+				MyCheckpoint.BadFits = BadFits;
+				MyCheckpoint.Hits = Hits;
+				if (!Flush_Hit_Buffer (&MyHits)) goto Error;
+				MyCheckpoint.LogOffset = Result_Sink_Offset (&MySink);
+				if (!Write_Checkpoint (CheckpointFile, &MyCheckpoint, Saves)) printf ("Warning: Unable to write checkpoint %s, continuing without it\n",CheckpointFile);
+				LastCheckpoint = time(NULL);
+			}
+			if (!Shard_Owns_Row (IndexA, IndexB, RowsPerA, ShardIndex, ShardCount)) continue;
 			CurrentC = ConstantsStart;
+			IndexC = 0;
 			while (CurrentC < ConstantsStop) {
 				if ((CurrentA > CurrentB) && (CurrentB > CurrentC)) {
 							
@@ -527,116 +1048,736 @@ FILE *FileHandle;
 					Kappa = Get_Kappa(CurrentA,CurrentB,CurrentC);	//First we do the easy math to see if it's a structurally reasonable molecule
 					Delta = Get_Delta(CurrentA,CurrentB,CurrentC);	//This is somewhat arbitrary, but grounded in experience, feel free to adjust as needed
 					if ((Kappa < MaxKappa) && (Kappa > -1.0*MaxKappa) && (Delta < MaxDelta) && (Delta > MinDelta)) {	//Only move forward if we have a sane molecule
-						Get_Catalog (	SearchingCatalog, 	//Catalog to compute frequencies for
+						Get_Catalog (	ScoringCatalog, 	//Catalog to compute frequencies for
 										Constants, 			//Rotational constants for the calculation
 										CatalogTransitions,	//# of transitions in the catalog
 										0,					//Verbose
 										ETStruct,			
 										SearchingDictionary
 									);		
+						if (SortedCatalog != NULL) insertionSort (SortedCatalog, CatalogTransitions);	//The order barely changes between neighbouring grid points, so this is close to linear
 						switch (ScoreMethod) {	//Score the catalog, really for this only the first method is decent
 							case 1:
-								Wins = CountWins (ExperimentalLines, ExperimentalLineCount, SearchingCatalog, CatalogTransitions, Tolerance);
+								Wins = CountWins (ExperimentalLines, ExperimentalLineCount, ScoringCatalog, CatalogTransitions, Tolerance);
 								break;
 							case 2:
-								Wins = CountWins_Exp (ExperimentalLines, ExperimentalLineCount, SearchingCatalog, CatalogTransitions, Tolerance);	
+								Wins = CountWins_Exp (ExperimentalLines, ExperimentalLineCount, ScoringCatalog, CatalogTransitions, Tolerance);	
 								break;
 							case 3:
-								Wins = CountWins_No_Double (ExperimentalLines, ExperimentalLineCount, SearchingCatalog, CatalogTransitions, Tolerance);
+								Wins = CountWins_No_Double (ExperimentalLines, ExperimentalLineCount, ScoringCatalog, CatalogTransitions, Tolerance);
 								break;
 							case 4:
-								Wins = CountWins_No_Double_Exp (ExperimentalLines, ExperimentalLineCount, SearchingCatalog, CatalogTransitions, Tolerance);
+								Wins = CountWins_No_Double_Exp (ExperimentalLines, ExperimentalLineCount, ScoringCatalog, CatalogTransitions, Tolerance);
+								break;
+							case 5:
+								Wins = CountWins_Sorted (SortedLines, ExperimentalLineCount, ScoringCatalog, CatalogTransitions, Tolerance);
+								break;
+							case 6:
+								Wins = CountWins_Exp_Sorted (SortedLines, ExperimentalLineCount, ScoringCatalog, CatalogTransitions, Tolerance);
+								break;
+							case 7:
+								Wins = CountWins_No_Double_Sorted (SortedLines, ExperimentalLineCount, ScoringCatalog, CatalogTransitions, Tolerance);
+								break;
+							case 8:
+								Wins = CountWins_No_Double_Exp_Sorted (SortedLines, ExperimentalLineCount, ScoringCatalog, CatalogTransitions, Tolerance);
 								break;
 							default:
-								Wins = CountWins_No_Double (ExperimentalLines, ExperimentalLineCount, SearchingCatalog, CatalogTransitions, Tolerance);
+								Wins = CountWins_No_Double (ExperimentalLines, ExperimentalLineCount, ScoringCatalog, CatalogTransitions, Tolerance);
 								break;
 						}
 						if (Wins > 3) {
-							FittableLines = Find_Wins (ExperimentalLines, ExperimentalLineCount, SearchingCatalog, CatalogTransitions, Tolerance, &FoundLines);	//Separate function for actually pulling out the match transitions rather than just counting, could possibly combine with the score function above
+							if (SortedLines != NULL) FittableLines = Find_Wins_Sorted (SortedLines, ExperimentalLineCount, ScoringCatalog, CatalogTransitions, Tolerance, &FoundLines);	//Same sorted copy the score used
+							else FittableLines = Find_Wins (ExperimentalLines, ExperimentalLineCount, ScoringCatalog, CatalogTransitions, Tolerance, &FoundLines);	//Separate function for actually pulling out the match transitions rather than just counting, could possibly combine with the score function above
 							if ((FittingFrequencies == NULL) || (FittableLines < 4)) goto Error;	//If it didnt work for whatever reason we bail
-							Pick_Four (FittableLines, &PickFourArray, &BinomialSize);	//Generate the array of possible options, easier to just remake it each time
-							for (i=0;i<BinomialSize;i++) {	//Now we iterate through all possible sets of lines
-								MyOptBundle.TransitionsGSL[0] = FoundLines[PickFourArray[i][0]];
-								MyOptBundle.TransitionsGSL[1] = FoundLines[PickFourArray[i][1]];
-								MyOptBundle.TransitionsGSL[2] = FoundLines[PickFourArray[i][2]];
-								MyOptBundle.TransitionsGSL[3] = FoundLines[PickFourArray[i][3]];
-								FittingFrequencies[0] = FoundLines[PickFourArray[i][0]].Frequency; //Assign the lines to the fitting setup
-								FittingFrequencies[1] = FoundLines[PickFourArray[i][1]].Frequency;
-								FittingFrequencies[2] = FoundLines[PickFourArray[i][2]].Frequency;
-								FittingFrequencies[3] = FoundLines[PickFourArray[i][3]].Frequency;
-								if (!SBFIT (Constants, &ChiSqr, &MyGSLBundle, MyOptBundle, FittingFrequencies, &FitConstants)) {	//Fit the four lines
-									BadFits+=1.0;	//Count the bad fits for later
-								} else {
-									Kappa = Get_Kappa(FitConstants[0],FitConstants[1],FitConstants[2]);	//Recheck the structure now that weve fit, semi redundant but still can cut some junk out
-									Delta = Get_Delta(FitConstants[0],FitConstants[1],FitConstants[2]);
-									if ((ChiSqr < MaxChiSqr) && (Kappa < MaxKappa) && (Kappa > -1.0*MaxKappa) && (Delta < MaxDelta) && (Delta > MinDelta)) {	//Also recheck against chisqr, we need a converged fit with a sane chi sqr for a four line fit or theres no point in continuing
-										Saves[0].Score = ChiSqr; 	//Save the best fit, but honestly, its pretty useless, this needs to be put through a much more rigorous 
-										Saves[0].A = FitConstants[0];
-										Saves[0].B = FitConstants[1];
-										Saves[0].C = FitConstants[2];
-										insertionSort_Saves_Descending(Saves, SaveCount); 
-										FileHandle = fopen("TestLog.txt","a");
-										fprintf (FileHandle,"%.3f %.3f %.3f\n",FitConstants[0],FitConstants[1],FitConstants[2]);
-										fclose(FileHandle);
-										if (Verbose > 1) {
-											Count+=1.0;
-											printf ("New Good One %.2e -- ChiSqr:%.2f A:%.2f B:%.2f C:%.2f Kappa:%f Delta:%f\n",Count,ChiSqr,FitConstants[0],FitConstants[1],FitConstants[2],Kappa,Delta);
-										}
-									} else {
-										BadFits+=1.0;	//Count the bad fits for later
-									}
-								}
-							}
+							GridIndex[0] = IndexA;
+							GridIndex[1] = IndexB;
+							GridIndex[2] = IndexC;
+							Kept = Fit_Line_Subsets (FoundLines, FittableLines, 4, 0.0, Binomial(FittableLines,4), Constants, &MyGSLBundle, FitMethod, MyOptBundle, &MyCache, FittingFrequencies, MaxChiSqr, MaxKappa, MinDelta, MaxDelta, Wins, GridIndex, SaveCount, Saves, &MyHits, ((ClusterRadius > 0.0) ? &MyClusters : NULL), &BadFits, Verbose);	//Subsets are enumerated as they're fit, nothing is built up front
+							if (Kept < 0.0) goto Error;
+							Hits += Kept;
+							Count += Binomial(FittableLines,4);
 						}
 					}
 				}
 				CurrentC += ConstantsStep;
+				IndexC++;
 			}
-			CurrentB += ConstantsStep;
 		}
-		CurrentA += ConstantsStep;
-		printf ("A:%f\n",CurrentA);
+		printf ("A:%f\n",CurrentA+ConstantsStep);
 	}
+	Set_Telemetry_Source (Source);
+	Merge_Fit_Telemetry ();
 	clock_t end = clock();
 	Timing = (double)(end - begin) / CLOCKS_PER_SEC;
+	Sort_Saves_Descending (Saves, SaveCount);
+	if (ClusterRadius > 0.0) {
+		if (!Recenter_Solution_Clusters (&MyClusters)) goto Error;
+		Solution_Clusters_To_Saves (&MyClusters, SaveCount, Saves);
+		if (Verbose) Print_Cluster_Stats (&MyClusters);
+		if (!Save_Solution_Clusters (ClusterName, &MyClusters, SearchingDictionary)) goto Error;
+		Free_Solution_Clusters (&MyClusters);
+	}
+	MyCheckpoint.IndexA = IndexA;
+	MyCheckpoint.IndexB = 0;
+	MyCheckpoint.Complete = 1;
+	MyCheckpoint.Count = Count;
+	MyCheckpoint.BadFits = BadFits;
+	MyCheckpoint.Hits = Hits;
+	if (!Free_Hit_Buffer (&MyHits)) goto Error;
+	MyCheckpoint.LogOffset = Result_Sink_Offset (&MySink);
+	if (!Close_Result_Sink (&MySink)) goto Error;
+	if (CheckpointFile != NULL) Write_Checkpoint (CheckpointFile, &MyCheckpoint, Saves);	//Mark the search as finished so a rerun of the same job returns straight away
+	if ((PartialFile != NULL) && !Write_Checkpoint (PartialFile, &MyCheckpoint, Saves)) goto Error;	//A partial is just the finished checkpoint of the shard
 	//if (Verbose > 1) for (i=0;i<SaveCount;i++) printf ("%d: Score:%f %f %f %f\n",i,Saves[i].Score,Saves[i].A,Saves[i].B,Saves[i].C);
 	if (Verbose) printf ("%.1f Fits in %.2f sec\n", Count,Timing);
 	if (Verbose) printf ("%f Bad Fits Ratio of bad to good fits: %.2f\n",BadFits,(BadFits/Count));
+	if (Verbose) Print_Fit_Cache_Stats (&MyCache);
+	if (Verbose) Print_Fit_Telemetry (TELEMETRY_FOUR_LINE);
+	Free_Fit_Cache (&MyCache);
 	free (FittingFrequencies);
-	free (FitConstants);
+	free (SortedLines);
+	free (SortedCatalog);
+	free (FoundLines);
 	return 1;
 Error:
-	printf ("Memory Error\n");
+	Set_Telemetry_Source (Source);
+	Merge_Fit_Telemetry ();
+	if (MyHits.Records != NULL) Free_Hit_Buffer (&MyHits);	//Keep the hits found so far, they're trimmed off again if the search resumes from a checkpoint
+	if (MySink.FileHandle != NULL) Close_Result_Sink (&MySink);
+	Free_Fit_Cache (&MyCache);
+	Free_Solution_Clusters (&MyClusters);
+	free (FittingFrequencies);
+	free (SortedLines);
+	free (SortedCatalog);
+	free (FoundLines);
+	printf ("Error: Brute force search stopped early\n");
 	return 0;	
 }
 
+double Fit_Line_Subsets (struct Transition *Lines, int LineCount, int SubsetSize, double First, double Last, double *Guess, struct GSL_Bundle *FitBundle, int FitMethod, struct Opt_Bundle FitOptBundle, struct Fit_Cache *Cache, double *FittingFrequencies, double MaxChiSqr, double MaxKappa, double MinDelta, double MaxDelta, double Score, int *GridIndex, int SaveCount, struct MultiSave *Saves, struct Hit_Buffer *Hits, struct Solution_Clusters *Clusters, double *BadFits, int Verbose)
+{
+/*
+	-Fits every SubsetSize line subset of Lines with ranks in [First,Last), keeping the fits that pass the ChiSqr and structure checks
+	-Subsets come from a Combination so they're generated one at a time as they're fit, the old Pick_Four array of every four line set isn't needed
+	-Everything the loop writes to is passed in, so threads can each take a range from Split_Combinations with their own bundle, saves and hit buffer
+	-There's no feasibility filter (Tuple_Feasible) in front of the fits. Every line was matched within Tolerance of the catalog at a grid point, so that grid point is an A>B>C fitting the whole subset and the filter can't reject it
+	 Even held to sqrt(MaxChiSqr) it turned down about 1 subset in 10^4, none of which would have been kept, and Setup_Feasibility_Bounds for each new set of transitions costs many times a fit
 
-//Meta Functions
+Lines - Matched transitions to pick subsets from, their Frequency is the experimental line they were matched to
+LineCount - # of lines in Lines
+SubsetSize - # of lines per fit, FitBundle/FitOptBundle must have been set up by Initialize_SBFIT with TransitionCount = SubsetSize
+First - Rank of the first subset to fit, 0 for all of them
+Last - Rank to stop before, Binomial(LineCount,SubsetSize) for all of them
+Guess - Initial constants for every fit
+FitBundle - GSL workspace for SBFIT, only needed for FIT_METHOD_GSL or subsets too big for the other fitters
+FitMethod - Fitter for each subset, see SBFIT_Method
+FitOptBundle - Fitting setup, its TransitionsGSL array is overwritten with each subset
+Cache - Fit cache checked before every fit (see SBFIT_Cached), NULL to always fit. Not locked, so one per thread
+FittingFrequencies - Scratch array of at least SubsetSize doubles
+MaxChiSqr - Fits with a ChiSqr at or above this are rejected
+MaxKappa - Fits with |Kappa| at or above this are rejected
+MinDelta/MaxDelta - Fits with Delta outside this range are rejected
+Score - Score of the catalog the lines came from, stored with each hit
+GridIndex - Grid position the lines came from, stored with each hit, can be NULL
+SaveCount - # of saves, 0 to skip
+Saves - Lowest ChiSqr fits, updated with Push_Save_Descending
+Hits - Hit buffer every kept fit is written to, NULL to skip
+Clusters - Every kept fit is merged into these as well, NULL to skip
+BadFits - Incremented for every fit that failed or was rejected
+Verbose - The standard verbosity flag
 
+Returns the number of fits kept, or -1 if a hit couldn't be written or clustered
 
-//Scoring functions
-int CountWins (double *ExperimentalFrequencies, int ExperimentalLines, struct Transition *SourceCatalog, int CatalogTransitions, double Tolerance) 
-{
-int i,j, Wins;
-	Wins = 0;
-	for (i=0;i<CatalogTransitions;i++) {
-		for (j=0;j<ExperimentalLines;j++) {
-			if (fabs(ExperimentalFrequencies[j]-SourceCatalog[i].Frequency) < Tolerance) {
-				Wins++;
-				break;
-			}
-		}
+*/
+struct Combination Subset;
+double Kept,ChiSqr,Kappa,Delta;
+double FitConstants[3];
+int i;
+	Kept = 0.0;
+	if ((FittingFrequencies == NULL) || (FitOptBundle.TransitionCount != SubsetSize)) {
+		printf ("Error: Fitting setup doesn't match a subset size of %d\n",SubsetSize);
+		return -1.0;
 	}
-	return Wins;
+	if (!Start_Combination (&Subset, LineCount, SubsetSize, First, Last)) return 0.0;	//Empty range, nothing to fit
+	do {
+		for (i=0;i<SubsetSize;i++) {
+			FitOptBundle.TransitionsGSL[i] = Lines[Subset.Index[i]];
+			FittingFrequencies[i] = Lines[Subset.Index[i]].Frequency;	//Assign the lines to the fitting setup
+		}
+		if (!SBFIT_Cached (Cache, FitMethod, Guess, &ChiSqr, FitBundle, FitOptBundle, FittingFrequencies, FitConstants)) {
+			(*BadFits) += 1.0;	//Count the bad fits for later
+			continue;
+		}
+		Kappa = Get_Kappa(FitConstants[0],FitConstants[1],FitConstants[2]);	//Recheck the structure now that weve fit, semi redundant but still can cut some junk out
+		Delta = Get_Delta(FitConstants[0],FitConstants[1],FitConstants[2]);
+		if ((ChiSqr < MaxChiSqr) && (Kappa < MaxKappa) && (Kappa > -1.0*MaxKappa) && (Delta < MaxDelta) && (Delta > MinDelta)) {	//Also recheck against chisqr, we need a converged fit with a sane chi sqr or theres no point in continuing
+			Push_Save_Descending (Saves, SaveCount, ChiSqr, FitConstants[0], FitConstants[1], FitConstants[2]);
+			if ((Hits != NULL) && !Add_Hit (Hits, FitConstants, ChiSqr, Score, GridIndex, FitOptBundle.TransitionsGSL, SubsetSize)) return -1.0;
+			if ((Clusters != NULL) && (Add_Cluster_Fit (Clusters, FitConstants, ChiSqr, Score, FitOptBundle.TransitionsGSL, SubsetSize) == -1)) return -1.0;
+			Kept += 1.0;
+			if (Verbose > 1) printf ("New Good One %.2e -- ChiSqr:%.2f A:%.2f B:%.2f C:%.2f Kappa:%f Delta:%f\n",Kept,ChiSqr,FitConstants[0],FitConstants[1],FitConstants[2],Kappa,Delta);
+		} else {
+			(*BadFits) += 1.0;
+		}
+	} while (Next_Combination (&Subset));
+	return Kept;
 }
 
-double CountWins_Exp (double *ExperimentalFrequencies, int ExperimentalLines, struct Transition *SourceCatalog, int CatalogTransitions, double Tolerance) 
+double Brute_Force_Fit_Four_Local_Shards (double AStart, double AStop, double ConstantsStart, double ConstantsStop, double ConstantsStep, double *ExperimentalLines, int ExperimentalLineCount, struct Transition *SearchingCatalog, int CatalogTransitions, double Tolerance, struct ETauStruct ETStruct, struct Level *SearchingDictionary, int ScoreMethod, int SaveCount, struct MultiSave *Saves, int Verbose, int ShardCount, char *PartialPrefix, double ClusterRadius)
 {
-int i,j;
-double Wins;
-	Wins = 0.0;
-	for (i=0;i<CatalogTransitions;i++) {
-		for (j=0;j<ExperimentalLines;j++) {
+/*
+	Runs Brute_Force_Fit_Four_Shard as ShardCount local processes and merges the results into Saves
+	Each child writes <PartialPrefix>_<ShardIndex>.bin, the partials are left on disk so a failed shard can be rerun by hand and merged again
+	The same partials can come from different machines, this is just the single box version with no scheduler involved
+
+PartialPrefix - Path prefix for the partial files
+ClusterRadius (MHz) - Passed to every shard and to Merge_Shard_Partials, so the merged Saves are unique solutions across all the shards. 0 disables clustering
+Everything else is as Brute_Force_Fit_Four_Shard
+*/
+int i,Status,Failed,Started;
+pid_t *Children;
+char **PartialFiles;
+	Children = NULL;
+	PartialFiles = NULL;
+	if (ShardCount < 1) goto Error;
+	Children = malloc(ShardCount*sizeof(pid_t));
+	PartialFiles = calloc(ShardCount,sizeof(char *));	//Zeroed so the error path can free a partly built list
+	if ((Children == NULL) || (PartialFiles == NULL)) goto Error;
+	for (i=0;i<ShardCount;i++) {
+		PartialFiles[i] = malloc((strlen(PartialPrefix)+32)*sizeof(char));
+		if (PartialFiles[i] == NULL) goto Error;
+		sprintf (PartialFiles[i],"%s_%d.bin",PartialPrefix,i);
+	}
+	fflush (stdout);	//Otherwise anything buffered gets printed once per child
+	Started = ShardCount;
+	for (i=0;i<ShardCount;i++) {
+		Children[i] = fork();
+		if (Children[i] < 0) {
+			printf ("Error: Unable to start shard %d\n",i);
+			Started = i;	//Still wait on the ones we did start
+			break;
+		}
+		if (Children[i] == 0) {
+			Status = Brute_Force_Fit_Four_Shard (AStart, AStop, ConstantsStart, ConstantsStop, ConstantsStep, ExperimentalLines, ExperimentalLineCount, SearchingCatalog, CatalogTransitions, Tolerance, ETStruct, SearchingDictionary, ScoreMethod, SaveCount, Saves, Verbose, i, ShardCount, PartialFiles[i], NULL, 0.0, FIT_METHOD_GSL, ClusterRadius);
+			fflush (stdout);
+			_exit (Status ? 0 : 1);
+		}
+	}
+	Failed = ShardCount-Started;
+	for (i=0;i<Started;i++) {
+		if ((waitpid (Children[i], &Status, 0) < 0) || !WIFEXITED(Status) || (WEXITSTATUS(Status) != 0)) {
+			printf ("Error: Shard %d failed\n",i);
+			Failed++;
+		}
+	}
+	if (Failed) goto Error;
+	if (!Merge_Shard_Partials (PartialFiles, ShardCount, SaveCount, Saves, ClusterRadius, Verbose)) goto Error;
+	for (i=0;i<ShardCount;i++) free (PartialFiles[i]);
+	free (PartialFiles);
+	free (Children);
+	return 1;
+Error:
+	printf ("Error running local shards\n");
+	if (PartialFiles != NULL) for (i=0;i<ShardCount;i++) free (PartialFiles[i]);
+	free (PartialFiles);
+	free (Children);
+	return 0;
+}
+
+int Merge_Shard_Partials (char **PartialFiles, int PartialCount, int SaveCount, struct MultiSave *Saves, double ClusterRadius, int Verbose)
+{
+/*
+	Combines the partial results of a sharded Brute_Force_Fit_Four into the global top SaveCount
+	Saves come out the same way the search leaves them, sorted descending in ChiSqr so Saves[SaveCount-1] is the best fit
+	Every partial has to come from the same search (bounds, step, tolerance, shard count) and each shard has to be there exactly once, otherwise we refuse to merge
+
+PartialFiles - Paths of the partials, in any order
+PartialCount - # of partials, should be the shard count
+SaveCount - # of saves, must match the SaveCount the shards were run with
+Saves - Merged saves, allocated to SaveCount by the caller
+ClusterRadius (MHz) - 0 merges the shards' saves as they are, so a solution found by two shards is in Saves twice. Above 0 every shard's hit file (Hits_<ShardIndex>.bin in the working directory) is clustered into one set, Saves gets the best fit of each of the SaveCount best clusters and the clusters are written to Clusters.txt, same as an unsharded search with clustering
+*/
+int i;
+int *Seen;
+double BadFits,Hits;
+char HitFile[64];
+struct Search_Checkpoint First,Partial;
+struct MultiSave *PartialSaves;
+struct Solution_Clusters Clusters;
+	Seen = NULL;
+	memset (&Clusters, 0, sizeof(struct Solution_Clusters));
+	PartialSaves = malloc(SaveCount*sizeof(struct MultiSave));
+	if ((PartialSaves == NULL) || (PartialCount < 1)) goto Error;
+	Initialize_Saves (Saves, SaveCount, 10000.0);
+	BadFits = 0.0;
+	Hits = 0.0;
+	for (i=0;i<PartialCount;i++) {
+		if (Read_Checkpoint (PartialFiles[i], &Partial, PartialSaves, SaveCount, sizeof(struct MultiSave)) != 1) {
+			printf ("Error: Unable to load partial %s\n",PartialFiles[i]);
+			goto Error;
+		}
+		if (i == 0) {
+			First = Partial;
+			if (First.ShardCount < 1) {
+				printf ("Error: %s has a shard count of %d\n",PartialFiles[i],First.ShardCount);
+				goto Error;
+			}
+			Seen = calloc(First.ShardCount,sizeof(int));
+			if (Seen == NULL) goto Error;
+		}
+		if ((Partial.ShardIndex < 0) || (Partial.ShardIndex >= First.ShardCount)) {	//Checkpoint_Matches is handed the partial's own index, so it can't catch this
+			printf ("Error: %s is shard %d, outside 0-%d\n",PartialFiles[i],Partial.ShardIndex,First.ShardCount-1);
+			goto Error;
+		}
+		if (!Partial.Complete || !Checkpoint_Matches (&Partial, First.SearchType, First.Bounds, First.Step, First.Tolerance, Partial.ShardIndex, First.ShardCount)) {
+			printf ("Error: %s is unfinished or from a different search\n",PartialFiles[i]);
+			goto Error;
+		}
+		if (Seen[Partial.ShardIndex]) {
+			printf ("Error: Shard %d is in the list twice\n",Partial.ShardIndex);
+			goto Error;
+		}
+		Seen[Partial.ShardIndex] = 1;
+		Merge_Saves_Descending (Saves, SaveCount, PartialSaves, SaveCount);
+		BadFits += Partial.BadFits;
+		Hits += Partial.Hits;
+	}
+	for (i=0;i<First.ShardCount;i++) {
+		if (!Seen[i]) {
+			printf ("Error: Shard %d of %d is missing\n",i,First.ShardCount);
+			goto Error;
+		}
+	}
+	Sort_Saves_Descending (Saves, SaveCount);
+	if (ClusterRadius > 0.0) {	//Shards only cluster their own fits, the same solution can turn up in several of them
+		if (!Initialize_Solution_Clusters (&Clusters, ClusterRadius, 1024)) goto Error;
+		for (i=0;i<First.ShardCount;i++) {
+			sprintf (HitFile,"Hits_%d.bin",i);
+			if (!Cluster_Hit_File (HitFile, &Clusters)) goto Error;
+		}
+		if (!Recenter_Solution_Clusters (&Clusters)) goto Error;
+		Solution_Clusters_To_Saves (&Clusters, SaveCount, Saves);
+		if (Verbose) Print_Cluster_Stats (&Clusters);
+		if (!Save_Solution_Clusters ("Clusters.txt", &Clusters, NULL)) goto Error;
+		Free_Solution_Clusters (&Clusters);
+	}
+	if (Verbose) printf ("Merged %d shards, %.0f fits kept, %.0f bad fits\n",First.ShardCount,Hits,BadFits);
+	if (Verbose > 1) for (i=0;i<SaveCount;i++) printf ("%d: Score:%f %f %f %f\n",i,Saves[i].Score,Saves[i].A,Saves[i].B,Saves[i].C);
+	free (PartialSaves);
+	free (Seen);
+	return 1;
+Error:
+	printf ("Error merging shard partials\n");
+	Free_Solution_Clusters (&Clusters);
+	free (PartialSaves);
+	free (Seen);
+	return 0;
+}
+
+double Brute_Force_Hierarchical (double ConstantsStart, double ConstantsStop, double CoarseStep, double FineStep, int RefineFactor, int CellsKept, double *ExperimentalLines, int ExperimentalLineCount, struct Transition *SearchingCatalog, int CatalogTransitions, double Tolerance, struct ETauStruct ETStruct, struct Level *SearchingDictionary, WinCounter WinFunction, int SaveCount, struct MultiSave *Saves, int Verbose)
+{
+/*
+	-Coarse to fine variant of the brute force search
+	-The full box is searched on a coarse grid, the best cells are kept and only those cells are searched again on a grid RefineFactor times finer, repeated until we reach FineStep
+	-Every grid point is the center of a cell, the children of a cell exactly tile it, so nothing is searched twice and nothing inside a kept cell is skipped
+	-A line can move a long way inside a coarse cell, so the tolerance is widened in proportion to the step at each level, the same ~1-2x stepsize rule as the other searches. The final level uses Tolerance as given
+
+ConstantsStart (MHz) - Start for A, B and C
+ConstantsStop (MHz) - Stop for A, B and C
+CoarseStep (MHz) - Step used for the first pass over the whole box
+FineStep (MHz) - Target step, refinement stops at the first level at or below this
+RefineFactor - Number of child cells per axis when a cell is refined, 2-4 is sensible
+CellsKept - Number of cells carried from one level to the next, this is what sets the cost, each level is CellsKept*RefineFactor^3 catalogs
+WinFunction - Any of the WinCounter scoring functions
+SaveCount/Saves - Top results at the final step, highest score last, same layout as Brute_Force_Pointer_Scoring. Saves are reset here
+*/
+double Step,ParentStep,LevelTolerance,Count,Timing;
+double Low[3];
+int i,Steps,Level,Final;
+struct MultiSave *Cells,*NextCells,*Target,*Temp;
+	Cells = NULL;		//Everything the error path frees starts out empty
+	NextCells = NULL;
+	if ((RefineFactor < 2) || (CellsKept < 1) || (FineStep <= 0.0) || (CoarseStep < FineStep)) {
+		printf ("Error: Brute_Force_Hierarchical needs RefineFactor > 1, CellsKept > 0 and CoarseStep >= FineStep > 0\n");
+		goto Error;
+	}
+	Cells = malloc(CellsKept*sizeof(struct MultiSave));
+	NextCells = malloc(CellsKept*sizeof(struct MultiSave));
+	if ((Cells == NULL) || (NextCells == NULL)) {
+		printf ("Memory Error\n");
+		goto Error;
+	}
+	clock_t begin = clock();
+	
+	//Level 0, the whole box
+	Step = CoarseStep;
+	Final = (Step <= FineStep*(1.0+1.0E-9));
+	LevelTolerance = Final ? Tolerance : Tolerance*Step/FineStep;
+	Steps = (int) ceil((ConstantsStop-ConstantsStart)/Step);
+	Target = Final ? Saves : Cells;
+	Initialize_Saves (Target, Final ? SaveCount : CellsKept, -1.0);	//Anything below zero marks an empty slot
+	Low[0] = ConstantsStart;
+	Low[1] = ConstantsStart;
+	Low[2] = ConstantsStart;
+	Count = Search_Cell_Grid (Low, Step, Steps, Final, ExperimentalLines, ExperimentalLineCount, SearchingCatalog, CatalogTransitions, LevelTolerance, ETStruct, SearchingDictionary, WinFunction, Final ? SaveCount : CellsKept, Target);
+	Sort_Saves (Target, Final ? SaveCount : CellsKept);
+	if (Verbose) printf ("Level 0: Step %.3f Tolerance %.3f, %.0f catalogs, best score %.2f\n",Step,LevelTolerance,Count,Target[(Final ? SaveCount : CellsKept)-1].Score);
+	
+	//Refine the kept cells until we reach the target step
+	Level = 0;
+	while (!Final) {
+		Level++;
+		ParentStep = Step;
+		Step = ParentStep/RefineFactor;
+		Final = (Step <= FineStep*(1.0+1.0E-9));
+		LevelTolerance = Final ? Tolerance : Tolerance*Step/FineStep;
+		Target = Final ? Saves : NextCells;
+		Initialize_Saves (Target, Final ? SaveCount : CellsKept, -1.0);
+		for (i=0;i<CellsKept;i++) {
+			if (Cells[i].Score < 0.0) continue;	//Fewer valid cells than slots
+			Low[0] = Cells[i].A-0.5*ParentStep;
+			Low[1] = Cells[i].B-0.5*ParentStep;
+			Low[2] = Cells[i].C-0.5*ParentStep;
+			Count += Search_Cell_Grid (Low, Step, RefineFactor, Final, ExperimentalLines, ExperimentalLineCount, SearchingCatalog, CatalogTransitions, LevelTolerance, ETStruct, SearchingDictionary, WinFunction, Final ? SaveCount : CellsKept, Target);
+		}
+		Sort_Saves (Target, Final ? SaveCount : CellsKept);
+		if (Verbose) printf ("Level %d: Step %.3f Tolerance %.3f, %.0f catalogs so far, best score %.2f\n",Level,Step,LevelTolerance,Count,Target[(Final ? SaveCount : CellsKept)-1].Score);
+		Temp = Cells;
+		Cells = NextCells;
+		NextCells = Temp;
+	}
+	clock_t end = clock();
+	Timing = (double)(end - begin) / CLOCKS_PER_SEC;
+	if (Verbose) printf ("%.1f Fits in %.2f sec, a flat search at this step would take %.2e\n", Count,Timing,pow((ConstantsStop-ConstantsStart)/Step,3.0)/6.0);
+	if (Verbose > 1) for (i=0;i<SaveCount;i++) printf ("%d: Score:%f %f %f %f\n",i,Saves[i].Score,Saves[i].A,Saves[i].B,Saves[i].C);
+	free (Cells);
+	free (NextCells);
+	return 1;
+Error:
+	free (Cells);
+	free (NextCells);
+	return 0;
+}
+
+double Search_Cell_Grid (double *Low, double Step, int Steps, int Strict, double *ExperimentalLines, int ExperimentalLineCount, struct Transition *SearchingCatalog, int CatalogTransitions, double Tolerance, struct ETauStruct ETStruct, struct Level *SearchingDictionary, WinCounter WinFunction, int SaveCount, struct MultiSave *Saves)
+{
+/*
+	Scores the Steps^3 cell centers of the box starting at Low and keeps the best in Saves, returns the number of catalogs computed
+	Cells that straddle the A>B>C boundary are scored at the nearest point on the boundary rather than dropped, otherwise the coarse levels miss near-symmetric tops entirely
+	Strict drops them instead, as the flat searches do, this is what the final level uses
+*/
+double Wins,Count;
+double Constants[3],Center[3];
+int i,j,k;
+	Count = 0.0;
+	for (i=0;i<Steps;i++) {
+		Center[0] = Low[0]+(i+0.5)*Step;
+		for (j=0;j<Steps;j++) {
+			Center[1] = Low[1]+(j+0.5)*Step;
+			if (Center[0]-Center[1] <= -Step) continue;	//Whole cell is on the wrong side of A=B
+			for (k=0;k<Steps;k++) {
+				Center[2] = Low[2]+(k+0.5)*Step;
+				if (Center[1]-Center[2] <= -Step) continue;
+				if (Strict && !((Center[0] > Center[1]) && (Center[1] > Center[2]))) continue;
+				Constants[0] = Center[0];
+				Constants[1] = (Center[1] < Center[0]) ? Center[1] : Center[0];
+				Constants[2] = (Center[2] < Constants[1]) ? Center[2] : Constants[1];
+				if (Constants[0] <= Constants[2]) continue;	//A=B=C, no asymmetric top in here
+				Get_Catalog (	SearchingCatalog, 		//Catalog to compute frequencies for
+								Constants, 			//Rotational constants for the calculation
+								CatalogTransitions,	//# of transitions in the catalog
+								0,					//Verbose
+								ETStruct,
+								SearchingDictionary
+							);
+				Wins = WinFunction (ExperimentalLines, ExperimentalLineCount, SearchingCatalog, CatalogTransitions, Tolerance);
+				Push_Save (Saves, SaveCount, Wins, Center[0], Center[1], Center[2]);	//Keep the cell center, not the clamped point, so the children still tile the cell
+				Count+=1.0;
+			}
+		}
+	}
+	return Count;
+}
+
+double Brute_Force_Branch_Bound (double ConstantsStart, double ConstantsStop, double ConstantsStep, double *ExperimentalLines, int ExperimentalLineCount, struct Transition *SearchingCatalog, int CatalogTransitions, double Tolerance, struct ETauStruct ETStruct, struct Level *SearchingDictionary, WinCounter WinFunction, int SaveCount, struct MultiSave *Saves, int Verbose)
+{
+/*
+	-Branch and bound variant of Brute_Force_Pointer_Scoring, gives the same top results over the same grid without scoring most of it
+	-Works on boxes of grid points. For each box every catalog line gets a frequency interval covering all constants in the box (see Frequency_Bounds), and the number of lines whose interval comes within Tolerance of an experimental line is an upper bound on the score of anything in the box
+	-Boxes that can't beat the worst save are dropped, the rest are split in half along every axis, single grid points are scored normally
+	-The bound allows at most one win per catalog line, so it only holds for WinFunctions that have a bounded version (see Bounded_Win_Counter), anything else is refused
+	-CountWins_No_Double isn't one of them, it goes through the experimental lines and the same catalog line can win for more than one of them
+	-For plain CountWins scoring pass CountWins_Score, CountWins itself returns an int and isn't a WinCounter
+	-Boxes are searched depth first with the most promising child first, so the saves fill up with good scores early and pruning kicks in quickly
+
+Arguments are the same as Brute_Force_Pointer_Scoring, Saves are reset here. Single points get the bounded WinFunction, with SearchingCatalog in Order_Catalog_Strongest_First order
+*/
+double Wins,Count,Pruned,Timing;
+double Constants[3],Lower[3],Upper[3];
+double *SortedLines;
+int i,j,Axis,Children,StackSize,StackLimit,GridSteps;
+int Split[3],Half[3][2][2];
+struct Search_Box *Stack,*Grown,CurrentBox,ChildBoxes[8],TempBox;
+BoundedWinCounter BoundedFunction;
+	SortedLines = NULL;	//So Error can free whatever was allocated
+	Stack = NULL;
+	BoundedFunction = Bounded_Win_Counter (WinFunction);
+	if (BoundedFunction == NULL) {
+		printf ("Error: Brute_Force_Branch_Bound needs a WinFunction that scores at most 1 per catalog line, CountWins_Score or CountWins_Exp\n");
+		return 0;
+	}
+	Order_Catalog_Strongest_First (SearchingCatalog, CatalogTransitions);
+	//Sorted copy of the experimental lines so the bound can binary search them
+	SortedLines = malloc(ExperimentalLineCount*sizeof(double));
+	if (SortedLines == NULL) {
+		printf ("Memory Error\n");
+		goto Error;
+	}
+	memcpy (SortedLines, ExperimentalLines, ExperimentalLineCount*sizeof(double));
+	qsort (SortedLines, ExperimentalLineCount, sizeof(double), Comparator_Double);
+	StackLimit = 1024;
+	Stack = malloc(StackLimit*sizeof(struct Search_Box));
+	if (Stack == NULL) {
+		printf ("Memory Error\n");
+		goto Error;
+	}
+	Initialize_Saves (Saves, SaveCount, -1.0);
+	Count = 0.0;
+	Pruned = 0.0;
+	clock_t begin = clock();
+	
+	GridSteps = (int) ceil((ConstantsStop-ConstantsStart)/ConstantsStep);	//Same grid as the while (Current < Stop) loops of the flat searches
+	for (i=0;i<3;i++) {
+		Stack[0].Low[i] = 0;
+		Stack[0].High[i] = GridSteps-1;
+	}
+	Stack[0].Bound = CatalogTransitions;
+	StackSize = 1;
+	while (StackSize > 0) {
+		StackSize--;
+		CurrentBox = Stack[StackSize];
+		if (CurrentBox.Bound <= Saves[0].Score) {	//Saves may have improved since this box was pushed
+			Pruned += 1.0;
+			continue;
+		}
+		if ((CurrentBox.Low[0] == CurrentBox.High[0]) && (CurrentBox.Low[1] == CurrentBox.High[1]) && (CurrentBox.Low[2] == CurrentBox.High[2])) {
+			//Single grid point, score it just like the flat search
+			for (i=0;i<3;i++) Constants[i] = ConstantsStart+CurrentBox.Low[i]*ConstantsStep;
+			if (!((Constants[0] > Constants[1]) && (Constants[1] > Constants[2]))) continue;
+			Get_Catalog (	SearchingCatalog, 		//Catalog to compute frequencies for
+							Constants, 			//Rotational constants for the calculation
+							CatalogTransitions,	//# of transitions in the catalog
+							0,					//Verbose
+							ETStruct,
+							SearchingDictionary
+						);
+			Wins = BoundedFunction (ExperimentalLines, ExperimentalLineCount, SearchingCatalog, CatalogTransitions, Tolerance, Saves[0].Score);
+			if (Push_Save (Saves, SaveCount, Wins, Constants[0], Constants[1], Constants[2])) {
+				if (Verbose > 1) printf ("New Good One -- %.2f %.2f %.2f %.2f Kappa:%f\n",Wins,Constants[0],Constants[1],Constants[2],Get_Kappa(Constants[0],Constants[1],Constants[2]));
+			}
+			Count+=1.0;
+			continue;
+		}
+		//Split every axis that's wider than one grid point in half
+		for (Axis=0;Axis<3;Axis++) {
+			Half[Axis][0][0] = CurrentBox.Low[Axis];
+			Half[Axis][1][1] = CurrentBox.High[Axis];
+			if (CurrentBox.High[Axis] > CurrentBox.Low[Axis]) {
+				Split[Axis] = 2;
+				Half[Axis][0][1] = (CurrentBox.Low[Axis]+CurrentBox.High[Axis])/2;
+				Half[Axis][1][0] = Half[Axis][0][1]+1;
+			} else {
+				Split[Axis] = 1;
+				Half[Axis][0][1] = CurrentBox.High[Axis];
+			}
+		}
+		Children = 0;
+		for (i=0;i<Split[0]*Split[1]*Split[2];i++) {
+			ChildBoxes[Children].Low[0] = Half[0][i%Split[0]][0];
+			ChildBoxes[Children].High[0] = Half[0][i%Split[0]][1];
+			ChildBoxes[Children].Low[1] = Half[1][(i/Split[0])%Split[1]][0];
+			ChildBoxes[Children].High[1] = Half[1][(i/Split[0])%Split[1]][1];
+			ChildBoxes[Children].Low[2] = Half[2][i/(Split[0]*Split[1])][0];
+			ChildBoxes[Children].High[2] = Half[2][i/(Split[0]*Split[1])][1];
+			for (j=0;j<3;j++) {
+				Lower[j] = ConstantsStart+ChildBoxes[Children].Low[j]*ConstantsStep;
+				Upper[j] = ConstantsStart+ChildBoxes[Children].High[j]*ConstantsStep;
+			}
+			if (!Box_Has_Asymmetric_Top (Lower, Upper)) continue;
+			ChildBoxes[Children].Bound = Box_Win_Bound (Lower, Upper, SortedLines, ExperimentalLineCount, SearchingCatalog, CatalogTransitions, Tolerance, ETStruct, SearchingDictionary);
+			if (ChildBoxes[Children].Bound <= Saves[0].Score) {
+				Pruned += 1.0;
+				continue;
+			}
+			Children++;
+		}
+		//Push the children worst first so the best one is popped next
+		for (i=1;i<Children;i++) {
+			TempBox = ChildBoxes[i];
+			j = i-1;
+			while ((j >= 0) && (ChildBoxes[j].Bound > TempBox.Bound)) {
+				ChildBoxes[j+1] = ChildBoxes[j];
+				j--;
+			}
+			ChildBoxes[j+1] = TempBox;
+		}
+		if (StackSize+Children > StackLimit) {
+			Grown = realloc(Stack,2*StackLimit*sizeof(struct Search_Box));	//Stack is still ours if this fails
+			if (Grown == NULL) {
+				printf ("Memory Error: Couldn't grow the box stack past %d boxes\n",StackLimit);
+				goto Error;
+			}
+			Stack = Grown;
+			StackLimit *= 2;
+		}
+		for (i=0;i<Children;i++) {
+			Stack[StackSize] = ChildBoxes[i];
+			StackSize++;
+		}
+	}
+	clock_t end = clock();
+	Timing = (double)(end - begin) / CLOCKS_PER_SEC;
+	Sort_Saves (Saves, SaveCount);
+	if (Verbose) printf ("%.1f Fits in %.2f sec, %.0f boxes pruned, a flat search would take %.2e fits\n", Count,Timing,Pruned,pow(GridSteps,3.0)/6.0);
+	if (Verbose > 1) for (i=0;i<SaveCount;i++) printf ("%d: Score:%f %f %f %f\n",i,Saves[i].Score,Saves[i].A,Saves[i].B,Saves[i].C);
+	free (SortedLines);
+	free (Stack);
+	return 1;
+Error:
+	free (SortedLines);
+	free (Stack);
+	return 0;
+}
+
+double Box_Win_Bound (double *Lower, double *Upper, double *SortedLines, int LineCount, struct Transition *SearchingCatalog, int CatalogTransitions, double Tolerance, struct ETauStruct ETStruct, struct Level *SearchingDictionary)
+{
+//Upper bound on the CountWins score of any constants in the box, the number of catalog lines that could possibly land within Tolerance of an experimental line
+double FrequencyLow,FrequencyHigh;
+int i,Bottom,Top,Middle,Bound;
+	Bound = 0;
+	for (i=0;i<CatalogTransitions;i++) {
+		Frequency_Bounds (Lower, Upper, SearchingCatalog[i], ETStruct, SearchingDictionary, &FrequencyLow, &FrequencyHigh);
+		//Binary search for the first experimental line above FrequencyLow-Tolerance
+		Bottom = 0;
+		Top = LineCount;
+		while (Bottom < Top) {
+			Middle = (Bottom+Top)/2;
+			if (SortedLines[Middle] <= FrequencyLow-Tolerance) Bottom = Middle+1;
+			else Top = Middle;
+		}
+		if ((Bottom < LineCount) && (SortedLines[Bottom] < FrequencyHigh+Tolerance)) Bound++;
+	}
+	return Bound;
+}
+
+int Frequency_Bounds (double *Lower, double *Upper, struct Transition BoundTransition, struct ETauStruct ETStruct, struct Level *SearchingDictionary, double *FrequencyLow, double *FrequencyHigh)
+{
+/*
+	Interval containing the frequency of a transition for every A/B/C in the box Lower-Upper that satisfies A>=B>=C
+	Rigid_Rotor is 0.5*(A+C)*J(J+1) + 0.5*(A-C)*E_tau(kappa), so the frequency is 0.5*(A+C)*dJ + 0.5*(A-C)*dE with dJ fixed by the quantum numbers
+	kappa+1 = 2(B-C)/(A-C) and 1-kappa = 2(A-B)/(A-C), which give the kappa range over the box. Every E_tau is nondecreasing in kappa, so dE is bounded by the upper/lower levels at the opposite ends of that range
+	The rest is interval arithmetic, so the bound is loose for big boxes but always valid
+*/
+double KappaLow,KappaHigh,SumLow,SumHigh,DiffLow,DiffHigh,dJ,dELow,dEHigh,Low,High,Products[4];
+int i,JUp,JLow;
+	DiffLow = Lower[0]-Upper[2];	//A-C
+	if (DiffLow < 0.0) DiffLow = 0.0;
+	DiffHigh = Upper[0]-Lower[2];
+	SumLow = Lower[0]+Lower[2];		//A+C
+	SumHigh = Upper[0]+Upper[2];
+	KappaLow = -1.0;
+	KappaHigh = 0.999999999999;	//Just shy of 1 so E_tau stays inside the table row
+	if ((Lower[1] > Upper[2]) && (DiffHigh > 0.0)) KappaLow = 2.0*(Lower[1]-Upper[2])/DiffHigh-1.0;
+	if ((Lower[0] > Upper[1]) && (DiffHigh > 0.0)) KappaHigh = 1.0-2.0*(Lower[0]-Upper[1])/DiffHigh;
+	if (KappaHigh > 0.999999999999) KappaHigh = 0.999999999999;
+	JUp = SearchingDictionary[BoundTransition.Upper].J;
+	JLow = SearchingDictionary[BoundTransition.Lower].J;
+	dJ = JUp*(JUp+1.0)-JLow*(JLow+1.0);
+	dELow = E_tau(BoundTransition.Upper,KappaLow,ETStruct)-E_tau(BoundTransition.Lower,KappaHigh,ETStruct);
+	dEHigh = E_tau(BoundTransition.Upper,KappaHigh,ETStruct)-E_tau(BoundTransition.Lower,KappaLow,ETStruct);
+	//0.5*(A+C)*dJ, dJ is a constant so only the sign matters
+	if (dJ >= 0.0) {
+		Low = 0.5*SumLow*dJ;
+		High = 0.5*SumHigh*dJ;
+	} else {
+		Low = 0.5*SumHigh*dJ;
+		High = 0.5*SumLow*dJ;
+	}
+	//Plus 0.5*(A-C)*dE, product of two intervals
+	Products[0] = 0.5*DiffLow*dELow;
+	Products[1] = 0.5*DiffLow*dEHigh;
+	Products[2] = 0.5*DiffHigh*dELow;
+	Products[3] = 0.5*DiffHigh*dEHigh;
+	dELow = Products[0];
+	dEHigh = Products[0];
+	for (i=1;i<4;i++) {
+		if (Products[i] < dELow) dELow = Products[i];
+		if (Products[i] > dEHigh) dEHigh = Products[i];
+	}
+	Low += dELow;
+	High += dEHigh;
+	//Frequencies are the absolute value of the energy difference
+	if (Low >= 0.0) {
+		*FrequencyLow = Low;
+		*FrequencyHigh = High;
+	} else if (High <= 0.0) {
+		*FrequencyLow = -High;
+		*FrequencyHigh = -Low;
+	} else {
+		*FrequencyLow = 0.0;
+		*FrequencyHigh = (-Low > High) ? -Low : High;
+	}
+	return 1;
+}
+
+int Box_Has_Asymmetric_Top (double *Lower, double *Upper)
+{
+//Does the box contain any grid point with A>B>C
+	return ((Upper[0] > Lower[1]) && (Upper[1] > Lower[2]) && (Upper[0] > Lower[2]));
+}
+
+int Comparator_Double (const void *a, const void *b) 
+{
+//Comparison function for qsort sorting of doubles
+	double A = *(double *) a;
+	double B = *(double *) b;
+	if (A > B) return 1;
+	else if (A < B) return -1;
+	else return 0;
+}
+
+//Meta Functions
+
+
+//Scoring functions
+int CountWins (double *ExperimentalFrequencies, int ExperimentalLines, struct Transition *SourceCatalog, int CatalogTransitions, double Tolerance) 
+{
+int i,j, Wins;
+	Wins = 0;
+	for (i=0;i<CatalogTransitions;i++) {
+		for (j=0;j<ExperimentalLines;j++) {
+			if (fabs(ExperimentalFrequencies[j]-SourceCatalog[i].Frequency) < Tolerance) {
+				Wins++;
+				break;
+			}
+		}
+	}
+	return Wins;
+}
+
+double CountWins_Score (double *ExperimentalFrequencies, int ExperimentalLines, struct Transition *SourceCatalog, int CatalogTransitions, double Tolerance) 
+{
+//CountWins with the WinCounter signature, CountWins returns an int so it can't be handed to the searches that take a WinCounter
+	return (double) CountWins (ExperimentalFrequencies, ExperimentalLines, SourceCatalog, CatalogTransitions, Tolerance);
+}
+
+double CountWins_Exp (double *ExperimentalFrequencies, int ExperimentalLines, struct Transition *SourceCatalog, int CatalogTransitions, double Tolerance) 
+{
+int i,j;
+double Wins;
+	Wins = 0.0;
+	for (i=0;i<CatalogTransitions;i++) {
+		for (j=0;j<ExperimentalLines;j++) {
 			if (fabs(ExperimentalFrequencies[j]-SourceCatalog[i].Frequency) < Tolerance) {
 				Wins += exp(-fabs(ExperimentalFrequencies[j]-SourceCatalog[i].Frequency));
 				break;
@@ -710,6 +1851,684 @@ int i,j, Wins,Max;
 	return Wins;
 }
 
+/*
+	Sorted merge versions of the scores above, same results for the same (ascending) experimental lines but O(N+M) instead of O(N*M)
+	-ExperimentalFrequencies must be in ascending order, Sort_Exp_Lines makes a sorted copy
+	-SourceCatalog must be sorted by frequency as well, none of these reorder it. Sort the catalog once per grid point and pass the same copy to the score and Find_Wins_Sorted
+	-Each walks a pointer to the lowest line that can still match, lines more than Tolerance below the current one can never match a later one
+	-They share the WinCounter signature but aren't meant for the searches that take one, those pass a catalog straight out of Get_Catalog
+*/
+
+double CountWins_Sorted (double *ExperimentalFrequencies, int ExperimentalLines, struct Transition *SourceCatalog, int CatalogTransitions, double Tolerance) 
+{
+//CountWins, each catalog line within Tolerance of any experimental line is a win
+int i,j;
+double Wins,Frequency;
+	Wins = 0.0;
+	j = 0;
+	for (i=0;i<CatalogTransitions;i++) {
+		Frequency = SourceCatalog[i].Frequency;
+		while ((j < ExperimentalLines) && (ExperimentalFrequencies[j] < Frequency) && (Frequency-ExperimentalFrequencies[j] >= Tolerance)) j++;
+		if ((j < ExperimentalLines) && (fabs(ExperimentalFrequencies[j]-Frequency) < Tolerance)) Wins++;	//Only the lowest remaining line needs checking, anything above it is further away
+	}
+	return Wins;
+}
+
+double CountWins_Exp_Sorted (double *ExperimentalFrequencies, int ExperimentalLines, struct Transition *SourceCatalog, int CatalogTransitions, double Tolerance) 
+{
+//CountWins_Exp, the first matching experimental line is the lowest one in the window, same as the unsorted version walking sorted lines
+int i,j;
+double Wins,Frequency;
+	Wins = 0.0;
+	j = 0;
+	for (i=0;i<CatalogTransitions;i++) {
+		Frequency = SourceCatalog[i].Frequency;
+		while ((j < ExperimentalLines) && (ExperimentalFrequencies[j] < Frequency) && (Frequency-ExperimentalFrequencies[j] >= Tolerance)) j++;
+		if ((j < ExperimentalLines) && (fabs(ExperimentalFrequencies[j]-Frequency) < Tolerance)) Wins += exp(-fabs(ExperimentalFrequencies[j]-Frequency));
+	}
+	return Wins;
+}
+
+double CountWins_No_Double_Sorted (double *ExperimentalFrequencies, int ExperimentalLines, struct Transition *SourceCatalog, int CatalogTransitions, double Tolerance) 
+{
+//CountWins_No_Double, experimental lines in order each take the lowest catalog line in their window that isn't within Tolerance of the last win
+double Wins,LastWin,LastExp,Frequency;
+int i,j,k;
+	Wins = 0.0;
+	LastWin = 0.0;
+	LastExp = 0.0;
+	i = 0;
+	for (j=0;j<ExperimentalLines;j++) {
+		Frequency = ExperimentalFrequencies[j];
+		while ((i < CatalogTransitions) && (SourceCatalog[i].Frequency < Frequency) && (Frequency-SourceCatalog[i].Frequency >= Tolerance)) i++;
+		if (fabs(LastExp-Frequency) <= Tolerance) continue;	//Too close to the last matched line, nothing in the catalog can count for it
+		for (k=i;(k < CatalogTransitions) && (fabs(Frequency-SourceCatalog[k].Frequency) < Tolerance);k++) {	//The window is contiguous from i
+			if (fabs(LastWin-SourceCatalog[k].Frequency) > Tolerance) {
+				Wins++;
+				LastWin = SourceCatalog[k].Frequency;
+				LastExp = Frequency;
+				break;
+			}
+		}
+	}
+	return Wins;
+}
+
+double CountWins_No_Double_Exp_Sorted (double *ExperimentalFrequencies, int ExperimentalLines, struct Transition *SourceCatalog, int CatalogTransitions, double Tolerance) 
+{
+//CountWins_No_Double_Exp, same walk as CountWins_No_Double_Sorted with the exponential weight
+double Wins,LastWin,LastExp,Frequency;
+int i,j,k;
+	Wins = 0.0;
+	LastWin = 0.0;
+	LastExp = 0.0;
+	i = 0;
+	for (j=0;j<ExperimentalLines;j++) {
+		Frequency = ExperimentalFrequencies[j];
+		while ((i < CatalogTransitions) && (SourceCatalog[i].Frequency < Frequency) && (Frequency-SourceCatalog[i].Frequency >= Tolerance)) i++;
+		if (fabs(LastExp-Frequency) <= Tolerance) continue;
+		for (k=i;(k < CatalogTransitions) && (fabs(Frequency-SourceCatalog[k].Frequency) < Tolerance);k++) {
+			if (fabs(LastWin-SourceCatalog[k].Frequency) > Tolerance) {
+				Wins += exp(-fabs(Frequency-SourceCatalog[k].Frequency));
+				LastWin = SourceCatalog[k].Frequency;
+				LastExp = Frequency;
+				break;
+			}
+		}
+	}
+	return Wins;
+}
+
+int Find_Wins_Sorted (double *ExperimentalFrequencies, int ExperimentalLines, struct Transition *SourceCatalog, int CatalogTransitions, double Tolerance, struct Transition **MatchedTransitions) 
+{
+//Find_Wins, every (catalog, experimental) pair within Tolerance in catalog then experimental order, capped at 100
+int i,j,k,Wins,Max;
+double Frequency;
+	Max = 100;
+	Wins = 0;
+	j = 0;
+	for (i=0;i<CatalogTransitions;i++) {
+		Frequency = SourceCatalog[i].Frequency;
+		while ((j < ExperimentalLines) && (ExperimentalFrequencies[j] < Frequency) && (Frequency-ExperimentalFrequencies[j] >= Tolerance)) j++;
+		for (k=j;(k < ExperimentalLines) && (fabs(ExperimentalFrequencies[k]-Frequency) < Tolerance);k++) {
+			(*MatchedTransitions)[Wins] = SourceCatalog[i];
+			(*MatchedTransitions)[Wins].Frequency = ExperimentalFrequencies[k];
+			Wins++;
+			if (Wins>Max-1) {
+				return Max;
+			}
+		}
+	}
+	return Wins;
+}
+
+/*
+	Bounded scoring
+	-A grid point only matters if it beats the worst save kept, so the scorers take that score as Threshold
+	-Every catalog line adds at most 1, once the wins so far plus the lines left can't get above Threshold the count stops
+	-The early return is that bound (<= Threshold) rather than the score, so Push_Save turns it away like any other loser
+	-Scores that do get above Threshold are exact, the order of the catalog doesn't change them only how soon hopeless points stop
+*/
+
+double CountWins_Bounded (double *ExperimentalFrequencies, int ExperimentalLines, struct Transition *SourceCatalog, int CatalogTransitions, double Tolerance, double Threshold) 
+{
+int i,j;
+double Wins;
+	Wins = 0.0;
+	for (i=0;i<CatalogTransitions;i++) {
+		if (Wins+(CatalogTransitions-i) <= Threshold) return Wins+(CatalogTransitions-i);
+		for (j=0;j<ExperimentalLines;j++) {
+			if (fabs(ExperimentalFrequencies[j]-SourceCatalog[i].Frequency) < Tolerance) {
+				Wins++;
+				break;
+			}
+		}
+	}
+	return Wins;
+}
+
+double CountWins_Exp_Bounded (double *ExperimentalFrequencies, int ExperimentalLines, struct Transition *SourceCatalog, int CatalogTransitions, double Tolerance, double Threshold) 
+{
+int i,j;
+double Wins;
+	Wins = 0.0;
+	for (i=0;i<CatalogTransitions;i++) {
+		if (Wins+(CatalogTransitions-i) <= Threshold) return Wins+(CatalogTransitions-i);
+		for (j=0;j<ExperimentalLines;j++) {
+			if (fabs(ExperimentalFrequencies[j]-SourceCatalog[i].Frequency) < Tolerance) {
+				Wins += exp(-fabs(ExperimentalFrequencies[j]-SourceCatalog[i].Frequency));
+				break;
+			}
+		}
+	}
+	return Wins;
+}
+
+BoundedWinCounter Bounded_Win_Counter (WinCounter WinFunction)
+{
+//Bounded version of a WinCounter that has one, NULL otherwise so the caller falls back to the full count
+//Only counters that score at most 1 per catalog line get one, CountWins_No_Double can count a catalog line more than once and stays unbounded
+	if (WinFunction == CountWins_Score) return CountWins_Bounded;
+	if (WinFunction == CountWins_Exp) return CountWins_Exp_Bounded;
+	if (WinFunction == CountWins_Indexed) return CountWins_Indexed_Bounded;
+	if (WinFunction == CountWins_Exp_Indexed) return CountWins_Exp_Indexed_Bounded;
+	return NULL;
+}
+
+/*
+	Indexed WinCounters
+	-Same scores as CountWins_Score/CountWins_Exp (and the bounded versions) through a bucketed line index (see Build_Line_Index in Fitter.h), for the searches that take a WinCounter
+	-CountWins_Exp weights a catalog line by the first experimental line in tolerance, the indexed version by the lowest, so they agree when the lines are ascending
+	-A WinCounter only gets the raw line list, so each thread keeps one index and rebuilds it whenever it's handed different lines or a different tolerance
+	-The lines are compared by value against a copy taken when the index was built, an array that's refilled or reused at the same address can't be scored against a stale index
+	-Free_Thread_Line_Index drops the calling thread's index once it's done searching
+*/
+
+static __thread struct Line_Index Thread_Index;
+static __thread double *Thread_Index_Lines = NULL;	//Copy of the lines Thread_Index was built from
+static __thread int Thread_Index_Built = 0;
+
+struct Line_Index *Thread_Line_Index (double *ExperimentalFrequencies, int ExperimentalLines, double Tolerance)
+{
+//The calling thread's index over ExperimentalFrequencies at Tolerance, NULL if it can't be built
+	if (Thread_Index_Built && (Thread_Index.LineCount == ExperimentalLines) && (Thread_Index.Tolerance == Tolerance) && ((ExperimentalLines == 0) || (memcmp (Thread_Index_Lines, ExperimentalFrequencies, ExperimentalLines*sizeof(double)) == 0))) return &Thread_Index;
+	Free_Thread_Line_Index ();
+	Thread_Index_Lines = malloc ((ExperimentalLines > 0 ? ExperimentalLines : 1)*sizeof(double));
+	if (Thread_Index_Lines == NULL) {
+		printf ("Error allocating line index\n");
+		return NULL;
+	}
+	if (ExperimentalLines > 0) memcpy (Thread_Index_Lines, ExperimentalFrequencies, ExperimentalLines*sizeof(double));
+	if (!Build_Line_Index (Thread_Index_Lines, ExperimentalLines, Tolerance, &Thread_Index)) {
+		Free_Thread_Line_Index ();
+		return NULL;
+	}
+	Thread_Index_Built = 1;
+	return &Thread_Index;
+}
+
+void Free_Thread_Line_Index (void)
+{
+	if (Thread_Index_Built) Free_Line_Index (&Thread_Index);
+	free (Thread_Index_Lines);
+	Thread_Index_Lines = NULL;
+	Thread_Index_Built = 0;
+}
+
+double CountWins_Indexed (double *ExperimentalFrequencies, int ExperimentalLines, struct Transition *SourceCatalog, int CatalogTransitions, double Tolerance) 
+{
+//CountWins through the thread's line index, any catalog order and any line order
+struct Line_Index *Index;
+	Index = Thread_Line_Index (ExperimentalFrequencies, ExperimentalLines, Tolerance);
+	if (Index == NULL) return CountWins (ExperimentalFrequencies, ExperimentalLines, SourceCatalog, CatalogTransitions, Tolerance);
+	return Count_Index_Wins (Index, SourceCatalog, CatalogTransitions);
+}
+
+double CountWins_Exp_Indexed (double *ExperimentalFrequencies, int ExperimentalLines, struct Transition *SourceCatalog, int CatalogTransitions, double Tolerance) 
+{
+//CountWins_Exp through the thread's line index, matches the unindexed version when the lines are in ascending order
+struct Line_Index *Index;
+	Index = Thread_Line_Index (ExperimentalFrequencies, ExperimentalLines, Tolerance);
+	if (Index == NULL) return CountWins_Exp (ExperimentalFrequencies, ExperimentalLines, SourceCatalog, CatalogTransitions, Tolerance);
+	return Count_Index_Wins_Exp (Index, SourceCatalog, CatalogTransitions);
+}
+
+double CountWins_Indexed_Bounded (double *ExperimentalFrequencies, int ExperimentalLines, struct Transition *SourceCatalog, int CatalogTransitions, double Tolerance, double Threshold) 
+{
+struct Line_Index *Index;
+	Index = Thread_Line_Index (ExperimentalFrequencies, ExperimentalLines, Tolerance);
+	if (Index == NULL) return CountWins_Bounded (ExperimentalFrequencies, ExperimentalLines, SourceCatalog, CatalogTransitions, Tolerance, Threshold);
+	return Count_Index_Wins_Bounded (Index, SourceCatalog, CatalogTransitions, Threshold);
+}
+
+double CountWins_Exp_Indexed_Bounded (double *ExperimentalFrequencies, int ExperimentalLines, struct Transition *SourceCatalog, int CatalogTransitions, double Tolerance, double Threshold) 
+{
+struct Line_Index *Index;
+	Index = Thread_Line_Index (ExperimentalFrequencies, ExperimentalLines, Tolerance);
+	if (Index == NULL) return CountWins_Exp_Bounded (ExperimentalFrequencies, ExperimentalLines, SourceCatalog, CatalogTransitions, Tolerance, Threshold);
+	return Count_Index_Wins_Exp_Bounded (Index, SourceCatalog, CatalogTransitions, Threshold);
+}
+
+int CountWins_Multi (double *ExperimentalFrequencies, int ExperimentalLines, struct Transition *SourceCatalog, int CatalogTransitions, double *Tolerances, int ToleranceCount, double *Wins, double *WinsExp)
+{
+//CountWins and CountWins_Exp (lines in ascending order) at every tolerance in one pass, through the thread's line index at the widest tolerance
+struct Line_Index *Index;
+double MaxTolerance;
+int t;
+	if (ToleranceCount < 1) return 0;
+	MaxTolerance = Tolerances[0];
+	for (t=1;t<ToleranceCount;t++) if (Tolerances[t] > MaxTolerance) MaxTolerance = Tolerances[t];
+	Index = Thread_Line_Index (ExperimentalFrequencies, ExperimentalLines, MaxTolerance);
+	if (Index == NULL) return 0;
+	return Count_Index_Wins_Multi (Index, SourceCatalog, CatalogTransitions, Tolerances, ToleranceCount, Wins, WinsExp);
+}
+
+int Test_Indexed_Win_Counters (void)
+{
+/*
+	Test Code - Checks the indexed WinCounters give exactly the scores of the linear ones
+	Random ascending line lists and random catalogs at several tolerances, every indexed score (plain, bounded and multi tolerance) has to match CountWins_Score/CountWins_Exp to the last bit
+	The line list is also refilled in place between rounds, so a stale thread index would show up as a mismatch
+	Returns 1 if every score matched
+*/
+double Lines[200],Tolerances[3],Wins[3],WinsExp[3];
+double Linear,LinearExp,Threshold,Bounded;
+int i,t,Round,LineCount,CatalogCount,Mismatches,Checks;
+struct Transition Catalog[500];
+	Mismatches = 0;
+	Checks = 0;
+	srand (1);		//Same lines and catalogs every run
+	for (Round=0;Round<200;Round++) {
+		LineCount = 1+rand()%200;
+		CatalogCount = rand()%500;
+		for (i=0;i<LineCount;i++) Lines[i] = 2000.0+18000.0*rand()/RAND_MAX;
+		qsort (Lines, LineCount, sizeof(double), Comparator_Double);
+		for (i=0;i<CatalogCount;i++) {
+			Catalog[i].Frequency = (rand()%4 == 0) ? Lines[rand()%LineCount]+(2.0*rand()/RAND_MAX-1.0) : 1000.0+20000.0*rand()/RAND_MAX;	//Plenty of near misses around the tolerance
+			if (rand()%50 == 0) Catalog[i].Frequency = -Catalog[i].Frequency;
+		}
+		Tolerances[0] = 0.05+1.5*rand()/RAND_MAX;
+		Tolerances[1] = Tolerances[0]/2.0;
+		Tolerances[2] = Tolerances[0]/5.0;
+		for (t=0;t<3;t++) {
+			Linear = CountWins_Score (Lines, LineCount, Catalog, CatalogCount, Tolerances[t]);
+			LinearExp = CountWins_Exp (Lines, LineCount, Catalog, CatalogCount, Tolerances[t]);
+			Threshold = Linear+(rand()%11-5);
+			Checks += 4;
+			if (CountWins_Indexed (Lines, LineCount, Catalog, CatalogCount, Tolerances[t]) != Linear) Mismatches++;
+			if (CountWins_Exp_Indexed (Lines, LineCount, Catalog, CatalogCount, Tolerances[t]) != LinearExp) Mismatches++;
+			Bounded = CountWins_Indexed_Bounded (Lines, LineCount, Catalog, CatalogCount, Tolerances[t], Threshold);
+			if ((Linear > Threshold) ? (Bounded != Linear) : (Bounded > Threshold)) Mismatches++;		//Scores that beat Threshold are exact, the rest only have to stay at or under it
+			Bounded = CountWins_Exp_Indexed_Bounded (Lines, LineCount, Catalog, CatalogCount, Tolerances[t], LinearExp-0.5);
+			if (Bounded != LinearExp) Mismatches++;
+		}
+		if (!CountWins_Multi (Lines, LineCount, Catalog, CatalogCount, Tolerances, 3, Wins, WinsExp)) return 0;
+		for (t=0;t<3;t++) {
+			Checks += 2;
+			if (Wins[t] != CountWins_Score (Lines, LineCount, Catalog, CatalogCount, Tolerances[t])) Mismatches++;
+			if (WinsExp[t] != CountWins_Exp (Lines, LineCount, Catalog, CatalogCount, Tolerances[t])) Mismatches++;
+		}
+	}
+	Free_Thread_Line_Index ();
+	printf ("Indexed win counters: %d of %d scores differ from the linear scorers\n",Mismatches,Checks);
+	return (Mismatches == 0);
+}
+
+int Test_Fixed_Point_Kernels (void)
+{
+/*
+	Test Code - Checks every fixed point kernel this CPU can run gives the same count as the scalar one
+	Random ascending line lists and catalogs full of near misses at several tolerances, each catalog is encoded and counted by every kernel up to Fixed_Best_Kernel
+	The scalar count also has to equal a direct all pairs count over the codes and be no less than CountWins_Score
+	Returns 1 if every count matched
+*/
+double Lines[200],Tolerances[3];
+int Codes[500],LineCodes[200];
+int i,j,t,k,Pass,Round,LineCount,CatalogCount,Mismatches,Checks,Scalar,Direct,BestKernel;
+struct Transition Catalog[500];
+struct Fixed_Lines Fixed;
+	Mismatches = 0;
+	Checks = 0;
+	BestKernel = Fixed_Best_Kernel ();
+	srand (1);		//Same lines and catalogs every run
+	for (Round=0;Round<200;Round++) {
+		LineCount = 1+rand()%200;
+		CatalogCount = 1+rand()%500;
+		for (i=0;i<LineCount;i++) Lines[i] = 2000.0+18000.0*rand()/RAND_MAX;
+		qsort (Lines, LineCount, sizeof(double), Comparator_Double);
+		Tolerances[0] = 0.05+1.5*rand()/RAND_MAX;
+		Tolerances[1] = Tolerances[0]/2.0;
+		Tolerances[2] = Tolerances[0]/5.0;
+		for (t=0;t<3;t++) {
+			if (!Initialize_Fixed_Lines (&Fixed, Lines, LineCount, CatalogCount, Tolerances[t])) return 0;
+			for (i=0;i<LineCount;i++) LineCodes[i] = Fixed_Code (&Fixed, Lines[i]);
+			for (Pass=0;Pass<2;Pass++) {
+				//Two catalogs through the same Fixed_Lines, so stale buckets or group ranges would show up
+				for (i=0;i<CatalogCount;i++) {
+					Catalog[i].Frequency = (rand()%4 != 0) ? Lines[rand()%LineCount]+Tolerances[t]*(2.5*rand()/RAND_MAX-1.25) : 1000.0+20000.0*rand()/RAND_MAX;
+					if (rand()%50 == 0) Catalog[i].Frequency = -Catalog[i].Frequency;
+					Codes[i] = Fixed_Code (&Fixed, Catalog[i].Frequency);
+				}
+				Encode_Fixed_Catalog (&Fixed, Catalog);
+				Direct = 0;
+				for (i=0;i<CatalogCount;i++) {
+					for (j=0;j<LineCount;j++) {
+						if (abs(Codes[i]-LineCodes[j]) <= Fixed.Reach) {
+							Direct++;
+							break;
+						}
+					}
+				}
+				Scalar = Count_Fixed_Wins_Scalar (&Fixed);
+				Checks += 2;
+				if (Scalar != Direct) Mismatches++;
+				if (Scalar < CountWins_Score (Lines, LineCount, Catalog, CatalogCount, Tolerances[t])) Mismatches++;
+				for (k=FIXED_KERNEL_SCALAR+1;k<=BestKernel;k++) {
+					Fixed.Kernel = k;
+					Checks++;
+					if (Count_Fixed_Wins (&Fixed) != Scalar) Mismatches++;
+				}
+			}
+			Free_Fixed_Lines (&Fixed);
+		}
+	}
+	printf ("Fixed point kernels (%s): %d of %d counts differ from the scalar one\n",(BestKernel == FIXED_KERNEL_AVX512) ? "scalar, AVX2 and AVX-512" : ((BestKernel == FIXED_KERNEL_AVX2) ? "scalar and AVX2" : "scalar only"),Mismatches,Checks);
+	return (Mismatches == 0);
+}
+
+void Order_Catalog_Strongest_First (struct Transition *SearchingCatalog, int CatalogTransitions)
+{
+//Sorts the catalog by the Intensity already filled in (see Calculate_Intensities), strongest first, so the lines most likely to decide a point are counted first
+	qsort (SearchingCatalog, CatalogTransitions, sizeof(struct Transition), Catalog_Comparator_Intensity);
+}
+
+int Sort_Exp_Lines (double *ExperimentalLines, int ExperimentalLineCount, double **SortedLines)
+{
+//Allocates an ascending copy of the experimental lines for the sorted scores, the caller's array is left alone
+	*SortedLines = malloc (ExperimentalLineCount*sizeof(double));
+	if (*SortedLines == NULL) {
+		printf ("Error allocating sorted experimental lines\n");
+		return 0;
+	}
+	memcpy (*SortedLines, ExperimentalLines, ExperimentalLineCount*sizeof(double));
+	qsort (*SortedLines, ExperimentalLineCount, sizeof(double), Comparator_Double);
+	return 1;
+}
+
+/*
+	Incremental scoring along the C sweep
+	-Stepping C only nudges each frequency, so each catalog line keeps a cursor to the lowest experimental line that isn't more than Tolerance below it
+	-Start_Incremental_Score places every cursor with a binary search, Update_Incremental_Score only walks them across the lines they moved past
+	-Cursors are per catalog line, so lines overtaking each other in frequency doesn't matter, call Start again whenever the constants jump (new B row etc.)
+	-Wins is the CountWins score, WinsExp the CountWins_Exp score for the (ascending) lines
+*/
+
+int Initialize_Incremental_Score (struct Incremental_Score *Score, double *SortedLines, int LineCount, int CatalogTransitions, double Tolerance, int Weighted)
+{
+//SortedLines must be ascending and stay alive while Score is used, Weighted also tracks WinsExp
+	Score->Lines = SortedLines;
+	Score->LineCount = LineCount;
+	Score->CatalogTransitions = CatalogTransitions;
+	Score->Tolerance = Tolerance;
+	Score->Weighted = Weighted;
+	Score->Wins = 0.0;
+	Score->WinsExp = 0.0;
+	Score->Moves = 0.0;
+	Score->Cursor = malloc (CatalogTransitions*sizeof(int));
+	Score->Weight = malloc (CatalogTransitions*sizeof(double));
+	if ((Score->Cursor == NULL) || (Score->Weight == NULL)) {
+		printf ("Error allocating incremental score for %d transitions\n",CatalogTransitions);
+		free (Score->Cursor);
+		free (Score->Weight);
+		Score->Cursor = NULL;
+		Score->Weight = NULL;
+		return 0;
+	}
+	return 1;
+}
+
+void Free_Incremental_Score (struct Incremental_Score *Score)
+{
+	free (Score->Cursor);
+	free (Score->Weight);
+	Score->Cursor = NULL;
+	Score->Weight = NULL;
+}
+
+void Start_Incremental_Score (struct Incremental_Score *Score, struct Transition *SourceCatalog)
+{
+//Places every cursor from scratch and recomputes both scores
+int i,Bottom,Top,Middle;
+double Frequency;
+	Score->Wins = 0.0;
+	Score->WinsExp = 0.0;
+	for (i=0;i<Score->CatalogTransitions;i++) {
+		Frequency = SourceCatalog[i].Frequency;
+		Bottom = 0;
+		Top = Score->LineCount;
+		while (Bottom < Top) {	//First line that isn't Tolerance or more below the frequency, same test the walk in Update uses
+			Middle = (Bottom+Top)/2;
+			if ((Score->Lines[Middle] < Frequency) && (Frequency-Score->Lines[Middle] >= Score->Tolerance)) Bottom = Middle+1;
+			else Top = Middle;
+		}
+		Score->Cursor[i] = Bottom;
+		Score->Weight[i] = Incremental_Line_Weight (Score, Bottom, Frequency);
+		if (Score->Weight[i] >= 0.0) {
+			Score->Wins++;
+			Score->WinsExp += Score->Weight[i];
+		}
+	}
+}
+
+void Update_Incremental_Score (struct Incremental_Score *Score, struct Transition *SourceCatalog)
+{
+//Moves each cursor to the catalog's new frequencies and adjusts the scores by whatever changed
+int i,j;
+double Frequency,Weight;
+	for (i=0;i<Score->CatalogTransitions;i++) {
+		Frequency = SourceCatalog[i].Frequency;
+		j = Score->Cursor[i];
+		while ((j < Score->LineCount) && (Score->Lines[j] < Frequency) && (Frequency-Score->Lines[j] >= Score->Tolerance)) j++;
+		while ((j > 0) && !((Score->Lines[j-1] < Frequency) && (Frequency-Score->Lines[j-1] >= Score->Tolerance))) j--;
+		Score->Moves += abs(j-Score->Cursor[i]);
+		Score->Cursor[i] = j;
+		Weight = Incremental_Line_Weight (Score, j, Frequency);
+		if ((Weight >= 0.0) != (Score->Weight[i] >= 0.0)) Score->Wins += (Weight >= 0.0) ? 1.0 : -1.0;
+		if (Score->Weighted) Score->WinsExp += ((Weight >= 0.0) ? Weight : 0.0)-((Score->Weight[i] >= 0.0) ? Score->Weight[i] : 0.0);
+		Score->Weight[i] = Weight;
+	}
+}
+
+double Incremental_Line_Weight (struct Incremental_Score *Score, int Cursor, double Frequency)
+{
+//Contribution of one catalog line, -1 if the line under its cursor is out of tolerance. Only matched/unmatched (0) is worked out unless Weighted
+	if ((Cursor >= Score->LineCount) || !(fabs(Score->Lines[Cursor]-Frequency) < Score->Tolerance)) return -1.0;
+	return Score->Weighted ? exp(-fabs(Score->Lines[Cursor]-Frequency)) : 0.0;
+}
+
+/*
+	Fixed point scoring
+	-Frequencies become floor((f-Low)*Scale) with FIXED_POINT_STEPS codes per Tolerance, so a match is an integer compare of |code difference| against Reach
+	-Flooring moves a difference by less than one code, every true match passes and so do near misses out to Tolerance*(1+1/FIXED_POINT_STEPS)
+	-Count_Fixed_Wins is then an upper bound on CountWins (and CountWins_Exp), exact scores need a double precision pass over whatever the bound can't rule out
+	-The score doesn't care about catalog order, so the codes are counting sorted into about one bucket per catalog line and each group of FIXED_POINT_LANES catalog lines only spans a narrow band
+	-Each group goes against one broadcast experimental line at a time from its band, hit masks are ORed together and popcounted
+	-Count_Fixed_Wins runs the AVX-512 or AVX2 kernel when the CPU has it (checked once in Initialize_Fixed_Lines), otherwise a plain loop over the lanes
+	-The vector kernels are compiled with target attributes so a plain build still has them, every kernel gives the same count (see Test_Fixed_Point_Kernels)
+*/
+
+int Initialize_Fixed_Lines (struct Fixed_Lines *Fixed, double *SortedLines, int LineCount, int CatalogTransitions, double Tolerance)
+{
+//SortedLines must be ascending, they're copied into codes so they don't need to outlive Fixed
+int i;
+	if ((LineCount < 1) || (CatalogTransitions < 1) || !(Tolerance > 0.0)) {
+		printf ("Error: Initialize_Fixed_Lines needs at least one line, one catalog transition and a positive tolerance\n");
+		return 0;
+	}
+	Fixed->LineCount = LineCount;
+	Fixed->CatalogTransitions = CatalogTransitions;
+	Fixed->Groups = (CatalogTransitions+FIXED_POINT_LANES-1)/FIXED_POINT_LANES;
+	Fixed->Low = SortedLines[0]-Tolerance;
+	Fixed->Scale = FIXED_POINT_STEPS/Tolerance;
+	Fixed->Reach = FIXED_POINT_STEPS;
+	Fixed->Kernel = Fixed_Best_Kernel ();
+	if ((SortedLines[LineCount-1]-Fixed->Low)*Fixed->Scale >= FIXED_POINT_FAR/2) {
+		printf ("Error: Lines span too many tolerances for fixed point codes, %f to %f at %f\n",SortedLines[0],SortedLines[LineCount-1],Tolerance);
+		return 0;
+	}
+	Fixed->Codes = malloc (LineCount*sizeof(int));
+	Fixed->Catalog = malloc ((Fixed->Groups*FIXED_POINT_LANES+1)*sizeof(int));
+	Fixed->Shift = 0;
+	while (ldexp ((SortedLines[LineCount-1]-Fixed->Low)*Fixed->Scale, -Fixed->Shift) > CatalogTransitions) Fixed->Shift++;	//Codes are under FIXED_POINT_FAR/2 here, so this stops well before Shift reaches 31
+	Fixed->BucketCount = (int) ldexp ((SortedLines[LineCount-1]-Fixed->Low)*Fixed->Scale, -Fixed->Shift) + 2;
+	Fixed->Scratch = malloc ((CatalogTransitions+1)*sizeof(int));
+	Fixed->Buckets = malloc ((Fixed->BucketCount+1)*sizeof(int));
+	Fixed->GroupFirst = malloc ((Fixed->Groups+1)*sizeof(int));
+	Fixed->GroupLast = malloc ((Fixed->Groups+1)*sizeof(int));
+	if ((Fixed->Codes == NULL) || (Fixed->Catalog == NULL) || (Fixed->Scratch == NULL) || (Fixed->Buckets == NULL) || (Fixed->GroupFirst == NULL) || (Fixed->GroupLast == NULL)) {
+		printf ("Error: Unable to allocate fixed point lines\n");
+		Free_Fixed_Lines (Fixed);
+		return 0;
+	}
+	for (i=0;i<LineCount;i++) Fixed->Codes[i] = Fixed_Code (Fixed, SortedLines[i]);
+	for (i=CatalogTransitions;i<Fixed->Groups*FIXED_POINT_LANES;i++) Fixed->Catalog[i] = FIXED_POINT_FAR;		//Padding, never within reach of a line
+	return 1;
+}
+
+void Free_Fixed_Lines (struct Fixed_Lines *Fixed)
+{
+	free (Fixed->Codes);
+	free (Fixed->Catalog);
+	free (Fixed->Scratch);
+	free (Fixed->Buckets);
+	free (Fixed->GroupFirst);
+	free (Fixed->GroupLast);
+	Fixed->Codes = NULL;
+	Fixed->Catalog = NULL;
+	Fixed->Scratch = NULL;
+	Fixed->Buckets = NULL;
+	Fixed->GroupFirst = NULL;
+	Fixed->GroupLast = NULL;
+}
+
+int Fixed_Code (struct Fixed_Lines *Fixed, double Frequency)
+{
+//Clamped to +-FIXED_POINT_FAR so code differences can't overflow, NaN frequencies land at the bottom
+double X;
+	X = floor ((Frequency-Fixed->Low)*Fixed->Scale);
+	if (!(X > -FIXED_POINT_FAR)) return -FIXED_POINT_FAR;
+	if (X > FIXED_POINT_FAR) return FIXED_POINT_FAR;
+	return (int) X;
+}
+
+int Fixed_Bucket (struct Fixed_Lines *Fixed, int Code)
+{
+//Coarse bucket for the counting sort, lines off either end of the band share the end buckets
+	if (Code < 0) return 0;
+	Code >>= Fixed->Shift;
+	return (Code < Fixed->BucketCount) ? Code : Fixed->BucketCount-1;
+}
+
+void Encode_Fixed_Catalog (struct Fixed_Lines *Fixed, struct Transition *SourceCatalog)
+{
+//Codes the catalog, counting sorts the codes into coarse buckets and works out which experimental lines each group of catalog lines can reach
+int g,i,Low,High,First,Last;
+	memset (Fixed->Buckets, 0, (Fixed->BucketCount+1)*sizeof(int));
+	for (i=0;i<Fixed->CatalogTransitions;i++) {
+		Fixed->Scratch[i] = Fixed_Code (Fixed, SourceCatalog[i].Frequency);
+		Fixed->Buckets[Fixed_Bucket (Fixed, Fixed->Scratch[i])+1]++;
+	}
+	for (i=0;i<Fixed->BucketCount;i++) Fixed->Buckets[i+1] += Fixed->Buckets[i];
+	for (i=0;i<Fixed->CatalogTransitions;i++) Fixed->Catalog[Fixed->Buckets[Fixed_Bucket (Fixed, Fixed->Scratch[i])]++] = Fixed->Scratch[i];
+	First = 0;
+	Last = 0;
+	for (g=0;g<Fixed->Groups;g++) {
+		//Bucket edges rather than the group's own min/max so both ends only ever move up, the end buckets reach off the band
+		Low = Fixed_Bucket (Fixed, Fixed->Catalog[g*FIXED_POINT_LANES]);
+		i = ((g+1)*FIXED_POINT_LANES < Fixed->CatalogTransitions) ? (g+1)*FIXED_POINT_LANES-1 : Fixed->CatalogTransitions-1;
+		High = Fixed_Bucket (Fixed, Fixed->Catalog[i]);
+		Low = (Low == 0) ? -FIXED_POINT_FAR : (Low << Fixed->Shift)-Fixed->Reach;
+		High = (High == Fixed->BucketCount-1) ? FIXED_POINT_FAR : ((High+1) << Fixed->Shift)+Fixed->Reach;
+		while ((First < Fixed->LineCount) && (Fixed->Codes[First] < Low)) First++;
+		if (Last < First) Last = First;
+		while ((Last < Fixed->LineCount) && (Fixed->Codes[Last] < High)) Last++;
+		Fixed->GroupFirst[g] = First;
+		Fixed->GroupLast[g] = Last;
+	}
+}
+
+unsigned int Fixed_Group_Hits (struct Fixed_Lines *Fixed, int Group)
+{
+//Bit i is set if catalog line Group*FIXED_POINT_LANES+i is within Reach of any experimental line in the group's range, scalar reference for the vector kernels
+int *Catalog;
+int i,j;
+unsigned int Hits;
+	Catalog = Fixed->Catalog + Group*FIXED_POINT_LANES;
+	Hits = 0;
+	for (j=Fixed->GroupFirst[Group];j<Fixed->GroupLast[Group];j++) {
+		for (i=0;i<FIXED_POINT_LANES;i++) {
+			if (abs(Catalog[i]-Fixed->Codes[j]) <= Fixed->Reach) Hits |= 1u << i;
+		}
+		if (Hits == 0xFFFF) break;
+	}
+	return Hits;
+}
+
+int Fixed_Best_Kernel (void)
+{
+//Fastest FIXED_KERNEL_* this CPU can run
+#ifdef FIXED_POINT_X86
+	if (__builtin_cpu_supports ("avx512f")) return FIXED_KERNEL_AVX512;
+	if (__builtin_cpu_supports ("avx2")) return FIXED_KERNEL_AVX2;
+#endif
+	return FIXED_KERNEL_SCALAR;
+}
+
+int Count_Fixed_Wins_Scalar (struct Fixed_Lines *Fixed)
+{
+int g,Wins;
+	Wins = 0;
+	for (g=0;g<Fixed->Groups;g++) Wins += __builtin_popcount (Fixed_Group_Hits (Fixed, g));
+	return Wins;
+}
+
+#ifdef FIXED_POINT_X86
+__attribute__((target("avx2"))) int Count_Fixed_Wins_AVX2 (struct Fixed_Lines *Fixed)
+{
+//Same count as Count_Fixed_Wins_Scalar, each group is two registers of 8 lanes compared against one broadcast line at a time
+__m256i CodesLow,CodesHigh,Limit,Line;
+int *Catalog;
+int g,j,Wins;
+unsigned int Hits;
+	Limit = _mm256_set1_epi32 (Fixed->Reach+1);
+	Wins = 0;
+	for (g=0;g<Fixed->Groups;g++) {
+		Catalog = Fixed->Catalog + g*FIXED_POINT_LANES;
+		CodesLow = _mm256_loadu_si256 ((__m256i *) Catalog);
+		CodesHigh = _mm256_loadu_si256 ((__m256i *) (Catalog+8));
+		Hits = 0;
+		for (j=Fixed->GroupFirst[g];j<Fixed->GroupLast[g];j++) {
+			Line = _mm256_set1_epi32 (Fixed->Codes[j]);
+			Hits |= (unsigned int) _mm256_movemask_ps (_mm256_castsi256_ps (_mm256_cmpgt_epi32 (Limit, _mm256_abs_epi32 (_mm256_sub_epi32 (CodesLow, Line)))));
+			Hits |= ((unsigned int) _mm256_movemask_ps (_mm256_castsi256_ps (_mm256_cmpgt_epi32 (Limit, _mm256_abs_epi32 (_mm256_sub_epi32 (CodesHigh, Line)))))) << 8;
+			if (Hits == 0xFFFF) break;
+		}
+		Wins += __builtin_popcount (Hits);
+	}
+	return Wins;
+}
+
+__attribute__((target("avx512f"))) int Count_Fixed_Wins_AVX512 (struct Fixed_Lines *Fixed)
+{
+//Same count as Count_Fixed_Wins_Scalar, each group is one register of 16 lanes
+__m512i Codes,Reach;
+int g,j,Wins;
+unsigned int Hits;
+	Reach = _mm512_set1_epi32 (Fixed->Reach);
+	Wins = 0;
+	for (g=0;g<Fixed->Groups;g++) {
+		Codes = _mm512_loadu_si512 ((void *) (Fixed->Catalog + g*FIXED_POINT_LANES));
+		Hits = 0;
+		for (j=Fixed->GroupFirst[g];j<Fixed->GroupLast[g];j++) {
+			Hits |= _mm512_cmple_epi32_mask (_mm512_abs_epi32 (_mm512_sub_epi32 (Codes, _mm512_set1_epi32 (Fixed->Codes[j]))), Reach);
+			if (Hits == 0xFFFF) break;
+		}
+		Wins += __builtin_popcount (Hits);
+	}
+	return Wins;
+}
+#endif
+
+int Count_Fixed_Wins (struct Fixed_Lines *Fixed)
+{
+//Upper bound on CountWins for the catalog last passed to Encode_Fixed_Catalog, from the kernel in Fixed->Kernel
+#ifdef FIXED_POINT_X86
+	if (Fixed->Kernel == FIXED_KERNEL_AVX512) return Count_Fixed_Wins_AVX512 (Fixed);
+	if (Fixed->Kernel == FIXED_KERNEL_AVX2) return Count_Fixed_Wins_AVX2 (Fixed);
+#endif
+	return Count_Fixed_Wins_Scalar (Fixed);
+}
+
 int Find_Wins_No_Double_Nearest (double *ExperimentalFrequencies, int ExperimentalLines, struct Transition *SourceCatalog, int CatalogTransitions, double Tolerance, struct Transition **FrequencyList, int Count, double **FittingFrequencies) 
 {
 double LastWin,LastExp,Test;
@@ -746,10 +2565,9 @@ int i,j,Wins;
 //General Functions
 void insertionSort_Saves(struct MultiSave *SavestoSort, int SaveCount) 
 { 
-//Insertion sort for sorting the saves
+//Insertion sort for sorting the saves, the searches now use the heap functions in Fitter.h instead
 struct MultiSave Key;
 int i, j; 
-	SaveCount++;
 	for (i=1;i<SaveCount;i++) { 
 		Key = SavestoSort[i]; 
         j = i - 1; 
@@ -763,10 +2581,9 @@ int i, j;
 
 void insertionSort_Saves_Descending(struct MultiSave *SavestoSort, int SaveCount) 
 { 
-//Insertion sort for sorting the saves
+//Insertion sort for sorting the saves, the searches now use the heap functions in Fitter.h instead
 struct MultiSave Key;
 int i, j; 
-	SaveCount++;
 	for (i=1;i<SaveCount;i++) { 
 		Key = SavestoSort[i]; 
         j = i - 1; 
@@ -836,6 +2653,31 @@ Error:
 	printf ("Error: Unable to open save file");
 	return 0;	
 }
+int Save_Profile_Saves (char *FileName, int Size, struct Profile_Save *SavestoSave, double *Tolerances)
+{
+//Text version of the profile saves, a header line of tolerances then Score A B C followed by the CountWins and CountWins_Exp scores at each tolerance
+int i,t;
+FILE *FileHandle;
+	
+	FileHandle = NULL;
+	FileHandle = fopen (FileName, "w");
+	if (FileHandle == NULL) goto Error;
+	if (Size > 0) {
+		fprintf (FileHandle,"#Score\tA\tB\tC");
+		for (t=0;t<SavestoSave[0].ToleranceCount;t++) fprintf (FileHandle,"\tWins@%.3f\tExp@%.3f",Tolerances[t],Tolerances[t]);
+		fprintf (FileHandle,"\n");
+	}
+	for (i=0;i<Size;i++) {
+		fprintf (FileHandle,"%.3f\t%.2f\t%.2f\t%.2f",SavestoSave[i].Score,SavestoSave[i].A,SavestoSave[i].B,SavestoSave[i].C);
+		for (t=0;t<SavestoSave[i].ToleranceCount;t++) fprintf (FileHandle,"\t%.0f\t%.3f",SavestoSave[i].Wins[t],SavestoSave[i].WinsExp[t]);
+		fprintf (FileHandle,"\n");
+	}
+	fclose(FileHandle);
+	return 1;
+Error:
+	printf ("Error: Unable to open save file");
+	return 0;	
+}
 
 int Build_Axis_Linear (struct Axis *TargetAxis, double AxisStart, double AxisStepSize, unsigned int AxisSteps)
 {
@@ -873,6 +2715,7 @@ int Pick_Four (int InputSize, int ***Return, int *ReturnSize)
 /*
   
  Builds an array of all possible combinations of 4 input lines
+ Kept for older callers, the searches use a Combination from Fitter.h instead which doesn't need the array
   
 */
 int i,j,k,l,Binomial,Count;
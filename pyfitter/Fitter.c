@@ -4,11 +4,11 @@ Built by Brandon Carroll 4/7/19 All Rights Reserved
 Generic version of the fitting program
 
 Build Command:
-gcc -Wall -o Go Fitter.c -lm -lgsl -lgslcblas -O3 -funroll-loops
+gcc -Wall -o Go Fitter.c -lm -lgsl -lgslcblas -pthread -O3 -funroll-loops
 gcc -Wall -o Go Fitter.c -lm -O3 -funroll-loops
 
 Ctypes Shared Lib:
-gcc -Wall -o Fitter.so -shared -fPIC -O3 -funroll-loops Fitter.c -lm -lgsl -lgslcblas
+gcc -Wall -o Fitter.so -shared -fPIC -O3 -funroll-loops Fitter.c -lm -lgsl -lgslcblas -pthread
 */
 
 #include <math.h>
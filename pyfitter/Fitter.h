@@ -6,13 +6,66 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <unistd.h>
+#include <pthread.h>
 #include <gsl/gsl_vector.h>
 #include <gsl/gsl_blas.h>
 #include <gsl/gsl_matrix.h>
 #include <gsl/gsl_multifit_nlinear.h>
 #include <gsl/gsl_linalg.h>
+#include <gsl/gsl_machine.h>
 
 #define MAXLINESIZE 50000000	// A hard limit on the load buffer size, can cause issues on low RAM systems	
+#define CHECKPOINT_MAGIC 0x43544946	//"FITC" in little endian, first four bytes of every checkpoint file
+#define CHECKPOINT_VERSION 2
+#define CHECKPOINT_FIT_FOUR 1		//SearchType values, so a checkpoint can't be resumed by the wrong search
+#define CHECKPOINT_DR_HITS 2
+#define HIT_MAGIC 0x54494846		//"FHIT", first four bytes of every binary hit file
+#define HIT_VERSION 1
+#define HIT_MAX_LINES 8			//Most fitted transitions recorded per hit, fits with more lines only keep the first HIT_MAX_LINES
+#define MAX_COMBINATION 16		//Largest subset size a Combination can enumerate
+#define MAX_TOLERANCES 8		//Most tolerances a multi tolerance search scores at once
+#define FIT_CACHE_MAX_LINES 8	//Fits with more lines than this bypass the fit cache
+#define FIT_CACHE_SIZE 65536		//Entries in the fit cache each search allocates, roughly 14MB
+#define KAPPA_PROFILE_MAX_LINES 5	//Most lines the kappa profile solver takes, SBFIT_Profile hands anything bigger to SBFIT
+#define KAPPA_PROFILE_MAX_SOLUTIONS 8
+#define KAPPA_PROFILE_POINTS 32		//Kappa scan intervals, roots closer together than 2/KAPPA_PROFILE_POINTS can be missed
+#define KAPPA_PROFILE_EDGE 1e-6		//Scan stops this far short of |Kappa| = 1
+#define KAPPA_PROFILE_TOLERANCE 1e-12
+#define KAPPA_PROFILE_SLOPE_STEP 1e-7	//Forward difference step for dE_tau/dKappa, the scan stops far enough short of 1 for it
+#define KAPPA_PROFILE_MAX_STEPS 100	//Safety net only, a bracket always converges well before this
+#define SMALL_LM_MAX_LINES 8		//Most residuals Small_LM_Fit takes, its arrays are sized for this
+#define SMALL_LM_MAX_REJECTS 15		//Rejected steps in a row before Small_LM_Fit gives up, same as GSL's trust region
+#define FIT_METHOD_GSL 0		//FitMethod values for SBFIT_Method and the searches that take one
+#define FIT_METHOD_PROFILE 1
+#define FIT_METHOD_SMALL_LM 2
+#define CANDIDATE_MAX_TARGETS 8	//Most target transitions a Candidate_Stream takes, same as the most lines the small LM fits
+#define FEASIBILITY_KAPPA_BINS 16	//Feasibility cells are FEASIBILITY_KAPPA_BINS x FEASIBILITY_RATIO_BINS in (Kappa, (A-C)/(A+C))
+#define FEASIBILITY_RATIO_BINS 4
+#define FEASIBILITY_SAMPLES 16		//Kappa samples per bin when the bounds are set up
+#define FEASIBILITY_MAX_PAIRS (CANDIDATE_MAX_TARGETS*(CANDIDATE_MAX_TARGETS-1)/2)
+#define CLUSTER_MAX_LINES 32		//Distinct supporting lines kept per solution cluster, any past this are only counted
+#define CLUSTER_RADIUS 0.5		//Suggested radius (MHz) for the four line search to merge fits within, clustering is off unless a radius is passed
+#define BATCH_CHUNK 16			//Problems an SBFIT_Batch thread takes off the pool at a time
+#define MODEL_MAX_PARAMETERS 8		//A, B, C and up to five distortion terms in a Rotor_Model
+#define MODEL_SLOPE_STEP 1e-6		//Central difference step for dE_tau/dKappa of the closed form levels
+#define DJ_SCALE (-29979.2458)		//Level shift per unit DJ and DJCoeffs.txt slope, the speed of light in MHz per cm-1 (DJ_Shift, Add_DJ_Term)
+#define TELEMETRY_DIRECT 0			//Fit_Telemetry sources, fits made outside the searches below
+#define TELEMETRY_TRIPLES 1			//Triples fitters and Fit_Candidate_Stream
+#define TELEMETRY_FOUR_LINE 2		//Brute_Force_Fit_Four_Shard
+#define TELEMETRY_BATCH 3			//SBFIT_Batch
+#define TELEMETRY_DR_HITS 4			//Search_DR_Hits
+#define TELEMETRY_SOURCES 5
+#define TELEMETRY_STOP_CAP 0		//Fit_Telemetry stop reasons, hit the iteration cap
+#define TELEMETRY_STOP_XTOL 1		//Small step, GSL's info 1
+#define TELEMETRY_STOP_GTOL 2		//Small gradient, GSL's info 2
+#define TELEMETRY_STOP_ERROR 3		//Driver error or no progress, or no solution from the kappa profile
+#define TELEMETRY_STOP_DIRECT 4		//Solved without iterating (kappa profile)
+#define TELEMETRY_STOP_REASONS 5
+#define TELEMETRY_ITERATION_BINS 256	//One bin per iteration count, the last also takes anything past it
+#define TELEMETRY_EVALUATION_BINS 256	//Same for residual evaluations
+#define TELEMETRY_TIME_BINS 40		//Bin i is [2^i,2^(i+1)) ns
+#define TELEMETRY_COUNTERS ((int) (sizeof(struct Fit_Telemetry)/sizeof(long long)))
 
 //=============Structures==============
 struct Level
@@ -67,8 +120,352 @@ struct GSL_Bundle
 	gsl_multifit_nlinear_parameters fdf_params;
 };
 
+struct MultiSave 
+{
+	double Score;
+	double A;
+	double B;
+	double C;
+};
+
+struct Profile_Save
+{
+	//Save from a multi tolerance search, Score is the profile entry the search ranks by
+	double Score;
+	double A;
+	double B;
+	double C;
+	int ToleranceCount;
+	double Wins[MAX_TOLERANCES];		//CountWins score at each tolerance
+	double WinsExp[MAX_TOLERANCES];		//CountWins_Exp score at each tolerance
+};
+
+struct Hit_Record
+{
+	//One accepted fit in a binary hit file, fixed size so a file is just a header followed by a flat array of these
+	double Constants[3];				//Fitted A/B/C
+	double ChiSqr;
+	double Score;						//Score of the grid point the fit started from
+	int GridIndex[3];					//A/B/C grid indices of that grid point
+	int LineCount;						//# of transitions in the fit
+	unsigned int Upper[HIT_MAX_LINES];	//Dictionary indices of each fitted transition's levels
+	unsigned int Lower[HIT_MAX_LINES];
+	double Frequency[HIT_MAX_LINES];	//Experimental frequency each transition was assigned to
+};
+
+struct Combination
+{
+	//Lazy k-combination of the indices 0..N-1 in lexicographic order, only the current tuple is stored
+	int N;
+	int K;
+	int Index[MAX_COMBINATION];	//Current tuple, strictly increasing
+	double Rank;				//Position of the current tuple in the full enumeration
+	double Last;				//Enumeration stops before this rank, so a range of the space can be handed to a thread
+};
+
+struct Hit_File_Header
+{
+	unsigned int Magic;
+	unsigned int Version;
+	int RecordSize;
+	int MaxLines;
+};
+
+struct Result_Sink
+{
+	//Binary hit file shared by every thread of a search, only touched under Lock
+	FILE *FileHandle;
+	char *FileName;
+	pthread_mutex_t Lock;
+	double Records;
+};
+
+struct Hit_Buffer
+{
+	//Per thread buffer of hits, filled without locking and written to the sink in one block when full
+	struct Hit_Record *Records;
+	int Count;
+	int Size;
+	struct Result_Sink *Sink;
+};
+
+struct Line_Index
+{
+	//Experimental lines bucketed by frequency, so the lines within Tolerance of any frequency are found without a search
+	double *Source;			//Array the index was built from
+	double *Lines;			//Lines grouped by bucket, ascending within each bucket
+	int *Order;				//Position of each entry of Lines in Source
+	int *Start;				//Bucket b holds Lines[Start[b]] to Lines[Start[b+1]-1]
+	int LineCount;
+	int BucketCount;
+	double Low;				//Lower edge of bucket 0, the lowest line
+	double Width;			//At least twice the tolerance, so a +/-Tolerance window touches at most two buckets
+	double Tolerance;
+};
+
+struct Fit_Cache_Entry
+{
+	//One memoized fit, the key is the (transition, experimental line) pairs sorted so the order they were picked in doesn't matter
+	unsigned int Upper[FIT_CACHE_MAX_LINES];
+	unsigned int Lower[FIT_CACHE_MAX_LINES];
+	double Frequency[FIT_CACHE_MAX_LINES];
+	int LineCount;
+	int FitMethod;			//Fitters don't all land on the same answer, so each caches its own
+	double Guess[3];		//Starting point for 3 line profile fits, zero for everything else (see Fit_Cache_Key)
+	unsigned long long Hash;
+	double Constants[3];
+	double ChiSqr;
+	int Converged;			//Return value of SBFIT
+	int Next;				//Next entry in the same hash bucket, -1 ends the chain
+	int Newer;				//Neighbours in the LRU list, -1 at either end
+	int Older;
+};
+
+struct Fit_Cache
+{
+	//Fixed size LRU cache of SBFIT results, one per thread since nothing in it is locked
+	struct Fit_Cache_Entry *Entries;
+	int *Buckets;			//Head entry of each hash chain, -1 if empty
+	int Capacity;
+	int BucketMask;			//Bucket count is a power of two, so this picks the bucket from a hash
+	int Count;
+	int Newest;
+	int Oldest;
+	double Lookups;
+	double Hits;
+	double Evictions;
+};
+
+struct Search_Checkpoint
+{
+	//Header of a binary checkpoint file, followed on disk by SaveCount records of SaveSize bytes each
+	unsigned int Magic;
+	unsigned int Version;
+	int SearchType;
+	double Bounds[4];		//AStart/AStop/ConstantsStart/ConstantsStop the search was launched with, used to refuse mismatched resumes
+	double Step;
+	double Tolerance;
+	int ShardIndex;			//Which slice of the grid this search covers, 0 of 1 for an unsharded search
+	int ShardCount;
+	int IndexA;				//Grid cursor, the A/B row the search will evaluate next
+	int IndexB;
+	int Complete;			//Set once the whole grid has been walked
+	double Count;			//Running counters, carried across resumes
+	double BadFits;
+	double Hits;
+	long LogOffset;			//Length of the text log at checkpoint time, anything after this is trimmed on resume
+	int SaveCount;
+	int SaveSize;
+};
+
 typedef double (*ScoreFunction)(struct Transition *, void *);	//Generic function pointer for the scoring function used in the triples fitter
 
+struct Triples_Save
+{
+	//Thread local save in Fit_Triples_Parallel, the flat triple index breaks score ties so the saves don't depend on how the cube was split
+	double Score;
+	double Index;
+	double A;
+	double B;
+	double C;
+};
+
+struct Triples_Task
+{
+	//One thread's slice of the triples cube in Fit_Triples_Parallel, everything it writes is either its own or a disjoint part of a shared array
+	struct Triple *Triples;				//Shared, read only
+	double *Guess;						//Shared, read only, every fit starts from it
+	struct Transition *Catalog;			//Thread's own catalog buffer for scoring, left in the last fit's order so the next sort has little to do
+	int CatalogLines;
+	int *LevelList;						//Shared, read only, every level the catalog uses
+	int LevelCount;
+	double *Energies;					//Thread's own level energies, indexed like the dictionary
+	int FitMethod;
+	struct GSL_Bundle FitBundle;		//Thread's own workspace, only allocated for FIT_METHOD_GSL
+	struct Opt_Bundle OptBundle;		//Thread's own copy of the three fitted transitions
+	ScoreFunction TriplesScoreFunction;
+	void *ScoringParameters;			//Shared, the score function may only read it
+	double First;						//Flat triple indices [First,Last) handled by this thread
+	double Last;
+	double *FitResults;					//Shared, the thread only writes the A/B/C slots of its own triples
+	int SaveCount;
+	struct Triples_Save *Saves;			//Thread local top K, worst first, merged once every thread is done
+	double Iterations;
+	double Errors;
+};
+
+struct Kappa_Profile
+{
+	//Lines being fit by Kappa_Profile_Fit, everything that doesn't depend on Kappa is worked out once in Setup_Kappa_Profile
+	int LineCount;
+	int Upper[KAPPA_PROFILE_MAX_LINES];
+	int Lower[KAPPA_PROFILE_MAX_LINES];
+	int JUpper[KAPPA_PROFILE_MAX_LINES];
+	int JLower[KAPPA_PROFILE_MAX_LINES];
+	double JTerm[KAPPA_PROFILE_MAX_LINES];		//J'(J'+1)-J"(J"+1), the coefficient of (A+C)/2
+	double Frequency[KAPPA_PROFILE_MAX_LINES];
+	double Orientation[KAPPA_PROFILE_MAX_LINES];	//+1 if Upper is the higher level, -1 if the line is really Upper <- Lower
+	struct ETauStruct ETStruct;
+};
+
+struct Kappa_Solution
+{
+	double Constants[3];
+	double Kappa;
+	double ChiSqr;
+};
+
+struct Candidate_Stream
+{
+	//Lazy walk over every tuple of peaks, one from each target transition's window, only the current tuple is stored
+	double *Peaks;									//Ascending peak list the windows index into, not owned
+	int TargetCount;
+	int Start[CANDIDATE_MAX_TARGETS];				//Target t's candidates are Peaks[Start[t]] to Peaks[End[t]-1]
+	int End[CANDIDATE_MAX_TARGETS];
+	int Position[CANDIDATE_MAX_TARGETS];			//Current tuple as positions in Peaks
+	double Frequencies[CANDIDATE_MAX_TARGETS];		//and as frequencies, ready to hand to a fit
+	double Total;									//Product of the window sizes
+	double Rank;									//Position of the current tuple in the full walk
+	double Last;									//Walk stops before this rank
+};
+
+struct Feasibility_Bounds
+{
+	//Per (Kappa,r) cell bounds for a set of target transitions, see Setup_Feasibility_Bounds. Counters aren't locked, one per thread
+	int TargetCount;
+	double Low[CANDIDATE_MAX_TARGETS][FEASIBILITY_KAPPA_BINS*FEASIBILITY_RATIO_BINS];		//Range of |JTerm + r*ETerm| for each target
+	double High[CANDIDATE_MAX_TARGETS][FEASIBILITY_KAPPA_BINS*FEASIBILITY_RATIO_BINS];
+	double PairLow[FEASIBILITY_MAX_PAIRS][FEASIBILITY_KAPPA_BINS*FEASIBILITY_RATIO_BINS];	//Range of line i over line j, pairs (0,1),(0,2)...(1,2)...
+	double PairHigh[FEASIBILITY_MAX_PAIRS][FEASIBILITY_KAPPA_BINS*FEASIBILITY_RATIO_BINS];
+	double ScaleLow;				//Allowed range of (A+C)/2
+	double ScaleHigh;
+	double Tolerance;
+	double Checked;
+	double Rejected;
+};
+
+struct Solution_Cluster
+{
+	//One unique solution, the fits that landed within Radius of its first fit
+	double Center[3];		//First fit, until Recenter_Solution_Clusters moves it to the best one
+	long long Cell[3];		//Grid cell of Center
+	double Constants[3];	//Lowest ChiSqr fit
+	double ChiSqr;
+	double Score;			//Best score of any of the fits
+	double Multiplicity;	//# of fits merged
+	unsigned int Upper[CLUSTER_MAX_LINES];	//Distinct (transition, experimental line) pairs of all the fits
+	unsigned int Lower[CLUSTER_MAX_LINES];
+	double Frequency[CLUSTER_MAX_LINES];
+	int LineCount;
+	double DroppedLines;	//Pairs past CLUSTER_MAX_LINES
+	int Next;				//Next cluster in the same hash bucket, -1 ends the chain
+};
+
+struct Fit_Problem
+{
+	//One independent fit for SBFIT_Batch
+	double Guess[3];			//Starting A/B/C
+	struct Transition *Lines;	//LineCount assigned transitions, only Upper/Lower are used
+	double *Frequencies;		//Experimental frequency each line is fit to
+	double *Weights;			//Weight of each residual (1/sigma^2, as GSL takes them), NULL for an unweighted fit
+	int LineCount;
+};
+
+struct Batch_Pool
+{
+	//Problems and result arrays shared by the SBFIT_Batch threads, Next is the first problem not yet taken and is only touched under Lock
+	struct Fit_Problem *Problems;
+	int ProblemCount;
+	int MaxLines;
+	struct ETauStruct ETStruct;
+	struct Level *MyDictionary;
+	double *Constants;
+	double *ChiSqr;
+	int *Iterations;
+	double *Covariance;
+	int *Status;
+	int Next;
+	pthread_mutex_t Lock;
+};
+
+struct Batch_Worker
+{
+	//One SBFIT_Batch thread, Workspaces[n] is its GSL workspace for n line fits, NULL until it first needs one
+	struct Batch_Pool *Pool;
+	gsl_multifit_nlinear_workspace **Workspaces;
+	gsl_multifit_nlinear_fdf fdf;
+	gsl_multifit_nlinear_parameters fdf_params;
+	struct Opt_Bundle OptBundle;
+	gsl_matrix *Covar;
+	double Converged;
+};
+
+struct Rotor_Model
+{
+	//A/B/C plus terms linear in a per level table, see Add_Model_Term
+	struct ETauStruct ETStruct;
+	struct Level *MyDictionary;
+	int ParameterCount;
+	double *Tables[MODEL_MAX_PARAMETERS-3];		//Tables[k][Level] for parameter k+3, indexed like the dictionary
+	double Scales[MODEL_MAX_PARAMETERS-3];
+};
+
+struct Model_Fit_Bundle
+{
+	//Workspace and lines for fitting a Rotor_Model to LineCount lines, set up once by Initialize_Model_Fit
+	gsl_multifit_nlinear_workspace *Workspace;
+	gsl_multifit_nlinear_fdf fdf;
+	gsl_multifit_nlinear_parameters fdf_params;
+	gsl_matrix *Covariance;
+	struct Rotor_Model *Model;
+	struct Transition *Lines;
+	int LineCount;
+};
+
+struct Fit_Telemetry
+{
+	//Fit counts for one source, every field has to stay a long long (see Merge_Fit_Telemetry) and match pyfitter.Fit_Telemetry
+	long long Fits;
+	long long CacheHits;				//Fits answered by a fit cache instead (see SBFIT_Cached), not counted in Fits
+	long long Capped;					//Fits that hit their iteration cap
+	long long Iterations;
+	long long FunctionEvaluations;
+	long long JacobianEvaluations;
+	long long Nanoseconds;
+	long long StopReasons[TELEMETRY_STOP_REASONS];
+	long long IterationHistogram[TELEMETRY_ITERATION_BINS];
+	long long EvaluationHistogram[TELEMETRY_EVALUATION_BINS];
+	long long TimeHistogram[TELEMETRY_TIME_BINS];
+};
+
+struct Solution_Clusters
+{
+	//Grid hash of Solution_Cluster over (A,B,C) in Radius wide cells, see Add_Cluster_Fit. Not locked, one per thread
+	struct Solution_Cluster *Clusters;
+	int *Buckets;			//Head cluster of each hash chain, -1 if empty
+	int Count;
+	int Capacity;
+	int BucketMask;
+	double Radius;
+	double Fits;
+};
+
+struct Triples_Verifier
+{
+	//Small catalog every triples fit is scored on in place of the full catalog, see Setup_Triples_Verifier
+	struct Transition *Catalog;		//Verification transitions, Frequency is refilled by Fill_Triples_Verifier for each fit
+	int LineCount;
+	int *UpperSlot;					//Where each transition's levels are in the level arrays
+	int *LowerSlot;
+	int *LevelJ;					//J and E_tau index of every level the transitions use
+	int *LevelIndex;
+	double *Energies;				//Scratch, one per level
+	int LevelCount;
+	struct ETauStruct ETStruct;
+	struct Line_Index Index;		//Experimental peaks
+	double Threshold;				//Score to beat, Fit_Triples_Verified keeps it at the worst save so Score_Verification_Wins can stop early
+};
+
 //=============Function Prototypes==============
 
 //Program setup functions
@@ -123,6 +520,7 @@ void Initialize_Triples_Fitter (struct GSL_Bundle * /*FitBundle*/, struct Opt_Bu
 void Initialize_Triples_Fitter_Alloc (struct GSL_Bundle * /*FitBundle*/, struct Opt_Bundle * /*MyOpt_Bundle*/);
 int OptFunc_gsl (const gsl_vector */*x*/, void */*params*/, gsl_vector */*f*/);
 int Fit_Triples_Bundle (struct Triple /*TransitionstoFit*/, double */*Guess*/, double **/*FitResults*/, struct Transition **/*Catalog*/, int /*CatalogLines*/, struct GSL_Bundle */*FitBundle*/, struct Opt_Bundle /*MyOpt_Bundle*/, ScoreFunction /*TriplesScoreFunction*/, void */*ScoringParameters*/);
+int Fit_Triples_Bundle_Method (struct Triple /*TransitionstoFit*/, double */*Guess*/, double **/*FitResults*/, struct Transition **/*Catalog*/, int /*CatalogLines*/, struct GSL_Bundle */*FitBundle*/, struct Opt_Bundle /*MyOpt_Bundle*/, ScoreFunction /*TriplesScoreFunction*/, void */*ScoringParameters*/, int /*FitMethod*/, struct Feasibility_Bounds * /*Bounds*/);
 void callback (const size_t /*iter*/, void */*params*/, const gsl_multifit_nlinear_workspace */*w*/);
 int Initialize_SBFIT (struct GSL_Bundle * /*FitBundle*/, struct Opt_Bundle * /*MyOpt_Bundle*/);
 int Initialize_SBFIT_Alloc (struct GSL_Bundle * /*FitBundle*/, struct Opt_Bundle * /*MyOpt_Bundle*/);
@@ -132,8 +530,178 @@ int SBFIT_OptFunc_gsl (const gsl_vector * /*x*/, void * /*params*/, gsl_vector *
 
 //DR Search functions
 int Search_DR_Hits (int /*DRPairs*/, double /*ConstStart*/, double /*ConstStop*/, double /*Step*/, double */*DRFrequency*/, double /*Tolerance*/, int /*ExtraLineCount*/, double */*ExtraLines*/, int **/*DRLinks*/, int /*LinkCount*/, struct Transition */*CatalogtoFill*/, int /*CatLines*/, int /*Verbose*/, struct ETauStruct /*ETStruct*/, struct Level * /*MyDictionary*/, char * /*FileName*/);
+int Search_DR_Hits_Checkpoint (int /*DRPairs*/, double /*ConstStart*/, double /*ConstStop*/, double /*Step*/, double */*DRFrequency*/, double /*Tolerance*/, int /*ExtraLineCount*/, double */*ExtraLines*/, int **/*DRLinks*/, int /*LinkCount*/, struct Transition */*CatalogtoFill*/, int /*CatLines*/, int /*Verbose*/, struct ETauStruct /*ETStruct*/, struct Level * /*MyDictionary*/, char * /*FileName*/, char * /*CheckpointFile*/, double /*CheckpointInterval*/, int /*SaveCount*/, struct MultiSave * /*Saves*/);
 int Match_Levels (int /*Match1*/, int /*Match2*/, struct Transition * /*MatchCatalog*/);
 
+//Checkpoint functions
+int Write_Checkpoint (char * /*FileName*/, struct Search_Checkpoint * /*Checkpoint*/, void * /*Saves*/);
+int Read_Checkpoint (char * /*FileName*/, struct Search_Checkpoint * /*Checkpoint*/, void * /*Saves*/, int /*SaveCount*/, int /*SaveSize*/);
+int Checkpoint_Matches (struct Search_Checkpoint * /*Checkpoint*/, int /*SearchType*/, double * /*Bounds*/, double /*Step*/, double /*Tolerance*/, int /*ShardIndex*/, int /*ShardCount*/);
+int Shard_Owns_Row (int /*IndexA*/, int /*IndexB*/, int /*RowsPerA*/, int /*ShardIndex*/, int /*ShardCount*/);
+
+//Top K save functions
+void Initialize_Saves (struct MultiSave * /*Saves*/, int /*SaveCount*/, double /*EmptyScore*/);
+int Allocate_Local_Saves (struct MultiSave * /*Saves*/, int /*SaveCount*/, struct MultiSave ** /*LocalSaves*/);
+int Push_Save (struct MultiSave * /*Saves*/, int /*SaveCount*/, double /*Score*/, double /*A*/, double /*B*/, double /*C*/);
+int Push_Save_Descending (struct MultiSave * /*Saves*/, int /*SaveCount*/, double /*Score*/, double /*A*/, double /*B*/, double /*C*/);
+int Merge_Saves (struct MultiSave * /*Saves*/, int /*SaveCount*/, struct MultiSave * /*LocalSaves*/, int /*LocalCount*/);
+int Merge_Saves_Descending (struct MultiSave * /*Saves*/, int /*SaveCount*/, struct MultiSave * /*LocalSaves*/, int /*LocalCount*/);
+void Heapify_Saves (struct MultiSave * /*Saves*/, int /*SaveCount*/, double /*Sign*/);
+void Sift_Saves (struct MultiSave * /*Saves*/, int /*SaveCount*/, int /*Index*/, double /*Sign*/);
+void Sort_Saves (struct MultiSave * /*Saves*/, int /*SaveCount*/);
+void Sort_Saves_Descending (struct MultiSave * /*Saves*/, int /*SaveCount*/);
+int Compare_Saves (const void * /*a*/, const void * /*b*/);
+int Compare_Saves_Descending (const void * /*a*/, const void * /*b*/);
+void Initialize_Profile_Saves (struct Profile_Save * /*Saves*/, int /*SaveCount*/);
+int Push_Profile_Save (struct Profile_Save * /*Saves*/, int /*SaveCount*/, struct Profile_Save * /*NewSave*/);
+void Sort_Profile_Saves (struct Profile_Save * /*Saves*/, int /*SaveCount*/);
+int Compare_Profile_Saves (const void * /*a*/, const void * /*b*/);
+
+//Combination functions
+double Binomial (int /*N*/, int /*K*/);
+int Start_Combination (struct Combination * /*Comb*/, int /*N*/, int /*K*/, double /*First*/, double /*Last*/);
+int Next_Combination (struct Combination * /*Comb*/);
+void Split_Combinations (double /*Total*/, int /*Part*/, int /*Parts*/, double * /*First*/, double * /*Last*/);
+
+//Hit output functions
+int Open_Result_Sink (char * /*FileName*/, int /*Resume*/, struct Result_Sink * /*Sink*/);
+int Close_Result_Sink (struct Result_Sink * /*Sink*/);
+long Result_Sink_Offset (struct Result_Sink * /*Sink*/);
+int Allocate_Hit_Buffer (struct Result_Sink * /*Sink*/, int /*Size*/, struct Hit_Buffer * /*Buffer*/);
+int Add_Hit (struct Hit_Buffer * /*Buffer*/, double * /*Constants*/, double /*ChiSqr*/, double /*Score*/, int * /*GridIndex*/, struct Transition * /*Lines*/, int /*LineCount*/);
+int Flush_Hit_Buffer (struct Hit_Buffer * /*Buffer*/);
+int Free_Hit_Buffer (struct Hit_Buffer * /*Buffer*/);
+int Load_Hits (char * /*FileName*/, struct Hit_Record ** /*Hits*/, int * /*HitCount*/);
+int Export_Hits_Text (char * /*HitFile*/, char * /*TextFile*/, struct Level * /*MyDictionary*/);
+long Log_Length (char * /*FileName*/);
+int Trim_Log (char * /*FileName*/, long /*Length*/);
+
+//Line index functions
+int Build_Line_Index (double * /*Lines*/, int /*LineCount*/, double /*Tolerance*/, struct Line_Index * /*Index*/);
+void Free_Line_Index (struct Line_Index * /*Index*/);
+void Line_Index_Range (struct Line_Index * /*Index*/, double /*Frequency*/, int * /*First*/, int * /*Last*/);
+int Line_Index_Matches (struct Line_Index * /*Index*/, double /*Frequency*/);
+double Count_Index_Wins (struct Line_Index * /*Index*/, struct Transition * /*SourceCatalog*/, int /*CatalogTransitions*/);
+double Count_Index_Wins_Exp (struct Line_Index * /*Index*/, struct Transition * /*SourceCatalog*/, int /*CatalogTransitions*/);
+double Count_Index_Wins_Bounded (struct Line_Index * /*Index*/, struct Transition * /*SourceCatalog*/, int /*CatalogTransitions*/, double /*Threshold*/);
+double Count_Index_Wins_Exp_Bounded (struct Line_Index * /*Index*/, struct Transition * /*SourceCatalog*/, int /*CatalogTransitions*/, double /*Threshold*/);
+int Count_Index_Wins_Multi (struct Line_Index * /*Index*/, struct Transition * /*SourceCatalog*/, int /*CatalogTransitions*/, double * /*Tolerances*/, int /*ToleranceCount*/, double * /*Wins*/, double * /*WinsExp*/);
+double Score_Catalog_Fused (struct Transition * /*SourceCatalog*/, int /*CatalogTransitions*/, double * /*Constants*/, struct ETauStruct /*ETStruct*/, struct Level * /*MyDictionary*/, struct Line_Index * /*Index*/, int /*Weighted*/, double /*Threshold*/);
+
+//Fit cache functions
+int Initialize_Fit_Cache (struct Fit_Cache * /*Cache*/, int /*Capacity*/);
+void Free_Fit_Cache (struct Fit_Cache * /*Cache*/);
+int Fit_Cache_Key (struct Transition * /*Lines*/, double * /*Frequencies*/, int /*LineCount*/, int /*FitMethod*/, double * /*Guess*/, struct Fit_Cache_Entry * /*Key*/);
+int Fit_Cache_Find (struct Fit_Cache * /*Cache*/, struct Fit_Cache_Entry * /*Key*/);
+void Fit_Cache_Touch (struct Fit_Cache * /*Cache*/, int /*Index*/);
+int Fit_Cache_Lookup (struct Fit_Cache * /*Cache*/, struct Transition * /*Lines*/, double * /*Frequencies*/, int /*LineCount*/, int /*FitMethod*/, double * /*Guess*/, double * /*Constants*/, double * /*ChiSqr*/, int * /*Converged*/);
+int Fit_Cache_Store (struct Fit_Cache * /*Cache*/, struct Transition * /*Lines*/, double * /*Frequencies*/, int /*LineCount*/, int /*FitMethod*/, double * /*Guess*/, double * /*Constants*/, double /*ChiSqr*/, int /*Converged*/);
+int SBFIT_Cached (struct Fit_Cache * /*Cache*/, int /*FitMethod*/, double * /*Guess*/, double * /*ChiSq*/, struct GSL_Bundle * /*FitBundle*/, struct Opt_Bundle /*MyOpt_Bundle*/, double * /*LineFrequencies*/, double [3]/*FinalConstants*/);
+void Print_Fit_Cache_Stats (struct Fit_Cache * /*Cache*/);
+
+//Parallel triples functions
+int Fit_Triples_Parallel (struct Triple /*TransitionstoFit*/, double * /*Guess*/, double ** /*FitResults*/, struct Transition * /*FittingCatalog*/, int /*CatalogLines*/, struct GSL_Bundle * /*FitBundle*/, struct Opt_Bundle /*MyOpt_Bundle*/, ScoreFunction /*TriplesScoreFunction*/, void * /*ScoringParameters*/, int /*FitMethod*/, int /*ThreadCount*/, int /*SaveCount*/, struct MultiSave * /*Saves*/, int /*Verbose*/);
+int Initialize_Triples_Task (struct Triples_Task * /*Task*/, struct Triple * /*Triples*/, double * /*Guess*/, struct Transition * /*FittingCatalog*/, int /*CatalogLines*/, int * /*LevelList*/, int /*LevelCount*/, int /*LevelSlots*/, int /*FitMethod*/, struct GSL_Bundle * /*FitBundle*/, struct Opt_Bundle /*MyOpt_Bundle*/, struct MultiSave * /*Saves*/, int /*SaveCount*/);
+int Make_Catalog_Level_List (struct Transition * /*Catalog*/, int /*CatLines*/, int ** /*LevelList*/, int * /*LevelCount*/);
+int Get_Catalog_Levels (struct Transition * restrict /*CatalogtoFill*/, double * restrict /*Constants*/, int /*CatLines*/, struct ETauStruct /*ETStruct*/, struct Level * /*MyDictionary*/, int * /*LevelList*/, int /*LevelCount*/, double * /*Energies*/);
+void Free_Triples_Task (struct Triples_Task * /*Task*/);
+void *Fit_Triples_Worker (void * /*Arg*/);
+int Push_Triples_Save (struct Triples_Save * /*Saves*/, int /*SaveCount*/, struct Triples_Save * /*NewSave*/);
+int Compare_Triples_Saves (const void * /*a*/, const void * /*b*/);
+
+//Kappa profile functions
+int Setup_Kappa_Profile (struct Kappa_Profile * /*Profile*/, struct Transition * /*Lines*/, double * /*LineFrequencies*/, int /*LineCount*/, struct ETauStruct /*ETStruct*/, struct Level * /*MyDictionary*/);
+void Kappa_Profile_Terms (struct Kappa_Profile * /*Profile*/, double /*Kappa*/, double * /*ETerm*/);
+double Kappa_Profile_Determinant (struct Kappa_Profile * /*Profile*/, double * /*ETerm*/);
+double Kappa_Profile_Residual (struct Kappa_Profile * /*Profile*/, double * /*ETerm*/, double * /*Sum*/, double * /*Difference*/);
+double Kappa_Profile_Slope (struct Kappa_Profile * /*Profile*/, double * /*ETerm*/, double * /*ESlope*/, double /*Sum*/, double /*Difference*/);
+double Kappa_Profile_Value (struct Kappa_Profile * /*Profile*/, double /*Kappa*/, double /*Sign*/);
+double Kappa_Profile_ChiSqr (struct Kappa_Profile * /*Profile*/, double * /*Constants*/);
+double Kappa_Profile_Root (struct Kappa_Profile * /*Profile*/, double /*Low*/, double /*High*/, double /*FLow*/, double /*FHigh*/);
+double Kappa_Profile_Minimum (struct Kappa_Profile * /*Profile*/, double /*Low*/, double /*Middle*/, double /*High*/, double /*Sign*/);
+int Add_Kappa_Solution (struct Kappa_Profile * /*Profile*/, double /*Kappa*/, struct Kappa_Solution * /*Solutions*/, int /*SolutionCount*/, int /*MaxSolutions*/);
+int Scan_Kappa_Profile (struct Kappa_Profile * /*Profile*/, double * /*Kappa*/, double (* /*Terms*/)[KAPPA_PROFILE_MAX_LINES], double (* /*Slopes*/)[KAPPA_PROFILE_MAX_LINES], struct Kappa_Solution * /*Solutions*/, int /*SolutionCount*/, int /*MaxSolutions*/, int * /*Brackets*/);
+int Kappa_Profile_Fit (struct Kappa_Profile * /*Profile*/, struct Kappa_Solution * /*Solutions*/, int /*MaxSolutions*/, int * /*BracketFailures*/);
+int SBFIT_Profile (double * /*Guess*/, double * /*ChiSq*/, struct GSL_Bundle * /*FitBundle*/, struct Opt_Bundle /*MyOpt_Bundle*/, double * /*LineFrequencies*/, double [3]/*FinalConstants*/);
+
+//Small LM functions
+double Small_LM_Residual (gsl_multifit_nlinear_fdf * /*fdf*/, double * /*x*/, double * /*f*/);
+void Small_LM_Jacobian (gsl_multifit_nlinear_fdf * /*fdf*/, double * /*x*/, double * /*f*/, double (* /*J*/)[3]);
+int Solve_Small_LM_Step (double (* /*A*/)[3], double * /*g*/, double * /*D*/, double /*mu*/, double * /*dx*/);
+int Small_LM_Fit (gsl_multifit_nlinear_fdf * /*fdf*/, double * /*Guess*/, int /*MaxIterations*/, double /*xtol*/, double /*gtol*/, double /*ftol*/, double [3]/*FinalConstants*/, double * /*ChiSq*/, int * /*Iterations*/, int * /*Info*/);
+int SBFIT_Small (double * /*Guess*/, double * /*ChiSq*/, struct GSL_Bundle * /*FitBundle*/, struct Opt_Bundle /*MyOpt_Bundle*/, double * /*LineFrequencies*/, double [3]/*FinalConstants*/);
+int SBFIT_Method (int /*FitMethod*/, double * /*Guess*/, double * /*ChiSq*/, struct GSL_Bundle * /*FitBundle*/, struct Opt_Bundle /*MyOpt_Bundle*/, double * /*LineFrequencies*/, double [3]/*FinalConstants*/);
+
+//Triples verification functions
+int Setup_Triples_Verifier (struct Triples_Verifier * /*Verifier*/, struct Transition * /*VerifyCatalog*/, int /*VerifyLines*/, struct Level * /*MyDictionary*/, struct ETauStruct /*ETStruct*/, double * /*Peaks*/, int /*PeakCount*/, double /*Tolerance*/);
+void Free_Triples_Verifier (struct Triples_Verifier * /*Verifier*/);
+void Fill_Triples_Verifier (struct Triples_Verifier * /*Verifier*/, double * /*Constants*/);
+double Score_Verification_Wins (struct Transition * /*VerifyCatalog*/, void * /*ScoringParameters*/);
+int Fit_Triples_Verified (struct Triple /*TransitionstoFit*/, double * /*Guess*/, struct GSL_Bundle * /*FitBundle*/, struct Opt_Bundle /*MyOpt_Bundle*/, int /*FitMethod*/, struct Feasibility_Bounds * /*Bounds*/, struct Solution_Clusters * /*Clusters*/, struct Triples_Verifier * /*Verifier*/, ScoreFunction /*TriplesScoreFunction*/, void * /*ScoringParameters*/, int /*SaveCount*/, struct MultiSave * /*Saves*/, int /*Verbose*/);
+
+//Candidate stream functions
+int Peak_Lower_Bound (double * /*Peaks*/, int /*PeakCount*/, double /*Frequency*/);
+int Start_Candidate_Stream (struct Candidate_Stream * /*Stream*/, double * /*Peaks*/, int /*PeakCount*/, double * /*Targets*/, double * /*Windows*/, int /*TargetCount*/, double /*First*/, double /*Last*/);
+int Next_Candidate (struct Candidate_Stream * /*Stream*/);
+void Feasibility_Terms (struct Transition /*Target*/, struct Level * /*MyDictionary*/, struct ETauStruct /*ETStruct*/, double /*Kappa*/, double /*RatioLow*/, double /*RatioHigh*/, double * /*First*/, double * /*Last*/);
+int Setup_Feasibility_Bounds (struct Feasibility_Bounds * /*Bounds*/, struct Transition * /*Targets*/, int /*TargetCount*/, struct Level * /*MyDictionary*/, struct ETauStruct /*ETStruct*/, double /*ScaleLow*/, double /*ScaleHigh*/, double /*Tolerance*/);
+int Tuple_Feasible (struct Feasibility_Bounds * /*Bounds*/, double * /*Frequencies*/);
+void Print_Feasibility_Stats (struct Feasibility_Bounds * /*Bounds*/);
+int Fit_Candidate_Stream (struct Candidate_Stream * /*Stream*/, struct Transition * /*Targets*/, double * /*Guess*/, struct GSL_Bundle * /*FitBundle*/, struct Opt_Bundle /*MyOpt_Bundle*/, int /*FitMethod*/, struct Feasibility_Bounds * /*Bounds*/, struct Solution_Clusters * /*Clusters*/, struct Triples_Verifier * /*Verifier*/, ScoreFunction /*CandidateScoreFunction*/, void * /*ScoringParameters*/, int /*SaveCount*/, struct MultiSave * /*Saves*/, int /*Verbose*/);
+
+//Solution clustering functions
+int Initialize_Solution_Clusters (struct Solution_Clusters * /*Clusters*/, double /*Radius*/, int /*Capacity*/);
+void Free_Solution_Clusters (struct Solution_Clusters * /*Clusters*/);
+unsigned long long Cluster_Cell_Hash (long long * /*Cell*/);
+int Find_Cluster (struct Solution_Clusters * /*Clusters*/, double * /*Constants*/);
+int Grow_Solution_Clusters (struct Solution_Clusters * /*Clusters*/);
+int New_Cluster (struct Solution_Clusters * /*Clusters*/, double * /*Constants*/);
+void Add_Cluster_Line (struct Solution_Cluster * /*Cluster*/, unsigned int /*Upper*/, unsigned int /*Lower*/, double /*Frequency*/);
+int Add_Cluster_Fit (struct Solution_Clusters * /*Clusters*/, double * /*Constants*/, double /*ChiSqr*/, double /*Score*/, struct Transition * /*Lines*/, int /*LineCount*/);
+int Fold_Cluster (struct Solution_Clusters * /*Into*/, struct Solution_Cluster * /*Source*/, double * /*Position*/);
+int Merge_Solution_Clusters (struct Solution_Clusters * /*Into*/, struct Solution_Clusters * /*From*/);
+int Compare_Clusters_ChiSqr (const void * /*a*/, const void * /*b*/);
+int Recenter_Solution_Clusters (struct Solution_Clusters * /*Clusters*/);
+int Cluster_Hit_File (char * /*HitFile*/, struct Solution_Clusters * /*Clusters*/);
+void Solution_Clusters_To_Saves (struct Solution_Clusters * /*Clusters*/, int /*SaveCount*/, struct MultiSave * /*Saves*/);
+int Compare_Clusters (const void * /*a*/, const void * /*b*/);
+int Save_Solution_Clusters (char * /*FileName*/, struct Solution_Clusters * /*Clusters*/, struct Level * /*MyDictionary*/);
+void Print_Cluster_Stats (struct Solution_Clusters * /*Clusters*/);
+
+//Batched fitting functions
+int SBFIT_Batch (struct Fit_Problem * /*Problems*/, int /*ProblemCount*/, struct ETauStruct /*ETStruct*/, struct Level * /*MyDictionary*/, int /*ThreadCount*/, double * /*Constants*/, double * /*ChiSqr*/, int * /*Iterations*/, double * /*Covariance*/, int * /*Status*/, int /*Verbose*/);
+int Initialize_Batch_Worker (struct Batch_Worker * /*Worker*/, struct Batch_Pool * /*Pool*/);
+void Free_Batch_Worker (struct Batch_Worker * /*Worker*/);
+void *Batch_Worker_Thread (void * /*Arg*/);
+void Batch_Fit_Problem (struct Batch_Worker * /*Worker*/, int /*Index*/);
+
+//Distortion fitting functions
+int E_tau_Closed_Form (int /*TransitionIndex*/);
+double E_tau_Slope (int /*TransitionIndex*/, double /*Kappa*/, struct ETauStruct /*ETStruct*/);
+void Initialize_Rotor_Model (struct Rotor_Model * /*Model*/, struct ETauStruct /*ETStruct*/, struct Level * /*MyDictionary*/);
+int Add_Model_Term (struct Rotor_Model * /*Model*/, double * /*Table*/, double /*Scale*/);
+int Add_DJ_Term (struct Rotor_Model * /*Model*/, double * /*DJSlopes*/);
+double Model_Level (struct Rotor_Model * /*Model*/, double * /*Parameters*/, double /*Kappa*/, int /*Level*/, double * /*Gradient*/);
+int Model_OptFunc_gsl (const gsl_vector * /*x*/, void * /*params*/, gsl_vector * /*f*/);
+int Model_Jacobian_gsl (const gsl_vector * /*x*/, void * /*params*/, gsl_matrix * /*J*/);
+int Initialize_Model_Fit (struct Model_Fit_Bundle * /*Bundle*/, struct Rotor_Model * /*Model*/, int /*LineCount*/);
+void Free_Model_Fit (struct Model_Fit_Bundle * /*Bundle*/);
+int Model_Fit (struct Model_Fit_Bundle * /*Bundle*/, double * /*Guess*/, struct Transition * /*Lines*/, double * /*LineFrequencies*/, double * /*FinalParameters*/, double * /*ChiSq*/);
+int Get_Model_Fit_Error (struct Model_Fit_Bundle * /*Bundle*/, double * /*Errors*/);
+
+//Telemetry functions
+void Enable_Fit_Telemetry (int /*Enabled*/);
+int Set_Telemetry_Source (int /*Source*/);
+long long Telemetry_Clock (void);
+void Record_Fit_Telemetry (int /*Iterations*/, int /*Reason*/, long long /*FunctionEvaluations*/, long long /*JacobianEvaluations*/, long long /*Start*/);
+void Record_Fit_Cache_Hit (void);
+void Record_GSL_Fit (gsl_multifit_nlinear_workspace * /*Workspace*/, int /*Status*/, int /*Info*/, int /*MaxIterations*/, long long /*Start*/);
+void Merge_Fit_Telemetry (void);
+void Reset_Fit_Telemetry (void);
+int Get_Fit_Telemetry (int /*Source*/, struct Fit_Telemetry * /*Telemetry*/);
+int Telemetry_Percentile (long long * /*Histogram*/, int /*Bins*/, long long /*Count*/, double /*Fraction*/);
+void Print_Fit_Telemetry (int /*Source*/);
+
 //V2 Get Catalog and related functions
 int Fill_Catalog_Restricted_J2 (struct Transition */*SourceCatalog*/, struct Transition **/*CatalogtoFill*/, double */*Constants*/, int /*CatLines*/, int /*JMin*/, int /*JMax*/, int /*Verbose*/, struct Level */*MyDictionary*/, int ** /*Mask*/, int * /*MaskCount*/);
 int Fill_Catalog_Restricted_Ka2 (struct Transition */*SourceCatalog*/, struct Transition **/*CatalogtoFill*/, double */*Constants*/, int /*CatLines*/, int /*JMin*/, int /*JMax*/, int /*Verbose*/, struct Level */*MyDictionary*/, int ** /*Mask*/, int * /*MaskCount*/);
@@ -149,6 +717,8 @@ void Test_SBFIT (void);
 void Test_Triples (char *, struct Transition *, struct Level *, int /*CatalogLines*/, struct ETauStruct /*FittingETStruct*/);
 double DummyFunction (struct Transition */*MyCatalog*/, void */*Data*/);
 int Timing_Test_Triples (void);
+int Test_Feasibility_Bounds (struct Transition * /*TestCatalog*/, int /*CatalogLines*/, struct Level * /*TestDictionary*/, struct ETauStruct /*TestETStruct*/);
+int Test_DR_Fit_Cache (struct Transition * /*TestCatalog*/, int /*CatalogLines*/, struct Level * /*TestDictionary*/, struct ETauStruct /*TestETStruct*/);
 
 
 
@@ -714,7 +1284,7 @@ int Index;
 
 double DJ_Shift (int State, double DJ, double *DJSlopes)
 {
-	return -DJ*DJSlopes[State]*29979.2458;
+	return DJ*DJSlopes[State]*DJ_SCALE;
 }
 
 ////////////////////////////////////
@@ -1000,46 +1570,25 @@ int i,PeakCount;
 
 int Find_Triples (struct Triple *TripletoFit, double *LineFrequencies, double Window, int LineCount, int Verbose)
 {
-int i,Count;	
+//LineFrequencies must be ascending, each window is found by binary search (see Peak_Lower_Bound) and the lines in it copied out back to back
+int i,t,First,Last,Count;
+double *Trimmed;
 	TripletoFit->TriplesList = malloc(LineCount*3*sizeof(double));	//Allocate an array that is 3x the total number of lines we could fit, thats the max, assuming every line is within the search window of all three transitions
-	TripletoFit->TriplesCount[0] = 0;
-	TripletoFit->TriplesCount[1] = 0;
-	TripletoFit->TriplesCount[2] = 0;
-	i=0;
-	Count = 0;
-	while (LineFrequencies[i] < TripletoFit->TransitionList[0].Frequency-Window) {
-		i++;
-	}
-	while ((LineFrequencies[i] < TripletoFit->TransitionList[0].Frequency+Window) & (i<LineCount)) {	//As long as the line is lower than the max frequency of the window and we aren't at the end of the array, add it to the list
-		TripletoFit->TriplesList[Count] = LineFrequencies[i];
-		Count++;
-		i++;
-	}	
-	TripletoFit->TriplesCount[0] = Count;
-	i=0;	//Reset the index above, since we have no way of knowing if these are in order of frequency or if they over lap. This is the safest, but slowest. Sorting could speed this up, but it is more work, something to add later if bigggg files start giving this issues
-	Count = 0;
-	while (LineFrequencies[i] < TripletoFit->TransitionList[1].Frequency-Window) {
-		i++;
-	}
-	while ((LineFrequencies[i] < TripletoFit->TransitionList[1].Frequency+Window) & (i<LineCount)) {
-		TripletoFit->TriplesList[Count+TripletoFit->TriplesCount[0]] = LineFrequencies[i];
-		Count++;
-		i++;
+	if (TripletoFit->TriplesList == NULL) {
+		printf ("Error: Unable to allocate the triples list\n");
+		return 0;
 	}
-	TripletoFit->TriplesCount[1] = Count;
-	i=0;	//Reset the index above again
 	Count = 0;
-	while (LineFrequencies[i] < TripletoFit->TransitionList[2].Frequency-Window) {
-		i++;
+	for (t=0;t<3;t++) {
+		First = Peak_Lower_Bound (LineFrequencies, LineCount, TripletoFit->TransitionList[t].Frequency-Window);
+		Last = Peak_Lower_Bound (LineFrequencies, LineCount, TripletoFit->TransitionList[t].Frequency+Window);
+		TripletoFit->TriplesCount[t] = Last-First;
+		for (i=First;i<Last;i++) TripletoFit->TriplesList[Count++] = LineFrequencies[i];
 	}
-	while ((LineFrequencies[i] < TripletoFit->TransitionList[2].Frequency+Window) & (i<LineCount)) {
-		TripletoFit->TriplesList[Count+TripletoFit->TriplesCount[0]+TripletoFit->TriplesCount[1]] = LineFrequencies[i];
-		Count++;
-		i++;
+	if (Count > 0) {	//The list is the three windows one after another, so it's the sum of the counts long, not the product
+		Trimmed = realloc(TripletoFit->TriplesList,Count*sizeof(double));
+		if (Trimmed != NULL) TripletoFit->TriplesList = Trimmed;
 	}
-	TripletoFit->TriplesCount[2] = Count;
-	//Check this alloc
-	TripletoFit->TriplesList = realloc(TripletoFit->TriplesList,TripletoFit->TriplesCount[0]*TripletoFit->TriplesCount[1]*TripletoFit->TriplesCount[2]*sizeof(double));	
 	printf ("=====Find_Triples=====\n");
 	printf ("%d experimental lines sent to function\n",LineCount);
 	printf ("Found %d lines for %f\n",TripletoFit->TriplesCount[0],TripletoFit->TransitionList[0].Frequency);
@@ -1157,7 +1706,19 @@ double GSLConstants[3];	//Declare some doubles to hold our constants
 
 int Fit_Triples_Bundle (struct Triple TransitionstoFit, double *Guess, double **FitResults, struct Transition **MyFittingCatalog, int CatalogLines, struct GSL_Bundle *FitBundle, struct Opt_Bundle MyOpt_Bundle, ScoreFunction TriplesScoreFunction, void *ScoringParameters)
 {
-int i,j,k,info,Count,Iterations,Wins,Errors;
+//Fits every triple with GSL, see Fit_Triples_Bundle_Method for the other fitters and the feasibility filter
+	return Fit_Triples_Bundle_Method (TransitionstoFit, Guess, FitResults, MyFittingCatalog, CatalogLines, FitBundle, MyOpt_Bundle, TriplesScoreFunction, ScoringParameters, FIT_METHOD_GSL, NULL);
+}
+
+int Fit_Triples_Bundle_Method (struct Triple TransitionstoFit, double *Guess, double **FitResults, struct Transition **MyFittingCatalog, int CatalogLines, struct GSL_Bundle *FitBundle, struct Opt_Bundle MyOpt_Bundle, ScoreFunction TriplesScoreFunction, void *ScoringParameters, int FitMethod, struct Feasibility_Bounds *Bounds)
+{
+//Fit_Triples_Bundle with a choice of fitter. FitMethod picks the fitter for each triple (see SBFIT_Method), FitBundle is only needed for FIT_METHOD_GSL. *FitResults is allocated here and freed by the caller
+//Bounds is a feasibility filter set up for TransitionList (see Setup_Feasibility_Bounds), triples it rejects aren't fit or scored and get 0 constants in FitResults. NULL to fit them all
+//Every fit recomputes and sorts *MyFittingCatalog and hands it to TriplesScoreFunction (NULL to skip scoring)
+int i,j,k,info,Count,Iterations,Wins,Errors,Status,Source;
+long long Start;
+double ChiSqr;
+double Frequencies[3];
 const double xtol = 1e-8;
 const double gtol = 1e-8;
 const double ftol = 1e-1;
@@ -1179,8 +1740,9 @@ gsl_vector_view x;
   	Count = 0;		//Track the total number of constants (A+B+C) in the fit results
   	Iterations = 0;	//Variable to track the total number of iterations throughout the fit, just a bookeeping thing for me to see how the fitter is operating
   	Errors = 0;		//A count of the number of unconverged fits, another metric for me to track the fitting
-  	double MyConstants[3];
-  	FitBundle->fdf.params = &MyOpt_Bundle;
+  	double MyConstants[3] = {0.0,0.0,0.0};	//Stays 0 if every triple is rejected
+  	if (FitMethod == FIT_METHOD_GSL) FitBundle->fdf.params = &MyOpt_Bundle;
+  	Source = Set_Telemetry_Source (TELEMETRY_TRIPLES);
   	for (i=0;i<TransitionstoFit.TriplesCount[0];i++) {
   		for (j=0;j<TransitionstoFit.TriplesCount[1];j++) {
   			for (k=0;k<TransitionstoFit.TriplesCount[2];k++) {
@@ -1188,35 +1750,57 @@ gsl_vector_view x;
 				MyOpt_Bundle.TransitionsGSL[0].Frequency = TransitionstoFit.TriplesList[i];			
 				MyOpt_Bundle.TransitionsGSL[1].Frequency = TransitionstoFit.TriplesList[j+TransitionstoFit.TriplesCount[0]];
 				MyOpt_Bundle.TransitionsGSL[2].Frequency =  TransitionstoFit.TriplesList[k+TransitionstoFit.TriplesCount[0]+TransitionstoFit.TriplesCount[1]];								
-				FitBundle->fdf.params = &MyOpt_Bundle;															//Set the parameters for this run					
-   				gsl_multifit_nlinear_init (&x.vector, &(FitBundle->fdf), FitBundle->Workspace);	//reInitialize the workspace incase this isnt the first run of the loop  	
-				FitBundle->f = gsl_multifit_nlinear_residual(FitBundle->Workspace);								//compute initial cost function
-  				gsl_multifit_nlinear_driver(50, xtol, gtol, ftol, NULL, NULL, &info, FitBundle->Workspace);		//solve the system with a maximum of 20 iterations
-  				Iterations += gsl_multifit_nlinear_niter (FitBundle->Workspace); 	//Track the iterations
-  				Final = gsl_multifit_nlinear_position(FitBundle->Workspace);		//Snag the results
-  				if (gsl_multifit_nlinear_niter (FitBundle->Workspace) == 50) {		//Check for an error, currently only considering non-convergence
-  					//printf ("Error: Unconverged Fit: %.4f %.4f %.4f\n",Transitions[0].Frequency,Transitions[1].Frequency,Transitions[2].Frequency);
-  					Errors++;
-  				}
-   				(*FitResults)[Count] = gsl_vector_get(Final, 0);	//Get the final A
-  				MyConstants[0] = gsl_vector_get(Final, 0);				//Update the constants
-  				Count++;											//Track the number of items in FitResults
-  				(*FitResults)[Count] = gsl_vector_get(Final, 1);	
-  				MyConstants[1] = gsl_vector_get(Final, 1);
-  				Count++;
-  				(*FitResults)[Count] = gsl_vector_get(Final, 2);
-  				MyConstants[2] = gsl_vector_get(Final, 2);
-  				Count++;
+				Frequencies[0] = MyOpt_Bundle.TransitionsGSL[0].Frequency;
+				Frequencies[1] = MyOpt_Bundle.TransitionsGSL[1].Frequency;
+				Frequencies[2] = MyOpt_Bundle.TransitionsGSL[2].Frequency;
+				if ((Bounds != NULL) && !Tuple_Feasible (Bounds, Frequencies)) {	//No A>B>C can fit this one, so skip it but keep its place in FitResults
+					(*FitResults)[Count++] = 0.0;
+					(*FitResults)[Count++] = 0.0;
+					(*FitResults)[Count++] = 0.0;
+					continue;
+				}
+				if (FitMethod != FIT_METHOD_GSL) {
+					if (!SBFIT_Method (FitMethod, Guess, &ChiSqr, FitBundle, MyOpt_Bundle, Frequencies, MyConstants)) Errors++;	//A bracket failure for the profile, the iteration cap for the small LM
+					(*FitResults)[Count++] = MyConstants[0];
+					(*FitResults)[Count++] = MyConstants[1];
+					(*FitResults)[Count++] = MyConstants[2];
+				} else {
+					FitBundle->fdf.params = &MyOpt_Bundle;															//Set the parameters for this run					
+					Start = Telemetry_Clock ();
+	   				gsl_multifit_nlinear_init (&x.vector, &(FitBundle->fdf), FitBundle->Workspace);	//reInitialize the workspace incase this isnt the first run of the loop  	
+					FitBundle->f = gsl_multifit_nlinear_residual(FitBundle->Workspace);								//compute initial cost function
+	  				Status = gsl_multifit_nlinear_driver(50, xtol, gtol, ftol, NULL, NULL, &info, FitBundle->Workspace);		//solve the system with a maximum of 20 iterations
+					Record_GSL_Fit (FitBundle->Workspace, Status, info, 50, Start);
+	  				Iterations += gsl_multifit_nlinear_niter (FitBundle->Workspace); 	//Track the iterations
+	  				Final = gsl_multifit_nlinear_position(FitBundle->Workspace);		//Snag the results
+	  				if (gsl_multifit_nlinear_niter (FitBundle->Workspace) == 50) {		//Check for an error, currently only considering non-convergence
+	  					//printf ("Error: Unconverged Fit: %.4f %.4f %.4f\n",Transitions[0].Frequency,Transitions[1].Frequency,Transitions[2].Frequency);
+	  					Errors++;
+	  				}
+	   				(*FitResults)[Count] = gsl_vector_get(Final, 0);	//Get the final A
+	  				MyConstants[0] = gsl_vector_get(Final, 0);				//Update the constants
+	  				Count++;											//Track the number of items in FitResults
+	  				(*FitResults)[Count] = gsl_vector_get(Final, 1);	
+	  				MyConstants[1] = gsl_vector_get(Final, 1);
+	  				Count++;
+	  				(*FitResults)[Count] = gsl_vector_get(Final, 2);
+	  				MyConstants[2] = gsl_vector_get(Final, 2);
+	  				Count++;
+				}
   				Get_Catalog (*MyFittingCatalog, MyConstants, CatalogLines,0,MyOpt_Bundle.ETGSL,MyOpt_Bundle.MyDictionary);	//Now we recompute the full catalog, this isnt necessary to complete the fit, but has to be done to score the fit
   				Sort_Catalog (*MyFittingCatalog,CatalogLines,0,0);					//Catalog is not necessarily sorted, so we sort it
-				//TriplesScoreFunction (*MyFittingCatalog,ScoringParameters);
+				if (TriplesScoreFunction != NULL) TriplesScoreFunction (*MyFittingCatalog,ScoringParameters);
   			} 
   		} 
   	}
+	Set_Telemetry_Source (Source);
+	Merge_Fit_Telemetry ();
 	printf ("%d\n",Count);
   	printf ("%e %e %e\n",MyConstants[0],MyConstants[1],MyConstants[2]);
-  	printf ("%i average iterations, %i Errors\n",Iterations/(TransitionstoFit.TriplesCount[0]*TransitionstoFit.TriplesCount[1]*TransitionstoFit.TriplesCount[2]),Errors);
-	free(*FitResults);
+  	if (FitMethod == FIT_METHOD_PROFILE) printf ("%i bracket failures\n",Errors);
+  	else if (FitMethod == FIT_METHOD_SMALL_LM) printf ("%i Errors\n",Errors);
+  	else printf ("%i average iterations, %i Errors\n",Iterations/(TransitionstoFit.TriplesCount[0]*TransitionstoFit.TriplesCount[1]*TransitionstoFit.TriplesCount[2]),Errors);
+	if (Bounds != NULL) Print_Feasibility_Stats (Bounds);
 	return 1;
 }
 
@@ -1272,7 +1856,8 @@ size_t n = MyOpt_Bundle->TransitionCount;	//The only major variation between the
 
 int SBFIT (double *Guess, double *ChiSq, struct GSL_Bundle *FitBundle, struct Opt_Bundle MyOpt_Bundle, double *LineFrequencies, double FinalConstants[3])
 {
-int i,info,Success;
+int i,info,Success,Status;
+long long Start;
 const double xtol = 1e-8;
 const double gtol = 1e-8;
 const double ftol = 1e-1;
@@ -1283,10 +1868,12 @@ gsl_vector_view x;
   	for (i=0;i<MyOpt_Bundle.TransitionCount;i++) MyOpt_Bundle.TransitionsGSL[i].Frequency = LineFrequencies[i];
   	x = gsl_vector_view_array (Guess, p);															//Set the guess	
 	FitBundle->fdf.params = &MyOpt_Bundle;
+	Start = Telemetry_Clock ();
 	gsl_multifit_nlinear_init (&x.vector, &(FitBundle->fdf), FitBundle->Workspace);					//reInitialize the workspace incase this isnt the first run of the loop  	
 	FitBundle->f = gsl_multifit_nlinear_residual(FitBundle->Workspace);								//compute initial cost function
 	Success = 1;
-	gsl_multifit_nlinear_driver(200, xtol, gtol, ftol, NULL, NULL, &info, FitBundle->Workspace);		//solve the system with a maximum of 50 iterations
+	Status = gsl_multifit_nlinear_driver(200, xtol, gtol, ftol, NULL, NULL, &info, FitBundle->Workspace);		//solve the system with a maximum of 50 iterations
+	Record_GSL_Fit (FitBundle->Workspace, Status, info, 200, Start);
 	Final = gsl_multifit_nlinear_position(FitBundle->Workspace);									//Snag the results
 	if (gsl_multifit_nlinear_niter (FitBundle->Workspace) == 200) {
 		//printf ("Error: Unconverged Fit\n");
@@ -2700,6 +3287,7 @@ ScoreFunction TestFunction;
 							TestFunction, 
 							0 
 						);
+	free(Results);
 
 }
 
@@ -2825,8 +3413,8 @@ ScoreFunction TestFunction;
 									TestFunction, 
 									0 
 								);	
+			free(Results);
 		}
-		free(Results);
 		clock_t end = clock();
 		Timing[j] = (double)(end - begin) / CLOCKS_PER_SEC;
 		printf("%f\n", Timing[j]);
@@ -2851,9 +3439,130 @@ Error:
 	return 0;
 }
 
+int Test_Feasibility_Bounds (struct Transition *TestCatalog, int CatalogLines, struct Level *TestDictionary, struct ETauStruct TestETStruct)
+{
+/*
+	Test Code - Checks the pre-fit feasibility filter never rejects a tuple that can be fit
+	Target sets of 3 and 4 lines are picked across the catalog, and for a grid of A>B>C the exact predicted lines of each set go through Tuple_Feasible with no tolerance, every one of them has to pass
+	The same number of random tuples over the same frequency range are checked as well, which is the rejection rate to expect from the filter
+	Returns 1 if nothing fittable was rejected
+*/
+double Constants[3],Frequencies[CANDIDATE_MAX_TARGETS],Low,High;
+double Fittable,Missed,Random,Rejected,Tuples;
+int i,Set,TargetCount,Skip;
+struct Transition Targets[CANDIDATE_MAX_TARGETS];
+struct Feasibility_Bounds Bounds;
+	Fittable = 0.0;
+	Missed = 0.0;
+	Random = 0.0;
+	Rejected = 0.0;
+	srand (1);		//Same random tuples every run
+	for (Set=0;Set<16;Set++) {
+		TargetCount = 3+Set%2;
+		for (i=0;i<TargetCount;i++) Targets[i] = TestCatalog[(Set*97+i*389)%CatalogLines];
+		if (!Setup_Feasibility_Bounds (&Bounds, Targets, TargetCount, TestDictionary, TestETStruct, 0.0, HUGE_VAL, 0.0)) return 0;
+		Low = HUGE_VAL;
+		High = 0.0;
+		for (Constants[0]=1000.0;Constants[0]<=10000.0;Constants[0]+=250.0) {
+			for (Constants[1]=500.0;Constants[1]<Constants[0];Constants[1]+=125.0) {
+				for (Constants[2]=250.0;Constants[2]<Constants[1];Constants[2]+=125.0) {
+					Get_Catalog (Targets, Constants, TargetCount, 0, TestETStruct, TestDictionary);
+					Skip = 0;
+					for (i=0;i<TargetCount;i++) {
+						Frequencies[i] = Targets[i].Frequency;
+						if (Frequencies[i] <= 0.0) Skip = 1;		//Not a line anyone would observe at these constants
+					}
+					if (Skip) continue;
+					for (i=0;i<TargetCount;i++) {
+						Low = fmin (Low,Frequencies[i]);
+						High = fmax (High,Frequencies[i]);
+					}
+					Fittable++;
+					if (!Tuple_Feasible (&Bounds, Frequencies)) {
+						Missed++;
+						printf ("Error: Feasibility filter rejected the exact lines of A:%.1f B:%.1f C:%.1f for target set %d\n",Constants[0],Constants[1],Constants[2],Set);
+					}
+				}
+			}
+		}
+		Tuples = Bounds.Checked;
+		for (i=0;(i<Tuples) && (Low < High);i++) {
+			for (Skip=0;Skip<TargetCount;Skip++) Frequencies[Skip] = Low+(High-Low)*rand()/RAND_MAX;
+			Random++;
+			if (!Tuple_Feasible (&Bounds, Frequencies)) Rejected++;
+		}
+	}
+	printf ("Feasibility filter: %.0f of %.0f fittable tuples rejected, %.0f of %.0f random tuples rejected (%.1f%%)\n",Missed,Fittable,Rejected,Random,(Random > 0.0) ? 100.0*Rejected/Random : 0.0);
+	return (Missed == 0.0);
+}
+
+int Test_DR_Fit_Cache (struct Transition *TestCatalog, int CatalogLines, struct Level *TestDictionary, struct ETauStruct TestETStruct)
+{
+/*
+	Test Code - Runs a real Search_DR_Hits over a coarse grid and checks the fit cache answers some of its fits
+	Four DR lines are taken from the catalog at A:3000 B:1500 C:1100, chained so each shares a level with the next, and linked the same way
+	The tolerance is wide enough that several grid points around the answer match the same transitions, which is the repeat the cache is for
+	Writes and then removes Test_DR_Hits.bin in the working directory. Returns 1 if the cache had any hits
+*/
+double Constants[3] = {3000.0,1500.0,1100.0};
+double DRFrequency[4];
+int Chain[4],Links[3][2],*DRLinks[3];
+int i,j,Start,Found;
+struct Transition *WorkingCatalog;
+struct Fit_Telemetry Telemetry;
+	WorkingCatalog = malloc (CatalogLines*sizeof(struct Transition));
+	if (WorkingCatalog == NULL) return 0;
+	memcpy (WorkingCatalog, TestCatalog, CatalogLines*sizeof(struct Transition));
+	Get_Catalog (WorkingCatalog, Constants, CatalogLines, 0, TestETStruct, TestDictionary);
+	Found = 0;
+	for (Start=0;Start<CatalogLines;Start++) {	//Greedy chain of linked lines in the band
+		if ((WorkingCatalog[Start].Frequency < 2000.0) || (WorkingCatalog[Start].Frequency > 20000.0)) continue;
+		Chain[0] = Start;
+		for (Found=1;Found<4;Found++) {
+			for (i=0;i<CatalogLines;i++) {
+				if ((WorkingCatalog[i].Frequency < 2000.0) || (WorkingCatalog[i].Frequency > 20000.0)) continue;
+				for (j=0;(j<Found) && (Chain[j] != i);j++);
+				if ((j == Found) && Match_Levels (Chain[Found-1], i, WorkingCatalog)) break;
+			}
+			if (i == CatalogLines) break;
+			Chain[Found] = i;
+		}
+		if (Found == 4) break;
+	}
+	if (Found < 4) {
+		printf ("Error: No chain of four linked lines in the test catalog\n");
+		free (WorkingCatalog);
+		return 0;
+	}
+	for (i=0;i<4;i++) DRFrequency[i] = WorkingCatalog[Chain[i]].Frequency;
+	for (i=0;i<3;i++) {
+		Links[i][0] = i;
+		Links[i][1] = i+1;
+		DRLinks[i] = Links[i];
+	}
+	remove ("Test_DR_Hits.bin");
+	Reset_Fit_Telemetry ();
+	if (!Search_DR_Hits (4, 1000.0, 3200.0, 50.0, DRFrequency, 100.0, 0, DRFrequency, DRLinks, 3, WorkingCatalog, CatalogLines, 0, TestETStruct, TestDictionary, "Test_DR_Hits.bin")) {
+		free (WorkingCatalog);
+		return 0;
+	}
+	remove ("Test_DR_Hits.bin");
+	free (WorkingCatalog);
+	Get_Fit_Telemetry (TELEMETRY_DR_HITS, &Telemetry);
+	printf ("DR fit cache: %lld fits, %lld answered by the cache (%.1f%%)\n",Telemetry.Fits,Telemetry.CacheHits,(Telemetry.Fits+Telemetry.CacheHits > 0) ? 100.0*Telemetry.CacheHits/(Telemetry.Fits+Telemetry.CacheHits) : 0.0);
+	return (Telemetry.CacheHits > 0);
+}
+
 ////////////////////////////////////
 int Search_DR_Hits (int DRPairs, double ConstStart, double ConstStop, double Step, double *DRFrequency, double Tolerance, int ExtraLineCount, double *ExtraLines, int **DRLinks, int LinkCount, struct Transition *CatalogtoFill, int CatLines, int Verbose, struct ETauStruct ETStruct, struct Level *MyDictionary, char *FileName)
 {
+//Original entry point, runs the search start to finish without checkpointing
+//FileName is now a binary hit file rather than the old text log, use Export_Hits_Text (or "./Brute export") for a readable table. A leftover text log at that path is refused, not appended to
+	return Search_DR_Hits_Checkpoint (DRPairs, ConstStart, ConstStop, Step, DRFrequency, Tolerance, ExtraLineCount, ExtraLines, DRLinks, LinkCount, CatalogtoFill, CatLines, Verbose, ETStruct, MyDictionary, FileName, NULL, 0.0, 0, NULL);
+}
+
+int Search_DR_Hits_Checkpoint (int DRPairs, double ConstStart, double ConstStop, double Step, double *DRFrequency, double Tolerance, int ExtraLineCount, double *ExtraLines, int **DRLinks, int LinkCount, struct Transition *CatalogtoFill, int CatLines, int Verbose, struct ETauStruct ETStruct, struct Level *MyDictionary, char *FileName, char *CheckpointFile, double CheckpointInterval, int SaveCount, struct MultiSave *Saves)
+{
 /*Function to find rotational constants through an arbitrary set of DR links
 Inputs:
 DRPairs - The number of DR transitions to be searched
@@ -2871,6 +3580,11 @@ CatLines - Number of lines in the catalog
 Verbose - Flag for printing more verbose inforamtion from the function
 ETStruct - Eigenvalue struct passed so we can do fitting in the function
 MyDictionary - Catalog dictionary passed for fitting and printing
+FileName - Binary hit file the fitted constants are written to (see Add_Hit), Export_Hits_Text turns it into text. A new search starts the file over, a search resumed from CheckpointFile appends to it. This used to be a plain text log, an existing file that isn't a hit file is refused rather than overwritten
+CheckpointFile - Binary checkpoint file, NULL disables checkpointing. If the file already exists the search resumes from it, otherwise it's created. A checkpoint that can't be read or belongs to another search stops the search, delete it (and the hit file) to start over
+CheckpointInterval (s) - Minimum wall time between checkpoints, checked once per B row
+SaveCount - # of best fits to keep in Saves, 0 to only write the log
+Saves - Best SaveCount logged fits by ChiSqr, sorted so the best is last. Kept in the checkpoint as well
 
 
 Todo:
@@ -2878,13 +3592,27 @@ Todo:
 
 */
 double CurrentA,CurrentB,CurrentC,Count,ChiSqr;
-double Constants[3],FitConstants[3];
-int *Match,**MatchArrays,i,j,k,DRMatch,AllLinks,Wins,LocalLink,MatchLimit,MatchCount,StartJ,StartK;
+double Constants[3],FitConstants[3],Bounds[4];
+int *Match,**MatchArrays,i,j,k,DRMatch,AllLinks,Wins,LocalLink,MatchLimit,MatchCount,StartJ,StartK,IndexA,IndexB,IndexC,StartA,StartB,First,Last;
+int GridIndex[3];
 int ***MatchRecord; //Record all of our matches in one place || MatchRecord[Match][Link][Upper/Lower]
+int Resume;
 struct GSL_Bundle MyGSLBundle;
 struct Opt_Bundle MyOptBundle;
-FILE *FileHandle;
-
+struct Search_Checkpoint MyCheckpoint;
+struct Result_Sink MySink;
+struct Hit_Buffer MyHits;
+struct Fit_Cache MyCache;
+struct Line_Index DRIndex,ExtraIndex;
+time_t LastCheckpoint;
+int Source;
+
+	memset (&DRIndex, 0, sizeof(struct Line_Index));		//So the error path can free them whether or not they were built
+	memset (&ExtraIndex, 0, sizeof(struct Line_Index));
+	memset (&MyCache, 0, sizeof(struct Fit_Cache));
+	Source = -1;		//Not a telemetry source, so putting it back on the error path is a no-op until it's been set
+	MySink.FileHandle = NULL;
+	MyHits.Records = NULL;
 	MatchLimit = 100;
 	MatchRecord = malloc (MatchLimit*sizeof(int **));
 	for (i=0;i<MatchLimit;i++) {
@@ -2909,8 +3637,48 @@ FILE *FileHandle;
 		if (Verbose) printf ("Tolerance set too low, defaulting to 20MHz\n");
 		ConstStart = 20.0;
 	}
-	FileHandle = fopen(FileName,"a");
-	if (FileHandle == NULL) goto Error;
+	//Pick up where a previous run left off if there's a checkpoint for this exact search
+	Bounds[0] = ConstStart;
+	Bounds[1] = ConstStop;
+	Bounds[2] = ConstStart;
+	Bounds[3] = ConstStop;
+	StartA = 0;
+	StartB = 0;
+	Count = 0.0;	//Tracking the number of counts we perform, using doubles to prevent int overflow
+	if (SaveCount > 0) Initialize_Saves (Saves, SaveCount, 10000.0);
+	Resume = (CheckpointFile != NULL) ? Read_Checkpoint (CheckpointFile, &MyCheckpoint, Saves, SaveCount, sizeof(struct MultiSave)) : 0;
+	if (Resume < 0) {
+		printf ("Error: Checkpoint %s can't be resumed, delete it and %s to start the search over\n",CheckpointFile,FileName);
+		goto Error;
+	}
+	if (Resume) {
+		if (!Checkpoint_Matches (&MyCheckpoint, CHECKPOINT_DR_HITS, Bounds, Step, Tolerance, 0, 1)) {
+			printf ("Error: Checkpoint %s was written by a different search, refusing to resume\n",CheckpointFile);
+			goto Error;
+		}
+		if (MyCheckpoint.Complete) {
+			if (Verbose) printf ("Checkpoint %s is for a completed search, nothing to do\n",CheckpointFile);
+			return 1;
+		}
+		if (!Trim_Log (FileName, MyCheckpoint.LogOffset)) goto Error;	//Drop any hits logged after the checkpoint, they'll be found again
+		StartA = MyCheckpoint.IndexA;
+		StartB = MyCheckpoint.IndexB;
+		Count = MyCheckpoint.Count;
+		if (Verbose) printf ("Resuming from checkpoint %s at A:%.2f B:%.2f\n",CheckpointFile,ConstStart+StartA*Step,ConstStart+StartB*Step);
+	} else {
+		MyCheckpoint.SearchType = CHECKPOINT_DR_HITS;
+		for (i=0;i<4;i++) MyCheckpoint.Bounds[i] = Bounds[i];
+		MyCheckpoint.Step = Step;
+		MyCheckpoint.Tolerance = Tolerance;
+		MyCheckpoint.ShardIndex = 0;
+		MyCheckpoint.ShardCount = 1;
+		MyCheckpoint.BadFits = 0.0;
+		MyCheckpoint.Hits = 0.0;
+		MyCheckpoint.SaveCount = SaveCount;
+		MyCheckpoint.SaveSize = sizeof(struct MultiSave);
+	}
+	Source = Set_Telemetry_Source (TELEMETRY_DR_HITS);
+	if (!Open_Result_Sink (FileName, Resume, &MySink) || !Allocate_Hit_Buffer (&MySink, 4096, &MyHits)) goto Error;
 
 	//Initialize the GSL fitter
 	if (DRPairs >= 3) {
@@ -2920,34 +3688,46 @@ FILE *FileHandle;
 		MyOptBundle.TransitionCount = DRPairs;
 		Initialize_SBFIT (&MyGSLBundle, &MyOptBundle);	
 	}
+	if (!Initialize_Fit_Cache (&MyCache, (DRPairs >= 3) ? FIT_CACHE_SIZE : 0)) goto Error;
+	//Bucket the DR and extra lines once, so matching a catalog line only looks at the lines near it
+	if (!Build_Line_Index (DRFrequency, DRPairs, Tolerance, &DRIndex)) goto Error;
+	if (!Build_Line_Index (ExtraLines, ExtraLineCount, Tolerance/100.0, &ExtraIndex)) goto Error;
 
 	//Verbose startup 
 	if (Verbose) {
 		printf ("Grid Search from %.2f MHz to %.2f MHz in %.2f MHz steps, %.2e total catalogs\n", ConstStart,ConstStop,Step, (double) pow((ConstStop-ConstStart)/Step,3.0)/6.0);
+		printf ("Tolerance %f, %d DR lines supplied, %d links between them, %d extra lines supplied\n",Tolerance,DRPairs,LinkCount,ExtraLineCount);
 		if ((DRPairs <=3) && (ExtraLineCount < 1)) {
 			printf ("Insufficient information given, either give extra lines to score against or more DR links\n");
-			return 0;
+			goto Error;
 		} else {
 			if (DRPairs <= 3) printf ("Not enough DR pairs for fitting, will match only against extra lines\n");
 			if (ExtraLineCount < 1) printf ("No extra lines supplied, can only score by fitting\n");
 		}
 	}
 
-	fprintf (FileHandle, "Constants Start :%f Constants Stop :%f Constants Step :%f Tolerance %f\n",ConstStart,ConstStop,Step,Tolerance);
-	fprintf (FileHandle, "%d DR lines supplied, %d links between them, %d extra lines supplied",DRPairs,ExtraLineCount,LinkCount);
-	
 	
 	Match = malloc(DRPairs*sizeof(int));	//Array of yes/no to track if each of the DR frequencies has a matching catalog transition or not
 	if (Match == NULL) goto Error;	//Basic but overkill error checking
 	MatchArrays = malloc (DRPairs*sizeof(int *));	//Array to store all the potential matches for each DR frequency
 	for (i=0;i<DRPairs;i++) MatchArrays[i] = malloc(100*sizeof(Match)); //Each of these arrays stores the matches for each DR line, can currently match up to 100 catalog lines per DR frequency. Hard coded limit for now cause over 100 is a lot
-	CurrentA = ConstStart;
-	Count = 0.0;	//Tracking the number of counts we perform, using doubles to prevent int overflow
 	clock_t start = clock();
-	while (CurrentA < ConstStop) {
-		CurrentB = ConstStart;
-		while (CurrentB < ConstStop) {
+	LastCheckpoint = time(NULL);
+	//A and B are walked by integer index rather than accumulated so the grid cursor can be saved and restored exactly
+	for (IndexA=StartA;(CurrentA = ConstStart+IndexA*Step) < ConstStop;IndexA++) {
+		for (IndexB=((IndexA == StartA) ? StartB : 0);(CurrentB = ConstStart+IndexB*Step) < ConstStop;IndexB++) {
+			if ((CheckpointFile != NULL) && (difftime(time(NULL),LastCheckpoint) >= CheckpointInterval)) {
+				if (!Flush_Hit_Buffer (&MyHits)) goto Error;
+				MyCheckpoint.IndexA = IndexA;
+				MyCheckpoint.IndexB = IndexB;
+				MyCheckpoint.Complete = 0;
+				MyCheckpoint.Count = Count;
+				MyCheckpoint.LogOffset = Result_Sink_Offset (&MySink);
+				if (!Write_Checkpoint (CheckpointFile, &MyCheckpoint, Saves)) printf ("Warning: Unable to write checkpoint %s, continuing without it\n",CheckpointFile);
+				LastCheckpoint = time(NULL);
+			}
 			CurrentC = ConstStart;
+			IndexC = 0;
 			while (CurrentC < ConstStop) {
 				if ((CurrentA > CurrentB) && (CurrentB > CurrentC)) {
 					Count+= 1.0;
@@ -2963,9 +3743,11 @@ FILE *FileHandle;
 									MyDictionary
 					);
 					for (i=0;i<DRPairs;i++) Match[i] = 0;	//Reset our matches to 0
-					//Brute force check to see if our DR lines exist in the catalog, may be faster to check after a sort, need to try
+					//Check which DR lines each catalog line matches, the index only hands back the DR lines in the neighbouring buckets
 					for (i=0;i<CatLines;i++) {
-						for (j=0;j<DRPairs;j++) {
+						Line_Index_Range (&DRIndex, CatalogtoFill[i].Frequency, &First, &Last);
+						for (k=First;k<Last;k++) {
+							j = DRIndex.Order[k];
 							if (fabs(CatalogtoFill[i].Frequency-DRFrequency[j]) < Tolerance) {
 								MatchArrays[j][Match[j]] = i;
 								Match[j]++;
@@ -3024,7 +3806,7 @@ FILE *FileHandle;
 								MyOptBundle.TransitionsGSL[DRLinks[i][0]] = CatalogtoFill[MatchRecord[0][i][0]];
 								MyOptBundle.TransitionsGSL[DRLinks[i][1]] = CatalogtoFill[MatchRecord[0][i][1]];
 							}
-							SBFIT (Constants, &ChiSqr, &MyGSLBundle, MyOptBundle, DRFrequency, FitConstants);
+							SBFIT_Cached (&MyCache, FIT_METHOD_GSL, Constants, &ChiSqr, &MyGSLBundle, MyOptBundle, DRFrequency, FitConstants);
 							if ((ChiSqr/DRPairs) < 0.1) {
 								Get_Catalog (	CatalogtoFill, //Catalog to compute frequencies for
 												Constants, //Rotational constants for the calculation
@@ -3034,20 +3816,15 @@ FILE *FileHandle;
 												MyDictionary
 												);
 								Wins = 0;
-								for (i=0;i<ExtraLineCount;i++) {
-									for (j=0;j<CatLines;j++) {
-										if (fabs(CatalogtoFill[j].Frequency-ExtraLines[i]) < (Tolerance/100.0)) {
-											Wins++;
-										}
-									}
+								for (j=0;j<CatLines;j++) Wins += Line_Index_Matches (&ExtraIndex, CatalogtoFill[j].Frequency);	//Every (extra line, catalog line) pair within Tolerance/100
+								if (!ExtraLineCount || (Wins > 3)) {
+									GridIndex[0] = IndexA;
+									GridIndex[1] = IndexB;
+									GridIndex[2] = IndexC;
+									for (i=0;i<DRPairs;i++) MyOptBundle.TransitionsGSL[i].Frequency = DRFrequency[i];	//Record the DR frequencies each transition was fit to
+									if (!Add_Hit (&MyHits, FitConstants, ChiSqr, Wins, GridIndex, MyOptBundle.TransitionsGSL, DRPairs)) goto Error;
+									if (SaveCount > 0) Push_Save_Descending (Saves, SaveCount, ChiSqr, FitConstants[0], FitConstants[1], FitConstants[2]);
 								}
-								if (ExtraLineCount) {
-									if (Wins > 3) {
-										fprintf (FileHandle, "Fitted constants A:%f B:%f C:%f ChiSqr:%f\n",FitConstants[0],FitConstants[1],FitConstants[2],ChiSqr);
-									}
-								} else {
-									fprintf (FileHandle, "Fitted constants A:%f B:%f C:%f ChiSqr:%f\n",FitConstants[0],FitConstants[1],FitConstants[2],ChiSqr);
-								}	
 							}
 						} else {
 							//Working with only 2 DR links
@@ -3056,20 +3833,42 @@ FILE *FileHandle;
 					}
 				}
 				CurrentC += Step;
+				IndexC++;
 			}
-			CurrentB += Step;
 		}
-		CurrentA += Step;
 	}
 	clock_t end = clock();
 	double Timing = (double)(end - start) / CLOCKS_PER_SEC;
 	printf ("%e individual fits performed in %.2fs\n",Count,Timing);
+	if (Verbose && (DRPairs >= 3)) Print_Fit_Cache_Stats (&MyCache);
+	Set_Telemetry_Source (Source);
+	Merge_Fit_Telemetry ();
+	Free_Fit_Cache (&MyCache);
+	Free_Line_Index (&DRIndex);
+	Free_Line_Index (&ExtraIndex);
+	if (SaveCount > 0) Sort_Saves_Descending (Saves, SaveCount);
+	if (!Free_Hit_Buffer (&MyHits)) goto Error;
+	if (CheckpointFile != NULL) {	//Mark the search as finished so a rerun of the same job returns straight away
+		MyCheckpoint.IndexA = IndexA;
+		MyCheckpoint.IndexB = 0;
+		MyCheckpoint.Complete = 1;
+		MyCheckpoint.Count = Count;
+		MyCheckpoint.LogOffset = Result_Sink_Offset (&MySink);
+		Write_Checkpoint (CheckpointFile, &MyCheckpoint, Saves);
+	}
 	free(Match);
 	for (i=-0;i<DRPairs;i++) free(MatchArrays[i]);
 	free(MatchArrays);
-	fclose(FileHandle);
+	if (!Close_Result_Sink (&MySink)) goto Error;
 	return 1;
 Error:
+	Set_Telemetry_Source (Source);
+	Merge_Fit_Telemetry ();
+	Free_Fit_Cache (&MyCache);
+	Free_Line_Index (&DRIndex);
+	Free_Line_Index (&ExtraIndex);
+	if (MyHits.Records != NULL) Free_Hit_Buffer (&MyHits);	//Keep the hits found so far, they're trimmed off again if the search resumes from a checkpoint
+	if (MySink.FileHandle != NULL) Close_Result_Sink (&MySink);
 	printf("Error running matching program");
 	return 0;
 }
@@ -3083,6 +3882,3469 @@ int Match_Levels (int Match1, int Match2, struct Transition *MatchCatalog)
 	}
 } 
 
+////////////////////////////////////
+/* Checkpointing for the long running grid searches */
+
+int Write_Checkpoint (char *FileName, struct Search_Checkpoint *Checkpoint, void *Saves)
+{
+/*
+	Writes a binary checkpoint, the header struct followed by the raw save records
+	The file is written under a temporary name and then renamed over the old one, so a run killed mid-write still leaves the previous checkpoint intact
+	Checkpoints are raw structs, so they're only portable between builds on the same architecture
+*/
+char *TempName;
+FILE *FileHandle;
+int Status;
+	FileHandle = NULL;
+	TempName = malloc((strlen(FileName)+5)*sizeof(char));
+	if (TempName == NULL) goto Error;
+	sprintf (TempName,"%s.tmp",FileName);
+	Checkpoint->Magic = CHECKPOINT_MAGIC;
+	Checkpoint->Version = CHECKPOINT_VERSION;
+	FileHandle = fopen (TempName,"wb");
+	if (FileHandle == NULL) goto Error;
+	if (fwrite (Checkpoint, sizeof(struct Search_Checkpoint), 1, FileHandle) != 1) goto Error;
+	if (Checkpoint->SaveCount > 0) {
+		if (fwrite (Saves, Checkpoint->SaveSize, Checkpoint->SaveCount, FileHandle) != Checkpoint->SaveCount) goto Error;
+	}
+	Status = fclose (FileHandle);
+	FileHandle = NULL;	//Closed either way, even if the flush failed
+	if ((Status != 0) || (rename (TempName, FileName) != 0)) goto Error;
+	free (TempName);
+	return 1;
+Error:
+	printf ("Error writing checkpoint %s\n",FileName);
+	if (FileHandle != NULL) fclose (FileHandle);
+	if (TempName != NULL) {
+		remove (TempName);	//Whatever made it into the temporary file is useless, the previous checkpoint is still in place
+		free (TempName);
+	}
+	return 0;
+}
+
+int Read_Checkpoint (char *FileName, struct Search_Checkpoint *Checkpoint, void *Saves, int SaveCount, int SaveSize)
+{
+/*
+	Reads a checkpoint written by Write_Checkpoint
+	Returns 1 if it was read, 0 if there's no checkpoint (a fresh start) and -1 if there is one but it can't be used: unreadable, short, from another build or holding a different number of saves
+	Callers must not treat -1 as a fresh start, the hit file that goes with the checkpoint would get a second copy of everything before it
+	Saves should already be allocated to SaveCount records of SaveSize bytes
+*/
+FILE *FileHandle;
+	if (access (FileName, F_OK) != 0) return 0;	//No checkpoint is not an error, it just means a fresh start
+	FileHandle = fopen (FileName,"rb");
+	if (FileHandle == NULL) goto Error;
+	if (fread (Checkpoint, sizeof(struct Search_Checkpoint), 1, FileHandle) != 1) goto Error;
+	if ((Checkpoint->Magic != CHECKPOINT_MAGIC) || (Checkpoint->Version != CHECKPOINT_VERSION)) {
+		printf ("Error: %s is not a checkpoint file from this version of the program\n",FileName);
+		goto Error;
+	}
+	if ((Checkpoint->SaveCount != SaveCount) || ((SaveCount > 0) && (Checkpoint->SaveSize != SaveSize))) {
+		printf ("Error: Checkpoint %s holds %d saves, %d were expected\n",FileName,Checkpoint->SaveCount,SaveCount);
+		goto Error;
+	}
+	if (SaveCount > 0) {
+		if (fread (Saves, SaveSize, SaveCount, FileHandle) != SaveCount) goto Error;
+	}
+	fclose (FileHandle);
+	return 1;
+Error:
+	printf ("Error reading checkpoint %s\n",FileName);
+	if (FileHandle != NULL) fclose (FileHandle);
+	return -1;
+}
+
+int Checkpoint_Matches (struct Search_Checkpoint *Checkpoint, int SearchType, double *Bounds, double Step, double Tolerance, int ShardIndex, int ShardCount)
+{
+//Checks a loaded checkpoint was written by the same search over the same grid and shard, resuming anything else would silently give garbage
+int i;
+	if (Checkpoint->SearchType != SearchType) return 0;
+	for (i=0;i<4;i++) if (Checkpoint->Bounds[i] != Bounds[i]) return 0;
+	if ((Checkpoint->Step != Step) || (Checkpoint->Tolerance != Tolerance)) return 0;
+	if ((Checkpoint->ShardIndex != ShardIndex) || (Checkpoint->ShardCount != ShardCount)) return 0;
+	return 1;
+}
+
+int Shard_Owns_Row (int IndexA, int IndexB, int RowsPerA, int ShardIndex, int ShardCount)
+{
+/*
+	Partition of an A/B grid between shards, each A/B row (the full C sweep for that pair) belongs to exactly one shard
+	Rows are dealt out round robin in grid order. The cost of a row grows smoothly with B, so neighbouring rows cost about the same and every shard gets an even share of the work
+	Depends only on the grid indices, so any machine running the same arguments gets the same partition
+*/
+	return (((long) IndexA*RowsPerA+IndexB) % ShardCount) == ShardIndex;
+}
+
+long Log_Length (char *FileName)
+{
+//Current length of a text log in bytes, 0 if it doesn't exist yet
+long Length;
+FILE *FileHandle;
+	FileHandle = fopen (FileName,"rb");
+	if (FileHandle == NULL) return 0;
+	fseek (FileHandle, 0, SEEK_END);
+	Length = ftell (FileHandle);
+	fclose (FileHandle);
+	return Length;
+}
+
+int Trim_Log (char *FileName, long Length)
+{
+//Cuts a text log back to the length recorded in a checkpoint, so results found after the checkpoint aren't written twice on resume
+	if (Log_Length (FileName) <= Length) return 1;
+	if (truncate (FileName, Length) != 0) {
+		printf ("Error: Unable to trim log %s back to the checkpoint\n",FileName);
+		return 0;
+	}
+	return 1;
+}
+
+////////////////////////////////////
+/* Bounded top K saves for the searches */
+
+/*
+	Saves are kept as a binary heap with the worst save kept at Saves[0], so the usual "if (Score > Saves[0].Score)" test still rejects almost everything for free and a new save costs log(SaveCount) instead of a full insertion sort
+	Push_Save keeps the highest scores (min heap, for win counts), Push_Save_Descending keeps the lowest (max heap, for ChiSqr)
+	The heap is always full, empty slots just hold EmptyScore (-1 for win counts, 10000 for ChiSqr by convention), so there's no size to track
+	Sort_Saves/Sort_Saves_Descending put the saves back in the old sorted order with the best save last. A sorted array is still a valid heap, so searches can carry on pushing after a sort
+	For threaded searches each thread pushes into its own empty saves from Allocate_Local_Saves without locking, then those are merged into the shared saves once at the end (the caller holds any lock around the merge)
+*/
+
+void Initialize_Saves (struct MultiSave *Saves, int SaveCount, double EmptyScore)
+{
+//Fills every slot with EmptyScore, a heap of identical scores is a valid heap for either direction
+int i;
+	for (i=0;i<SaveCount;i++) {
+		Saves[i].Score = EmptyScore;
+		Saves[i].A = 0.0;
+		Saves[i].B = 0.0;
+		Saves[i].C = 0.0;
+	}
+}
+
+int Allocate_Local_Saves (struct MultiSave *Saves, int SaveCount, struct MultiSave **LocalSaves)
+{
+/*
+	Per thread saves for Push_Save or Push_Save_Descending, empty apart from using the shared worst score as their empty score
+	That's only a threshold, nothing from the shared saves is copied, so merging the local saves back can't add a shared save twice
+	Slots still holding the threshold are never merged, the pushes only take a strictly better score
+*/
+	*LocalSaves = malloc(SaveCount*sizeof(struct MultiSave));
+	if (*LocalSaves == NULL) {
+		printf ("Memory Error\n");
+		return 0;
+	}
+	Initialize_Saves (*LocalSaves, SaveCount, Saves[0].Score);
+	return 1;
+}
+
+int Push_Save (struct MultiSave *Saves, int SaveCount, double Score, double A, double B, double C)
+{
+//Keeps the new save if it beats the lowest score kept, returns 1 if it was kept
+	if (Score <= Saves[0].Score) return 0;
+	Saves[0].Score = Score;
+	Saves[0].A = A;
+	Saves[0].B = B;
+	Saves[0].C = C;
+	Sift_Saves (Saves, SaveCount, 0, 1.0);
+	return 1;
+}
+
+int Push_Save_Descending (struct MultiSave *Saves, int SaveCount, double Score, double A, double B, double C)
+{
+//Same as Push_Save but lower scores are better, as for ChiSqr
+	if (Score >= Saves[0].Score) return 0;
+	Saves[0].Score = Score;
+	Saves[0].A = A;
+	Saves[0].B = B;
+	Saves[0].C = C;
+	Sift_Saves (Saves, SaveCount, 0, -1.0);
+	return 1;
+}
+
+int Merge_Saves (struct MultiSave *Saves, int SaveCount, struct MultiSave *LocalSaves, int LocalCount)
+{
+//Pushes every local save from Allocate_Local_Saves into the shared saves, returns how many were kept
+int i,Kept;
+	Kept = 0;
+	for (i=0;i<LocalCount;i++) Kept += Push_Save (Saves, SaveCount, LocalSaves[i].Score, LocalSaves[i].A, LocalSaves[i].B, LocalSaves[i].C);
+	return Kept;
+}
+
+int Merge_Saves_Descending (struct MultiSave *Saves, int SaveCount, struct MultiSave *LocalSaves, int LocalCount)
+{
+//Merge_Saves for Push_Save_Descending, the local saves have to be empty to start with (Allocate_Local_Saves) or shared saves come back twice
+int i,Kept;
+	Kept = 0;
+	for (i=0;i<LocalCount;i++) Kept += Push_Save_Descending (Saves, SaveCount, LocalSaves[i].Score, LocalSaves[i].A, LocalSaves[i].B, LocalSaves[i].C);
+	return Kept;
+}
+
+void Heapify_Saves (struct MultiSave *Saves, int SaveCount, double Sign)
+{
+//Turns an arbitrary array of saves into a heap, Sign is 1 for Push_Save and -1 for Push_Save_Descending
+int i;
+	for (i=SaveCount/2-1;i>=0;i--) Sift_Saves (Saves, SaveCount, i, Sign);
+}
+
+void Sift_Saves (struct MultiSave *Saves, int SaveCount, int Index, double Sign)
+{
+//Moves Saves[Index] down until both children are no worse than it
+int Child;
+struct MultiSave Key;
+	Key = Saves[Index];
+	while ((Child = 2*Index+1) < SaveCount) {
+		if ((Child+1 < SaveCount) && (Sign*Saves[Child+1].Score < Sign*Saves[Child].Score)) Child++;
+		if (Sign*Saves[Child].Score >= Sign*Key.Score) break;
+		Saves[Index] = Saves[Child];
+		Index = Child;
+	}
+	Saves[Index] = Key;
+}
+
+void Sort_Saves (struct MultiSave *Saves, int SaveCount)
+{
+	qsort (Saves, SaveCount, sizeof(struct MultiSave), Compare_Saves);
+}
+
+void Sort_Saves_Descending (struct MultiSave *Saves, int SaveCount)
+{
+	qsort (Saves, SaveCount, sizeof(struct MultiSave), Compare_Saves_Descending);
+}
+
+int Compare_Saves (const void *a, const void *b)
+{
+//Comparison function for qsort sorting of saves, ascending in score
+	double A = ((struct MultiSave *) a)->Score;
+	double B = ((struct MultiSave *) b)->Score;
+	if (A > B) return 1;
+	else if (A < B) return -1;
+	else return 0;
+}
+
+int Compare_Saves_Descending (const void *a, const void *b)
+{
+	return Compare_Saves (b, a);
+}
+
+////////////////////////////////////
+/* Top K saves with a score profile */
+
+/*
+	Same min heap as Push_Save (lowest score at Saves[0], best last after sorting), but each save carries the scores at every tolerance of a multi tolerance search
+	Score is whichever entry of the profile the search ranks by
+*/
+
+void Initialize_Profile_Saves (struct Profile_Save *Saves, int SaveCount)
+{
+int i;
+	for (i=0;i<SaveCount;i++) {
+		memset (&(Saves[i]),0,sizeof(struct Profile_Save));
+		Saves[i].Score = -1.0;
+	}
+}
+
+int Push_Profile_Save (struct Profile_Save *Saves, int SaveCount, struct Profile_Save *NewSave)
+{
+//Keeps NewSave if it beats the lowest score kept, returns 1 if it was kept
+int Index,Child;
+	if ((SaveCount < 1) || (NewSave->Score <= Saves[0].Score)) return 0;
+	Index = 0;
+	while ((Child = 2*Index+1) < SaveCount) {
+		if ((Child+1 < SaveCount) && (Saves[Child+1].Score < Saves[Child].Score)) Child++;
+		if (Saves[Child].Score >= NewSave->Score) break;
+		Saves[Index] = Saves[Child];
+		Index = Child;
+	}
+	Saves[Index] = *NewSave;
+	return 1;
+}
+
+void Sort_Profile_Saves (struct Profile_Save *Saves, int SaveCount)
+{
+	qsort (Saves, SaveCount, sizeof(struct Profile_Save), Compare_Profile_Saves);
+}
+
+int Compare_Profile_Saves (const void *a, const void *b)
+{
+//Comparison function for qsort sorting of profile saves, ascending in score
+	double A = ((struct Profile_Save *) a)->Score;
+	double B = ((struct Profile_Save *) b)->Score;
+	if (A > B) return 1;
+	else if (A < B) return -1;
+	else return 0;
+}
+
+////////////////////////////////////
+/* Lazy k-combination enumeration */
+
+/*
+	Walks every K line subset of N lines one tuple at a time, so fitting all subsets needs no memory beyond the current tuple
+	A range of ranks [First,Last) can be started directly, Split_Combinations hands out even ranges so threads can share one subset space
+	Typical use:
+		if (Start_Combination (&Comb, N, K, First, Last)) do {
+			...Comb.Index[0]...Comb.Index[K-1]...
+		} while (Next_Combination (&Comb));
+*/
+
+double Binomial (int N, int K)
+{
+//N choose K, exact as long as the result fits in a double's mantissa
+double Result;
+int i;
+	if ((K < 0) || (K > N)) return 0.0;
+	if (K > N-K) K = N-K;
+	Result = 1.0;
+	for (i=1;i<=K;i++) Result = Result*(N-K+i)/i;	//Every partial product is itself a binomial, so this stays an integer
+	return Result;
+}
+
+int Start_Combination (struct Combination *Comb, int N, int K, double First, double Last)
+{
+//Sets Comb to the First'th K subset of N, returns 0 if there's nothing to enumerate
+int i,x;
+double Rank,Count;
+	if ((K < 1) || (K > MAX_COMBINATION) || (K > N)) return 0;
+	if (Last > Binomial(N,K)) Last = Binomial(N,K);
+	if ((First < 0.0) || (First >= Last)) return 0;
+	Comb->N = N;
+	Comb->K = K;
+	Comb->Rank = First;
+	Comb->Last = Last;
+	//Unrank, each position skips over the whole blocks of tuples that start with a smaller index
+	Rank = First;
+	x = 0;
+	for (i=0;i<K;i++) {
+		while ((Count = Binomial(N-1-x,K-1-i)) <= Rank) {
+			Rank -= Count;
+			x++;
+		}
+		Comb->Index[i] = x;
+		x++;
+	}
+	return 1;
+}
+
+int Next_Combination (struct Combination *Comb)
+{
+//Moves to the next tuple, returns 0 once the range is used up
+int i,j;
+	Comb->Rank += 1.0;
+	if (Comb->Rank >= Comb->Last) return 0;
+	i = Comb->K-1;
+	while ((i >= 0) && (Comb->Index[i] == Comb->N-Comb->K+i)) i--;	//Rightmost index that can still move up
+	if (i < 0) return 0;
+	Comb->Index[i]++;
+	for (j=i+1;j<Comb->K;j++) Comb->Index[j] = Comb->Index[j-1]+1;
+	return 1;
+}
+
+void Split_Combinations (double Total, int Part, int Parts, double *First, double *Last)
+{
+//Rank range [First,Last) of part Part out of Parts, the parts differ in size by at most one tuple
+	*First = floor(Total*Part/Parts);
+	*Last = floor(Total*(Part+1)/Parts);
+}
+
+////////////////////////////////////
+/* Buffered binary hit output for the searches */
+
+/*
+	Searches used to fopen/fprintf/fclose a text log for every hit, which throttles the search once a noisy spectrum gives millions of hits
+	Now each thread fills its own Hit_Buffer with no locking, and only takes the sink's lock to write a whole buffer in one fwrite
+	The file is a Hit_File_Header followed by raw Hit_Records, so like the checkpoints it's only portable between builds on the same architecture
+	Export_Hits_Text turns a hit file into a readable text table
+*/
+
+int Open_Result_Sink (char *FileName, int Resume, struct Result_Sink *Sink)
+{
+/*
+	Opens a hit file for a search
+	FileName - Hit file
+	Resume - 0 for a new search, the file is emptied and gets a fresh header. Otherwise the search is resuming from a checkpoint and carries on appending to the hits it already wrote, which have to be there behind a header from this build
+	A file that's already there has to start with a header from this build either way, anything else (like a text log from before hit files were binary) is left alone and the search refuses to run rather than overwriting or appending to it
+*/
+struct Hit_File_Header Header;
+int Found;
+	Sink->FileName = FileName;
+	Sink->Records = 0.0;
+	Found = 0;
+	Sink->FileHandle = fopen (FileName,"rb");	//Look at what's there before touching it
+	if (Sink->FileHandle != NULL) {
+		Found = fread (&Header, 1, sizeof(struct Hit_File_Header), Sink->FileHandle);
+		fclose (Sink->FileHandle);
+		Sink->FileHandle = NULL;
+	}
+	if ((Found != 0) && ((Found != sizeof(struct Hit_File_Header)) || (Header.Magic != HIT_MAGIC) || (Header.Version != HIT_VERSION) || (Header.RecordSize != sizeof(struct Hit_Record)) || (Header.MaxLines != HIT_MAX_LINES))) {
+		printf ("Error: %s exists but isn't a hit file from this build, move it out of the way or pick another name\n",FileName);
+		goto Error;
+	}
+	if (Resume && (Found == 0)) {
+		printf ("Error: %s is missing the hits written before the checkpoint, delete the checkpoint to start over\n",FileName);
+		goto Error;
+	}
+	Sink->FileHandle = fopen (FileName, Resume ? "a+b" : "w+b");	//Appending keeps every write at the end, a new search starts from an empty file
+	if (Sink->FileHandle == NULL) goto Error;
+	if (!Resume) {
+		Header.Magic = HIT_MAGIC;
+		Header.Version = HIT_VERSION;
+		Header.RecordSize = sizeof(struct Hit_Record);
+		Header.MaxLines = HIT_MAX_LINES;
+		if (fwrite (&Header, sizeof(struct Hit_File_Header), 1, Sink->FileHandle) != 1) goto Error;
+	}
+	fseek (Sink->FileHandle, 0, SEEK_END);
+	if (pthread_mutex_init (&(Sink->Lock), NULL) != 0) goto Error;
+	return 1;
+Error:
+	printf ("Error: Unable to open hit file %s\n",FileName);
+	if (Sink->FileHandle != NULL) fclose (Sink->FileHandle);
+	Sink->FileHandle = NULL;
+	return 0;
+}
+
+int Close_Result_Sink (struct Result_Sink *Sink)
+{
+//Every buffer writing to the sink should have been freed first, FileHandle is NULL afterwards so error paths can tell it's closed
+int Status;
+	pthread_mutex_destroy (&(Sink->Lock));
+	Status = fclose (Sink->FileHandle);
+	Sink->FileHandle = NULL;
+	if (Status != 0) {
+		printf ("Error: Unable to finish writing hit file %s\n",Sink->FileName);
+		return 0;
+	}
+	return 1;
+}
+
+long Result_Sink_Offset (struct Result_Sink *Sink)
+{
+//Length of the hit file with everything handed to the sink so far on disk, used for checkpoints. Flush the hit buffers first
+long Offset;
+	pthread_mutex_lock (&(Sink->Lock));
+	fflush (Sink->FileHandle);
+	Offset = ftell (Sink->FileHandle);
+	pthread_mutex_unlock (&(Sink->Lock));
+	return Offset;
+}
+
+int Allocate_Hit_Buffer (struct Result_Sink *Sink, int Size, struct Hit_Buffer *Buffer)
+{
+	Buffer->Records = malloc(Size*sizeof(struct Hit_Record));
+	if (Buffer->Records == NULL) {
+		printf ("Memory Error\n");
+		return 0;
+	}
+	Buffer->Count = 0;
+	Buffer->Size = Size;
+	Buffer->Sink = Sink;
+	return 1;
+}
+
+int Add_Hit (struct Hit_Buffer *Buffer, double *Constants, double ChiSqr, double Score, int *GridIndex, struct Transition *Lines, int LineCount)
+{
+/*
+	Records a hit, the sink is only touched when the buffer fills up
+Constants - Fitted constants
+ChiSqr/Score - Fit quality and the score of the grid point that led to it
+GridIndex - A/B/C grid indices, NULL if the search isn't on a grid
+Lines - Fitted transitions, Frequency should be the experimental frequency they were assigned to
+LineCount - # of transitions in Lines
+*/
+int i;
+struct Hit_Record *Record;
+	Record = &(Buffer->Records[Buffer->Count]);
+	for (i=0;i<3;i++) {
+		Record->Constants[i] = Constants[i];
+		Record->GridIndex[i] = (GridIndex == NULL) ? -1 : GridIndex[i];
+	}
+	Record->ChiSqr = ChiSqr;
+	Record->Score = Score;
+	Record->LineCount = LineCount;
+	for (i=0;i<HIT_MAX_LINES;i++) {
+		if (i < LineCount) {
+			Record->Upper[i] = Lines[i].Upper;
+			Record->Lower[i] = Lines[i].Lower;
+			Record->Frequency[i] = Lines[i].Frequency;
+		} else {
+			Record->Upper[i] = 0;
+			Record->Lower[i] = 0;
+			Record->Frequency[i] = 0.0;
+		}
+	}
+	Buffer->Count++;
+	if (Buffer->Count == Buffer->Size) return Flush_Hit_Buffer (Buffer);
+	return 1;
+}
+
+int Flush_Hit_Buffer (struct Hit_Buffer *Buffer)
+{
+//Writes out everything in the buffer in one block
+int Written;
+	if (Buffer->Count == 0) return 1;
+	pthread_mutex_lock (&(Buffer->Sink->Lock));
+	Written = fwrite (Buffer->Records, sizeof(struct Hit_Record), Buffer->Count, Buffer->Sink->FileHandle);
+	Buffer->Sink->Records += Written;
+	pthread_mutex_unlock (&(Buffer->Sink->Lock));
+	if (Written != Buffer->Count) {
+		printf ("Error: Unable to write hits to %s\n",Buffer->Sink->FileName);
+		return 0;
+	}
+	Buffer->Count = 0;
+	return 1;
+}
+
+int Free_Hit_Buffer (struct Hit_Buffer *Buffer)
+{
+//Flushes whatever is left and frees the buffer
+int Status;
+	Status = Flush_Hit_Buffer (Buffer);
+	free (Buffer->Records);
+	Buffer->Records = NULL;
+	return Status;
+}
+
+int Load_Hits (char *FileName, struct Hit_Record **Hits, int *HitCount)
+{
+//Reads a whole hit file into memory
+long Length;
+struct Hit_File_Header Header;
+FILE *FileHandle;
+	*Hits = NULL;
+	FileHandle = fopen (FileName,"rb");
+	if (FileHandle == NULL) goto Error;
+	if (fread (&Header, sizeof(struct Hit_File_Header), 1, FileHandle) != 1) goto Error;
+	if ((Header.Magic != HIT_MAGIC) || (Header.Version != HIT_VERSION) || (Header.RecordSize != sizeof(struct Hit_Record)) || (Header.MaxLines != HIT_MAX_LINES)) {
+		printf ("Error: %s is not a hit file from this version of the program\n",FileName);
+		goto Error;
+	}
+	fseek (FileHandle, 0, SEEK_END);
+	Length = ftell (FileHandle)-sizeof(struct Hit_File_Header);
+	fseek (FileHandle, sizeof(struct Hit_File_Header), SEEK_SET);
+	*HitCount = Length/sizeof(struct Hit_Record);
+	*Hits = malloc(((*HitCount > 0) ? *HitCount : 1)*sizeof(struct Hit_Record));
+	if (*Hits == NULL) goto Error;
+	if (fread (*Hits, sizeof(struct Hit_Record), *HitCount, FileHandle) != *HitCount) goto Error;
+	fclose (FileHandle);
+	return 1;
+Error:
+	printf ("Error: Unable to load hit file %s\n",FileName);
+	if (FileHandle != NULL) fclose (FileHandle);
+	free (*Hits);
+	*Hits = NULL;
+	return 0;
+}
+
+int Export_Hits_Text (char *HitFile, char *TextFile, struct Level *MyDictionary)
+{
+/*
+	Writes a hit file out as text, one hit per line
+	A B C ChiSqr Score GridA GridB GridC, then each fitted transition as Frequency J,Ka,Kc-J,Ka,Kc
+	MyDictionary is only needed for the quantum numbers, with NULL the raw level indices are written instead
+*/
+int i,j,HitCount;
+struct Hit_Record *Hits;
+FILE *FileHandle;
+	if (!Load_Hits (HitFile, &Hits, &HitCount)) return 0;
+	FileHandle = fopen (TextFile,"w");
+	if (FileHandle == NULL) {
+		printf ("Error: Unable to open %s\n",TextFile);
+		free (Hits);
+		return 0;
+	}
+	for (i=0;i<HitCount;i++) {
+		fprintf (FileHandle,"%.3f %.3f %.3f %f %.2f %d %d %d",Hits[i].Constants[0],Hits[i].Constants[1],Hits[i].Constants[2],Hits[i].ChiSqr,Hits[i].Score,Hits[i].GridIndex[0],Hits[i].GridIndex[1],Hits[i].GridIndex[2]);
+		for (j=0;(j<Hits[i].LineCount) && (j<HIT_MAX_LINES);j++) {
+			if (MyDictionary != NULL) {
+				fprintf (FileHandle," %.4f %d,%d,%d-%d,%d,%d",Hits[i].Frequency[j],MyDictionary[Hits[i].Upper[j]].J,MyDictionary[Hits[i].Upper[j]].Ka,MyDictionary[Hits[i].Upper[j]].Kc,MyDictionary[Hits[i].Lower[j]].J,MyDictionary[Hits[i].Lower[j]].Ka,MyDictionary[Hits[i].Lower[j]].Kc);
+			} else {
+				fprintf (FileHandle," %.4f %u-%u",Hits[i].Frequency[j],Hits[i].Upper[j],Hits[i].Lower[j]);
+			}
+		}
+		fprintf (FileHandle,"\n");
+	}
+	fclose (FileHandle);
+	free (Hits);
+	return 1;
+}
+
+
+////////////////////////////////////
+/* Bucketed experimental line index */
+
+/*
+	Get_Catalog output isn't in frequency order, so matching a catalog line used to mean checking it against every experimental line
+	The index splits the band covered by the lines into buckets, built once per search with a counting sort
+	-Buckets are the wider of 2*Tolerance and the band over the line count, so there are never more buckets than lines and a tiny tolerance costs no memory
+	-Every line within Tolerance of a frequency is then in at most two neighbouring buckets, which sit next to each other in Lines
+	Per catalog line the cost depends on how many lines share those buckets, about one each on average, not on how many lines there are
+*/
+
+int Build_Line_Index (double *Lines, int LineCount, double Tolerance, struct Line_Index *Index)
+{
+//Builds the index over Lines for matches within Tolerance, Lines is left untouched. An empty list gives an index that never matches
+int i,j,Bucket,Position;
+double High,Key;
+	Index->Source = Lines;
+	Index->Lines = NULL;
+	Index->Order = NULL;
+	Index->Start = NULL;
+	Index->LineCount = LineCount;
+	Index->BucketCount = 0;
+	Index->Low = 0.0;
+	Index->Width = 2.0*Tolerance;
+	Index->Tolerance = Tolerance;
+	if (LineCount <= 0) return 1;
+	if (Tolerance <= 0.0) {
+		printf ("Error: Line index needs a positive tolerance, got %f\n",Tolerance);
+		return 0;
+	}
+	Index->Low = Lines[0];
+	High = Lines[0];
+	for (i=1;i<LineCount;i++) {
+		if (Lines[i] < Index->Low) Index->Low = Lines[i];
+		if (Lines[i] > High) High = Lines[i];
+	}
+	if ((High-Index->Low)/LineCount > Index->Width) Index->Width = (High-Index->Low)/LineCount;	//Sized by the line count, not the tolerance
+	Index->BucketCount = (int) floor((High-Index->Low)/Index->Width)+1;
+	Index->Lines = malloc (LineCount*sizeof(double));
+	Index->Order = malloc (LineCount*sizeof(int));
+	Index->Start = calloc (Index->BucketCount+1,sizeof(int));
+	if ((Index->Lines == NULL) || (Index->Order == NULL) || (Index->Start == NULL)) goto Error;
+	//Counting sort, Start[b] counts bucket b, then becomes its end, then walking the lines backwards moves it down to the bucket's start
+	for (i=0;i<LineCount;i++) Index->Start[(int) floor((Lines[i]-Index->Low)/Index->Width)]++;
+	for (i=1;i<Index->BucketCount;i++) Index->Start[i] += Index->Start[i-1];
+	Index->Start[Index->BucketCount] = LineCount;
+	for (i=LineCount-1;i>=0;i--) {
+		Bucket = (int) floor((Lines[i]-Index->Low)/Index->Width);
+		Index->Start[Bucket]--;
+		Index->Lines[Index->Start[Bucket]] = Lines[i];
+		Index->Order[Index->Start[Bucket]] = i;
+	}
+	//Buckets only hold a handful of lines, insertion sort each so the lowest match in a window is the first one found
+	for (Bucket=0;Bucket<Index->BucketCount;Bucket++) {
+		for (i=Index->Start[Bucket]+1;i<Index->Start[Bucket+1];i++) {
+			Key = Index->Lines[i];
+			Position = Index->Order[i];
+			for (j=i-1;(j >= Index->Start[Bucket]) && (Index->Lines[j] > Key);j--) {
+				Index->Lines[j+1] = Index->Lines[j];
+				Index->Order[j+1] = Index->Order[j];
+			}
+			Index->Lines[j+1] = Key;
+			Index->Order[j+1] = Position;
+		}
+	}
+	return 1;
+Error:
+	printf ("Error allocating line index\n");
+	Free_Line_Index (Index);
+	return 0;
+}
+
+void Free_Line_Index (struct Line_Index *Index)
+{
+	free (Index->Lines);
+	free (Index->Order);
+	free (Index->Start);
+	Index->Lines = NULL;
+	Index->Order = NULL;
+	Index->Start = NULL;
+	Index->Source = NULL;
+	Index->LineCount = 0;
+	Index->BucketCount = 0;
+}
+
+void Line_Index_Range (struct Line_Index *Index, double Frequency, int *First, int *Last)
+{
+//Entries [First,Last) of Index->Lines are the only ones that can be within Tolerance of Frequency, callers still check the distance
+int Low,High;
+	*First = 0;
+	*Last = 0;
+	if ((Index->BucketCount == 0) || !(Frequency+Index->Tolerance >= Index->Low)) return;	//Also drops NaN frequencies
+	Low = (Frequency-Index->Tolerance < Index->Low) ? 0 : (int) floor((Frequency-Index->Tolerance-Index->Low)/Index->Width);
+	if (Low >= Index->BucketCount) return;
+	High = (int) floor((Frequency+Index->Tolerance-Index->Low)/Index->Width);
+	if (High >= Index->BucketCount) High = Index->BucketCount-1;
+	*First = Index->Start[Low];
+	*Last = Index->Start[High+1];
+}
+
+int Line_Index_Matches (struct Line_Index *Index, double Frequency)
+{
+//# of indexed lines within Tolerance of Frequency
+int i,First,Last,Matches;
+	Line_Index_Range (Index, Frequency, &First, &Last);
+	Matches = 0;
+	for (i=First;i<Last;i++) if (fabs(Index->Lines[i]-Frequency) < Index->Tolerance) Matches++;
+	return Matches;
+}
+
+double Count_Index_Wins (struct Line_Index *Index, struct Transition *SourceCatalog, int CatalogTransitions)
+{
+//Same score as CountWins, each catalog line within Tolerance of any indexed line is a win
+int i,j,First,Last;
+double Wins;
+	Wins = 0.0;
+	for (i=0;i<CatalogTransitions;i++) {
+		Line_Index_Range (Index, SourceCatalog[i].Frequency, &First, &Last);
+		for (j=First;j<Last;j++) {
+			if (fabs(Index->Lines[j]-SourceCatalog[i].Frequency) < Index->Tolerance) {
+				Wins++;
+				break;
+			}
+		}
+	}
+	return Wins;
+}
+
+double Count_Index_Wins_Exp (struct Line_Index *Index, struct Transition *SourceCatalog, int CatalogTransitions)
+{
+//Same score as CountWins_Exp with the lines in ascending order, each catalog line is weighted by its distance to the lowest line in its window
+int i,j,First,Last;
+double Wins;
+	Wins = 0.0;
+	for (i=0;i<CatalogTransitions;i++) {
+		Line_Index_Range (Index, SourceCatalog[i].Frequency, &First, &Last);
+		for (j=First;j<Last;j++) {
+			if (fabs(Index->Lines[j]-SourceCatalog[i].Frequency) < Index->Tolerance) {
+				Wins += exp(-fabs(Index->Lines[j]-SourceCatalog[i].Frequency));
+				break;
+			}
+		}
+	}
+	return Wins;
+}
+
+double Count_Index_Wins_Bounded (struct Line_Index *Index, struct Transition *SourceCatalog, int CatalogTransitions, double Threshold)
+{
+//Count_Index_Wins that stops once the lines left can't lift the score above Threshold, what it returns then is a bound <= Threshold rather than the score
+int i,j,First,Last;
+double Wins;
+	Wins = 0.0;
+	for (i=0;i<CatalogTransitions;i++) {
+		if (Wins+(CatalogTransitions-i) <= Threshold) return Wins+(CatalogTransitions-i);
+		Line_Index_Range (Index, SourceCatalog[i].Frequency, &First, &Last);
+		for (j=First;j<Last;j++) {
+			if (fabs(Index->Lines[j]-SourceCatalog[i].Frequency) < Index->Tolerance) {
+				Wins++;
+				break;
+			}
+		}
+	}
+	return Wins;
+}
+
+double Count_Index_Wins_Exp_Bounded (struct Line_Index *Index, struct Transition *SourceCatalog, int CatalogTransitions, double Threshold)
+{
+//Count_Index_Wins_Exp with the same early stop, every line is worth at most 1
+int i,j,First,Last;
+double Wins;
+	Wins = 0.0;
+	for (i=0;i<CatalogTransitions;i++) {
+		if (Wins+(CatalogTransitions-i) <= Threshold) return Wins+(CatalogTransitions-i);
+		Line_Index_Range (Index, SourceCatalog[i].Frequency, &First, &Last);
+		for (j=First;j<Last;j++) {
+			if (fabs(Index->Lines[j]-SourceCatalog[i].Frequency) < Index->Tolerance) {
+				Wins += exp(-fabs(Index->Lines[j]-SourceCatalog[i].Frequency));
+				break;
+			}
+		}
+	}
+	return Wins;
+}
+
+int Count_Index_Wins_Multi (struct Line_Index *Index, struct Transition *SourceCatalog, int CatalogTransitions, double *Tolerances, int ToleranceCount, double *Wins, double *WinsExp)
+{
+/*
+	Count_Index_Wins and Count_Index_Wins_Exp for several tolerances in one pass, Wins[t]/WinsExp[t] are the scores at Tolerances[t]
+	Index must have been built with the largest tolerance, each catalog line walks its window once and each line in it settles every tolerance it's inside
+	Returns 0 if a tolerance is bigger than the index covers
+*/
+int i,j,t,First,Last,Unmatched;
+int Matched[MAX_TOLERANCES];
+double Distance,Weight;
+	if ((ToleranceCount < 1) || (ToleranceCount > MAX_TOLERANCES)) {
+		printf ("Error: %d tolerances given, between 1 and %d are supported\n",ToleranceCount,MAX_TOLERANCES);
+		return 0;
+	}
+	for (t=0;t<ToleranceCount;t++) {
+		if (Tolerances[t] > Index->Tolerance) {
+			printf ("Error: Tolerance %f is wider than the line index (%f)\n",Tolerances[t],Index->Tolerance);
+			return 0;
+		}
+		Wins[t] = 0.0;
+		WinsExp[t] = 0.0;
+	}
+	for (i=0;i<CatalogTransitions;i++) {
+		Line_Index_Range (Index, SourceCatalog[i].Frequency, &First, &Last);
+		for (t=0;t<ToleranceCount;t++) Matched[t] = 0;
+		Unmatched = ToleranceCount;
+		for (j=First;(j<Last) && (Unmatched > 0);j++) {	//Lines come lowest first, so the first one inside a tolerance is the one CountWins_Exp would weight
+			Distance = fabs(Index->Lines[j]-SourceCatalog[i].Frequency);
+			Weight = -1.0;
+			for (t=0;t<ToleranceCount;t++) {
+				if (!Matched[t] && (Distance < Tolerances[t])) {
+					if (Weight < 0.0) Weight = exp(-Distance);
+					Matched[t] = 1;
+					Unmatched--;
+					Wins[t]++;
+					WinsExp[t] += Weight;
+				}
+			}
+		}
+	}
+	return 1;
+}
+
+double Score_Catalog_Fused (struct Transition *SourceCatalog, int CatalogTransitions, double *Constants, struct ETauStruct ETStruct, struct Level *MyDictionary, struct Line_Index *Index, int Weighted, double Threshold)
+{
+/*
+	Get_Catalog and Count_Index_Wins (or Count_Index_Wins_Exp if Weighted) in one pass, each frequency is scored as soon as it's computed and never written back
+	Every catalog line adds at most 1 to either score, so once the lines left can't lift the score above Threshold the rest are skipped
+	Pass the lowest score in the top K saves as Threshold, or -1 to always score the whole catalog
+	Returns the score, or some value <= Threshold if the catalog was cut short
+*/
+int i,j,First,Last;
+double Wins,Kappa,Frequency;
+	Kappa = Get_Kappa (Constants[0],Constants[1],Constants[2]);	//Same for every line, Get_Frequency would redo it each time
+	Wins = 0.0;
+	for (i=0;i<CatalogTransitions;i++) {
+		if (Wins+(CatalogTransitions-i) <= Threshold) return Wins;
+		Frequency = fabs(Rigid_Rotor(Constants[0],Constants[2],MyDictionary[SourceCatalog[i].Upper].J,SourceCatalog[i].Upper,Kappa,ETStruct)-Rigid_Rotor(Constants[0],Constants[2],MyDictionary[SourceCatalog[i].Lower].J,SourceCatalog[i].Lower,Kappa,ETStruct));
+		Line_Index_Range (Index, Frequency, &First, &Last);
+		for (j=First;j<Last;j++) {
+			if (fabs(Index->Lines[j]-Frequency) < Index->Tolerance) {
+				Wins += Weighted ? exp(-fabs(Index->Lines[j]-Frequency)) : 1.0;
+				break;
+			}
+		}
+	}
+	return Wins;
+}
+
+////////////////////////////////////
+/* Memoized fits */
+
+/*
+	Neighbouring grid points mostly match the same catalog transitions to the same experimental lines, so the same fit gets run over and over
+	The cache keys a fit by its sorted (Upper, Lower, experimental frequency) pairs and the fit method, and hands back the stored constants, ChiSqr and convergence
+	-Local fits (GSL, small LM) are keyed on the assignment alone. A hit returns the minimum the first fit of that set converged to, from that fit's guess. Started from a neighbouring grid point the same set almost always lands in the same minimum, but if it has more than one the answer depends on which grid point fit it first
+	-FIT_METHOD_PROFILE on 4 or more lines returns the lowest ChiSqr solution whatever the guess, so nothing depends on the guess there
+	-3 line profile fits pick the exact solution closest to the guess, so the guess is part of their key and they only hit on a refit from the same point
+	Memory is fixed at Capacity entries, the least recently used entry is dropped when it's full
+	Caches aren't locked, give each thread its own
+*/
+
+int Initialize_Fit_Cache (struct Fit_Cache *Cache, int Capacity)
+{
+//Allocates an empty cache of Capacity fits, Capacity 0 gives a cache that never hits
+int i,Buckets;
+	Cache->Entries = NULL;
+	Cache->Buckets = NULL;
+	Cache->Capacity = 0;
+	Cache->BucketMask = 0;
+	Cache->Count = 0;
+	Cache->Newest = -1;
+	Cache->Oldest = -1;
+	Cache->Lookups = 0.0;
+	Cache->Hits = 0.0;
+	Cache->Evictions = 0.0;
+	if (Capacity <= 0) return 1;
+	for (Buckets=1;Buckets<2*Capacity;Buckets*=2);	//Keep the load factor at or under 0.5
+	Cache->Entries = malloc (Capacity*sizeof(struct Fit_Cache_Entry));
+	Cache->Buckets = malloc (Buckets*sizeof(int));
+	if ((Cache->Entries == NULL) || (Cache->Buckets == NULL)) goto Error;
+	for (i=0;i<Buckets;i++) Cache->Buckets[i] = -1;
+	Cache->Capacity = Capacity;
+	Cache->BucketMask = Buckets-1;
+	return 1;
+Error:
+	printf ("Error allocating fit cache of %d entries\n",Capacity);
+	free (Cache->Entries);
+	free (Cache->Buckets);
+	Cache->Entries = NULL;
+	Cache->Buckets = NULL;
+	return 0;
+}
+
+void Free_Fit_Cache (struct Fit_Cache *Cache)
+{
+	free (Cache->Entries);
+	free (Cache->Buckets);
+	Cache->Entries = NULL;
+	Cache->Buckets = NULL;
+	Cache->Capacity = 0;
+	Cache->Count = 0;
+}
+
+int Fit_Cache_Key (struct Transition *Lines, double *Frequencies, int LineCount, int FitMethod, double *Guess, struct Fit_Cache_Entry *Key)
+{
+//Fills the key fields of Key, pairs are insertion sorted (at most FIT_CACHE_MAX_LINES of them) and hashed with FNV-1a plus a final mix, returns 0 if the fit has too many lines to cache
+int i,j;
+unsigned int Upper,Lower;
+unsigned long long Hash,Bits;
+double Frequency;
+	if ((LineCount < 1) || (LineCount > FIT_CACHE_MAX_LINES)) return 0;
+	for (i=0;i<LineCount;i++) {
+		Upper = Lines[i].Upper;
+		Lower = Lines[i].Lower;
+		Frequency = Frequencies[i];
+		for (j=i-1;j>=0;j--) {
+			if ((Key->Upper[j] < Upper) || ((Key->Upper[j] == Upper) && ((Key->Lower[j] < Lower) || ((Key->Lower[j] == Lower) && (Key->Frequency[j] <= Frequency))))) break;
+			Key->Upper[j+1] = Key->Upper[j];
+			Key->Lower[j+1] = Key->Lower[j];
+			Key->Frequency[j+1] = Key->Frequency[j];
+		}
+		Key->Upper[j+1] = Upper;
+		Key->Lower[j+1] = Lower;
+		Key->Frequency[j+1] = Frequency;
+	}
+	Key->LineCount = LineCount;
+	Key->FitMethod = FitMethod;
+	for (i=0;i<3;i++) Key->Guess[i] = ((FitMethod == FIT_METHOD_PROFILE) && (LineCount <= 3)) ? Guess[i] : 0.0;	//Only the 3 line profile fit picks its answer by the guess
+	Hash = (14695981039346656037ULL^FitMethod)*1099511628211ULL;
+	for (i=0;i<3;i++) {
+		memcpy (&Bits,&(Key->Guess[i]),sizeof(Bits));
+		Hash = (Hash^Bits)*1099511628211ULL;
+	}
+	for (i=0;i<LineCount;i++) {
+		memcpy (&Bits,&(Key->Frequency[i]),sizeof(Bits));
+		Hash = (Hash^Key->Upper[i])*1099511628211ULL;
+		Hash = (Hash^Key->Lower[i])*1099511628211ULL;
+		Hash = (Hash^Bits)*1099511628211ULL;
+	}
+	Hash ^= Hash >> 33;	//FNV on whole words leaves the low bits blind to the high input bits, mix them down since buckets use the low bits
+	Hash *= 0xff51afd7ed558ccdULL;
+	Hash ^= Hash >> 33;
+	Key->Hash = Hash;
+	return 1;
+}
+
+int Fit_Cache_Find (struct Fit_Cache *Cache, struct Fit_Cache_Entry *Key)
+{
+//Index of the entry matching Key, -1 if it isn't cached
+int i,Index;
+struct Fit_Cache_Entry *Entry;
+	for (Index=Cache->Buckets[Key->Hash & Cache->BucketMask];Index != -1;Index=Entry->Next) {
+		Entry = &(Cache->Entries[Index]);
+		if ((Entry->Hash != Key->Hash) || (Entry->LineCount != Key->LineCount) || (Entry->FitMethod != Key->FitMethod)) continue;
+		if ((Entry->Guess[0] != Key->Guess[0]) || (Entry->Guess[1] != Key->Guess[1]) || (Entry->Guess[2] != Key->Guess[2])) continue;
+		for (i=0;i<Key->LineCount;i++) {
+			if ((Entry->Upper[i] != Key->Upper[i]) || (Entry->Lower[i] != Key->Lower[i]) || (Entry->Frequency[i] != Key->Frequency[i])) break;
+		}
+		if (i == Key->LineCount) return Index;
+	}
+	return -1;
+}
+
+void Fit_Cache_Touch (struct Fit_Cache *Cache, int Index)
+{
+//Moves an entry already in the LRU list to the newest end
+struct Fit_Cache_Entry *Entry;
+	if (Cache->Newest == Index) return;
+	Entry = &(Cache->Entries[Index]);
+	if (Entry->Older != -1) Cache->Entries[Entry->Older].Newer = Entry->Newer;
+	else Cache->Oldest = Entry->Newer;
+	Cache->Entries[Entry->Newer].Older = Entry->Older;	//Not the newest, so there's always a newer entry
+	Entry->Older = Cache->Newest;
+	Entry->Newer = -1;
+	Cache->Entries[Cache->Newest].Newer = Index;
+	Cache->Newest = Index;
+}
+
+int Fit_Cache_Lookup (struct Fit_Cache *Cache, struct Transition *Lines, double *Frequencies, int LineCount, int FitMethod, double *Guess, double *Constants, double *ChiSqr, int *Converged)
+{
+//Returns 1 and fills Constants/ChiSqr/Converged if this set of lines has been fit before with the same FitMethod (and Guess, for 3 line profile fits)
+struct Fit_Cache_Entry Key;
+struct Fit_Cache_Entry *Entry;
+int Index;
+	if ((Cache->Capacity == 0) || !Fit_Cache_Key (Lines, Frequencies, LineCount, FitMethod, Guess, &Key)) return 0;
+	Cache->Lookups += 1.0;
+	Index = Fit_Cache_Find (Cache, &Key);
+	if (Index == -1) return 0;
+	Cache->Hits += 1.0;
+	Fit_Cache_Touch (Cache, Index);
+	Entry = &(Cache->Entries[Index]);
+	Constants[0] = Entry->Constants[0];
+	Constants[1] = Entry->Constants[1];
+	Constants[2] = Entry->Constants[2];
+	*ChiSqr = Entry->ChiSqr;
+	*Converged = Entry->Converged;
+	return 1;
+}
+
+int Fit_Cache_Store (struct Fit_Cache *Cache, struct Transition *Lines, double *Frequencies, int LineCount, int FitMethod, double *Guess, double *Constants, double ChiSqr, int Converged)
+{
+//Adds a fit to the cache, evicting the least recently used one if it's full. Returns 0 if the fit can't be cached
+struct Fit_Cache_Entry Key;
+struct Fit_Cache_Entry *Entry;
+int Index,*Link;
+	if ((Cache->Capacity == 0) || !Fit_Cache_Key (Lines, Frequencies, LineCount, FitMethod, Guess, &Key)) return 0;
+	Index = Fit_Cache_Find (Cache, &Key);
+	if (Index == -1) {
+		if (Cache->Count < Cache->Capacity) {
+			Index = Cache->Count;
+			Cache->Count++;
+		} else {
+			Index = Cache->Oldest;	//Drop the least recently used fit, first from its hash chain then from the LRU list
+			for (Link=&(Cache->Buckets[Cache->Entries[Index].Hash & Cache->BucketMask]);*Link != Index;Link=&(Cache->Entries[*Link].Next));
+			*Link = Cache->Entries[Index].Next;
+			Cache->Oldest = Cache->Entries[Index].Newer;
+			if (Cache->Oldest != -1) Cache->Entries[Cache->Oldest].Older = -1;
+			else Cache->Newest = -1;
+			Cache->Evictions += 1.0;
+		}
+		Entry = &(Cache->Entries[Index]);
+		*Entry = Key;
+		Entry->Next = Cache->Buckets[Key.Hash & Cache->BucketMask];
+		Cache->Buckets[Key.Hash & Cache->BucketMask] = Index;
+		Entry->Newer = -1;
+		Entry->Older = Cache->Newest;
+		if (Cache->Newest != -1) Cache->Entries[Cache->Newest].Newer = Index;
+		else Cache->Oldest = Index;
+		Cache->Newest = Index;
+	} else {
+		Fit_Cache_Touch (Cache, Index);
+		Entry = &(Cache->Entries[Index]);
+	}
+	Entry->Constants[0] = Constants[0];
+	Entry->Constants[1] = Constants[1];
+	Entry->Constants[2] = Constants[2];
+	Entry->ChiSqr = ChiSqr;
+	Entry->Converged = Converged;
+	return 1;
+}
+
+int SBFIT_Cached (struct Fit_Cache *Cache, int FitMethod, double *Guess, double *ChiSq, struct GSL_Bundle *FitBundle, struct Opt_Bundle MyOpt_Bundle, double *LineFrequencies, double FinalConstants[3])
+{
+/*
+	Drop in replacement for SBFIT that checks the cache first, Cache can be NULL to always fit
+	Misses are fit with SBFIT_Method, so FitBundle is only needed for FIT_METHOD_GSL
+	On a hit TransitionsGSL still gets the line frequencies copied in, same as SBFIT, so callers logging the transitions see the same thing either way
+*/
+int i,Converged;
+	if ((Cache != NULL) && Fit_Cache_Lookup (Cache, MyOpt_Bundle.TransitionsGSL, LineFrequencies, MyOpt_Bundle.TransitionCount, FitMethod, Guess, FinalConstants, ChiSq, &Converged)) {
+		for (i=0;i<MyOpt_Bundle.TransitionCount;i++) MyOpt_Bundle.TransitionsGSL[i].Frequency = LineFrequencies[i];
+		Record_Fit_Cache_Hit ();
+		return Converged;
+	}
+	Converged = SBFIT_Method (FitMethod, Guess, ChiSq, FitBundle, MyOpt_Bundle, LineFrequencies, FinalConstants);
+	if (Cache != NULL) Fit_Cache_Store (Cache, MyOpt_Bundle.TransitionsGSL, LineFrequencies, MyOpt_Bundle.TransitionCount, FitMethod, Guess, FinalConstants, *ChiSq, Converged);
+	return Converged;
+}
+
+void Print_Fit_Cache_Stats (struct Fit_Cache *Cache)
+{
+	if (Cache->Lookups > 0.0) printf ("Fit cache: %.0f lookups, %.0f hits (%.1f%%), %.0f evictions, %d/%d entries used\n",Cache->Lookups,Cache->Hits,100.0*Cache->Hits/Cache->Lookups,Cache->Evictions,Cache->Count,Cache->Capacity);
+	else printf ("Fit cache: no lookups\n");
+}
+
+////////////////////////////////////
+/* Parallel triples fitting */
+
+/*
+	Fit_Triples_Bundle walks the TriplesCount[0]*TriplesCount[1]*TriplesCount[2] cube on one thread, with one workspace
+	Fit_Triples_Parallel numbers the cube flat (i major, k minor) and gives each thread an even contiguous range of it
+	Each thread gets its own GSL workspace, fitted transitions, catalog buffer, level energies and top K, so nothing is locked while fitting
+	The catalog's levels are listed once up front, so scoring a fit works out each level energy once (see Get_Catalog_Levels) instead of twice per line like Get_Catalog
+	FitResults[3*Index..3*Index+2] always holds the A/B/C of triple Index, whatever thread fit it, so the output matches the serial walk
+	Thread top K's rank ties by triple index too, so merging them once the threads are joined gives the same saves for any thread count
+*/
+
+int Fit_Triples_Parallel (struct Triple TransitionstoFit, double *Guess, double **FitResults, struct Transition *FittingCatalog, int CatalogLines, struct GSL_Bundle *FitBundle, struct Opt_Bundle MyOpt_Bundle, ScoreFunction TriplesScoreFunction, void *ScoringParameters, int FitMethod, int ThreadCount, int SaveCount, struct MultiSave *Saves, int Verbose)
+{
+/*
+	-Every triple in TransitionstoFit is fit from Guess, as in Fit_Triples_Bundle_Method
+	-If TriplesScoreFunction isn't NULL each fit's catalog is computed, sorted by frequency and scored, and the best SaveCount fits kept in Saves
+
+Arguments
+TransitionstoFit - Transitions and candidate lines from Find_Triples
+Guess - Starting A/B/C for every fit
+FitResults - Allocated here with 3 doubles per triple, NULL to skip keeping every fit, caller frees
+FittingCatalog - Catalog copied into each thread's scoring buffer
+CatalogLines - # of transitions in FittingCatalog
+FitBundle - Set up by Initialize_Triples_Fitter, only used as a template for the thread workspaces and only needed for FIT_METHOD_GSL
+MyOpt_Bundle - ET values and dictionary for the fits
+TriplesScoreFunction - Scores a fitted, sorted catalog (higher is better), NULL to only fit
+ScoringParameters - Passed to TriplesScoreFunction, shared by all the threads so it must be read only
+FitMethod - Fitter for each triple, FIT_METHOD_GSL, FIT_METHOD_PROFILE or FIT_METHOD_SMALL_LM (see SBFIT_Method)
+ThreadCount - # of threads, 0 or less uses one per online core
+SaveCount/Saves - Top K set up by the caller, ignored without a score function
+Verbose - Timing and fit statistics
+
+*/
+struct Triples_Task *Tasks;
+struct Triples_Save *Candidates;
+pthread_t *Threads;
+int *Started,*LevelList;
+int i,Made,LevelCount,LevelSlots;
+double Total,Iterations,Errors,Timing;
+struct timespec Begin,End;
+	Total = (double) TransitionstoFit.TriplesCount[0]*TransitionstoFit.TriplesCount[1]*TransitionstoFit.TriplesCount[2];
+	if (Total < 1.0) {
+		printf ("Error: Fit_Triples_Parallel has no triples to fit\n");
+		return 0;
+	}
+	if (ThreadCount < 1) ThreadCount = (int) sysconf (_SC_NPROCESSORS_ONLN);
+	if (ThreadCount < 1) ThreadCount = 1;
+	if (ThreadCount > Total) ThreadCount = (int) Total;
+	if ((FitMethod == FIT_METHOD_GSL) && (FitBundle == NULL)) {
+		printf ("Error: Fit_Triples_Parallel needs a FitBundle for FIT_METHOD_GSL\n");
+		return 0;
+	}
+	Made = 0;
+	LevelList = NULL;	//Error frees it, and it's made after the thread arrays
+	if (FitResults != NULL) {
+		*FitResults = malloc (3*Total*sizeof(double));
+		if (*FitResults == NULL) {
+			printf ("Error: Unable to allocate room for %.0f triples fits\n",Total);
+			return 0;
+		}
+	}
+	Tasks = malloc (ThreadCount*sizeof(struct Triples_Task));
+	Candidates = malloc ((ThreadCount*SaveCount+1)*sizeof(struct Triples_Save));
+	Threads = malloc (ThreadCount*sizeof(pthread_t));
+	Started = malloc (ThreadCount*sizeof(int));
+	if ((Tasks == NULL) || (Candidates == NULL) || (Threads == NULL) || (Started == NULL)) {
+		printf ("Error: Unable to allocate %d triples threads\n",ThreadCount);
+		goto Error;
+	}
+	LevelSlots = Make_Catalog_Level_List (FittingCatalog, CatalogLines, &LevelList, &LevelCount);
+	if (LevelSlots < 1) goto Error;
+	if (TriplesScoreFunction != NULL) Heapify_Saves (Saves, SaveCount, 1.0);	//Saves are set up by the caller, make sure they're a valid heap before merging
+	for (Made=0;Made<ThreadCount;Made++) {
+		if (!Initialize_Triples_Task (&(Tasks[Made]), &TransitionstoFit, Guess, FittingCatalog, CatalogLines, LevelList, LevelCount, LevelSlots, FitMethod, FitBundle, MyOpt_Bundle, (TriplesScoreFunction != NULL) ? Saves : NULL, SaveCount)) goto Error;
+		Tasks[Made].TriplesScoreFunction = TriplesScoreFunction;
+		Tasks[Made].ScoringParameters = ScoringParameters;
+		Tasks[Made].FitResults = (FitResults != NULL) ? *FitResults : NULL;
+		Split_Combinations (Total, Made, ThreadCount, &(Tasks[Made].First), &(Tasks[Made].Last));
+	}
+	clock_gettime (CLOCK_MONOTONIC, &Begin);
+	for (i=0;i<ThreadCount;i++) {
+		Started[i] = (pthread_create (&(Threads[i]), NULL, Fit_Triples_Worker, &(Tasks[i])) == 0);
+		if (!Started[i]) Fit_Triples_Worker (&(Tasks[i]));		//Couldn't get a thread, do this slice here instead
+	}
+	for (i=0;i<ThreadCount;i++) if (Started[i]) pthread_join (Threads[i], NULL);
+	clock_gettime (CLOCK_MONOTONIC, &End);
+	Timing = (End.tv_sec-Begin.tv_sec)+1.0E-9*(End.tv_nsec-Begin.tv_nsec);
+	Iterations = 0.0;
+	Errors = 0.0;
+	for (i=0;i<ThreadCount;i++) {
+		if (TriplesScoreFunction != NULL) memcpy (&(Candidates[i*SaveCount]), Tasks[i].Saves, SaveCount*sizeof(struct Triples_Save));
+		Iterations += Tasks[i].Iterations;
+		Errors += Tasks[i].Errors;
+	}
+	if (TriplesScoreFunction != NULL) {
+		qsort (Candidates, ThreadCount*SaveCount, sizeof(struct Triples_Save), Compare_Triples_Saves);	//Best first, so the first SaveCount are the overall top K
+		for (i=0;i<SaveCount;i++) if (Candidates[i].Index >= 0.0) Push_Save (Saves, SaveCount, Candidates[i].Score, Candidates[i].A, Candidates[i].B, Candidates[i].C);
+		Sort_Saves (Saves, SaveCount);
+	}
+	if (Verbose && (FitMethod == FIT_METHOD_PROFILE)) printf ("%.0f triples fit on %d threads in %.2f sec, %.0f bracket failures\n",Total,ThreadCount,Timing,Errors);
+	else if (Verbose && (FitMethod == FIT_METHOD_SMALL_LM)) printf ("%.0f triples fit on %d threads in %.2f sec, %.0f Errors\n",Total,ThreadCount,Timing,Errors);
+	else if (Verbose) printf ("%.0f triples fit on %d threads in %.2f sec, %.1f average iterations, %.0f Errors\n",Total,ThreadCount,Timing,Iterations/Total,Errors);
+	if (Verbose > 1) Print_Fit_Telemetry (TELEMETRY_TRIPLES);
+	if ((Verbose > 1) && (TriplesScoreFunction != NULL)) for (i=0;i<SaveCount;i++) printf ("%d: Score:%f %f %f %f\n",i,Saves[i].Score,Saves[i].A,Saves[i].B,Saves[i].C);
+	for (i=0;i<Made;i++) Free_Triples_Task (&(Tasks[i]));
+	free (Tasks);
+	free (Candidates);
+	free (Threads);
+	free (Started);
+	free (LevelList);
+	return 1;
+Error:
+	if (Tasks != NULL) for (i=0;i<Made;i++) Free_Triples_Task (&(Tasks[i]));
+	free (Tasks);
+	free (Candidates);
+	free (Threads);
+	free (Started);
+	free (LevelList);
+	if (FitResults != NULL) {
+		free (*FitResults);
+		*FitResults = NULL;
+	}
+	return 0;
+}
+
+int Initialize_Triples_Task (struct Triples_Task *Task, struct Triple *Triples, double *Guess, struct Transition *FittingCatalog, int CatalogLines, int *LevelList, int LevelCount, int LevelSlots, int FitMethod, struct GSL_Bundle *FitBundle, struct Opt_Bundle MyOpt_Bundle, struct MultiSave *Saves, int SaveCount)
+{
+//Gives a thread its own workspace (FIT_METHOD_GSL only), transitions, catalog buffer, LevelSlots level energies and (if Saves isn't NULL) top K starting at the caller's worst save
+int i;
+	Task->Triples = Triples;
+	Task->Guess = Guess;
+	Task->CatalogLines = CatalogLines;
+	Task->LevelList = LevelList;
+	Task->LevelCount = LevelCount;
+	Task->FitMethod = FitMethod;
+	Task->SaveCount = (Saves != NULL) ? SaveCount : 0;
+	Task->Iterations = 0.0;
+	Task->Errors = 0.0;
+	if (FitMethod == FIT_METHOD_GSL) {
+		Task->FitBundle = *FitBundle;
+		Task->FitBundle.Workspace = gsl_multifit_nlinear_alloc (FitBundle->T, &(FitBundle->fdf_params), 3, 3);
+	} else memset (&(Task->FitBundle), 0, sizeof(struct GSL_Bundle));	//The other fitters don't touch it
+	Task->OptBundle = MyOpt_Bundle;
+	Task->OptBundle.TransitionCount = 3;
+	Task->OptBundle.TransitionsGSL = malloc (3*sizeof(struct Transition));
+	Task->Catalog = malloc (CatalogLines*sizeof(struct Transition));
+	Task->Energies = malloc (LevelSlots*sizeof(double));
+	Task->Saves = (Saves != NULL) ? malloc (SaveCount*sizeof(struct Triples_Save)) : NULL;
+	if (((FitMethod == FIT_METHOD_GSL) && (Task->FitBundle.Workspace == NULL)) || (Task->OptBundle.TransitionsGSL == NULL) || (Task->Catalog == NULL) || (Task->Energies == NULL) || ((Saves != NULL) && (Task->Saves == NULL))) {
+		printf ("Error: Unable to allocate a triples thread\n");
+		Free_Triples_Task (Task);
+		return 0;
+	}
+	if (FitMethod == FIT_METHOD_GSL) Task->FitBundle.f = gsl_multifit_nlinear_residual (Task->FitBundle.Workspace);
+	for (i=0;i<3;i++) Task->OptBundle.TransitionsGSL[i] = Triples->TransitionList[i];
+	memcpy (Task->Catalog, FittingCatalog, CatalogLines*sizeof(struct Transition));
+	for (i=0;i<Task->SaveCount;i++) {		//Nothing at or below the caller's worst save could make it anyway
+		Task->Saves[i].Score = Saves[0].Score;
+		Task->Saves[i].Index = -1.0;
+		Task->Saves[i].A = Saves[0].A;
+		Task->Saves[i].B = Saves[0].B;
+		Task->Saves[i].C = Saves[0].C;
+	}
+	return 1;
+}
+
+void Free_Triples_Task (struct Triples_Task *Task)
+{
+	if (Task->FitBundle.Workspace != NULL) gsl_multifit_nlinear_free (Task->FitBundle.Workspace);
+	free (Task->OptBundle.TransitionsGSL);
+	free (Task->Catalog);
+	free (Task->Energies);
+	free (Task->Saves);
+	Task->FitBundle.Workspace = NULL;
+	Task->OptBundle.TransitionsGSL = NULL;
+	Task->Catalog = NULL;
+	Task->Energies = NULL;
+	Task->Saves = NULL;
+}
+
+void *Fit_Triples_Worker (void *Arg)
+{
+//Fits the triples [First,Last) of the flattened cube, same fit settings as Fit_Triples_Bundle_Method
+struct Triples_Task *Task;
+struct Triple *Triples;
+struct Triples_Save NewSave;
+long long Index,First,Last,Plane,Start;
+int i,j,k,info,Status,Source;
+const double xtol = 1e-8;
+const double gtol = 1e-8;
+const double ftol = 1e-1;
+double ChiSqr;
+double Constants[3],Frequencies[3];
+gsl_vector *Final;
+gsl_vector_view x;
+	Task = (struct Triples_Task *) Arg;
+	Triples = Task->Triples;
+	First = (long long) Task->First;
+	Last = (long long) Task->Last;
+	Plane = (long long) Triples->TriplesCount[1]*Triples->TriplesCount[2];
+	x = gsl_vector_view_array (Task->Guess, 3);		//Only read by gsl_multifit_nlinear_init, so the threads can share it
+	if (Task->FitMethod == FIT_METHOD_GSL) Task->FitBundle.fdf.params = &(Task->OptBundle);
+	Source = Set_Telemetry_Source (TELEMETRY_TRIPLES);
+	for (Index=First;Index<Last;Index++) {
+		i = (int) (Index/Plane);
+		j = (int) ((Index%Plane)/Triples->TriplesCount[2]);
+		k = (int) (Index%Triples->TriplesCount[2]);
+		Task->OptBundle.TransitionsGSL[0].Frequency = Triples->TriplesList[i];
+		Task->OptBundle.TransitionsGSL[1].Frequency = Triples->TriplesList[j+Triples->TriplesCount[0]];
+		Task->OptBundle.TransitionsGSL[2].Frequency = Triples->TriplesList[k+Triples->TriplesCount[0]+Triples->TriplesCount[1]];
+		if (Task->FitMethod != FIT_METHOD_GSL) {
+			for (i=0;i<3;i++) Frequencies[i] = Task->OptBundle.TransitionsGSL[i].Frequency;
+			if (!SBFIT_Method (Task->FitMethod, Task->Guess, &ChiSqr, NULL, Task->OptBundle, Frequencies, Constants)) Task->Errors += 1.0;	//A bracket failure for the profile, the iteration cap for the small LM
+		} else {
+			Start = Telemetry_Clock ();
+			gsl_multifit_nlinear_init (&x.vector, &(Task->FitBundle.fdf), Task->FitBundle.Workspace);
+			Task->FitBundle.f = gsl_multifit_nlinear_residual (Task->FitBundle.Workspace);
+			Status = gsl_multifit_nlinear_driver (50, xtol, gtol, ftol, NULL, NULL, &info, Task->FitBundle.Workspace);
+			Record_GSL_Fit (Task->FitBundle.Workspace, Status, info, 50, Start);
+			Task->Iterations += gsl_multifit_nlinear_niter (Task->FitBundle.Workspace);
+			if (gsl_multifit_nlinear_niter (Task->FitBundle.Workspace) == 50) Task->Errors += 1.0;
+			Final = gsl_multifit_nlinear_position (Task->FitBundle.Workspace);
+			Constants[0] = gsl_vector_get (Final, 0);
+			Constants[1] = gsl_vector_get (Final, 1);
+			Constants[2] = gsl_vector_get (Final, 2);
+		}
+		if (Task->FitResults != NULL) {
+			Task->FitResults[3*Index] = Constants[0];
+			Task->FitResults[3*Index+1] = Constants[1];
+			Task->FitResults[3*Index+2] = Constants[2];
+		}
+		if (Task->TriplesScoreFunction == NULL) continue;		//Only fitting, no need for the catalog
+		Get_Catalog_Levels (Task->Catalog, Constants, Task->CatalogLines, Task->OptBundle.ETGSL, Task->OptBundle.MyDictionary, Task->LevelList, Task->LevelCount, Task->Energies);
+		Sort_Catalog (Task->Catalog, Task->CatalogLines, 0, 0);		//Still in the last fit's order, so the insertion sort only has to fix up the lines that moved
+		NewSave.Score = Task->TriplesScoreFunction (Task->Catalog, Task->ScoringParameters);
+		NewSave.Index = (double) Index;
+		NewSave.A = Constants[0];
+		NewSave.B = Constants[1];
+		NewSave.C = Constants[2];
+		Push_Triples_Save (Task->Saves, Task->SaveCount, &NewSave);
+	}
+	Set_Telemetry_Source (Source);
+	Merge_Fit_Telemetry ();		//Before the thread exits and its counters go with it
+	return NULL;
+}
+
+int Push_Triples_Save (struct Triples_Save *Saves, int SaveCount, struct Triples_Save *NewSave)
+{
+//Saves are kept worst first, triples arrive in index order so a later one only gets in by beating the worst score outright
+int i;
+	if ((SaveCount < 1) || (NewSave->Score <= Saves[0].Score)) return 0;
+	i = 0;
+	while ((i+1 < SaveCount) && (Compare_Triples_Saves (NewSave, &(Saves[i+1])) < 0)) {
+		Saves[i] = Saves[i+1];
+		i++;
+	}
+	Saves[i] = *NewSave;
+	return 1;
+}
+
+int Compare_Triples_Saves (const void *a, const void *b)
+{
+//Best first, higher score then lower triple index
+	struct Triples_Save *A = (struct Triples_Save *) a;
+	struct Triples_Save *B = (struct Triples_Save *) b;
+	if (A->Score > B->Score) return -1;
+	if (A->Score < B->Score) return 1;
+	if (A->Index < B->Index) return -1;
+	if (A->Index > B->Index) return 1;
+	return 0;
+}
+
+int Make_Catalog_Level_List (struct Transition *Catalog, int CatLines, int **LevelList, int *LevelCount)
+{
+/*
+	Lists every dictionary level that Catalog's lines start or end on, once each and in dictionary order, for Get_Catalog_Levels
+	Returns how many slots a level energy array needs (the highest level used + 1), 0 on an error. *LevelList is allocated here, caller frees
+*/
+int i,Slots;
+char *Used;
+	if (CatLines < 1) {
+		printf ("Error: No catalog lines to list the levels of\n");
+		return 0;
+	}
+	Slots = 0;
+	for (i=0;i<CatLines;i++) {
+		if (Catalog[i].Upper >= Slots) Slots = Catalog[i].Upper+1;
+		if (Catalog[i].Lower >= Slots) Slots = Catalog[i].Lower+1;
+	}
+	*LevelList = NULL;
+	*LevelCount = 0;
+	Used = calloc (Slots+1, sizeof(char));
+	*LevelList = malloc ((Slots+1)*sizeof(int));
+	if ((Used == NULL) || (*LevelList == NULL)) {
+		printf ("Error: Unable to allocate the level list for %d catalog lines\n",CatLines);
+		free (Used);
+		free (*LevelList);
+		*LevelList = NULL;
+		return 0;
+	}
+	for (i=0;i<CatLines;i++) {
+		Used[Catalog[i].Upper] = 1;
+		Used[Catalog[i].Lower] = 1;
+	}
+	for (i=0;i<Slots;i++) {
+		if (Used[i]) {
+			(*LevelList)[*LevelCount] = i;
+			(*LevelCount)++;
+		}
+	}
+	free (Used);
+	return Slots;
+}
+
+int Get_Catalog_Levels (struct Transition *restrict CatalogtoFill, double *restrict Constants, int CatLines, struct ETauStruct ETStruct, struct Level *MyDictionary, int *LevelList, int LevelCount, double *Energies)
+{
+//Get_Catalog2 with the level energies kept in Energies instead of the dictionary, so threads sharing a dictionary can each fill their own catalog. Frequencies come out the same as Get_Catalog
+double Kappa;
+int i;
+	Kappa = Get_Kappa (Constants[0],Constants[1],Constants[2]);
+	for (i=0;i<LevelCount;i++) Energies[LevelList[i]] = Rigid_Rotor (Constants[0],Constants[2],MyDictionary[LevelList[i]].J,LevelList[i],Kappa,ETStruct);
+	for (i=0;i<CatLines;i++) CatalogtoFill[i].Frequency = fabs(Energies[CatalogtoFill[i].Upper]-Energies[CatalogtoFill[i].Lower]);
+	return 1;
+}
+
+////////////////////////////////////
+/* Kappa profile solver */
+
+/*
+	With Kappa held fixed a rigid rotor frequency is linear in the other two constants
+		Frequency = Sum*(J'(J'+1)-J"(J"+1)) + Difference*(E_tau' - E_tau"), Sum = (A+C)/2, Difference = (A-C)/2, B = Sum+Kappa*Difference
+	So a small fit only has one nonlinear direction. Kappa is scanned over (-1,1) and each point gets a 2x2 linear solve for Sum/Difference
+	-3 lines: the lines are consistent exactly when det[JTerm ETerm Frequency] is 0, every sign change in the scan is refined to a root
+	-4+ lines: the linear least squares residual is minimized, every place its slope goes from - to + is refined
+	Every root/minimum is returned rather than the one a local fit would fall into from the guess
+	Nothing is iterated to a cap, a fit either has a bracket or it's reported as a bracket failure
+	Get_Frequency takes the fabs of the level difference, and a catalog's Upper isn't always the higher level. A line whose sign can't change for any A > B > C > 0
+	is just flipped if it needs to be, only lines that can go either way get both signs tried
+	Two roots closer together than the scan spacing show up as a dip in |det| and are searched for, KAPPA_PROFILE_POINTS sets the spacing
+*/
+
+int Setup_Kappa_Profile (struct Kappa_Profile *Profile, struct Transition *Lines, double *LineFrequencies, int LineCount, struct ETauStruct ETStruct, struct Level *MyDictionary)
+{
+//Copies out what the profile needs from the fitted lines, LineFrequencies are the experimental frequencies in the same order
+int i;
+	if ((LineCount < 3) || (LineCount > KAPPA_PROFILE_MAX_LINES)) {
+		printf ("Error: The kappa profile solver needs 3 to %d lines, not %d\n",KAPPA_PROFILE_MAX_LINES,LineCount);
+		return 0;
+	}
+	Profile->LineCount = LineCount;
+	Profile->ETStruct = ETStruct;
+	for (i=0;i<LineCount;i++) {
+		Profile->Upper[i] = Lines[i].Upper;
+		Profile->Lower[i] = Lines[i].Lower;
+		Profile->JUpper[i] = MyDictionary[Lines[i].Upper].J;
+		Profile->JLower[i] = MyDictionary[Lines[i].Lower].J;
+		Profile->JTerm[i] = Profile->JUpper[i]*(Profile->JUpper[i]+1.0)-Profile->JLower[i]*(Profile->JLower[i]+1.0);
+		Profile->Frequency[i] = LineFrequencies[i];
+		Profile->Orientation[i] = 1.0;
+	}
+	return 1;
+}
+
+void Kappa_Profile_Terms (struct Kappa_Profile *Profile, double Kappa, double *ETerm)
+{
+//E_tau' - E_tau" of every line, the coefficient of (A-C)/2
+int i;
+	for (i=0;i<Profile->LineCount;i++) ETerm[i] = E_tau(Profile->Upper[i],Kappa,Profile->ETStruct)-E_tau(Profile->Lower[i],Kappa,Profile->ETStruct);
+}
+
+double Kappa_Profile_Determinant (struct Kappa_Profile *Profile, double *ETerm)
+{
+//det[JTerm ETerm Frequency] for three lines, zero where some Sum/Difference reproduces all three frequencies
+double F0,F1,F2;
+	F0 = Profile->Orientation[0]*Profile->Frequency[0];
+	F1 = Profile->Orientation[1]*Profile->Frequency[1];
+	F2 = Profile->Orientation[2]*Profile->Frequency[2];
+	return Profile->JTerm[0]*(ETerm[1]*F2-ETerm[2]*F1)-ETerm[0]*(Profile->JTerm[1]*F2-Profile->JTerm[2]*F1)+F0*(Profile->JTerm[1]*ETerm[2]-Profile->JTerm[2]*ETerm[1]);
+}
+
+double Kappa_Profile_Residual (struct Kappa_Profile *Profile, double *ETerm, double *Sum, double *Difference)
+{
+//Linear least squares for Sum/Difference at a fixed Kappa, returns the sum of squared residuals, HUGE_VAL if the lines can't separate the two
+double JJ,JE,EE,JF,EF,Det,Residual,RSS;
+int i;
+	JJ = JE = EE = JF = EF = 0.0;
+	for (i=0;i<Profile->LineCount;i++) {
+		JJ += Profile->JTerm[i]*Profile->JTerm[i];
+		JE += Profile->JTerm[i]*ETerm[i];
+		EE += ETerm[i]*ETerm[i];
+		JF += Profile->JTerm[i]*Profile->Orientation[i]*Profile->Frequency[i];
+		EF += ETerm[i]*Profile->Orientation[i]*Profile->Frequency[i];
+	}
+	Det = JJ*EE-JE*JE;
+	if (Det <= 1e-12*JJ*EE) return HUGE_VAL;	//The J and E_tau terms are proportional, Sum and Difference can't be told apart
+	*Sum = (EE*JF-JE*EF)/Det;
+	*Difference = (JJ*EF-JE*JF)/Det;
+	RSS = 0.0;
+	for (i=0;i<Profile->LineCount;i++) {	//Summed directly, the normal equations shortcut loses everything below ~1e-7 to cancellation
+		Residual = (*Sum)*Profile->JTerm[i]+(*Difference)*ETerm[i]-Profile->Orientation[i]*Profile->Frequency[i];
+		RSS += Residual*Residual;
+	}
+	return RSS;
+}
+
+double Kappa_Profile_Slope (struct Kappa_Profile *Profile, double *ETerm, double *ESlope, double Sum, double Difference)
+{
+//d(residual)/dKappa at the Sum/Difference from Kappa_Profile_Residual, those are optimal so only the explicit Kappa dependence is left
+double Slope,Residual;
+int i;
+	Slope = 0.0;
+	for (i=0;i<Profile->LineCount;i++) {
+		Residual = Sum*Profile->JTerm[i]+Difference*ETerm[i]-Profile->Orientation[i]*Profile->Frequency[i];
+		Slope += 2.0*Residual*Difference*ESlope[i];
+	}
+	return Slope;
+}
+
+double Kappa_Profile_Value (struct Kappa_Profile *Profile, double Kappa, double Sign)
+{
+//What the scan looks at, Sign*determinant for three lines, the residual otherwise
+double ETerm[KAPPA_PROFILE_MAX_LINES];
+double Sum,Difference;
+	Kappa_Profile_Terms (Profile, Kappa, ETerm);
+	if (Profile->LineCount == 3) return Sign*Kappa_Profile_Determinant (Profile, ETerm);
+	return Kappa_Profile_Residual (Profile, ETerm, &Sum, &Difference);
+}
+
+double Kappa_Profile_ChiSqr (struct Kappa_Profile *Profile, double *Constants)
+{
+//Sum of squared residuals with the full frequency model, same as SBFIT's ChiSq
+double ChiSqr,Residual;
+int i;
+	ChiSqr = 0.0;
+	for (i=0;i<Profile->LineCount;i++) {
+		Residual = Get_Frequency(Profile->JUpper[i],Profile->JLower[i],Profile->Upper[i],Profile->Lower[i],Constants,Profile->ETStruct)-Profile->Frequency[i];
+		ChiSqr += Residual*Residual;
+	}
+	return ChiSqr;
+}
+
+double Kappa_Profile_Root (struct Kappa_Profile *Profile, double Low, double High, double FLow, double FHigh)
+{
+//Illinois false position on a bracketed sign change of the determinant, converges superlinearly and can't leave the bracket
+double Kappa,Previous,F;
+int i,Side;
+	Side = 0;
+	Kappa = Low;
+	for (i=0;i<KAPPA_PROFILE_MAX_STEPS;i++) {
+		Previous = Kappa;
+		Kappa = (Low*FHigh-High*FLow)/(FHigh-FLow);
+		if ((High-Low < KAPPA_PROFILE_TOLERANCE) || (fabs(Kappa-Previous) < KAPPA_PROFILE_TOLERANCE)) break;
+		F = Kappa_Profile_Value (Profile, Kappa, 1.0);
+		if (F == 0.0) break;
+		if ((F < 0.0) == (FLow < 0.0)) {
+			Low = Kappa;
+			FLow = F;
+			if (Side == -1) FHigh *= 0.5;	//Same end moved twice, halve the other so it gets pulled in too
+			Side = -1;
+		} else {
+			High = Kappa;
+			FHigh = F;
+			if (Side == 1) FLow *= 0.5;
+			Side = 1;
+		}
+	}
+	return Kappa;
+}
+
+double Kappa_Profile_Minimum (struct Kappa_Profile *Profile, double Low, double Middle, double High, double Sign)
+{
+//Brent's minimizer (golden section with parabolic steps) of Kappa_Profile_Value on a bracket Low < Middle < High with the value lowest at Middle
+const double Golden = 0.3819660112501051;
+double X,W,V,U,FX,FW,FV,FU,Step,LastStep,Mid,Tol,P,Q,R;
+int i;
+	X = W = V = Middle;
+	FX = FW = FV = Kappa_Profile_Value (Profile, X, Sign);
+	Step = LastStep = 0.0;
+	for (i=0;i<KAPPA_PROFILE_MAX_STEPS;i++) {
+		Mid = 0.5*(Low+High);
+		Tol = KAPPA_PROFILE_TOLERANCE+1.5e-8*fabs(X);	//The residual is flat to about sqrt(epsilon) around a minimum, no point going finer
+		if (fabs(X-Mid) <= 2.0*Tol-0.5*(High-Low)) break;
+		P = Q = R = 0.0;
+		if (fabs(LastStep) > Tol) {	//Try a parabola through the last three points
+			R = (X-W)*(FX-FV);
+			Q = (X-V)*(FX-FW);
+			P = (X-V)*Q-(X-W)*R;
+			Q = 2.0*(Q-R);
+			if (Q > 0.0) P = -P;
+			Q = fabs(Q);
+			R = LastStep;
+			LastStep = Step;
+		}
+		if ((fabs(P) < fabs(0.5*Q*R)) && (P > Q*(Low-X)) && (P < Q*(High-X))) {
+			Step = P/Q;
+			U = X+Step;
+			if ((U-Low < 2.0*Tol) || (High-U < 2.0*Tol)) Step = (X < Mid) ? Tol : -Tol;
+		} else {
+			LastStep = (X < Mid) ? High-X : Low-X;
+			Step = Golden*LastStep;
+		}
+		U = (fabs(Step) >= Tol) ? X+Step : X+((Step > 0.0) ? Tol : -Tol);
+		FU = Kappa_Profile_Value (Profile, U, Sign);
+		if ((Profile->LineCount == 3) && (FU < 0.0)) return U;	//Dipped through zero, that's all the caller needs
+		if (FU <= FX) {
+			if (U < X) High = X;
+			else Low = X;
+			V = W;
+			FV = FW;
+			W = X;
+			FW = FX;
+			X = U;
+			FX = FU;
+		} else {
+			if (U < X) Low = U;
+			else High = U;
+			if ((FU <= FW) || (W == X)) {
+				V = W;
+				FV = FW;
+				W = U;
+				FW = FU;
+			} else if ((FU <= FV) || (V == X) || (V == W)) {
+				V = U;
+				FV = FU;
+			}
+		}
+	}
+	return X;
+}
+
+int Add_Kappa_Solution (struct Kappa_Profile *Profile, double Kappa, struct Kappa_Solution *Solutions, int SolutionCount, int MaxSolutions)
+{
+//Turns a refined Kappa into constants and inserts them by ChiSqr, anything without A > B > C > 0 is dropped. Returns the new count
+struct Kappa_Solution NewSolution;
+double ETerm[KAPPA_PROFILE_MAX_LINES];
+double Sum,Difference;
+int i;
+	Kappa_Profile_Terms (Profile, Kappa, ETerm);
+	if (Kappa_Profile_Residual (Profile, ETerm, &Sum, &Difference) == HUGE_VAL) return SolutionCount;
+	if ((Difference <= 0.0) || (Sum <= Difference)) return SolutionCount;
+	NewSolution.Constants[0] = Sum+Difference;
+	NewSolution.Constants[1] = Sum+Kappa*Difference;
+	NewSolution.Constants[2] = Sum-Difference;
+	NewSolution.Kappa = Kappa;
+	NewSolution.ChiSqr = Kappa_Profile_ChiSqr (Profile, NewSolution.Constants);
+	if ((SolutionCount == MaxSolutions) && (NewSolution.ChiSqr >= Solutions[SolutionCount-1].ChiSqr)) return SolutionCount;
+	if (SolutionCount < MaxSolutions) SolutionCount++;
+	for (i=SolutionCount-1;(i > 0) && (Solutions[i-1].ChiSqr > NewSolution.ChiSqr);i--) Solutions[i] = Solutions[i-1];
+	Solutions[i] = NewSolution;
+	return SolutionCount;
+}
+
+int Scan_Kappa_Profile (struct Kappa_Profile *Profile, double *Kappa, double (*Terms)[KAPPA_PROFILE_MAX_LINES], double (*Slopes)[KAPPA_PROFILE_MAX_LINES], struct Kappa_Solution *Solutions, int SolutionCount, int MaxSolutions, int *Brackets)
+{
+/*
+	One pass over the scan with the current line orientations, Terms/Slopes hold the E_tau differences and their Kappa derivatives at each scan point
+	4+ line minima are bracketed by the slope going from - to +, not by the sampled residual, a good fit is often a valley much narrower than the scan spacing
+	Returns the new solution count
+*/
+double Value[KAPPA_PROFILE_POINTS+1];
+double Sum,Difference,Sign,Dip,DipValue;
+int i;
+	for (i=0;i<=KAPPA_PROFILE_POINTS;i++) {
+		if (Profile->LineCount == 3) Value[i] = Kappa_Profile_Determinant (Profile, Terms[i]);
+		else if (Kappa_Profile_Residual (Profile, Terms[i], &Sum, &Difference) == HUGE_VAL) Value[i] = 0.0;
+		else Value[i] = Kappa_Profile_Slope (Profile, Terms[i], Slopes[i], Sum, Difference);
+	}
+	if (Profile->LineCount > 3) {
+		for (i=0;i<KAPPA_PROFILE_POINTS;i++) {
+			if ((Value[i] >= 0.0) || (Value[i+1] <= 0.0)) continue;
+			Dip = Kappa[i]-Value[i]*(Kappa[i+1]-Kappa[i])/(Value[i+1]-Value[i]);	//Start from where the slope crosses zero
+			SolutionCount = Add_Kappa_Solution (Profile, Kappa_Profile_Minimum (Profile, Kappa[i], Dip, Kappa[i+1], 1.0), Solutions, SolutionCount, MaxSolutions);
+			(*Brackets)++;
+		}
+		return SolutionCount;
+	}
+	for (i=0;i<=KAPPA_PROFILE_POINTS;i++) {
+		if (Value[i] == 0.0) {
+			SolutionCount = Add_Kappa_Solution (Profile, Kappa[i], Solutions, SolutionCount, MaxSolutions);
+			(*Brackets)++;
+		} else if ((i < KAPPA_PROFILE_POINTS) && (Value[i+1] != 0.0) && ((Value[i] < 0.0) != (Value[i+1] < 0.0))) {
+			SolutionCount = Add_Kappa_Solution (Profile, Kappa_Profile_Root (Profile, Kappa[i], Kappa[i+1], Value[i], Value[i+1]), Solutions, SolutionCount, MaxSolutions);
+			(*Brackets)++;
+		}
+	}
+	for (i=1;i<KAPPA_PROFILE_POINTS;i++) {	//A pair of roots between two scan points shows up as a dip in |det| with no sign change, look inside it
+		if (((Value[i-1] < 0.0) != (Value[i] < 0.0)) || ((Value[i] < 0.0) != (Value[i+1] < 0.0)) || (Value[i] == 0.0)) continue;
+		if ((fabs(Value[i]) > fabs(Value[i-1])) || (fabs(Value[i]) > fabs(Value[i+1]))) continue;
+		Sign = (Value[i] < 0.0) ? -1.0 : 1.0;
+		Dip = Kappa_Profile_Minimum (Profile, Kappa[i-1], Kappa[i], Kappa[i+1], Sign);
+		DipValue = Kappa_Profile_Value (Profile, Dip, 1.0);
+		if (Sign*DipValue > 0.0) continue;	//Never reached zero, just a dip
+		SolutionCount = Add_Kappa_Solution (Profile, Kappa_Profile_Root (Profile, Kappa[i-1], Dip, Value[i-1], DipValue), Solutions, SolutionCount, MaxSolutions);
+		SolutionCount = Add_Kappa_Solution (Profile, Kappa_Profile_Root (Profile, Dip, Kappa[i+1], DipValue, Value[i+1]), Solutions, SolutionCount, MaxSolutions);
+		(*Brackets) += 2;
+	}
+	return SolutionCount;
+}
+
+int Kappa_Profile_Fit (struct Kappa_Profile *Profile, struct Kappa_Solution *Solutions, int MaxSolutions, int *BracketFailures)
+{
+/*
+	Finds every solution of the lines in Profile, see the notes above
+
+Profile - Lines to fit, set up by Setup_Kappa_Profile
+Solutions - Filled with up to MaxSolutions solutions, lowest ChiSqr first
+MaxSolutions - Size of Solutions, KAPPA_PROFILE_MAX_SOLUTIONS is plenty for 3-5 lines
+BracketFailures - Incremented when the scan found nothing to refine: 3 lines without a sign change, 4+ lines whose residual only falls toward the Kappa edge, or only Q branch lines
+
+Returns the number of solutions found, 0 if there weren't any
+
+*/
+double Kappa[KAPPA_PROFILE_POINTS+1];
+double Terms[KAPPA_PROFILE_POINTS+1][KAPPA_PROFILE_MAX_LINES];
+double Slopes[KAPPA_PROFILE_POINTS+1][KAPPA_PROFILE_MAX_LINES];
+double Step,Value;
+int i,j,SolutionCount,Brackets,Pattern,AmbiguousCount,Positive,Negative;
+int Ambiguous[KAPPA_PROFILE_MAX_LINES];
+	SolutionCount = 0;
+	Brackets = 0;
+	if (MaxSolutions < 1) return 0;
+	for (i=0;(i < Profile->LineCount) && (Profile->JTerm[i] == 0.0);i++);
+	if (i == Profile->LineCount) {	//All Q branch, (A+C)/2 drops out of every frequency so there's no single answer to give
+		(*BracketFailures)++;
+		return 0;
+	}
+	Step = 2.0*(1.0-KAPPA_PROFILE_EDGE)/KAPPA_PROFILE_POINTS;
+	for (i=0;i<=KAPPA_PROFILE_POINTS;i++) {
+		Kappa[i] = -1.0+KAPPA_PROFILE_EDGE+i*Step;
+		Kappa_Profile_Terms (Profile, Kappa[i], Terms[i]);
+		if (Profile->LineCount == 3) continue;
+		Kappa_Profile_Terms (Profile, Kappa[i]+KAPPA_PROFILE_SLOPE_STEP, Slopes[i]);
+		for (j=0;j<Profile->LineCount;j++) Slopes[i][j] = (Slopes[i][j]-Terms[i][j])/KAPPA_PROFILE_SLOPE_STEP;
+	}
+	//A line's level difference is Sum*(JTerm+(Difference/Sum)*ETerm), and 0 < Difference/Sum < 1, so it's enough to check the sign at the two ends
+	AmbiguousCount = 0;
+	for (i=0;i<Profile->LineCount;i++) {
+		Positive = (Profile->JTerm[i] > 0.0);
+		Negative = (Profile->JTerm[i] < 0.0);
+		for (j=0;j<=KAPPA_PROFILE_POINTS;j++) {
+			Value = Profile->JTerm[i]+Terms[j][i];
+			if (Value > 0.0) Positive = 1;
+			if (Value < 0.0) Negative = 1;
+		}
+		Profile->Orientation[i] = Negative ? -1.0 : 1.0;
+		if (Positive && Negative) Ambiguous[AmbiguousCount++] = i;
+	}
+	for (Pattern=0;Pattern<(1 << AmbiguousCount);Pattern++) {
+		for (i=0;i<AmbiguousCount;i++) Profile->Orientation[Ambiguous[i]] = ((Pattern >> i) & 1) ? -1.0 : 1.0;
+		SolutionCount = Scan_Kappa_Profile (Profile, Kappa, Terms, Slopes, Solutions, SolutionCount, MaxSolutions, &Brackets);
+	}
+	if (Brackets == 0) (*BracketFailures)++;
+	return SolutionCount;
+}
+
+int SBFIT_Profile (double *Guess, double *ChiSq, struct GSL_Bundle *FitBundle, struct Opt_Bundle MyOpt_Bundle, double *LineFrequencies, double FinalConstants[3])
+{
+/*
+	Drop in replacement for SBFIT using the kappa profile solver for 3 to KAPPA_PROFILE_MAX_LINES lines, FitBundle isn't used for those and can be NULL
+	More lines than that go to SBFIT, which needs FitBundle
+	3 lines have exact solutions, the one closest to Guess is returned, which is what the local fit would find. 4+ lines return the lowest ChiSqr
+	Returns 0 on a bracket failure or when no solution is physical, with FinalConstants left at Guess
+*/
+struct Kappa_Profile Profile;
+struct Kappa_Solution Solutions[KAPPA_PROFILE_MAX_SOLUTIONS];
+double Distance,BestDistance;
+int i,j,Found,Best,Failures;
+long long Start;
+	if (MyOpt_Bundle.TransitionCount > KAPPA_PROFILE_MAX_LINES) {
+		if (FitBundle != NULL) return SBFIT (Guess, ChiSq, FitBundle, MyOpt_Bundle, LineFrequencies, FinalConstants);
+		printf ("Error: %d lines is too many for the kappa profile solver and there's no GSL workspace to fall back on\n",MyOpt_Bundle.TransitionCount);
+		return 0;
+	}
+	for (i=0;i<MyOpt_Bundle.TransitionCount;i++) MyOpt_Bundle.TransitionsGSL[i].Frequency = LineFrequencies[i];	//Same as SBFIT, callers read the lines back out of TransitionsGSL
+	Start = Telemetry_Clock ();
+	if (!Setup_Kappa_Profile (&Profile, MyOpt_Bundle.TransitionsGSL, LineFrequencies, MyOpt_Bundle.TransitionCount, MyOpt_Bundle.ETGSL, MyOpt_Bundle.MyDictionary)) {
+		Record_Fit_Telemetry (0, TELEMETRY_STOP_ERROR, 0, 0, Start);
+		return 0;
+	}
+	Failures = 0;
+	Found = Kappa_Profile_Fit (&Profile, Solutions, KAPPA_PROFILE_MAX_SOLUTIONS, &Failures);
+	if (Found == 0) {
+		for (i=0;i<3;i++) FinalConstants[i] = Guess[i];
+		*ChiSq = Kappa_Profile_ChiSqr (&Profile, FinalConstants);
+		Record_Fit_Telemetry (0, TELEMETRY_STOP_ERROR, 0, 0, Start);
+		return 0;
+	}
+	Best = 0;
+	if (Profile.LineCount == 3) {
+		BestDistance = HUGE_VAL;
+		for (i=0;i<Found;i++) {
+			Distance = 0.0;
+			for (j=0;j<3;j++) Distance += (Solutions[i].Constants[j]-Guess[j])*(Solutions[i].Constants[j]-Guess[j]);
+			if (Distance < BestDistance) {
+				BestDistance = Distance;
+				Best = i;
+			}
+		}
+	}
+	for (i=0;i<3;i++) FinalConstants[i] = Solutions[Best].Constants[i];
+	*ChiSq = Solutions[Best].ChiSqr;
+	Record_Fit_Telemetry (0, TELEMETRY_STOP_DIRECT, 0, 0, Start);
+	return 1;
+}
+
+////////////////////////////////////
+/* Small Levenberg-Marquardt */
+
+/*
+	Every fit in the searches is 3 parameters against 3 to 8 lines, gsl_multifit_nlinear's generic workspace is a lot of machinery for that
+	Small_LM_Fit is the same trust region Levenberg-Marquardt on fixed size stack arrays, nothing is allocated per fit or per search
+	-Residuals come from the same fdf GSL would be handed (SBFIT_OptFunc_gsl, OptFunc_gsl), called through vector views of the stack arrays
+	-fdf->df is used if it's set, otherwise a forward difference Jacobian with GSL's default step
+	-Steps solve (J^T J + mu D^2) dx = -J^T f with a 3x3 Cholesky, D is More's scaling (running max of the Jacobian column norms) and mu follows Nielsen's update
+	-Convergence is GSL's test, info 1 for a small step (xtol) and 2 for a small scaled gradient (gtol). GSL 2.x doesn't test ftol either, it's only taken to keep the call the same
+*/
+
+double Small_LM_Residual (gsl_multifit_nlinear_fdf *fdf, double *x, double *f)
+{
+//Residuals at x through the fdf's own function, returns the squared norm
+gsl_vector_view X,F;
+double Norm;
+size_t i;
+	X = gsl_vector_view_array (x, 3);
+	F = gsl_vector_view_array (f, fdf->n);
+	fdf->f (&X.vector, fdf->params, &F.vector);
+	fdf->nevalf++;
+	Norm = 0.0;
+	for (i=0;i<fdf->n;i++) Norm += f[i]*f[i];
+	return Norm;
+}
+
+void Small_LM_Jacobian (gsl_multifit_nlinear_fdf *fdf, double *x, double *f, double (*J)[3])
+{
+//Analytic if the fdf has one, otherwise forward differences stepping sqrt(epsilon)*|x| like GSL's fdjac
+gsl_vector_view X;
+gsl_matrix_view JView;
+double Step;
+double Shifted[3];
+double Probe[SMALL_LM_MAX_LINES];
+size_t i,j;
+	if (fdf->df != NULL) {
+		X = gsl_vector_view_array (x, 3);
+		JView = gsl_matrix_view_array (&(J[0][0]), fdf->n, 3);
+		fdf->df (&X.vector, fdf->params, &JView.matrix);
+		fdf->nevaldf++;
+		return;
+	}
+	for (j=0;j<3;j++) Shifted[j] = x[j];
+	for (j=0;j<3;j++) {
+		Step = GSL_SQRT_DBL_EPSILON*fabs(x[j]);
+		if (Step == 0.0) Step = GSL_SQRT_DBL_EPSILON;
+		Shifted[j] = x[j]+Step;
+		Small_LM_Residual (fdf, Shifted, Probe);
+		for (i=0;i<fdf->n;i++) J[i][j] = (Probe[i]-f[i])/Step;
+		Shifted[j] = x[j];
+	}
+}
+
+int Solve_Small_LM_Step (double (*A)[3], double *g, double *D, double mu, double *dx)
+{
+//Cholesky solve of (A + mu D^2) dx = -g, returns 0 if the damped matrix isn't positive definite
+double L[3][3];
+double y[3];
+double Sum;
+int i,j,k;
+	for (i=0;i<3;i++) {
+		for (j=0;j<=i;j++) {
+			Sum = A[i][j];
+			if (i == j) Sum += mu*D[i]*D[i];
+			for (k=0;k<j;k++) Sum -= L[i][k]*L[j][k];
+			if (i == j) {
+				if (!(Sum > 0.0)) return 0;
+				L[i][i] = sqrt(Sum);
+			}
+			else L[i][j] = Sum/L[j][j];
+		}
+	}
+	for (i=0;i<3;i++) {
+		Sum = -g[i];
+		for (k=0;k<i;k++) Sum -= L[i][k]*y[k];
+		y[i] = Sum/L[i][i];
+	}
+	for (i=2;i>=0;i--) {
+		Sum = y[i];
+		for (k=i+1;k<3;k++) Sum -= L[k][i]*dx[k];
+		dx[i] = Sum/L[i][i];
+	}
+	return 1;
+}
+
+int Small_LM_Fit (gsl_multifit_nlinear_fdf *fdf, double *Guess, int MaxIterations, double xtol, double gtol, double ftol, double FinalConstants[3], double *ChiSq, int *Iterations, int *Info)
+{
+/*
+	Levenberg-Marquardt for 3 parameters and 3 to SMALL_LM_MAX_LINES residuals with everything on the stack, see the section comment
+
+Arguments
+fdf - Residual function, n and params as they'd be handed to gsl_multifit_nlinear_init. p must be 3
+Guess - Starting constants, not changed
+MaxIterations - Iteration cap, same as the driver's maxiter
+xtol/gtol/ftol - Same as gsl_multifit_nlinear_driver, ftol is unused like it is there
+FinalConstants - Final position
+ChiSq - Squared norm of the residuals at FinalConstants
+Iterations - Iterations taken, what gsl_multifit_nlinear_niter would report
+Info - 1 or 2 for the xtol or gtol test like GSL, 0 if neither passed
+
+Returns 1 if a convergence test passed, 0 if it hit MaxIterations
+*/
+double x[3],NewX[3],dx[3],g[3],D[3];
+double f[SMALL_LM_MAX_LINES],NewF[SMALL_LM_MAX_LINES];
+double J[SMALL_LM_MAX_LINES][3];
+double A[3][3];
+double Cost,NewCost,Predicted,Rho,mu,nu,Norm,Scaled;
+int i,j,k,n,Rejects,Accepted;
+	*Iterations = 0;
+	*Info = 0;
+	if ((fdf->p != 3) || (fdf->n < 3) || (fdf->n > SMALL_LM_MAX_LINES)) {
+		printf ("Error: The small LM fitter takes 3 parameters and 3 to %d residuals, not %d and %d\n",SMALL_LM_MAX_LINES,(int) fdf->p,(int) fdf->n);
+		return 0;
+	}
+	n = (int) fdf->n;
+	for (j=0;j<3;j++) x[j] = Guess[j];
+	Cost = Small_LM_Residual (fdf, x, f);
+	Small_LM_Jacobian (fdf, x, f, J);
+	for (j=0;j<3;j++) {
+		Norm = 0.0;
+		for (i=0;i<n;i++) Norm += J[i][j]*J[i][j];
+		D[j] = (Norm > 0.0) ? sqrt(Norm) : 1.0;
+	}
+	for (j=0;j<3;j++) dx[j] = HUGE_VAL;
+	mu = 1.0e-3;
+	nu = 2.0;
+	while (*Iterations < MaxIterations) {
+		for (j=0;j<3;j++) {
+			g[j] = 0.0;
+			for (i=0;i<n;i++) g[j] += J[i][j]*f[i];
+			for (k=0;k<=j;k++) {
+				A[j][k] = 0.0;
+				for (i=0;i<n;i++) A[j][k] += J[i][j]*J[i][k];
+				A[k][j] = A[j][k];
+			}
+		}
+		Rejects = 0;
+		Accepted = 0;
+		while (!Accepted && (Rejects < SMALL_LM_MAX_REJECTS)) {
+			Rho = -1.0;
+			if (Solve_Small_LM_Step (A, g, D, mu, dx)) {
+				for (j=0;j<3;j++) NewX[j] = x[j]+dx[j];
+				NewCost = Small_LM_Residual (fdf, NewX, NewF);
+				Predicted = 0.0;		//Drop in 0.5|f|^2 the linear model predicts, -g.dx - 0.5 dx.A.dx
+				for (j=0;j<3;j++) {
+					Predicted -= g[j]*dx[j];
+					for (k=0;k<3;k++) Predicted -= 0.5*dx[j]*A[j][k]*dx[k];
+				}
+				if (Predicted > 0.0) Rho = 0.5*(Cost-NewCost)/Predicted;
+			}
+			if (Rho > 0.0) {
+				Accepted = 1;
+				Scaled = 2.0*Rho-1.0;
+				mu *= fmax (1.0/3.0, 1.0-Scaled*Scaled*Scaled);
+				nu = 2.0;
+			}
+			else {
+				Rejects++;
+				mu *= nu;
+				nu *= 2.0;
+			}
+		}
+		(*Iterations)++;		//A no progress iteration still counts, as in GSL, and the next one carries on with the larger mu
+		if (Accepted) {
+			for (j=0;j<3;j++) x[j] = NewX[j];
+			for (i=0;i<n;i++) f[i] = NewF[i];
+			Cost = NewCost;
+			Small_LM_Jacobian (fdf, x, f, J);
+			for (j=0;j<3;j++) {
+				Norm = 0.0;
+				for (i=0;i<n;i++) Norm += J[i][j]*J[i][j];
+				D[j] = fmax (D[j], sqrt(Norm));
+			}
+		}
+		for (j=0;j<3;j++) if (fabs(dx[j]) >= xtol*xtol+xtol*fabs(x[j])) break;		//The last trial step, so a stalled fit stops once mu has shrunk it enough, same as GSL
+		if (j == 3) {
+			*Info = 1;
+			break;
+		}
+		if (!Accepted) continue;
+		Norm = 0.0;
+		for (j=0;j<3;j++) {
+			g[j] = 0.0;
+			for (i=0;i<n;i++) g[j] += J[i][j]*f[i];
+			Norm = fmax (Norm, fabs(g[j])*fmax(fabs(x[j]),1.0));
+		}
+		if (Norm <= gtol*fmax(0.5*Cost,1.0)) {
+			*Info = 2;
+			break;
+		}
+	}
+	for (j=0;j<3;j++) FinalConstants[j] = x[j];
+	*ChiSq = Cost;
+	return (*Info != 0);
+}
+
+int SBFIT_Small (double *Guess, double *ChiSq, struct GSL_Bundle *FitBundle, struct Opt_Bundle MyOpt_Bundle, double *LineFrequencies, double FinalConstants[3])
+{
+/*
+	Drop in replacement for SBFIT using Small_LM_Fit, same residuals, tolerances and 200 iteration cap. FitBundle isn't used and can be NULL
+	More than SMALL_LM_MAX_LINES lines go to SBFIT, which needs FitBundle
+	Returns 0 if the fit didn't converge within 200 iterations, same as SBFIT
+*/
+gsl_multifit_nlinear_fdf fdf;
+int i,Iterations,Info,Converged;
+long long Start;
+	if (MyOpt_Bundle.TransitionCount > SMALL_LM_MAX_LINES) {
+		if (FitBundle != NULL) return SBFIT (Guess, ChiSq, FitBundle, MyOpt_Bundle, LineFrequencies, FinalConstants);
+		printf ("Error: %d lines is too many for the small LM fitter and there's no GSL workspace to fall back on\n",MyOpt_Bundle.TransitionCount);
+		return 0;
+	}
+	for (i=0;i<MyOpt_Bundle.TransitionCount;i++) MyOpt_Bundle.TransitionsGSL[i].Frequency = LineFrequencies[i];
+	memset (&fdf,0,sizeof(gsl_multifit_nlinear_fdf));
+	fdf.f = SBFIT_OptFunc_gsl;
+	fdf.df = NULL;
+	fdf.n = MyOpt_Bundle.TransitionCount;
+	fdf.p = 3;
+	fdf.params = &MyOpt_Bundle;
+	Start = Telemetry_Clock ();
+	Converged = Small_LM_Fit (&fdf, Guess, 200, 1e-8, 1e-8, 1e-1, FinalConstants, ChiSq, &Iterations, &Info);
+	Record_Fit_Telemetry (Iterations, Converged ? Info : ((Iterations >= 200) ? TELEMETRY_STOP_CAP : TELEMETRY_STOP_ERROR), (long long) fdf.nevalf, (long long) fdf.nevaldf, Start);
+	return Converged;
+}
+
+int SBFIT_Method (int FitMethod, double *Guess, double *ChiSq, struct GSL_Bundle *FitBundle, struct Opt_Bundle MyOpt_Bundle, double *LineFrequencies, double FinalConstants[3])
+{
+//SBFIT with the fitter picked by FitMethod (FIT_METHOD_GSL, FIT_METHOD_PROFILE or FIT_METHOD_SMALL_LM), only FIT_METHOD_GSL needs FitBundle
+	if (FitMethod == FIT_METHOD_PROFILE) return SBFIT_Profile (Guess, ChiSq, FitBundle, MyOpt_Bundle, LineFrequencies, FinalConstants);
+	if (FitMethod == FIT_METHOD_SMALL_LM) return SBFIT_Small (Guess, ChiSq, FitBundle, MyOpt_Bundle, LineFrequencies, FinalConstants);
+	return SBFIT (Guess, ChiSq, FitBundle, MyOpt_Bundle, LineFrequencies, FinalConstants);
+}
+
+////////////////////////////////////
+/* Triples verification scoring */
+
+/*
+	Scoring a triples fit used to mean Get_Catalog on the whole catalog and an insertion sort of it, for every triple, which is why Fit_Triples_Bundle never got to call its score
+	Most of those lines can't change the ranking, a small verification set of the strongest transitions picks out the right triples just as well
+	-Setup_Triples_Verifier works out once which levels the verification transitions use, each fit then computes those energies and differences them (the Get_Catalog2 approach, but into the verifier's own arrays so the dictionary isn't touched)
+	-The verification lines are matched to the peaks through a Line_Index, so nothing is sorted
+	-Any ScoreFunction can be used, it's handed the LineCount verification transitions with fresh frequencies. Score_Verification_Wins is the default
+*/
+
+int Setup_Triples_Verifier (struct Triples_Verifier *Verifier, struct Transition *VerifyCatalog, int VerifyLines, struct Level *MyDictionary, struct ETauStruct ETStruct, double *Peaks, int PeakCount, double Tolerance)
+{
+/*
+	Builds a verifier over a copy of VerifyCatalog, Fill_Catalog_Restricted_Intensity_Count's strongest few dozen lines are a good choice
+	Peaks are indexed for matches within Tolerance. Peaks must stay around as long as the verifier does, VerifyCatalog doesn't need to
+	Returns 0 on an allocation failure, with nothing left allocated
+*/
+int i,j,Level,Slot;
+int Levels[2];
+	memset (Verifier,0,sizeof(struct Triples_Verifier));
+	Verifier->LineCount = VerifyLines;
+	Verifier->ETStruct = ETStruct;
+	Verifier->Threshold = -1.0;
+	if (VerifyLines < 1) {
+		printf ("Error: Triples verifier needs at least one transition\n");
+		return 0;
+	}
+	Verifier->Catalog = malloc (VerifyLines*sizeof(struct Transition));
+	Verifier->UpperSlot = malloc (VerifyLines*sizeof(int));
+	Verifier->LowerSlot = malloc (VerifyLines*sizeof(int));
+	Verifier->LevelJ = malloc (2*VerifyLines*sizeof(int));		//Never more than two new levels per line
+	Verifier->LevelIndex = malloc (2*VerifyLines*sizeof(int));
+	Verifier->Energies = malloc (2*VerifyLines*sizeof(double));
+	if ((Verifier->Catalog == NULL) || (Verifier->UpperSlot == NULL) || (Verifier->LowerSlot == NULL) || (Verifier->LevelJ == NULL) || (Verifier->LevelIndex == NULL) || (Verifier->Energies == NULL)) goto Error;
+	memcpy (Verifier->Catalog, VerifyCatalog, VerifyLines*sizeof(struct Transition));
+	for (i=0;i<VerifyLines;i++) {
+		Levels[0] = Verifier->Catalog[i].Upper;
+		Levels[1] = Verifier->Catalog[i].Lower;
+		for (j=0;j<2;j++) {
+			Level = Levels[j];
+			for (Slot=0;Slot<Verifier->LevelCount;Slot++) if (Verifier->LevelIndex[Slot] == MyDictionary[Level].Index) break;	//Setup only, a linear look is fine for a few dozen lines
+			if (Slot == Verifier->LevelCount) {
+				Verifier->LevelJ[Slot] = MyDictionary[Level].J;
+				Verifier->LevelIndex[Slot] = MyDictionary[Level].Index;
+				Verifier->LevelCount++;
+			}
+			if (j == 0) Verifier->UpperSlot[i] = Slot;
+			else Verifier->LowerSlot[i] = Slot;
+		}
+	}
+	if (!Build_Line_Index (Peaks, PeakCount, Tolerance, &(Verifier->Index))) goto Error;
+	return 1;
+Error:
+	printf ("Error setting up the triples verifier\n");
+	Free_Triples_Verifier (Verifier);
+	return 0;
+}
+
+void Free_Triples_Verifier (struct Triples_Verifier *Verifier)
+{
+	free (Verifier->Catalog);
+	free (Verifier->UpperSlot);
+	free (Verifier->LowerSlot);
+	free (Verifier->LevelJ);
+	free (Verifier->LevelIndex);
+	free (Verifier->Energies);
+	Free_Line_Index (&(Verifier->Index));
+	Verifier->Catalog = NULL;
+	Verifier->UpperSlot = NULL;
+	Verifier->LowerSlot = NULL;
+	Verifier->LevelJ = NULL;
+	Verifier->LevelIndex = NULL;
+	Verifier->Energies = NULL;
+	Verifier->LineCount = 0;
+	Verifier->LevelCount = 0;
+}
+
+void Fill_Triples_Verifier (struct Triples_Verifier *Verifier, double *Constants)
+{
+//Verification frequencies for Constants, each level energy is worked out once however many lines share it
+double Kappa;
+int i;
+	Kappa = Get_Kappa (Constants[0],Constants[1],Constants[2]);
+	for (i=0;i<Verifier->LevelCount;i++) Verifier->Energies[i] = Rigid_Rotor (Constants[0],Constants[2],Verifier->LevelJ[i],Verifier->LevelIndex[i],Kappa,Verifier->ETStruct);
+	for (i=0;i<Verifier->LineCount;i++) Verifier->Catalog[i].Frequency = fabs(Verifier->Energies[Verifier->UpperSlot[i]]-Verifier->Energies[Verifier->LowerSlot[i]]);
+}
+
+double Score_Verification_Wins (struct Transition *VerifyCatalog, void *ScoringParameters)
+{
+//Default ScoreFunction for Fit_Triples_Verified, ScoringParameters is the verifier. Verification lines within Tolerance of a peak, stopping early once the worst save is out of reach
+struct Triples_Verifier *Verifier;
+	Verifier = (struct Triples_Verifier *) ScoringParameters;
+	return Count_Index_Wins_Bounded (&(Verifier->Index), VerifyCatalog, Verifier->LineCount, Verifier->Threshold);
+}
+
+int Fit_Triples_Verified (struct Triple TransitionstoFit, double *Guess, struct GSL_Bundle *FitBundle, struct Opt_Bundle MyOpt_Bundle, int FitMethod, struct Feasibility_Bounds *Bounds, struct Solution_Clusters *Clusters, struct Triples_Verifier *Verifier, ScoreFunction TriplesScoreFunction, void *ScoringParameters, int SaveCount, struct MultiSave *Saves, int Verbose)
+{
+/*
+	Fits every triple in TransitionstoFit from Guess, scores each converged fit on the verification set and keeps the best SaveCount
+
+Arguments
+TransitionstoFit - Transitions and candidate lines from Find_Triples
+Guess - Starting A/B/C for every fit
+FitBundle - Workspace from Initialize_Triples_Fitter, only needed for FIT_METHOD_GSL
+MyOpt_Bundle - ET values and dictionary for the fits, its transitions are replaced by the triple's
+FitMethod - Fitter for each triple, see SBFIT_Method
+Bounds - Feasibility filter set up for TransitionList, triples it rejects aren't fit. NULL to fit them all
+Clusters - Every converged fit is added here, and only the first fit of each cluster is scored and saved, so the saves are all different solutions. NULL to score every fit
+Verifier - Set up by Setup_Triples_Verifier, its catalog is refilled for each fit
+TriplesScoreFunction - Scores the verification catalog (higher is better), NULL for Score_Verification_Wins
+ScoringParameters - Passed to TriplesScoreFunction, ignored for the default
+SaveCount/Saves - Top K set up by the caller with Initialize_Saves, sorted best last on return like Sort_Saves
+Verbose - Timing and fit statistics
+
+Returns the number of triples scored
+*/
+struct Transition Transitions[3];
+double Frequencies[3];
+double Constants[3];
+double ChiSqr,Score,Total,Fits,Errors,Scored,Timing;
+int i,j,k,Index,Source;
+struct timespec Begin,End;
+	if (SaveCount < 1) {
+		printf ("Error: Fit_Triples_Verified needs somewhere to keep its saves\n");
+		return 0;
+	}
+	if (TriplesScoreFunction == NULL) {
+		TriplesScoreFunction = Score_Verification_Wins;
+		ScoringParameters = Verifier;
+	}
+	for (i=0;i<3;i++) Transitions[i] = TransitionstoFit.TransitionList[i];
+	MyOpt_Bundle.TransitionsGSL = Transitions;
+	MyOpt_Bundle.TransitionCount = 3;
+	Heapify_Saves (Saves, SaveCount, 1.0);
+	Total = (double) TransitionstoFit.TriplesCount[0]*TransitionstoFit.TriplesCount[1]*TransitionstoFit.TriplesCount[2];
+	Fits = 0.0;
+	Errors = 0.0;
+	Scored = 0.0;
+	Source = Set_Telemetry_Source (TELEMETRY_TRIPLES);
+	clock_gettime (CLOCK_MONOTONIC, &Begin);
+	for (i=0;i<TransitionstoFit.TriplesCount[0];i++) {
+		for (j=0;j<TransitionstoFit.TriplesCount[1];j++) {
+			for (k=0;k<TransitionstoFit.TriplesCount[2];k++) {
+				Frequencies[0] = TransitionstoFit.TriplesList[i];
+				Frequencies[1] = TransitionstoFit.TriplesList[j+TransitionstoFit.TriplesCount[0]];
+				Frequencies[2] = TransitionstoFit.TriplesList[k+TransitionstoFit.TriplesCount[0]+TransitionstoFit.TriplesCount[1]];
+				if ((Bounds != NULL) && !Tuple_Feasible (Bounds, Frequencies)) continue;
+				Fits++;
+				if (!SBFIT_Method (FitMethod, Guess, &ChiSqr, FitBundle, MyOpt_Bundle, Frequencies, Constants) || !isfinite(Constants[0]+Constants[1]+Constants[2])) {
+					Errors++;
+					continue;
+				}
+				Index = (Clusters != NULL) ? Add_Cluster_Fit (Clusters, Constants, ChiSqr, 0.0, Transitions, 3) : -1;	//-1 without clusters, or if they couldn't grow, and the fit is just scored
+				if ((Index != -1) && (Clusters->Clusters[Index].Multiplicity > 1.0)) continue;	//Same solution as a fit already scored
+				Fill_Triples_Verifier (Verifier, Constants);
+				Verifier->Threshold = Saves[0].Score;
+				Score = TriplesScoreFunction (Verifier->Catalog, ScoringParameters);
+				Scored++;
+				if (Index != -1) Clusters->Clusters[Index].Score = Score;
+				Push_Save (Saves, SaveCount, Score, Constants[0], Constants[1], Constants[2]);
+			}
+		}
+	}
+	clock_gettime (CLOCK_MONOTONIC, &End);
+	Set_Telemetry_Source (Source);
+	Merge_Fit_Telemetry ();
+	Timing = (End.tv_sec-Begin.tv_sec)+1.0E-9*(End.tv_nsec-Begin.tv_nsec);
+	Sort_Saves (Saves, SaveCount);
+	if (Verbose) printf ("%.0f triples, %.0f fit and scored against %d verification lines in %.2f sec, %.0f Errors\n",Total,Fits,Verifier->LineCount,Timing,Errors);
+	if (Verbose && (Bounds != NULL)) Print_Feasibility_Stats (Bounds);
+	if (Verbose && (Clusters != NULL)) Print_Cluster_Stats (Clusters);
+	if (Verbose > 1) Print_Fit_Telemetry (TELEMETRY_TRIPLES);
+	if (Verbose > 1) for (i=0;i<SaveCount;i++) printf ("%d: Score:%f %f %f %f\n",i,Saves[i].Score,Saves[i].A,Saves[i].B,Saves[i].C);
+	return (int) Scored;
+}
+
+////////////////////////////////////
+/* Streamed candidate generation */
+
+/*
+	Find_Triples copies out the lines inside each window and the fitter walks the cube of them, which only works for three transitions
+	A Candidate_Stream holds a window [Start,End) into the sorted peak list for each target transition, found by binary search
+	Tuples come out one at a time like a Combination, the last target changing fastest, so the full product is never built
+	-Any number of targets up to CANDIDATE_MAX_TARGETS, each with its own window
+	-A stream can be started at any rank and stopped before another, so Split_Combinations can hand out ranges of it to threads
+*/
+
+int Peak_Lower_Bound (double *Peaks, int PeakCount, double Frequency)
+{
+//First position in the ascending Peaks at or above Frequency, PeakCount if there isn't one
+int Low,High,Middle;
+	Low = 0;
+	High = PeakCount;
+	while (Low < High) {
+		Middle = Low+(High-Low)/2;
+		if (Peaks[Middle] < Frequency) Low = Middle+1;
+		else High = Middle;
+	}
+	return Low;
+}
+
+int Start_Candidate_Stream (struct Candidate_Stream *Stream, double *Peaks, int PeakCount, double *Targets, double *Windows, int TargetCount, double First, double Last)
+{
+/*
+	Sets up the windows and moves the stream to tuple First
+
+Arguments
+Stream - Stream to start
+Peaks - Experimental lines, must be ascending. Not copied, so it has to outlive the stream
+PeakCount - # of peaks
+Targets - Predicted frequency of each target transition
+Windows - Half width of each target's window, a peak is a candidate if it's within [Target-Window,Target+Window)
+TargetCount - # of targets, 1 to CANDIDATE_MAX_TARGETS
+First - Rank of the first tuple, 0 for all of them
+Last - Rank to stop before, negative for Stream->Total
+
+Returns 1 with Frequencies holding the first tuple, 0 if there's nothing in the range or the setup is bad
+*/
+int t;
+double Rank;
+	Stream->TargetCount = TargetCount;
+	Stream->Total = 0.0;
+	Stream->Rank = 0.0;
+	Stream->Last = 0.0;
+	if ((TargetCount < 1) || (TargetCount > CANDIDATE_MAX_TARGETS)) {
+		printf ("Error: %d target transitions given, between 1 and %d are supported\n",TargetCount,CANDIDATE_MAX_TARGETS);
+		return 0;
+	}
+	Stream->Peaks = Peaks;
+	Stream->Total = 1.0;
+	for (t=0;t<TargetCount;t++) {
+		Stream->Start[t] = Peak_Lower_Bound (Peaks, PeakCount, Targets[t]-Windows[t]);
+		Stream->End[t] = Peak_Lower_Bound (Peaks, PeakCount, Targets[t]+Windows[t]);
+		Stream->Total *= (double) (Stream->End[t]-Stream->Start[t]);
+	}
+	Stream->Last = ((Last < 0.0) || (Last > Stream->Total)) ? Stream->Total : Last;
+	if (!(First < Stream->Last)) return 0;
+	Stream->Rank = First;
+	Rank = First;
+	for (t=TargetCount-1;t>=0;t--) {	//Mixed radix, the last target is the lowest digit
+		Stream->Position[t] = Stream->Start[t]+(int) fmod(Rank,(double) (Stream->End[t]-Stream->Start[t]));
+		Rank = floor(Rank/(Stream->End[t]-Stream->Start[t]));
+		Stream->Frequencies[t] = Peaks[Stream->Position[t]];
+	}
+	return 1;
+}
+
+int Next_Candidate (struct Candidate_Stream *Stream)
+{
+//Moves to the next tuple, returns 0 once the stream's range is done
+int t;
+	Stream->Rank++;
+	if (!(Stream->Rank < Stream->Last)) return 0;
+	for (t=Stream->TargetCount-1;t>=0;t--) {
+		Stream->Position[t]++;
+		if (Stream->Position[t] < Stream->End[t]) {
+			Stream->Frequencies[t] = Stream->Peaks[Stream->Position[t]];
+			return 1;
+		}
+		Stream->Position[t] = Stream->Start[t];
+		Stream->Frequencies[t] = Stream->Peaks[Stream->Position[t]];
+	}
+	return 1;
+}
+
+int Fit_Candidate_Stream (struct Candidate_Stream *Stream, struct Transition *Targets, double *Guess, struct GSL_Bundle *FitBundle, struct Opt_Bundle MyOpt_Bundle, int FitMethod, struct Feasibility_Bounds *Bounds, struct Solution_Clusters *Clusters, struct Triples_Verifier *Verifier, ScoreFunction CandidateScoreFunction, void *ScoringParameters, int SaveCount, struct MultiSave *Saves, int Verbose)
+{
+/*
+	Fit_Triples_Verified for a started Candidate_Stream, each tuple is fit to Targets as it comes off the stream and scored on the verification set
+
+Arguments
+Stream - Started with Start_Candidate_Stream, it's run to the end of its range
+Targets - The Stream->TargetCount transitions the tuples are assigned to, in the order their windows were given
+Guess - Starting A/B/C for every fit
+FitBundle - Workspace for FIT_METHOD_GSL, set up for Stream->TargetCount lines. Other methods can take NULL within their line limits
+MyOpt_Bundle - ET values and dictionary for the fits, its transitions are replaced by Targets
+FitMethod - Fitter for each tuple, see SBFIT_Method
+Bounds - Feasibility filter set up for Targets, tuples it rejects aren't fit. NULL to fit them all
+Clusters - Converged fits are clustered and only the first of each cluster scored, as in Fit_Triples_Verified. NULL to score every fit
+Verifier/CandidateScoreFunction/ScoringParameters - Scoring, as in Fit_Triples_Verified
+SaveCount/Saves - Top K set up by the caller with Initialize_Saves, sorted best last on return
+Verbose - Timing and fit statistics
+
+Returns the number of tuples scored
+*/
+struct Transition Transitions[CANDIDATE_MAX_TARGETS];
+double Constants[3];
+double ChiSqr,Score,Fits,Errors,Scored,Timing;
+int i,Index,Source;
+struct timespec Begin,End;
+	if (SaveCount < 1) {
+		printf ("Error: Fit_Candidate_Stream needs somewhere to keep its saves\n");
+		return 0;
+	}
+	if (Stream->TargetCount < 3) {
+		printf ("Error: %d target transitions can't fix three constants\n",Stream->TargetCount);
+		return 0;
+	}
+	if (CandidateScoreFunction == NULL) {
+		CandidateScoreFunction = Score_Verification_Wins;
+		ScoringParameters = Verifier;
+	}
+	for (i=0;i<Stream->TargetCount;i++) Transitions[i] = Targets[i];
+	MyOpt_Bundle.TransitionsGSL = Transitions;
+	MyOpt_Bundle.TransitionCount = Stream->TargetCount;
+	Heapify_Saves (Saves, SaveCount, 1.0);
+	Fits = 0.0;
+	Errors = 0.0;
+	Scored = 0.0;
+	Source = Set_Telemetry_Source (TELEMETRY_TRIPLES);		//Counted with the triples, it's the same search generalized to more lines
+	clock_gettime (CLOCK_MONOTONIC, &Begin);
+	if (Stream->Rank < Stream->Last) {
+		do {
+			if ((Bounds != NULL) && !Tuple_Feasible (Bounds, Stream->Frequencies)) continue;
+			Fits++;
+			if (!SBFIT_Method (FitMethod, Guess, &ChiSqr, FitBundle, MyOpt_Bundle, Stream->Frequencies, Constants) || !isfinite(Constants[0]+Constants[1]+Constants[2])) {
+				Errors++;
+				continue;
+			}
+			Index = (Clusters != NULL) ? Add_Cluster_Fit (Clusters, Constants, ChiSqr, 0.0, Transitions, Stream->TargetCount) : -1;
+			if ((Index != -1) && (Clusters->Clusters[Index].Multiplicity > 1.0)) continue;
+			Fill_Triples_Verifier (Verifier, Constants);
+			Verifier->Threshold = Saves[0].Score;
+			Score = CandidateScoreFunction (Verifier->Catalog, ScoringParameters);
+			Scored++;
+			if (Index != -1) Clusters->Clusters[Index].Score = Score;
+			Push_Save (Saves, SaveCount, Score, Constants[0], Constants[1], Constants[2]);
+		} while (Next_Candidate (Stream));
+	}
+	clock_gettime (CLOCK_MONOTONIC, &End);
+	Set_Telemetry_Source (Source);
+	Merge_Fit_Telemetry ();
+	Timing = (End.tv_sec-Begin.tv_sec)+1.0E-9*(End.tv_nsec-Begin.tv_nsec);
+	Sort_Saves (Saves, SaveCount);
+	if (Verbose) printf ("%.0f %d line candidates fit and scored in %.2f sec, %.0f Errors\n",Fits,Stream->TargetCount,Timing,Errors);
+	if (Verbose && (Bounds != NULL)) Print_Feasibility_Stats (Bounds);
+	if (Verbose && (Clusters != NULL)) Print_Cluster_Stats (Clusters);
+	if (Verbose > 1) Print_Fit_Telemetry (TELEMETRY_TRIPLES);
+	if (Verbose > 1) for (i=0;i<SaveCount;i++) printf ("%d: Score:%f %f %f %f\n",i,Saves[i].Score,Saves[i].A,Saves[i].B,Saves[i].C);
+	return (int) Scored;
+}
+
+////////////////////////////////////
+/* Pre-fit feasibility filter */
+
+/*
+	Most tuples out of a triples cube or a Candidate_Stream can't be fit by any A>=B>=C>0, but each still costs a full fit to find that out
+	With S = (A+C)/2 and r = (A-C)/(A+C), a line is S*|JTerm + r*ETerm(Kappa)|, with Kappa in [-1,1] and r in [0,1)
+	-Setup_Feasibility_Bounds splits (Kappa,r) into cells and, once per search, bounds the ratio of every pair of target lines in each cell, along with each line over S
+	-A tuple can only be fit if some cell allows all its line ratios (and an S in ScaleLow/ScaleHigh), which is a few comparisons per cell
+	-Orderings no rotor can produce and spacings no Kappa allows fail every cell, so they never reach the fitter
+	-Ratios are what pin a tuple down, per line bounds alone leave S free to soak up almost anything
+	The bounds are padded so a fittable tuple is never rejected, the filter only ever lets through too much
+*/
+
+void Feasibility_Terms (struct Transition Target, struct Level *MyDictionary, struct ETauStruct ETStruct, double Kappa, double RatioLow, double RatioHigh, double *First, double *Last)
+{
+//JTerm + r*ETerm at the two ends of an r bin, linear in r in between
+int JUpper,JLower;
+double JTerm,ETerm;
+	JUpper = MyDictionary[Target.Upper].J;
+	JLower = MyDictionary[Target.Lower].J;
+	JTerm = JUpper*(JUpper+1.0)-JLower*(JLower+1.0);
+	ETerm = E_tau (Target.Upper,Kappa,ETStruct)-E_tau (Target.Lower,Kappa,ETStruct);
+	*First = JTerm+RatioLow*ETerm;
+	*Last = JTerm+RatioHigh*ETerm;
+}
+
+int Setup_Feasibility_Bounds (struct Feasibility_Bounds *Bounds, struct Transition *Targets, int TargetCount, struct Level *MyDictionary, struct ETauStruct ETStruct, double ScaleLow, double ScaleHigh, double Tolerance)
+{
+/*
+	Works out the per cell bounds for the target transitions
+
+Arguments
+Bounds - Bounds to fill, counters start at 0
+Targets - Transitions the tuple lines are assigned to, in tuple order
+TargetCount - # of targets, up to CANDIDATE_MAX_TARGETS
+MyDictionary/ETStruct - Levels and E_tau values, as used for the fits
+ScaleLow/ScaleHigh - Range of (A+C)/2 to allow, 0 and HUGE_VAL if nothing is known
+Tolerance - Slack on every line, at least whatever the fit will accept as a match
+
+Returns 1 on success, 0 if there are too many targets
+*/
+int i,j,k,m,s,Cell,Pair;
+double Kappa,KappaLow,KappaStep,RatioLow,RatioHigh,Low,High;
+double First[CANDIDATE_MAX_TARGETS],Last[CANDIDATE_MAX_TARGETS];
+double LineLow[CANDIDATE_MAX_TARGETS],LineHigh[CANDIDATE_MAX_TARGETS];
+double PairLow[FEASIBILITY_MAX_PAIRS],PairHigh[FEASIBILITY_MAX_PAIRS];
+double LineJump[CANDIDATE_MAX_TARGETS],PairJump[FEASIBILITY_MAX_PAIRS];
+	if ((TargetCount < 1) || (TargetCount > CANDIDATE_MAX_TARGETS)) {
+		printf ("Error: %d target transitions given, between 1 and %d are supported\n",TargetCount,CANDIDATE_MAX_TARGETS);
+		return 0;
+	}
+	Bounds->TargetCount = TargetCount;
+	Bounds->ScaleLow = ScaleLow;
+	Bounds->ScaleHigh = ScaleHigh;
+	Bounds->Tolerance = Tolerance;
+	Bounds->Checked = 0.0;
+	Bounds->Rejected = 0.0;
+	KappaStep = (2.0-2.0*KAPPA_PROFILE_EDGE)/(FEASIBILITY_KAPPA_BINS*FEASIBILITY_SAMPLES);
+	for (k=0;k<FEASIBILITY_KAPPA_BINS;k++) {
+		KappaLow = -1.0+KAPPA_PROFILE_EDGE+k*FEASIBILITY_SAMPLES*KappaStep;
+		for (m=0;m<FEASIBILITY_RATIO_BINS;m++) {
+			Cell = k*FEASIBILITY_RATIO_BINS+m;
+			RatioLow = (double) m/FEASIBILITY_RATIO_BINS;
+			RatioHigh = (double) (m+1)/FEASIBILITY_RATIO_BINS;
+			for (s=0;s<=FEASIBILITY_SAMPLES;s++) {
+				Kappa = KappaLow+s*KappaStep;
+				for (i=0;i<TargetCount;i++) Feasibility_Terms (Targets[i], MyDictionary, ETStruct, Kappa, RatioLow, RatioHigh, &(First[i]), &(Last[i]));
+				Pair = 0;
+				for (i=0;i<TargetCount;i++) {
+					//|JTerm + r*ETerm| over the r bin, the ends are the extremes unless it crosses 0
+					High = fmax (fabs(First[i]),fabs(Last[i]));
+					Low = (First[i]*Last[i] <= 0.0) ? 0.0 : fmin (fabs(First[i]),fabs(Last[i]));
+					if (s == 0) {
+						Bounds->Low[i][Cell] = Low;
+						Bounds->High[i][Cell] = High;
+						LineJump[i] = 0.0;
+					}
+					else LineJump[i] = fmax (LineJump[i],fmax (fabs(Low-LineLow[i]),fabs(High-LineHigh[i])));	//Anything between samples is padded by the biggest step seen
+					LineLow[i] = Low;
+					LineHigh[i] = High;
+					Bounds->Low[i][Cell] = fmin (Bounds->Low[i][Cell],Low);
+					Bounds->High[i][Cell] = fmax (Bounds->High[i][Cell],High);
+					for (j=i+1;j<TargetCount;j++) {
+						//Ratio of two lines is monotonic in r between the poles, so again the ends unless either line crosses 0
+						if (First[j]*Last[j] <= 0.0) {
+							Low = 0.0;
+							High = HUGE_VAL;
+						}
+						else {
+							Low = fmin (fabs(First[i]/First[j]),fabs(Last[i]/Last[j]));
+							High = fmax (fabs(First[i]/First[j]),fabs(Last[i]/Last[j]));
+							if (First[i]*Last[i] <= 0.0) Low = 0.0;
+						}
+						if (s == 0) {
+							Bounds->PairLow[Pair][Cell] = Low;
+							Bounds->PairHigh[Pair][Cell] = High;
+							PairJump[Pair] = 0.0;
+						}
+						else if (isfinite(High) && isfinite(PairHigh[Pair])) PairJump[Pair] = fmax (PairJump[Pair],fmax (fabs(Low-PairLow[Pair]),fabs(High-PairHigh[Pair])));
+						PairLow[Pair] = Low;
+						PairHigh[Pair] = High;
+						Bounds->PairLow[Pair][Cell] = fmin (Bounds->PairLow[Pair][Cell],Low);
+						Bounds->PairHigh[Pair][Cell] = fmax (Bounds->PairHigh[Pair][Cell],High);
+						Pair++;
+					}
+				}
+			}
+			for (i=0;i<TargetCount;i++) {
+				Bounds->Low[i][Cell] = fmax (0.0,Bounds->Low[i][Cell]-LineJump[i]);
+				Bounds->High[i][Cell] += LineJump[i];
+			}
+			for (Pair=0;Pair<TargetCount*(TargetCount-1)/2;Pair++) {
+				Bounds->PairLow[Pair][Cell] = fmax (0.0,Bounds->PairLow[Pair][Cell]-PairJump[Pair]);
+				Bounds->PairHigh[Pair][Cell] += PairJump[Pair];
+			}
+		}
+	}
+	return 1;
+}
+
+int Tuple_Feasible (struct Feasibility_Bounds *Bounds, double *Frequencies)
+{
+//1 if some cell allows every line ratio and an S that every line allows, 0 if the tuple can't be fit. Frequencies are in target order, Bounds->TargetCount of them
+int i,j,Cell,Pair,Allowed;
+double ScaleLow,ScaleHigh,Tolerance;
+	Bounds->Checked++;
+	Tolerance = Bounds->Tolerance;
+	for (Cell=0;Cell<FEASIBILITY_KAPPA_BINS*FEASIBILITY_RATIO_BINS;Cell++) {
+		Allowed = 1;
+		Pair = 0;
+		for (i=0;(i<Bounds->TargetCount) && Allowed;i++) {
+			for (j=i+1;j<Bounds->TargetCount;j++) {		//Widest the ratio can be with both lines off by Tolerance
+				if (((Frequencies[i]+Tolerance) < Bounds->PairLow[Pair][Cell]*(Frequencies[j]-Tolerance)) || ((Frequencies[i]-Tolerance) > Bounds->PairHigh[Pair][Cell]*(Frequencies[j]+Tolerance))) {
+					Allowed = 0;
+					break;
+				}
+				Pair++;
+			}
+		}
+		if (!Allowed) continue;
+		ScaleLow = Bounds->ScaleLow;
+		ScaleHigh = Bounds->ScaleHigh;
+		for (i=0;i<Bounds->TargetCount;i++) {		//S*Low-Tolerance <= Frequency <= S*High+Tolerance
+			if (Bounds->High[i][Cell] > 0.0) ScaleLow = fmax (ScaleLow,(Frequencies[i]-Tolerance)/Bounds->High[i][Cell]);
+			else if (Frequencies[i] > Tolerance) ScaleLow = HUGE_VAL;		//Line is 0 everywhere in this cell
+			if (Bounds->Low[i][Cell] > 0.0) ScaleHigh = fmin (ScaleHigh,(Frequencies[i]+Tolerance)/Bounds->Low[i][Cell]);
+			if (ScaleLow > ScaleHigh) break;
+		}
+		if (i == Bounds->TargetCount) return 1;
+	}
+	Bounds->Rejected++;
+	return 0;
+}
+
+void Print_Feasibility_Stats (struct Feasibility_Bounds *Bounds)
+{
+	if (Bounds->Checked > 0.0) printf ("Feasibility filter: %.0f tuples checked, %.0f rejected before fitting (%.1f%%)\n",Bounds->Checked,Bounds->Rejected,100.0*Bounds->Rejected/Bounds->Checked);
+	else printf ("Feasibility filter: no tuples checked\n");
+}
+
+////////////////////////////////////
+/* Online clustering of fitted constants */
+
+/*
+	The same molecule turns up from many line subsets and many grid starts, so the four line, DR and triples searches keep the same answer thousands of times over
+	Solution_Clusters merges fits as they come in, anything within Radius (MHz, in A/B/C) of an existing cluster's first fit joins that cluster
+	-Fits are hashed by the Radius wide grid cell they land in, so a new fit is only compared against clusters in the 27 cells around it
+	-A cluster keeps its multiplicity, its lowest ChiSqr constants, the best score seen and every distinct (transition, experimental line) pair that supported it
+	-Clusters don't move while fits arrive, so which fits share a cluster depends on the order they come in
+	-Once every fit is in, Recenter_Solution_Clusters rebuilds the clusters around their best fits, so the saved solutions don't depend on which shard or thread got there first
+	-Anything downstream (verification, saves, the written table) then only sees one entry per solution
+	Not locked, give each thread its own and combine them with Merge_Solution_Clusters
+*/
+
+int Initialize_Solution_Clusters (struct Solution_Clusters *Clusters, double Radius, int Capacity)
+{
+//Empty set of clusters merging fits within Radius, Capacity is only the starting size, it grows as needed
+int i,Buckets;
+	Clusters->Clusters = NULL;
+	Clusters->Buckets = NULL;
+	Clusters->Count = 0;
+	Clusters->Capacity = 0;
+	Clusters->BucketMask = 0;
+	Clusters->Radius = Radius;
+	Clusters->Fits = 0.0;
+	if (!(Radius > 0.0)) {
+		printf ("Error: Cluster radius must be positive, %f given\n",Radius);
+		return 0;
+	}
+	if (Capacity < 16) Capacity = 16;
+	for (Buckets=1;Buckets<2*Capacity;Buckets*=2);	//Load factor at or under 0.5, same as the fit cache
+	Clusters->Clusters = malloc (Capacity*sizeof(struct Solution_Cluster));
+	Clusters->Buckets = malloc (Buckets*sizeof(int));
+	if ((Clusters->Clusters == NULL) || (Clusters->Buckets == NULL)) goto Error;
+	for (i=0;i<Buckets;i++) Clusters->Buckets[i] = -1;
+	Clusters->Capacity = Capacity;
+	Clusters->BucketMask = Buckets-1;
+	return 1;
+Error:
+	printf ("Error allocating %d solution clusters\n",Capacity);
+	Free_Solution_Clusters (Clusters);
+	return 0;
+}
+
+void Free_Solution_Clusters (struct Solution_Clusters *Clusters)
+{
+	free (Clusters->Clusters);
+	free (Clusters->Buckets);
+	Clusters->Clusters = NULL;
+	Clusters->Buckets = NULL;
+	Clusters->Count = 0;
+	Clusters->Capacity = 0;
+}
+
+unsigned long long Cluster_Cell_Hash (long long *Cell)
+{
+//Same FNV-1a and final mix as the fit cache keys
+int i;
+unsigned long long Hash;
+	Hash = 14695981039346656037ULL;
+	for (i=0;i<3;i++) Hash = (Hash^((unsigned long long) Cell[i]))*1099511628211ULL;
+	Hash ^= Hash >> 33;
+	Hash *= 0xff51afd7ed558ccdULL;
+	Hash ^= Hash >> 33;
+	return Hash;
+}
+
+int Find_Cluster (struct Solution_Clusters *Clusters, double *Constants)
+{
+//Index of the cluster whose first fit is nearest Constants and within Radius, -1 if there isn't one
+int i,Index,Best;
+long long Home[3],Cell[3];
+double Distance,BestDistance;
+struct Solution_Cluster *Cluster;
+	for (i=0;i<3;i++) Home[i] = (long long) floor(Constants[i]/Clusters->Radius);
+	Best = -1;
+	BestDistance = Clusters->Radius*Clusters->Radius;
+	for (i=0;i<27;i++) {	//A center within Radius can be at most one cell away on each axis
+		Cell[0] = Home[0]+i/9-1;
+		Cell[1] = Home[1]+(i/3)%3-1;
+		Cell[2] = Home[2]+i%3-1;
+		for (Index=Clusters->Buckets[Cluster_Cell_Hash (Cell) & Clusters->BucketMask];Index != -1;Index=Cluster->Next) {
+			Cluster = &(Clusters->Clusters[Index]);
+			if ((Cluster->Cell[0] != Cell[0]) || (Cluster->Cell[1] != Cell[1]) || (Cluster->Cell[2] != Cell[2])) continue;
+			Distance = (Cluster->Center[0]-Constants[0])*(Cluster->Center[0]-Constants[0])+(Cluster->Center[1]-Constants[1])*(Cluster->Center[1]-Constants[1])+(Cluster->Center[2]-Constants[2])*(Cluster->Center[2]-Constants[2]);
+			if (Distance <= BestDistance) {
+				BestDistance = Distance;
+				Best = Index;
+			}
+		}
+	}
+	return Best;
+}
+
+int Grow_Solution_Clusters (struct Solution_Clusters *Clusters)
+{
+//Doubles the room for clusters and rehashes them into twice the buckets
+int i,Buckets,*NewBuckets;
+unsigned long long Hash;
+struct Solution_Cluster *NewClusters;
+	NewClusters = realloc (Clusters->Clusters, 2*Clusters->Capacity*sizeof(struct Solution_Cluster));
+	if (NewClusters == NULL) goto Error;
+	Clusters->Clusters = NewClusters;
+	Buckets = 2*(Clusters->BucketMask+1);
+	NewBuckets = malloc (Buckets*sizeof(int));
+	if (NewBuckets == NULL) goto Error;
+	for (i=0;i<Buckets;i++) NewBuckets[i] = -1;
+	for (i=0;i<Clusters->Count;i++) {
+		Hash = Cluster_Cell_Hash (Clusters->Clusters[i].Cell) & (Buckets-1);
+		Clusters->Clusters[i].Next = NewBuckets[Hash];
+		NewBuckets[Hash] = i;
+	}
+	free (Clusters->Buckets);
+	Clusters->Buckets = NewBuckets;
+	Clusters->BucketMask = Buckets-1;
+	Clusters->Capacity *= 2;
+	return 1;
+Error:
+	printf ("Error growing solution clusters past %d\n",Clusters->Capacity);
+	return 0;
+}
+
+int New_Cluster (struct Solution_Clusters *Clusters, double *Constants)
+{
+//Starts an empty cluster at Constants, returns its index or -1 on an allocation failure
+int i;
+unsigned long long Hash;
+struct Solution_Cluster *Cluster;
+	if ((Clusters->Count == Clusters->Capacity) && !Grow_Solution_Clusters (Clusters)) return -1;
+	Cluster = &(Clusters->Clusters[Clusters->Count]);
+	for (i=0;i<3;i++) {
+		Cluster->Center[i] = Constants[i];
+		Cluster->Constants[i] = Constants[i];
+		Cluster->Cell[i] = (long long) floor(Constants[i]/Clusters->Radius);
+	}
+	Cluster->ChiSqr = HUGE_VAL;
+	Cluster->Score = -HUGE_VAL;
+	Cluster->Multiplicity = 0.0;
+	Cluster->LineCount = 0;
+	Cluster->DroppedLines = 0.0;
+	Hash = Cluster_Cell_Hash (Cluster->Cell) & Clusters->BucketMask;
+	Cluster->Next = Clusters->Buckets[Hash];
+	Clusters->Buckets[Hash] = Clusters->Count;
+	Clusters->Count++;
+	return Clusters->Count-1;
+}
+
+void Add_Cluster_Line (struct Solution_Cluster *Cluster, unsigned int Upper, unsigned int Lower, double Frequency)
+{
+//Adds a supporting (transition, experimental line) pair if the cluster doesn't have it already
+int i;
+	for (i=0;i<Cluster->LineCount;i++) if ((Cluster->Upper[i] == Upper) && (Cluster->Lower[i] == Lower) && (Cluster->Frequency[i] == Frequency)) return;
+	if (Cluster->LineCount == CLUSTER_MAX_LINES) {
+		Cluster->DroppedLines++;
+		return;
+	}
+	Cluster->Upper[Cluster->LineCount] = Upper;
+	Cluster->Lower[Cluster->LineCount] = Lower;
+	Cluster->Frequency[Cluster->LineCount] = Frequency;
+	Cluster->LineCount++;
+}
+
+int Add_Cluster_Fit (struct Solution_Clusters *Clusters, double *Constants, double ChiSqr, double Score, struct Transition *Lines, int LineCount)
+{
+/*
+	Merges one fit into the clusters, starting a new cluster if nothing is within Radius
+Constants/ChiSqr/Score - The fit, Score is whatever the search ranks by (higher is better), the best one is kept
+Lines - Fitted transitions, Frequency should be the experimental frequency they were assigned to. NULL to skip
+LineCount - # of transitions in Lines
+
+Returns the index of the cluster the fit went into, its Multiplicity is 1 if the fit started it. -1 on an allocation failure
+*/
+int i,Index;
+struct Solution_Cluster *Cluster;
+	Clusters->Fits++;
+	Index = Find_Cluster (Clusters, Constants);
+	if ((Index == -1) && ((Index = New_Cluster (Clusters, Constants)) == -1)) return -1;
+	Cluster = &(Clusters->Clusters[Index]);
+	Cluster->Multiplicity++;
+	if (ChiSqr < Cluster->ChiSqr) {
+		Cluster->ChiSqr = ChiSqr;
+		for (i=0;i<3;i++) Cluster->Constants[i] = Constants[i];
+	}
+	if (Score > Cluster->Score) Cluster->Score = Score;
+	if (Lines != NULL) for (i=0;i<LineCount;i++) Add_Cluster_Line (Cluster, Lines[i].Upper, Lines[i].Lower, Lines[i].Frequency);
+	return Index;
+}
+
+int Fold_Cluster (struct Solution_Clusters *Into, struct Solution_Cluster *Source, double *Position)
+{
+//Adds everything in Source to the cluster of Into nearest Position, starting one there if nothing is within Radius. Returns 0 on an allocation failure
+int j,Index;
+struct Solution_Cluster *Cluster;
+	Index = Find_Cluster (Into, Position);
+	if ((Index == -1) && ((Index = New_Cluster (Into, Position)) == -1)) return 0;
+	Cluster = &(Into->Clusters[Index]);
+	Cluster->Multiplicity += Source->Multiplicity;
+	if (Source->ChiSqr < Cluster->ChiSqr) {
+		Cluster->ChiSqr = Source->ChiSqr;
+		for (j=0;j<3;j++) Cluster->Constants[j] = Source->Constants[j];
+	}
+	if (Source->Score > Cluster->Score) Cluster->Score = Source->Score;
+	for (j=0;j<Source->LineCount;j++) Add_Cluster_Line (Cluster, Source->Upper[j], Source->Lower[j], Source->Frequency[j]);
+	Cluster->DroppedLines += Source->DroppedLines;
+	return 1;
+}
+
+int Merge_Solution_Clusters (struct Solution_Clusters *Into, struct Solution_Clusters *From)
+{
+//Folds every cluster of From into Into as if its fits had been added there, From is left as it was. Returns 0 on an allocation failure
+int i;
+	for (i=0;i<From->Count;i++) if (!Fold_Cluster (Into, &(From->Clusters[i]), From->Clusters[i].Center)) return 0;
+	Into->Fits += From->Fits;
+	return 1;
+}
+
+int Compare_Clusters_ChiSqr (const void *a, const void *b)
+{
+//qsort comparison for Recenter_Solution_Clusters, best fit first
+	double A = ((struct Solution_Cluster *) a)->ChiSqr;
+	double B = ((struct Solution_Cluster *) b)->ChiSqr;
+	if (A > B) return 1;
+	else if (A < B) return -1;
+	else return 0;
+}
+
+int Recenter_Solution_Clusters (struct Solution_Clusters *Clusters)
+{
+/*
+	Rebuilds the clusters around their best fits, for once every fit is in (after the shards are merged, before the clusters are saved)
+	A cluster is anchored on whichever fit arrived first, which is rarely its best and depends on the order shards and threads ran in
+	Clusters are taken lowest ChiSqr first and each is folded in at its best constants, so the best fits become the centres and a cluster whose best fit is within Radius of a better one joins it
+	Returns 0 on an allocation failure, Clusters is left as it was
+*/
+int i;
+struct Solution_Cluster *Sorted;
+struct Solution_Clusters Recentered;
+	if (Clusters->Count == 0) return 1;
+	Sorted = malloc (Clusters->Count*sizeof(struct Solution_Cluster));	//Sorted copy, sorting in place would break the hash chains
+	if (Sorted == NULL) {
+		printf ("Memory Error\n");
+		return 0;
+	}
+	memcpy (Sorted, Clusters->Clusters, Clusters->Count*sizeof(struct Solution_Cluster));
+	qsort (Sorted, Clusters->Count, sizeof(struct Solution_Cluster), Compare_Clusters_ChiSqr);
+	if (!Initialize_Solution_Clusters (&Recentered, Clusters->Radius, Clusters->Count)) {
+		free (Sorted);
+		return 0;
+	}
+	for (i=0;i<Clusters->Count;i++) if (!Fold_Cluster (&Recentered, &(Sorted[i]), Sorted[i].Constants)) goto Error;
+	Recentered.Fits = Clusters->Fits;
+	free (Sorted);
+	Free_Solution_Clusters (Clusters);
+	*Clusters = Recentered;
+	return 1;
+Error:
+	free (Sorted);
+	Free_Solution_Clusters (&Recentered);
+	return 0;
+}
+
+int Cluster_Hit_File (char *HitFile, struct Solution_Clusters *Clusters)
+{
+//Adds every hit in a binary hit file (see Add_Hit) to the clusters, for the DR search, merged shards or a search resumed from a checkpoint
+int i,j,HitCount;
+struct Hit_Record *Hits;
+struct Transition Lines[HIT_MAX_LINES];
+	if (!Load_Hits (HitFile, &Hits, &HitCount)) return 0;
+	for (i=0;i<HitCount;i++) {
+		for (j=0;(j<Hits[i].LineCount) && (j<HIT_MAX_LINES);j++) {
+			Lines[j].Upper = Hits[i].Upper[j];
+			Lines[j].Lower = Hits[i].Lower[j];
+			Lines[j].Frequency = Hits[i].Frequency[j];
+		}
+		if (Add_Cluster_Fit (Clusters, Hits[i].Constants, Hits[i].ChiSqr, Hits[i].Score, Lines, j) == -1) {
+			free (Hits);
+			return 0;
+		}
+	}
+	free (Hits);
+	return 1;
+}
+
+void Solution_Clusters_To_Saves (struct Solution_Clusters *Clusters, int SaveCount, struct MultiSave *Saves)
+{
+//Best SaveCount clusters by ChiSqr as saves of their best fits, sorted so the best is last like the four line search's saves
+int i;
+	Initialize_Saves (Saves, SaveCount, 10000.0);
+	for (i=0;i<Clusters->Count;i++) Push_Save_Descending (Saves, SaveCount, Clusters->Clusters[i].ChiSqr, Clusters->Clusters[i].Constants[0], Clusters->Clusters[i].Constants[1], Clusters->Clusters[i].Constants[2]);
+	Sort_Saves_Descending (Saves, SaveCount);
+}
+
+int Compare_Clusters (const void *a, const void *b)
+{
+//qsort comparison for Save_Solution_Clusters, most fits first
+	double A = ((struct Solution_Cluster *) a)->Multiplicity;
+	double B = ((struct Solution_Cluster *) b)->Multiplicity;
+	if (A < B) return 1;
+	else if (A > B) return -1;
+	else return 0;
+}
+
+int Save_Solution_Clusters (char *FileName, struct Solution_Clusters *Clusters, struct Level *MyDictionary)
+{
+/*
+	Writes the clusters as text, most fits first, one cluster per line
+	A B C ChiSqr Score Multiplicity, then each supporting transition as Frequency J,Ka,Kc-J,Ka,Kc like Export_Hits_Text
+	MyDictionary is only needed for the quantum numbers, with NULL the raw level indices are written instead
+*/
+int i,j;
+struct Solution_Cluster *Sorted,*Cluster;
+FILE *FileHandle;
+	Sorted = malloc (((Clusters->Count > 0) ? Clusters->Count : 1)*sizeof(struct Solution_Cluster));	//Sorted copy, sorting in place would break the hash chains
+	if (Sorted == NULL) {
+		printf ("Memory Error\n");
+		return 0;
+	}
+	FileHandle = fopen (FileName,"w");
+	if (FileHandle == NULL) {
+		printf ("Error: Unable to open %s\n",FileName);
+		free (Sorted);
+		return 0;
+	}
+	memcpy (Sorted, Clusters->Clusters, Clusters->Count*sizeof(struct Solution_Cluster));
+	qsort (Sorted, Clusters->Count, sizeof(struct Solution_Cluster), Compare_Clusters);
+	for (i=0;i<Clusters->Count;i++) {
+		Cluster = &(Sorted[i]);
+		fprintf (FileHandle,"%.3f %.3f %.3f %f %.2f %.0f",Cluster->Constants[0],Cluster->Constants[1],Cluster->Constants[2],Cluster->ChiSqr,Cluster->Score,Cluster->Multiplicity);
+		for (j=0;j<Cluster->LineCount;j++) {
+			if (MyDictionary != NULL) {
+				fprintf (FileHandle," %.4f %d,%d,%d-%d,%d,%d",Cluster->Frequency[j],MyDictionary[Cluster->Upper[j]].J,MyDictionary[Cluster->Upper[j]].Ka,MyDictionary[Cluster->Upper[j]].Kc,MyDictionary[Cluster->Lower[j]].J,MyDictionary[Cluster->Lower[j]].Ka,MyDictionary[Cluster->Lower[j]].Kc);
+			} else {
+				fprintf (FileHandle," %.4f %u-%u",Cluster->Frequency[j],Cluster->Upper[j],Cluster->Lower[j]);
+			}
+		}
+		fprintf (FileHandle,"\n");
+	}
+	fclose (FileHandle);
+	free (Sorted);
+	return 1;
+}
+
+void Print_Cluster_Stats (struct Solution_Clusters *Clusters)
+{
+	if (Clusters->Fits > 0.0) printf ("Clustering: %.0f fits merged into %d unique solutions within %.3f MHz (%.1f fits each)\n",Clusters->Fits,Clusters->Count,Clusters->Radius,Clusters->Fits/Clusters->Count);
+	else printf ("Clustering: no fits\n");
+}
+
+////////////////////////////////////
+/* Batched fitting */
+
+/*
+	SBFIT fits one line set per call, on a workspace allocated for one line count, so fitting thousands of unrelated line sets means a loop around Initialize_SBFIT and SBFIT
+	SBFIT_Batch takes the whole list of Fit_Problems and fits them on a pool of threads
+	-Threads take BATCH_CHUNK problems at a time off a shared counter, so a thread that lands on slow fits just takes fewer chunks
+	-Each thread keeps one GSL workspace per line count, allocated the first time it sees that count and reused for every later problem of that size
+	-The fits are the same as SBFIT (trust region Levenberg-Marquardt, finite difference Jacobian, 200 iterations), plus optional weights
+	-Results go into flat arrays indexed by problem, so they don't depend on which thread fit what
+*/
+
+int SBFIT_Batch (struct Fit_Problem *Problems, int ProblemCount, struct ETauStruct ETStruct, struct Level *MyDictionary, int ThreadCount, double *Constants, double *ChiSqr, int *Iterations, double *Covariance, int *Status, int Verbose)
+{
+/*
+	Fits every problem in Problems
+
+Arguments
+Problems - Fits to do, see struct Fit_Problem. Only read, so the same Lines/Frequencies arrays can be shared between problems
+ProblemCount - # of problems
+ETStruct/MyDictionary - ET values and dictionary for the fits
+ThreadCount - # of threads, 0 or less uses one per online core
+Constants - 3*ProblemCount doubles, A/B/C of problem i at 3*i
+ChiSqr - ProblemCount doubles, weighted sum of squared residuals
+Iterations - ProblemCount ints, NULL to skip
+Covariance - 9*ProblemCount doubles, NULL to skip. Problem i's 3x3 (J^T W J)^-1 at 9*i, row major. That's unscaled like Get_SBFIT_Error, for an unweighted fit multiply by ChiSqr/(LineCount-3) to get the parameter covariance
+Status - ProblemCount ints, NULL to skip. 1 converged, 0 ran out of iterations (SBFIT's failure), -1 not fit (fewer than 3 lines or out of memory)
+Verbose - Timing and fit statistics
+
+Returns 1 once every problem has been tried, 0 if the batch couldn't be started
+*/
+struct Batch_Pool Pool;
+struct Batch_Worker *Workers;
+pthread_t *Threads;
+int *Started;
+int i,Made;
+double Converged,Timing;
+struct timespec Begin,End;
+	if ((ProblemCount < 1) || (Constants == NULL) || (ChiSqr == NULL)) {
+		printf ("Error: SBFIT_Batch needs problems to fit and somewhere to put the results\n");
+		return 0;
+	}
+	if (ThreadCount < 1) ThreadCount = (int) sysconf (_SC_NPROCESSORS_ONLN);
+	if (ThreadCount < 1) ThreadCount = 1;
+	if (ThreadCount > (ProblemCount+BATCH_CHUNK-1)/BATCH_CHUNK) ThreadCount = (ProblemCount+BATCH_CHUNK-1)/BATCH_CHUNK;	//More threads than chunks would just sit idle
+	Pool.Problems = Problems;
+	Pool.ProblemCount = ProblemCount;
+	Pool.ETStruct = ETStruct;
+	Pool.MyDictionary = MyDictionary;
+	Pool.Constants = Constants;
+	Pool.ChiSqr = ChiSqr;
+	Pool.Iterations = Iterations;
+	Pool.Covariance = Covariance;
+	Pool.Status = Status;
+	Pool.Next = 0;
+	Pool.MaxLines = 0;
+	for (i=0;i<ProblemCount;i++) if (Problems[i].LineCount > Pool.MaxLines) Pool.MaxLines = Problems[i].LineCount;
+	if (pthread_mutex_init (&(Pool.Lock), NULL) != 0) {
+		printf ("Error: Unable to set up the batch fitting lock\n");
+		return 0;
+	}
+	Made = 0;
+	Workers = malloc (ThreadCount*sizeof(struct Batch_Worker));
+	Threads = malloc (ThreadCount*sizeof(pthread_t));
+	Started = malloc (ThreadCount*sizeof(int));
+	if ((Workers == NULL) || (Threads == NULL) || (Started == NULL)) {
+		printf ("Error: Unable to allocate %d batch fitting threads\n",ThreadCount);
+		goto Error;
+	}
+	for (Made=0;Made<ThreadCount;Made++) if (!Initialize_Batch_Worker (&(Workers[Made]), &Pool)) goto Error;
+	clock_gettime (CLOCK_MONOTONIC, &Begin);
+	for (i=0;i<ThreadCount;i++) {
+		Started[i] = (pthread_create (&(Threads[i]), NULL, Batch_Worker_Thread, &(Workers[i])) == 0);
+		if (!Started[i]) Batch_Worker_Thread (&(Workers[i]));		//No thread to be had, this one just takes chunks until they're gone
+	}
+	for (i=0;i<ThreadCount;i++) if (Started[i]) pthread_join (Threads[i], NULL);
+	clock_gettime (CLOCK_MONOTONIC, &End);
+	Timing = (End.tv_sec-Begin.tv_sec)+1.0E-9*(End.tv_nsec-Begin.tv_nsec);
+	Converged = 0.0;
+	for (i=0;i<ThreadCount;i++) Converged += Workers[i].Converged;
+	if (Verbose) printf ("%d fits on %d threads in %.2f sec, %.0f converged\n",ProblemCount,ThreadCount,Timing,Converged);
+	for (i=0;i<Made;i++) Free_Batch_Worker (&(Workers[i]));
+	pthread_mutex_destroy (&(Pool.Lock));
+	free (Workers);
+	free (Threads);
+	free (Started);
+	return 1;
+Error:
+	if (Workers != NULL) for (i=0;i<Made;i++) Free_Batch_Worker (&(Workers[i]));
+	pthread_mutex_destroy (&(Pool.Lock));
+	free (Workers);
+	free (Threads);
+	free (Started);
+	return 0;
+}
+
+int Initialize_Batch_Worker (struct Batch_Worker *Worker, struct Batch_Pool *Pool)
+{
+//Fit settings as Initialize_SBFIT, the workspaces are left to be allocated as each line count turns up
+int i;
+	Worker->Pool = Pool;
+	Worker->Converged = 0.0;
+	Worker->OptBundle.ETGSL = Pool->ETStruct;
+	Worker->OptBundle.MyDictionary = Pool->MyDictionary;
+	Worker->OptBundle.TransitionCount = 0;
+	Worker->fdf_params = gsl_multifit_nlinear_default_parameters();
+	Worker->fdf_params.trs = gsl_multifit_nlinear_trs_lm;
+	Worker->fdf.f = SBFIT_OptFunc_gsl;
+	Worker->fdf.df = NULL;
+	Worker->fdf.fvv = NULL;
+	Worker->fdf.p = 3;
+	Worker->fdf.params = &(Worker->OptBundle);
+	Worker->OptBundle.TransitionsGSL = malloc ((Pool->MaxLines+1)*sizeof(struct Transition));
+	Worker->Workspaces = malloc ((Pool->MaxLines+1)*sizeof(gsl_multifit_nlinear_workspace *));
+	Worker->Covar = gsl_matrix_alloc (3, 3);
+	if ((Worker->OptBundle.TransitionsGSL == NULL) || (Worker->Workspaces == NULL) || (Worker->Covar == NULL)) {
+		printf ("Error: Unable to allocate a batch fitting thread\n");
+		free (Worker->OptBundle.TransitionsGSL);
+		free (Worker->Workspaces);
+		if (Worker->Covar != NULL) gsl_matrix_free (Worker->Covar);
+		return 0;
+	}
+	for (i=0;i<=Pool->MaxLines;i++) Worker->Workspaces[i] = NULL;
+	return 1;
+}
+
+void Free_Batch_Worker (struct Batch_Worker *Worker)
+{
+int i;
+	for (i=0;i<=Worker->Pool->MaxLines;i++) if (Worker->Workspaces[i] != NULL) gsl_multifit_nlinear_free (Worker->Workspaces[i]);
+	free (Worker->Workspaces);
+	free (Worker->OptBundle.TransitionsGSL);
+	gsl_matrix_free (Worker->Covar);
+	Worker->Workspaces = NULL;
+	Worker->OptBundle.TransitionsGSL = NULL;
+	Worker->Covar = NULL;
+}
+
+void *Batch_Worker_Thread (void *Arg)
+{
+//Takes chunks of problems off the pool until there are none left
+struct Batch_Worker *Worker;
+struct Batch_Pool *Pool;
+int i,First,Last,Source;
+	Worker = (struct Batch_Worker *) Arg;
+	Pool = Worker->Pool;
+	Source = Set_Telemetry_Source (TELEMETRY_BATCH);
+	while (1) {
+		pthread_mutex_lock (&(Pool->Lock));
+		First = Pool->Next;
+		Pool->Next = (First+BATCH_CHUNK < Pool->ProblemCount) ? First+BATCH_CHUNK : Pool->ProblemCount;
+		Last = Pool->Next;
+		pthread_mutex_unlock (&(Pool->Lock));
+		if (First >= Last) break;
+		for (i=First;i<Last;i++) Batch_Fit_Problem (Worker, i);
+	}
+	Set_Telemetry_Source (Source);
+	Merge_Fit_Telemetry ();
+	return NULL;
+}
+
+void Batch_Fit_Problem (struct Batch_Worker *Worker, int Index)
+{
+//Fits problem Index on the worker's workspace for its line count and writes the results into the pool's arrays
+struct Batch_Pool *Pool;
+struct Fit_Problem *Problem;
+gsl_multifit_nlinear_workspace *Workspace;
+gsl_vector *Final,*f;
+gsl_vector_view x,Weights;
+int i,j,n,info,Status,Niter,DriverStatus;
+long long Start;
+const double xtol = 1e-8;
+const double gtol = 1e-8;
+const double ftol = 1e-1;
+double Guess[3];
+	Pool = Worker->Pool;
+	Problem = &(Pool->Problems[Index]);
+	n = Problem->LineCount;
+	for (i=0;i<3;i++) {
+		Pool->Constants[3*Index+i] = Problem->Guess[i];
+		Guess[i] = Problem->Guess[i];
+	}
+	Pool->ChiSqr[Index] = HUGE_VAL;
+	if (Pool->Iterations != NULL) Pool->Iterations[Index] = 0;
+	if (Pool->Covariance != NULL) for (i=0;i<9;i++) Pool->Covariance[9*Index+i] = NAN;
+	if (Pool->Status != NULL) Pool->Status[Index] = -1;
+	if (n < 3) return;		//Three constants need at least three lines
+	if (Worker->Workspaces[n] == NULL) {
+		Worker->Workspaces[n] = gsl_multifit_nlinear_alloc (gsl_multifit_nlinear_trust, &(Worker->fdf_params), n, 3);
+		if (Worker->Workspaces[n] == NULL) return;
+	}
+	Workspace = Worker->Workspaces[n];
+	for (i=0;i<n;i++) {
+		Worker->OptBundle.TransitionsGSL[i] = Problem->Lines[i];
+		Worker->OptBundle.TransitionsGSL[i].Frequency = Problem->Frequencies[i];
+	}
+	Worker->OptBundle.TransitionCount = n;
+	Worker->fdf.n = n;
+	x = gsl_vector_view_array (Guess, 3);
+	Start = Telemetry_Clock ();
+	if (Problem->Weights != NULL) {
+		Weights = gsl_vector_view_array (Problem->Weights, n);
+		gsl_multifit_nlinear_winit (&x.vector, &Weights.vector, &(Worker->fdf), Workspace);
+	}
+	else gsl_multifit_nlinear_init (&x.vector, &(Worker->fdf), Workspace);
+	DriverStatus = gsl_multifit_nlinear_driver (200, xtol, gtol, ftol, NULL, NULL, &info, Workspace);
+	Record_GSL_Fit (Workspace, DriverStatus, info, 200, Start);
+	Niter = (int) gsl_multifit_nlinear_niter (Workspace);
+	Status = (Niter == 200) ? 0 : 1;
+	Final = gsl_multifit_nlinear_position (Workspace);
+	f = gsl_multifit_nlinear_residual (Workspace);		//Already scaled by sqrt(weight) with winit
+	for (i=0;i<3;i++) Pool->Constants[3*Index+i] = gsl_vector_get (Final, i);
+	gsl_blas_ddot (f, f, &(Pool->ChiSqr[Index]));
+	if (Pool->Iterations != NULL) Pool->Iterations[Index] = Niter;
+	if (Pool->Covariance != NULL) {
+		gsl_multifit_nlinear_covar (gsl_multifit_nlinear_jac (Workspace), 0.0, Worker->Covar);
+		for (i=0;i<3;i++) for (j=0;j<3;j++) Pool->Covariance[9*Index+3*i+j] = gsl_matrix_get (Worker->Covar, i, j);
+	}
+	if (Pool->Status != NULL) Pool->Status[Index] = Status;
+	Worker->Converged += Status;
+}
+
+////////////////////////////////////
+/* Fitting rotational constants plus distortion terms */
+
+/*
+	SBFIT and its workspace, residual and error functions are all written for exactly A, B and C, so DJ could be put into a catalog (Get_Catalog2_DJ) but never fit
+	A Rotor_Model is A/B/C plus any number (up to MODEL_MAX_PARAMETERS-3) of terms that are linear in a per level table, level energy += Parameter*Scale*Table[Level]
+	-DJ is one of these, with the DJCoeffs.txt slopes and DJ_Shift's scale (Add_DJ_Term). Further distortion constants are added the same way once their tables exist
+	-The Jacobian is analytic, dE/dA/B/C from Kappa's derivatives and dE_tau/dKappa (E_tau_Slope), and each term's column is just its table
+	-Everything, workspace included, is allocated by Initialize_Model_Fit, so a fit allocates nothing and the same bundle is reused for every line set of that size
+	Stopping rules and the 200 iteration limit are the same as SBFIT, so with no terms the two land on the same constants
+*/
+
+int E_tau_Closed_Form (int TransitionIndex)
+{
+//1 for the levels E_tau works out in closed form rather than from the table
+//E_tau's cases are the only list of them, so E_tau is asked directly with a table of NANs, only table levels come back as NAN
+static double NoTable[3] = {NAN,NAN,NAN};
+struct ETauStruct Probe;
+	Probe.StatePoints = 0;		//Every level reads the same two entries, at Kappa 0 that's NoTable[1] and NoTable[2]
+	Probe.Delta = 1.0;
+	Probe.ETVals = NoTable;
+	return !isnan (E_tau (TransitionIndex, 0.0, Probe));
+}
+
+double E_tau_Slope (int TransitionIndex, double Kappa, struct ETauStruct ETStruct)
+{
+/*
+	dE_tau/dKappa, with E_tau's remapping of |Kappa| > 1 included
+	Table levels get the slope of the table segment Kappa is in, which is exactly the derivative of E_tau's interpolation
+	Closed form levels get a central difference, they're smooth and the step keeps the error far below anything a fit can see
+*/
+int Index;
+double Remap,Low,High;
+	Remap = 1.0;
+	if ((Kappa > 1.0) || (Kappa < -1.0)) {
+		Remap = 100.0/(1.0+10000.0*Kappa*Kappa)/1.570796326794896619231321691639;		//d/dKappa of E_tau's atan mapping
+		Kappa = atan(100.0*Kappa)/1.570796326794896619231321691639;
+	}
+	if (E_tau_Closed_Form (TransitionIndex)) {
+		Low = fmax (Kappa-MODEL_SLOPE_STEP,-1.0);	//Stepping past +/-1 would hit the remapping
+		High = fmin (Kappa+MODEL_SLOPE_STEP,1.0);
+		return Remap*(E_tau (TransitionIndex,High,ETStruct)-E_tau (TransitionIndex,Low,ETStruct))/(High-Low);
+	}
+	Index = (int) ((Kappa+1.0)/ETStruct.Delta);
+	if (Index > ETStruct.StatePoints-2) Index = ETStruct.StatePoints-2;
+	return Remap*(ETStruct.ETVals[Index+ETStruct.StatePoints*TransitionIndex+1]-ETStruct.ETVals[Index+ETStruct.StatePoints*TransitionIndex])/ETStruct.Delta;
+}
+
+void Initialize_Rotor_Model (struct Rotor_Model *Model, struct ETauStruct ETStruct, struct Level *MyDictionary)
+{
+//A/B/C only, add distortion terms with Add_Model_Term or Add_DJ_Term
+	Model->ETStruct = ETStruct;
+	Model->MyDictionary = MyDictionary;
+	Model->ParameterCount = 3;
+}
+
+int Add_Model_Term (struct Rotor_Model *Model, double *Table, double Scale)
+{
+//Adds a fit parameter P contributing P*Scale*Table[Level] to each level energy, it becomes parameter Model->ParameterCount-1. Table isn't copied
+	if (Model->ParameterCount == MODEL_MAX_PARAMETERS) {
+		printf ("Error: Rotor models take at most %d parameters\n",MODEL_MAX_PARAMETERS);
+		return 0;
+	}
+	if (Table == NULL) {
+		printf ("Error: No table given for model parameter %d\n",Model->ParameterCount);
+		return 0;
+	}
+	Model->Tables[Model->ParameterCount-3] = Table;
+	Model->Scales[Model->ParameterCount-3] = Scale;
+	Model->ParameterCount++;
+	return 1;
+}
+
+int Add_DJ_Term (struct Rotor_Model *Model, double *DJSlopes)
+{
+//DJ as a fit parameter, same shift as DJ_Shift with slopes from Load_DJ_File
+	return Add_Model_Term (Model, DJSlopes, DJ_SCALE);
+}
+
+double Model_Level (struct Rotor_Model *Model, double *Parameters, double Kappa, int Level, double *Gradient)
+{
+//Energy of Level, and if Gradient isn't NULL its derivative with respect to every parameter. Parameters should already have A/B/C made positive
+double JTerm,ETerm,ESlope,Energy,Difference;
+int k;
+	JTerm = Model->MyDictionary[Level].J*(Model->MyDictionary[Level].J+1.0);
+	ETerm = E_tau (Level,Kappa,Model->ETStruct);
+	Energy = 0.5*(Parameters[0]+Parameters[2])*JTerm+0.5*(Parameters[0]-Parameters[2])*ETerm;
+	for (k=3;k<Model->ParameterCount;k++) Energy += Parameters[k]*Model->Scales[k-3]*Model->Tables[k-3][Level];
+	if (Gradient == NULL) return Energy;
+	//Kappa = (2B-A-C)/(A-C), so with (A-C)/2 in front the B derivative is just the slope
+	ESlope = E_tau_Slope (Level,Kappa,Model->ETStruct);
+	Difference = Parameters[0]-Parameters[2];
+	Gradient[0] = 0.5*(JTerm+ETerm)+ESlope*(Parameters[2]-Parameters[1])/Difference;
+	Gradient[1] = ESlope;
+	Gradient[2] = 0.5*(JTerm-ETerm)+ESlope*(Parameters[1]-Parameters[0])/Difference;
+	for (k=3;k<Model->ParameterCount;k++) Gradient[k] = Model->Scales[k-3]*Model->Tables[k-3][Level];
+	return Energy;
+}
+
+int Model_OptFunc_gsl (const gsl_vector *x, void *params, gsl_vector *f)
+{
+//Residuals of the bundle's lines, A/B/C are taken as absolute values like SBFIT_OptFunc_gsl
+struct Model_Fit_Bundle *Bundle;
+double Parameters[MODEL_MAX_PARAMETERS];
+double Kappa;
+int i;
+	Bundle = (struct Model_Fit_Bundle *) params;
+	for (i=0;i<Bundle->Model->ParameterCount;i++) Parameters[i] = (i < 3) ? fabs(gsl_vector_get(x, i)) : gsl_vector_get(x, i);
+	Kappa = Get_Kappa (Parameters[0],Parameters[1],Parameters[2]);
+	for (i=0;i<Bundle->LineCount;i++) {
+		gsl_vector_set (f, i, fabs(Model_Level (Bundle->Model,Parameters,Kappa,Bundle->Lines[i].Upper,NULL)-Model_Level (Bundle->Model,Parameters,Kappa,Bundle->Lines[i].Lower,NULL))-Bundle->Lines[i].Frequency);
+	}
+	return GSL_SUCCESS;
+}
+
+int Model_Jacobian_gsl (const gsl_vector *x, void *params, gsl_matrix *J)
+{
+//Analytic Jacobian of Model_OptFunc_gsl
+struct Model_Fit_Bundle *Bundle;
+double Parameters[MODEL_MAX_PARAMETERS],Sign[MODEL_MAX_PARAMETERS],Upper[MODEL_MAX_PARAMETERS],Lower[MODEL_MAX_PARAMETERS];
+double Kappa,Direction;
+int i,k;
+	Bundle = (struct Model_Fit_Bundle *) params;
+	for (k=0;k<Bundle->Model->ParameterCount;k++) {
+		Parameters[k] = (k < 3) ? fabs(gsl_vector_get(x, k)) : gsl_vector_get(x, k);
+		Sign[k] = ((k < 3) && (gsl_vector_get(x, k) < 0.0)) ? -1.0 : 1.0;
+	}
+	Kappa = Get_Kappa (Parameters[0],Parameters[1],Parameters[2]);
+	for (i=0;i<Bundle->LineCount;i++) {
+		Direction = Model_Level (Bundle->Model,Parameters,Kappa,Bundle->Lines[i].Upper,Upper)-Model_Level (Bundle->Model,Parameters,Kappa,Bundle->Lines[i].Lower,Lower);
+		Direction = (Direction < 0.0) ? -1.0 : 1.0;		//The frequency is the absolute difference
+		for (k=0;k<Bundle->Model->ParameterCount;k++) gsl_matrix_set (J, i, k, Direction*Sign[k]*(Upper[k]-Lower[k]));
+	}
+	return GSL_SUCCESS;
+}
+
+int Initialize_Model_Fit (struct Model_Fit_Bundle *Bundle, struct Rotor_Model *Model, int LineCount)
+{
+/*
+	Sets up a bundle for fitting LineCount lines with Model, the model's terms must all be added first
+	Model isn't copied, so it has to outlive the bundle
+*/
+	Bundle->Model = Model;
+	Bundle->LineCount = LineCount;
+	Bundle->Workspace = NULL;
+	Bundle->Covariance = NULL;
+	Bundle->Lines = NULL;
+	if (LineCount < Model->ParameterCount) {
+		printf ("Error: %d lines can't fix %d parameters\n",LineCount,Model->ParameterCount);
+		return 0;
+	}
+	Bundle->fdf_params = gsl_multifit_nlinear_default_parameters();
+	Bundle->fdf_params.trs = gsl_multifit_nlinear_trs_lm;
+	Bundle->fdf.f = Model_OptFunc_gsl;
+	Bundle->fdf.df = Model_Jacobian_gsl;
+	Bundle->fdf.fvv = NULL;
+	Bundle->fdf.n = LineCount;
+	Bundle->fdf.p = Model->ParameterCount;
+	Bundle->fdf.params = Bundle;
+	Bundle->Workspace = gsl_multifit_nlinear_alloc (gsl_multifit_nlinear_trust, &(Bundle->fdf_params), LineCount, Model->ParameterCount);
+	Bundle->Covariance = gsl_matrix_alloc (Model->ParameterCount, Model->ParameterCount);
+	Bundle->Lines = malloc (LineCount*sizeof(struct Transition));
+	if ((Bundle->Workspace == NULL) || (Bundle->Covariance == NULL) || (Bundle->Lines == NULL)) {
+		printf ("Error allocating a %d line, %d parameter fit\n",LineCount,Model->ParameterCount);
+		Free_Model_Fit (Bundle);
+		return 0;
+	}
+	return 1;
+}
+
+void Free_Model_Fit (struct Model_Fit_Bundle *Bundle)
+{
+	if (Bundle->Workspace != NULL) gsl_multifit_nlinear_free (Bundle->Workspace);
+	if (Bundle->Covariance != NULL) gsl_matrix_free (Bundle->Covariance);
+	free (Bundle->Lines);
+	Bundle->Workspace = NULL;
+	Bundle->Covariance = NULL;
+	Bundle->Lines = NULL;
+}
+
+int Model_Fit (struct Model_Fit_Bundle *Bundle, double *Guess, struct Transition *Lines, double *LineFrequencies, double *FinalParameters, double *ChiSq)
+{
+/*
+	Fits the bundle's LineCount lines, SBFIT for any Rotor_Model
+
+Arguments
+Bundle - Set up by Initialize_Model_Fit
+Guess - Starting value of every parameter, Model->ParameterCount of them (A, B, C, then the terms in the order they were added)
+Lines - Assigned transitions, only Upper/Lower are used
+LineFrequencies - Experimental frequency of each line
+FinalParameters - Fitted parameters, Model->ParameterCount of them
+ChiSq - Sum of squared residuals
+
+Returns 1 if the fit converged, 0 if it hit the iteration limit
+*/
+int i,info,Status;
+long long Start;
+const double xtol = 1e-8;
+const double gtol = 1e-8;
+const double ftol = 1e-1;
+gsl_vector *Final,*f;
+gsl_vector_view x;
+	for (i=0;i<Bundle->LineCount;i++) {
+		Bundle->Lines[i].Upper = Lines[i].Upper;
+		Bundle->Lines[i].Lower = Lines[i].Lower;
+		Bundle->Lines[i].Frequency = LineFrequencies[i];
+	}
+	x = gsl_vector_view_array (Guess, Bundle->Model->ParameterCount);
+	Start = Telemetry_Clock ();
+	gsl_multifit_nlinear_init (&x.vector, &(Bundle->fdf), Bundle->Workspace);
+	Status = gsl_multifit_nlinear_driver (200, xtol, gtol, ftol, NULL, NULL, &info, Bundle->Workspace);
+	Record_GSL_Fit (Bundle->Workspace, Status, info, 200, Start);
+	Final = gsl_multifit_nlinear_position (Bundle->Workspace);
+	f = gsl_multifit_nlinear_residual (Bundle->Workspace);
+	gsl_blas_ddot (f, f, ChiSq);
+	for (i=0;i<Bundle->Model->ParameterCount;i++) FinalParameters[i] = gsl_vector_get (Final, i);
+	return (gsl_multifit_nlinear_niter (Bundle->Workspace) == 200) ? 0 : 1;
+}
+
+int Get_Model_Fit_Error (struct Model_Fit_Bundle *Bundle, double *Errors)
+{
+//Get_SBFIT_Error for the last Model_Fit, the square roots of the diagonal of (J^T J)^-1, one per parameter
+int i;
+	gsl_multifit_nlinear_covar (gsl_multifit_nlinear_jac (Bundle->Workspace), 0.0, Bundle->Covariance);
+	for (i=0;i<Bundle->Model->ParameterCount;i++) Errors[i] = sqrt(gsl_matrix_get (Bundle->Covariance,i,i));
+	return 1;
+}
+
+////////////////////////////////////
+/* Fitter telemetry */
+
+/*
+	Counts of how the fits actually went, to tune xtol/gtol/ftol and the iteration caps against
+	-Every fitter (SBFIT, SBFIT_Small, SBFIT_Profile, Model_Fit, the triples fitters and SBFIT_Batch's workers) records its iterations, stop reason, residual/Jacobian evaluations and time through Record_Fit_Telemetry
+	-Records go to the calling thread's own counters, so the hot path is a handful of plain increments. Merge_Fit_Telemetry adds them into the shared totals with atomic adds and is called once per thread when a search finishes
+	-Fits are split by the search they came from (TELEMETRY_TRIPLES etc.), set with Set_Telemetry_Source, anything else counts as TELEMETRY_DIRECT
+	-Get_Fit_Telemetry reads the totals from C, pyfitter.get_fit_telemetry from python
+	Every field of Fit_Telemetry is a long long, merging and resetting walk the struct as an array of them
+*/
+
+struct Fit_Telemetry Fit_Telemetry_Totals[TELEMETRY_SOURCES];		//Shared, only touched with atomics
+_Thread_local struct Fit_Telemetry Thread_Fit_Telemetry[TELEMETRY_SOURCES];
+_Thread_local int Thread_Telemetry_Source = TELEMETRY_DIRECT;
+int Fit_Telemetry_Enabled = 1;
+
+void Enable_Fit_Telemetry (int Enabled)
+{
+//Telemetry is on by default, it costs two clock reads per fit
+	Fit_Telemetry_Enabled = Enabled;
+}
+
+int Set_Telemetry_Source (int Source)
+{
+//Fits on this thread count towards Source from now on, returns the previous source so the caller can put it back
+int Previous;
+	Previous = Thread_Telemetry_Source;
+	if ((Source >= 0) && (Source < TELEMETRY_SOURCES)) Thread_Telemetry_Source = Source;
+	return Previous;
+}
+
+long long Telemetry_Clock (void)
+{
+//Monotonic nanoseconds for timing a fit, 0 when telemetry is off so the clock isn't read for nothing
+struct timespec Now;
+	if (!Fit_Telemetry_Enabled) return 0;
+	clock_gettime (CLOCK_MONOTONIC, &Now);
+	return (long long) Now.tv_sec*1000000000LL+Now.tv_nsec;
+}
+
+void Record_Fit_Telemetry (int Iterations, int Reason, long long FunctionEvaluations, long long JacobianEvaluations, long long Start)
+{
+/*
+	Adds one fit to this thread's counters for the current source
+
+Arguments
+Iterations - Iterations the fit took
+Reason - TELEMETRY_STOP_*, why it stopped
+FunctionEvaluations/JacobianEvaluations - Residual and Jacobian evaluations, as the fdf counted them
+Start - Telemetry_Clock () from before the fit
+*/
+struct Fit_Telemetry *Telemetry;
+long long Elapsed;
+int Bin;
+	if (!Fit_Telemetry_Enabled) return;
+	Elapsed = Telemetry_Clock ()-Start;
+	Telemetry = &(Thread_Fit_Telemetry[Thread_Telemetry_Source]);
+	Telemetry->Fits++;
+	Telemetry->Iterations += Iterations;
+	Telemetry->FunctionEvaluations += FunctionEvaluations;
+	Telemetry->JacobianEvaluations += JacobianEvaluations;
+	Telemetry->Nanoseconds += Elapsed;
+	if (Reason == TELEMETRY_STOP_CAP) Telemetry->Capped++;
+	if ((Reason < 0) || (Reason >= TELEMETRY_STOP_REASONS)) Reason = TELEMETRY_STOP_ERROR;
+	Telemetry->StopReasons[Reason]++;
+	Telemetry->IterationHistogram[(Iterations < TELEMETRY_ITERATION_BINS) ? Iterations : TELEMETRY_ITERATION_BINS-1]++;
+	Telemetry->EvaluationHistogram[(FunctionEvaluations < TELEMETRY_EVALUATION_BINS) ? FunctionEvaluations : TELEMETRY_EVALUATION_BINS-1]++;
+	Bin = 0;
+	while ((Bin < TELEMETRY_TIME_BINS-1) && ((Elapsed >> (Bin+1)) > 0)) Bin++;
+	Telemetry->TimeHistogram[Bin]++;
+}
+
+void Record_Fit_Cache_Hit (void)
+{
+//Counts a fit the cache answered, these don't go through Record_Fit_Telemetry so they don't skew the fit statistics
+	if (Fit_Telemetry_Enabled) Thread_Fit_Telemetry[Thread_Telemetry_Source].CacheHits++;
+}
+
+void Record_GSL_Fit (gsl_multifit_nlinear_workspace *Workspace, int Status, int Info, int MaxIterations, long long Start)
+{
+//Record_Fit_Telemetry for a gsl_multifit_nlinear_driver run, Status is what the driver returned and Info its info
+int Iterations,Reason;
+	if (!Fit_Telemetry_Enabled) return;
+	Iterations = (int) gsl_multifit_nlinear_niter (Workspace);
+	if (Iterations >= MaxIterations) Reason = TELEMETRY_STOP_CAP;
+	else if ((Status == GSL_SUCCESS) && ((Info == 1) || (Info == 2))) Reason = Info;		//GSL's 1 and 2 are the xtol and gtol tests, same as TELEMETRY_STOP_XTOL/GTOL
+	else Reason = TELEMETRY_STOP_ERROR;
+	Record_Fit_Telemetry (Iterations, Reason, (long long) Workspace->fdf->nevalf, (long long) Workspace->fdf->nevaldf, Start);
+}
+
+void Merge_Fit_Telemetry (void)
+{
+//Adds this thread's counters to the shared totals and clears them, called when a search or worker thread finishes
+long long *Local,*Shared;
+int Source,i;
+	for (Source=0;Source<TELEMETRY_SOURCES;Source++) {
+		if ((Thread_Fit_Telemetry[Source].Fits == 0) && (Thread_Fit_Telemetry[Source].CacheHits == 0)) continue;
+		Local = (long long *) &(Thread_Fit_Telemetry[Source]);
+		Shared = (long long *) &(Fit_Telemetry_Totals[Source]);
+		for (i=0;i<TELEMETRY_COUNTERS;i++) if (Local[i] != 0) __atomic_fetch_add (&(Shared[i]), Local[i], __ATOMIC_RELAXED);
+		memset (&(Thread_Fit_Telemetry[Source]), 0, sizeof(struct Fit_Telemetry));
+	}
+}
+
+void Reset_Fit_Telemetry (void)
+{
+//Clears the totals and this thread's counters, other threads' unmerged counts are kept so only call this between searches
+long long *Shared;
+int Source,i;
+	for (Source=0;Source<TELEMETRY_SOURCES;Source++) {
+		Shared = (long long *) &(Fit_Telemetry_Totals[Source]);
+		for (i=0;i<TELEMETRY_COUNTERS;i++) __atomic_store_n (&(Shared[i]), 0, __ATOMIC_RELAXED);
+	}
+	memset (Thread_Fit_Telemetry, 0, sizeof(Thread_Fit_Telemetry));
+}
+
+int Get_Fit_Telemetry (int Source, struct Fit_Telemetry *Telemetry)
+{
+//Copies the totals for Source, or all of them added together if Source is -1, into Telemetry. This thread's counters are merged first
+long long *Shared,*Copy;
+int i,j;
+	if ((Source < -1) || (Source >= TELEMETRY_SOURCES)) {
+		printf ("Error: %d isn't a telemetry source\n",Source);
+		return 0;
+	}
+	Merge_Fit_Telemetry ();
+	memset (Telemetry, 0, sizeof(struct Fit_Telemetry));
+	Copy = (long long *) Telemetry;
+	for (i=0;i<TELEMETRY_SOURCES;i++) {
+		if ((Source != -1) && (Source != i)) continue;
+		Shared = (long long *) &(Fit_Telemetry_Totals[i]);
+		for (j=0;j<TELEMETRY_COUNTERS;j++) Copy[j] += __atomic_load_n (&(Shared[j]), __ATOMIC_RELAXED);
+	}
+	return 1;
+}
+
+int Telemetry_Percentile (long long *Histogram, int Bins, long long Count, double Fraction)
+{
+//Bin holding the Fraction quantile of Count entries
+long long Sum;
+int i;
+	Sum = 0;
+	for (i=0;i<Bins;i++) {
+		Sum += Histogram[i];
+		if (Sum >= Fraction*Count) return i;
+	}
+	return Bins-1;
+}
+
+void Print_Fit_Telemetry (int Source)
+{
+//Summary of the totals for Source (-1 for everything), quantiles are histogram bins so times are powers of two
+struct Fit_Telemetry Telemetry;
+double Fits;
+	if (!Get_Fit_Telemetry (Source, &Telemetry)) return;
+	if (Telemetry.CacheHits > 0) printf ("%lld fits answered by the fit cache\n",Telemetry.CacheHits);
+	if (Telemetry.Fits == 0) {
+		printf ("No fits recorded\n");
+		return;
+	}
+	Fits = (double) Telemetry.Fits;
+	printf ("%lld fits, %.2f%% hit the iteration cap, %.2f%% xtol, %.2f%% gtol, %.2f%% direct, %.2f%% errors\n",Telemetry.Fits,100.0*Telemetry.Capped/Fits,100.0*Telemetry.StopReasons[TELEMETRY_STOP_XTOL]/Fits,100.0*Telemetry.StopReasons[TELEMETRY_STOP_GTOL]/Fits,100.0*Telemetry.StopReasons[TELEMETRY_STOP_DIRECT]/Fits,100.0*Telemetry.StopReasons[TELEMETRY_STOP_ERROR]/Fits);
+	printf ("Iterations: %.2f average, median %d, 90%% %d, 99%% %d\n",Telemetry.Iterations/Fits,Telemetry_Percentile (Telemetry.IterationHistogram,TELEMETRY_ITERATION_BINS,Telemetry.Fits,0.5),Telemetry_Percentile (Telemetry.IterationHistogram,TELEMETRY_ITERATION_BINS,Telemetry.Fits,0.9),Telemetry_Percentile (Telemetry.IterationHistogram,TELEMETRY_ITERATION_BINS,Telemetry.Fits,0.99));
+	printf ("Evaluations: %.2f residual and %.2f Jacobian per fit, 99%% under %d residual\n",Telemetry.FunctionEvaluations/Fits,Telemetry.JacobianEvaluations/Fits,Telemetry_Percentile (Telemetry.EvaluationHistogram,TELEMETRY_EVALUATION_BINS,Telemetry.Fits,0.99)+1);
+	printf ("Time: %.2f us per fit, median under %.2f us, 99%% under %.2f us\n",1.0E-3*Telemetry.Nanoseconds/Fits,1.0E-3*ldexp(1.0,Telemetry_Percentile (Telemetry.TimeHistogram,TELEMETRY_TIME_BINS,Telemetry.Fits,0.5)+1),1.0E-3*ldexp(1.0,Telemetry_Percentile (Telemetry.TimeHistogram,TELEMETRY_TIME_BINS,Telemetry.Fits,0.99)+1));
+}
 
 ////////////////////////////////////
 /* Newly added faster Get_Catalog2 and it's related functions */
@@ -4,10 +4,10 @@ Built by Brandon Carroll 4/7/19 All Rights Reserved
 C Parser Extension to the Code
 
 Build Command:
-gcc -Wall -o Parse Parser\ Extension.c -lm -lgsl -lgslcblas -O3 -funroll-loops
+gcc -Wall -o Parse Parser\ Extension.c -lm -lgsl -lgslcblas -pthread -O3 -funroll-loops
 
 Ctypes Shared Lib:
-gcc -Wall -o Parser.so -shared -fPIC -O3 -funroll-loops Parser\ Extension.c -lm -lgsl -lgslcblas
+gcc -Wall -o Parser.so -shared -fPIC -O3 -funroll-loops Parser\ Extension.c -lm -lgsl -lgslcblas -pthread
 */
 
 #include <math.h>
@@ -3,7 +3,7 @@ import os
 import numpy as np
 import pandas as pd
 from pathlib import Path
-from ctypes import c_uint, c_int, c_double, create_string_buffer, CDLL, POINTER, byref, Structure
+from ctypes import c_uint, c_int, c_double, c_longlong, create_string_buffer, CDLL, POINTER, byref, Structure
 
 
 ###Structure definition for python
@@ -47,6 +47,28 @@ class Opt_Bundle(Structure):
         ("TransitionsGSL", POINTER(Transition))
         ]
 
+#Telemetry sizes and indices, these have to match the TELEMETRY_ defines in Fitter.h
+TELEMETRY_SOURCES = {"direct": 0, "triples": 1, "four_line": 2, "batch": 3, "dr_hits": 4}
+TELEMETRY_STOP_REASONS = ["cap", "xtol", "gtol", "error", "direct"]
+TELEMETRY_ITERATION_BINS = 256
+TELEMETRY_EVALUATION_BINS = 256
+TELEMETRY_TIME_BINS = 40
+
+class Fit_Telemetry(Structure):
+    _fields_ = [
+        ("Fits", c_longlong),
+        ("CacheHits", c_longlong),
+        ("Capped", c_longlong),
+        ("Iterations", c_longlong),
+        ("FunctionEvaluations", c_longlong),
+        ("JacobianEvaluations", c_longlong),
+        ("Nanoseconds", c_longlong),
+        ("StopReasons", c_longlong * len(TELEMETRY_STOP_REASONS)),
+        ("IterationHistogram", c_longlong * TELEMETRY_ITERATION_BINS),
+        ("EvaluationHistogram", c_longlong * TELEMETRY_EVALUATION_BINS),
+        ("TimeHistogram", c_longlong * TELEMETRY_TIME_BINS)
+        ]
+
 
 class AsymmetricMolecule:
     """
@@ -293,3 +315,50 @@ class AsymmetricMolecule:
                 )
         else:
             return np.array(table)
+
+
+def get_fit_telemetry(FitterLib, source=None):
+    """
+    Reads the fitter telemetry (iteration, evaluation and time histograms,
+    stop reasons) out of a loaded Fitter library.
+
+    Parameters
+    ----------
+    FitterLib : CDLL
+        The loaded library, e.g. AsymmetricMolecule.FitterLib
+    source : str or None, optional
+        One of the keys of TELEMETRY_SOURCES, None (default) for every fit.
+
+    Returns
+    -------
+    telemetry : dict
+        Counts from Fit_Telemetry, histograms as NumPy arrays. Bin i of
+        "time_histogram" counts fits taking 2^i to 2^(i+1) ns.
+    """
+    index = -1 if source is None else TELEMETRY_SOURCES[source]
+    telemetry = Fit_Telemetry()
+    if not FitterLib.Get_Fit_Telemetry(c_int(index), byref(telemetry)):
+        raise Exception("Unable to read fitter telemetry")
+    fits = max(telemetry.Fits, 1)
+    return {
+        "fits": telemetry.Fits,
+        "cache_hits": telemetry.CacheHits,
+        "capped": telemetry.Capped,
+        "capped_fraction": telemetry.Capped / fits,
+        "mean_iterations": telemetry.Iterations / fits,
+        "mean_function_evaluations": telemetry.FunctionEvaluations / fits,
+        "mean_jacobian_evaluations": telemetry.JacobianEvaluations / fits,
+        "mean_seconds": 1e-9 * telemetry.Nanoseconds / fits,
+        "stop_reasons": dict(zip(TELEMETRY_STOP_REASONS, telemetry.StopReasons)),
+        "iteration_histogram": np.array(telemetry.IterationHistogram),
+        "evaluation_histogram": np.array(telemetry.EvaluationHistogram),
+        "time_histogram": np.array(telemetry.TimeHistogram)
+        }
+
+
+def reset_fit_telemetry(FitterLib):
+    """
+    Clears the fitter telemetry, call it between searches rather than
+    while one is running.
+    """
+    FitterLib.Reset_Fit_Telemetry()
@@ -15,7 +15,7 @@ class InstallClass(install):
         else:
             # Copied the compiler flags from Fitter.c
             print("Building static libraries.")
-            lib_cmd = "gcc -Wall -o pyfitter/Fitter.so -shared -fPIC -O3 -funroll-loops pyfitter/Fitter.c -lm -lgsl -lgslcblas"
+            lib_cmd = "gcc -Wall -o pyfitter/Fitter.so -shared -fPIC -O3 -funroll-loops pyfitter/Fitter.c -lm -lgsl -lgslcblas -pthread"
             process = run(lib_cmd.split(), stdout=PIPE, stderr=PIPE)
             if process.returncode != 0:
                 warn(f"gcc compilation returned error code {process.returncode}")